@@ -0,0 +1,195 @@
+#include "GeometryImageBaker.h"
+#include "../MeshShaderRasterization/ParallelFor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	const float pi = 3.14159265359f;
+
+	inline auto Quantize(float value, float scale) -> uint32_t
+	{
+		return uint32_t(std::clamp(value, 0.0f, 1.0f) * scale + 0.5f);
+	}
+
+	inline auto Normalize(float v[3]) -> void
+	{
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		float scale = length > 0 ? 1 / length : 0;
+		for (uint32_t k = 0; k < 3; ++k)
+			v[k] *= scale;
+	}
+}
+
+auto GetParameterizationDirection(Parameterization parameterization, float u, float v, float direction[3]) -> void
+{
+	if (parameterization == Parameterization::Spherical)
+	{
+		// the last column is the first one again and the poles do not depend on the longitude, exactly
+		if (v <= 0 || v >= 1)
+		{
+			direction[0] = 0;
+			direction[1] = v <= 0 ? -1.0f : 1.0f;
+			direction[2] = 0;
+			return;
+		}
+		float longitude = (u < 1 ? u : 0) * 2 * pi;
+		float latitude = (v - 0.5f) * pi;
+		direction[0] = std::cos(latitude) * std::cos(longitude);
+		direction[1] = std::sin(latitude);
+		direction[2] = std::cos(latitude) * std::sin(longitude);
+		return;
+	}
+
+	// octahedral: the square is the upper pyramid, its corners are the lower one folded over
+	// u and 1 - u (v and 1 - v) give opposite x (y) exactly, and the fold only keeps their magnitude, so the two halves of an edge
+	// get the same directions bit for bit (without negative zeros)
+	float x = u * 2 - 1;
+	float y = v * 2 - 1;
+	float z = 1 - std::fabs(x) - std::fabs(y);
+	if (z < 0)
+	{
+		float foldedX = x >= 0 ? 1 - std::fabs(y) : std::fabs(y) - 1;
+		float foldedY = y >= 0 ? 1 - std::fabs(x) : std::fabs(x) - 1;
+		x = foldedX;
+		y = foldedY;
+	}
+	direction[0] = x;
+	direction[1] = z;
+	direction[2] = y;
+	Normalize(direction);
+}
+
+auto GetParameterizationFoldPartner(Parameterization parameterization, uint32_t mipSize, uint32_t x, uint32_t y, uint32_t& partnerX, uint32_t& partnerY) -> void
+{
+	partnerX = x;
+	partnerY = y;
+	if (parameterization == Parameterization::Spherical)
+	{
+		// every vertex of a pole row is the first one, the last column is the first one
+		if (y == 0 || y == mipSize)
+			partnerX = 0;
+		else if (x == 0 || x == mipSize)
+			partnerX = mipSize - x;
+		return;
+	}
+
+	// octahedral: halves of the first and last rows, then of the first and last columns (the corners are all the same pole)
+	if (y == 0 || y == mipSize)
+		partnerX = mipSize - x;
+	else if (x == 0 || x == mipSize)
+		partnerY = mipSize - y;
+}
+
+auto ComputeSurfaceCentroid(TriangleMesh const& mesh, float centroid[3]) -> void
+{
+	double sum[3] = { 0, 0, 0 };
+	double totalArea = 0;
+
+	for (uint32_t t = 0; t < mesh.GetTriangleCount(); ++t)
+	{
+		float const* p0 = &mesh.m_positions[3 * mesh.m_indices[3 * t + 0]];
+		float const* p1 = &mesh.m_positions[3 * mesh.m_indices[3 * t + 1]];
+		float const* p2 = &mesh.m_positions[3 * mesh.m_indices[3 * t + 2]];
+
+		double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) / 2;
+
+		for (uint32_t k = 0; k < 3; ++k)
+			sum[k] += area * (double(p0[k]) + p1[k] + p2[k]) / 3;
+		totalArea += area;
+	}
+
+	for (uint32_t k = 0; k < 3; ++k)
+		centroid[k] = totalArea > 0 ? float(sum[k] / totalArea) : 0.0f;
+}
+
+auto ComputeMeshBounds(TriangleMesh const& mesh, float boundsMin[3], float boundsMax[3]) -> void
+{
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		boundsMin[k] = FLT_MAX;
+		boundsMax[k] = -FLT_MAX;
+	}
+
+	for (uint32_t v = 0; v < mesh.GetVertexCount(); ++v)
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			boundsMin[k] = std::min(boundsMin[k], mesh.m_positions[3 * v + k]);
+			boundsMax[k] = std::max(boundsMax[k], mesh.m_positions[3 * v + k]);
+		}
+	}
+}
+
+auto BakeGeometryImageRows(TriangleMesh const& mesh, MeshRayCaster const& rayCaster, GeometryImageBakeSettings const& settings, uint32_t firstRow, uint32_t rowCount, float* position, uint32_t* albedo, float* normal) -> uint32_t
+{
+	const uint32_t size = settings.m_size;
+
+	std::atomic<uint32_t> missCount = 0;
+
+	ParallelFor(rowCount, [&](uint32_t index)
+	{
+		uint32_t i = firstRow + index;
+		float v = i / float(size);
+		uint32_t rowMisses = 0;
+
+		for (uint32_t j = 0; j <= size; ++j)
+		{
+			float u = j / float(size);
+			float direction[3];
+			GetParameterizationDirection(settings.m_parameterization, u, v, direction);
+
+			float p[3] = { settings.m_center[0], settings.m_center[1], settings.m_center[2] };
+			float n[3] = { direction[0], direction[1], direction[2] };
+			float c[4] = { 1, 1, 1, 1 };
+
+			RayHit hit;
+			if (rayCaster.CastFarthest(settings.m_center, direction, hit))
+			{
+				uint32_t const* triangle = &mesh.m_indices[3 * hit.m_triangle];
+				float weights[3] = { 1 - hit.m_barycentrics[0] - hit.m_barycentrics[1], hit.m_barycentrics[0], hit.m_barycentrics[1] };
+
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					p[k] = settings.m_center[k] + direction[k] * hit.m_distance;
+					n[k] = 0;
+					for (uint32_t corner = 0; corner < 3; ++corner)
+						n[k] += weights[corner] * mesh.m_normals[3 * triangle[corner] + k];
+				}
+				Normalize(n);
+
+				for (uint32_t k = 0; k < 4; ++k)
+				{
+					c[k] = 0;
+					for (uint32_t corner = 0; corner < 3; ++corner)
+						c[k] += weights[corner] * ((mesh.m_colors[triangle[corner]] >> (8 * k)) & 0xff) / 255.0f;
+				}
+			}
+			else
+				++rowMisses;
+
+			size_t texel = size_t(index) * (size + 1) + j;
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				position[3 * texel + k] = p[k];
+				normal[3 * texel + k] = n[k];
+			}
+
+			albedo[texel] = (Quantize(c[0], 255.0f) << 0)
+			              | (Quantize(c[1], 255.0f) << 8)
+			              | (Quantize(c[2], 255.0f) << 16)
+			              | (Quantize(c[3], 255.0f) << 24)
+			              ;
+		}
+
+		missCount += rowMisses;
+	}, settings.m_threadCount);
+
+	return missCount;
+}
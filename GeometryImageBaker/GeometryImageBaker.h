@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MeshRayCaster.h"
+#include "TriangleMesh.h"
+
+#include <cstdint>
+
+// maps geometry image vertices to directions around the mesh center
+// vertex (i, j) of a size x size image ((size + 1) x (size + 1) vertices) is at u = j / size, v = i / size: the edges of the image
+// lie exactly on the edges of the parameterization, and the vertices of an edge that map to the same direction get it bit for bit,
+// so they get the same position; with a power of two size every mip keeps both vertices of each such pair
+enum class Parameterization
+{
+	Octahedral, // even sampling over the sphere, each half edge of the image folds onto the other half: (x, 0) onto (size - x, 0), (0, y) onto (0, size - y)
+	Spherical,  // longitude along rows, latitude along columns, same layout as the procedural sphere: (0, y) is (size, y), the first and last rows are poles
+};
+
+auto GetParameterizationDirection(Parameterization parameterization, float u, float v, float direction[3]) -> void;
+
+// the vertex that border vertex (x, y) of a mip of size s maps to the same direction as (itself when it has no other), so both must
+// hold the same position at every mip
+auto GetParameterizationFoldPartner(Parameterization parameterization, uint32_t mipSize, uint32_t x, uint32_t y, uint32_t& partnerX, uint32_t& partnerY) -> void;
+
+// area weighted centroid of the surface, rays are cast from there
+auto ComputeSurfaceCentroid(TriangleMesh const& mesh, float centroid[3]) -> void;
+
+// bounds of the vertices, which contain every resampled position (and are the bounds of absolute position encodings)
+auto ComputeMeshBounds(TriangleMesh const& mesh, float boundsMin[3], float boundsMax[3]) -> void;
+
+struct GeometryImageBakeSettings
+{
+	uint32_t m_size;
+	Parameterization m_parameterization;
+	float m_center[3];
+	uint32_t m_threadCount; // 0 to use every core
+};
+
+// resamples rows [firstRow, firstRow + rowCount) of the geometry images (rows are size + 1 vertices wide, there are size + 1 of them),
+// rows are spread over threads
+// rows are at full precision, as produced by GenerateSphereGeometryImage: position is xyz floats, albedo is RGBA8, normal is unit xyz floats
+// vertices whose ray misses the mesh collapse to the center, their count is returned
+auto BakeGeometryImageRows(TriangleMesh const& mesh, MeshRayCaster const& rayCaster, GeometryImageBakeSettings const& settings, uint32_t firstRow, uint32_t rowCount, float* position, uint32_t* albedo, float* normal) -> uint32_t;
@@ -0,0 +1,213 @@
+#include "MeshRayCaster.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	const uint32_t maxLeafTriangles = 4;
+
+	// rays going exactly through a shared edge must not slip between both triangles
+	const float barycentricTolerance = 1e-5f;
+
+	// Moller-Trumbore, two sided
+	inline auto IntersectTriangle(float const origin[3], float const direction[3], float const* p0, float const* e1, float const* e2, float& distance, float& u, float& v) -> bool
+	{
+		float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0] };
+		float determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		if (std::fabs(determinant) < 1e-20f)
+			return false;
+
+		float inverseDeterminant = 1 / determinant;
+		float s[3] = { origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2] };
+		u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDeterminant;
+		if (u < -barycentricTolerance || u > 1 + barycentricTolerance)
+			return false;
+
+		float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverseDeterminant;
+		if (v < -barycentricTolerance || u + v > 1 + barycentricTolerance)
+			return false;
+
+		distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverseDeterminant;
+		return distance >= 0;
+	}
+
+	// returns the distance at which the ray leaves the box, or a negative value if it misses it
+	inline auto IntersectBox(float const origin[3], float const inverseDirection[3], float const min[3], float const max[3]) -> float
+	{
+		float entry = 0;
+		float exit = FLT_MAX;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			float t0 = (min[k] - origin[k]) * inverseDirection[k];
+			float t1 = (max[k] - origin[k]) * inverseDirection[k];
+			entry = std::max(entry, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		return entry <= exit ? exit : -1;
+	}
+}
+
+MeshRayCaster::MeshRayCaster(TriangleMesh const& mesh)
+	: m_mesh(mesh)
+{
+	uint32_t triangleCount = mesh.GetTriangleCount();
+
+	std::vector<float> centroids(size_t(triangleCount) * 3);
+	m_triangleIndices.resize(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		m_triangleIndices[t] = t;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			centroids[3 * t + k] = (mesh.m_positions[3 * mesh.m_indices[3 * t + 0] + k]
+			                      + mesh.m_positions[3 * mesh.m_indices[3 * t + 1] + k]
+			                      + mesh.m_positions[3 * mesh.m_indices[3 * t + 2] + k]) / 3;
+		}
+	}
+
+	m_nodes.reserve(2 * size_t(triangleCount / maxLeafTriangles + 1));
+	m_nodes.emplace_back();
+	Build(0, 0, triangleCount, centroids);
+
+	m_triangles.resize(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; ++i)
+	{
+		uint32_t const* indices = &mesh.m_indices[3 * m_triangleIndices[i]];
+		float const* p0 = &mesh.m_positions[3 * indices[0]];
+		float const* p1 = &mesh.m_positions[3 * indices[1]];
+		float const* p2 = &mesh.m_positions[3 * indices[2]];
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			m_triangles[i].m_p0[k] = p0[k];
+			m_triangles[i].m_e1[k] = p1[k] - p0[k];
+			m_triangles[i].m_e2[k] = p2[k] - p0[k];
+		}
+	}
+}
+
+// median split along the largest axis of the centroid bounds
+auto MeshRayCaster::Build(uint32_t nodeIndex, uint32_t first, uint32_t count, std::vector<float> const& centroids) -> void
+{
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float centroidMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		uint32_t t = m_triangleIndices[i];
+		for (uint32_t v = 0; v < 3; ++v)
+		{
+			float const* p = &m_mesh.m_positions[3 * m_mesh.m_indices[3 * t + v]];
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				min[k] = std::min(min[k], p[k]);
+				max[k] = std::max(max[k], p[k]);
+			}
+		}
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			centroidMin[k] = std::min(centroidMin[k], centroids[3 * t + k]);
+			centroidMax[k] = std::max(centroidMax[k], centroids[3 * t + k]);
+		}
+	}
+
+	Node& node = m_nodes[nodeIndex];
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		node.m_min[k] = min[k];
+		node.m_max[k] = max[k];
+	}
+
+	if (count <= maxLeafTriangles)
+	{
+		node.m_firstOrChild = first;
+		node.m_triangleCount = count;
+		return;
+	}
+
+	uint32_t axis = 0;
+	for (uint32_t k = 1; k < 3; ++k)
+	{
+		if (centroidMax[k] - centroidMin[k] > centroidMax[axis] - centroidMin[axis])
+			axis = k;
+	}
+
+	uint32_t half = count / 2;
+	std::nth_element(m_triangleIndices.begin() + first, m_triangleIndices.begin() + first + half, m_triangleIndices.begin() + first + count,
+		[&](uint32_t a, uint32_t b) { return centroids[3 * a + axis] < centroids[3 * b + axis]; });
+
+	uint32_t child = uint32_t(m_nodes.size());
+	node.m_firstOrChild = child;
+	node.m_triangleCount = 0;
+	m_nodes.emplace_back();
+	m_nodes.emplace_back();
+
+	// m_nodes may have been reallocated, do not use node past this point
+	Build(child, first, half, centroids);
+	Build(child + 1, first + half, count - half, centroids);
+}
+
+auto MeshRayCaster::CastFarthest(float const origin[3], float const direction[3], RayHit& hit) const -> bool
+{
+	float inverseDirection[3];
+	for (uint32_t k = 0; k < 3; ++k)
+		inverseDirection[k] = direction[k] != 0 ? 1 / direction[k] : FLT_MAX;
+
+	hit.m_distance = -1;
+
+	Node const& root = m_nodes[0];
+	if (IntersectBox(origin, inverseDirection, root.m_min, root.m_max) < 0)
+		return false;
+
+	uint32_t stack[64];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		Node const& node = m_nodes[stack[--stackSize]];
+
+		if (node.m_triangleCount == 0)
+		{
+			// the whole box is nearer than what was already found
+			Node const& child0 = m_nodes[node.m_firstOrChild];
+			Node const& child1 = m_nodes[node.m_firstOrChild + 1];
+			float exit0 = IntersectBox(origin, inverseDirection, child0.m_min, child0.m_max);
+			float exit1 = IntersectBox(origin, inverseDirection, child1.m_min, child1.m_max);
+			bool visit0 = exit0 >= 0 && exit0 >= hit.m_distance;
+			bool visit1 = exit1 >= 0 && exit1 >= hit.m_distance;
+
+			// the child that extends farther is visited first, it is the most likely to hold the farthest hit
+			if (visit0 && visit1)
+			{
+				bool farthestFirst = exit0 > exit1;
+				stack[stackSize++] = node.m_firstOrChild + (farthestFirst ? 1 : 0);
+				stack[stackSize++] = node.m_firstOrChild + (farthestFirst ? 0 : 1);
+			}
+			else if (visit0)
+				stack[stackSize++] = node.m_firstOrChild;
+			else if (visit1)
+				stack[stackSize++] = node.m_firstOrChild + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.m_firstOrChild; i < node.m_firstOrChild + node.m_triangleCount; ++i)
+		{
+			Triangle const& triangle = m_triangles[i];
+
+			float distance, u, v;
+			if (IntersectTriangle(origin, direction, triangle.m_p0, triangle.m_e1, triangle.m_e2, distance, u, v) && distance > hit.m_distance)
+			{
+				hit.m_triangle = m_triangleIndices[i];
+				hit.m_distance = distance;
+				hit.m_barycentrics[0] = std::clamp(u, 0.0f, 1.0f);
+				hit.m_barycentrics[1] = std::clamp(v, 0.0f, 1.0f - hit.m_barycentrics[0]);
+			}
+		}
+	}
+
+	return hit.m_distance >= 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "TriangleMesh.h"
+
+#include <cstdint>
+#include <vector>
+
+struct RayHit
+{
+	uint32_t m_triangle;
+	float m_distance;
+	float m_barycentrics[2]; // weights of the second and third vertices
+};
+
+// bounding volume hierarchy over the triangles of a mesh, built once and then queried from any number of threads
+class MeshRayCaster
+{
+public:
+	explicit MeshRayCaster(TriangleMesh const& mesh);
+
+	// farthest intersection along the ray, so that the outer surface wins when the mesh is not exactly star shaped
+	auto CastFarthest(float const origin[3], float const direction[3], RayHit& hit) const -> bool;
+
+private:
+	struct Node
+	{
+		float m_min[3];
+		float m_max[3];
+		uint32_t m_firstOrChild; // first triangle of a leaf, or index of the first of two children
+		uint32_t m_triangleCount; // 0 for inner nodes
+	};
+
+	// first vertex and both edges, stored in leaf order so that leaves are read contiguously
+	struct Triangle
+	{
+		float m_p0[3];
+		float m_e1[3];
+		float m_e2[3];
+	};
+
+	auto Build(uint32_t nodeIndex, uint32_t first, uint32_t count, std::vector<float> const& centroids) -> void;
+
+	TriangleMesh const& m_mesh;
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_triangleIndices; // mesh triangle of each leaf triangle
+	std::vector<Triangle> m_triangles;
+};
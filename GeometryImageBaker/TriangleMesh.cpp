@@ -0,0 +1,398 @@
+#include "TriangleMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	inline auto PackColor(float r, float g, float b, float a) -> uint32_t
+	{
+		return (uint32_t(std::clamp(r, 0.0f, 1.0f) * 255.0f + 0.5f) << 0)
+		     | (uint32_t(std::clamp(g, 0.0f, 1.0f) * 255.0f + 0.5f) << 8)
+		     | (uint32_t(std::clamp(b, 0.0f, 1.0f) * 255.0f + 0.5f) << 16)
+		     | (uint32_t(std::clamp(a, 0.0f, 1.0f) * 255.0f + 0.5f) << 24)
+		     ;
+	}
+
+	auto HasExtension(std::string const& filepath, char const* extension) -> bool
+	{
+		size_t length = strlen(extension);
+		if (filepath.size() < length)
+			return false;
+		for (size_t i = 0; i < length; ++i)
+		{
+			if (tolower(filepath[filepath.size() - length + i]) != extension[i])
+				return false;
+		}
+		return true;
+	}
+
+	// area weighted vertex normals
+	auto ComputeNormals(TriangleMesh& mesh) -> void
+	{
+		mesh.m_normals.assign(mesh.m_positions.size(), 0.0f);
+
+		for (uint32_t t = 0; t < mesh.GetTriangleCount(); ++t)
+		{
+			uint32_t const* triangle = &mesh.m_indices[3 * t];
+			float const* p0 = &mesh.m_positions[3 * triangle[0]];
+			float const* p1 = &mesh.m_positions[3 * triangle[1]];
+			float const* p2 = &mesh.m_positions[3 * triangle[2]];
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+			for (uint32_t v = 0; v < 3; ++v)
+			{
+				for (uint32_t k = 0; k < 3; ++k)
+					mesh.m_normals[3 * triangle[v] + k] += n[k];
+			}
+		}
+
+		for (uint32_t v = 0; v < mesh.GetVertexCount(); ++v)
+		{
+			float* n = &mesh.m_normals[3 * v];
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			float scale = length > 0 ? 1 / length : 0;
+			for (uint32_t k = 0; k < 3; ++k)
+				n[k] *= scale;
+		}
+	}
+
+	auto AddPolygon(TriangleMesh& mesh, std::vector<uint32_t> const& polygon) -> void
+	{
+		for (size_t i = 2; i < polygon.size(); ++i)
+		{
+			mesh.m_indices.push_back(polygon[0]);
+			mesh.m_indices.push_back(polygon[i - 1]);
+			mesh.m_indices.push_back(polygon[i]);
+		}
+	}
+
+	// vertex normals of OBJ files are per face corner, they are recomputed per vertex instead
+	auto LoadObj(std::string const& filepath, TriangleMesh& mesh) -> bool
+	{
+		std::ifstream file(filepath);
+		if (!file)
+		{
+			std::cerr << "could not open " << filepath << std::endl;
+			return false;
+		}
+
+		std::vector<uint32_t> polygon;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream(line);
+			std::string keyword;
+			stream >> keyword;
+
+			if (keyword == "v")
+			{
+				float p[3] = { 0, 0, 0 };
+				float c[3] = { 1, 1, 1 };
+				stream >> p[0] >> p[1] >> p[2];
+				if (!(stream >> c[0] >> c[1] >> c[2]))
+					c[0] = c[1] = c[2] = 1;
+				mesh.m_positions.insert(mesh.m_positions.end(), p, p + 3);
+				mesh.m_colors.push_back(PackColor(c[0], c[1], c[2], 1));
+			}
+			else if (keyword == "f")
+			{
+				polygon.clear();
+				std::string corner;
+				while (stream >> corner)
+				{
+					// v, v/vt, v//vn or v/vt/vn, negative indices are relative to the end
+					long index = std::strtol(corner.c_str(), nullptr, 10);
+					if (index < 0)
+						index += long(mesh.GetVertexCount()) + 1;
+					if (index < 1 || index > long(mesh.GetVertexCount()))
+					{
+						std::cerr << filepath << ": face references missing vertex " << corner << std::endl;
+						return false;
+					}
+					polygon.push_back(uint32_t(index - 1));
+				}
+				AddPolygon(mesh, polygon);
+			}
+		}
+
+		ComputeNormals(mesh);
+		return true;
+	}
+
+	enum class PlyType { Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64, Invalid };
+
+	auto ParsePlyType(std::string const& name) -> PlyType
+	{
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::Uint8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::Uint16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::Uint32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	struct PlyProperty
+	{
+		std::string m_name;
+		PlyType m_type;
+		PlyType m_countType; // Invalid unless the property is a list
+	};
+
+	struct PlyElement
+	{
+		std::string m_name;
+		uint32_t m_count;
+		std::vector<PlyProperty> m_properties;
+	};
+
+	// reads one scalar, either as text or as little endian binary
+	class PlyReader
+	{
+	public:
+		PlyReader(std::istream& stream, bool binary) : m_stream(stream), m_binary(binary) {}
+
+		auto Read(PlyType type) -> double
+		{
+			if (!m_binary)
+			{
+				double value = 0;
+				m_stream >> value;
+				return value;
+			}
+
+			switch (type)
+			{
+			case PlyType::Int8: return ReadBinary<int8_t>();
+			case PlyType::Uint8: return ReadBinary<uint8_t>();
+			case PlyType::Int16: return ReadBinary<int16_t>();
+			case PlyType::Uint16: return ReadBinary<uint16_t>();
+			case PlyType::Int32: return ReadBinary<int32_t>();
+			case PlyType::Uint32: return ReadBinary<uint32_t>();
+			case PlyType::Float32: return ReadBinary<float>();
+			case PlyType::Float64: return ReadBinary<double>();
+			default: return 0;
+			}
+		}
+
+		auto Good() const -> bool { return bool(m_stream); }
+
+	private:
+		template<typename T>
+		auto ReadBinary() -> double
+		{
+			T value = 0;
+			m_stream.read((char*)&value, sizeof(T));
+			return double(value);
+		}
+
+		std::istream& m_stream;
+		bool m_binary;
+	};
+
+	auto LoadPly(std::string const& filepath, TriangleMesh& mesh) -> bool
+	{
+		std::ifstream file(filepath, std::ios::binary);
+		if (!file)
+		{
+			std::cerr << "could not open " << filepath << std::endl;
+			return false;
+		}
+
+		std::vector<PlyElement> elements;
+		bool binary = false;
+
+		std::string line;
+		std::getline(file, line);
+		if (line.compare(0, 3, "ply") != 0)
+		{
+			std::cerr << filepath << " is not a PLY file" << std::endl;
+			return false;
+		}
+
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			std::istringstream stream(line);
+			std::string keyword;
+			stream >> keyword;
+
+			if (keyword == "format")
+			{
+				std::string format;
+				stream >> format;
+				if (format == "binary_little_endian")
+					binary = true;
+				else if (format != "ascii")
+				{
+					std::cerr << filepath << ": unsupported PLY format " << format << std::endl;
+					return false;
+				}
+			}
+			else if (keyword == "element")
+			{
+				PlyElement element;
+				stream >> element.m_name >> element.m_count;
+				elements.push_back(element);
+			}
+			else if (keyword == "property" && !elements.empty())
+			{
+				PlyProperty property;
+				std::string type;
+				stream >> type;
+				if (type == "list")
+				{
+					std::string countType, valueType;
+					stream >> countType >> valueType >> property.m_name;
+					property.m_countType = ParsePlyType(countType);
+					property.m_type = ParsePlyType(valueType);
+				}
+				else
+				{
+					stream >> property.m_name;
+					property.m_countType = PlyType::Invalid;
+					property.m_type = ParsePlyType(type);
+				}
+				if (property.m_type == PlyType::Invalid)
+				{
+					std::cerr << filepath << ": unsupported PLY property type in \"" << line << "\"" << std::endl;
+					return false;
+				}
+				elements.back().m_properties.push_back(property);
+			}
+			else if (keyword == "end_header")
+				break;
+		}
+
+		PlyReader reader(file, binary);
+		bool hasNormals = false;
+		std::vector<uint32_t> polygon;
+		std::vector<double> values;
+
+		for (PlyElement const& element : elements)
+		{
+			bool isVertex = element.m_name == "vertex";
+			bool isFace = element.m_name == "face";
+
+			auto PropertyIndex = [&](char const* name) -> int
+			{
+				for (size_t i = 0; i < element.m_properties.size(); ++i)
+				{
+					if (element.m_properties[i].m_name == name)
+						return int(i);
+				}
+				return -1;
+			};
+
+			int position[3] = { PropertyIndex("x"), PropertyIndex("y"), PropertyIndex("z") };
+			int normal[3] = { PropertyIndex("nx"), PropertyIndex("ny"), PropertyIndex("nz") };
+			int color[4] = { PropertyIndex("red"), PropertyIndex("green"), PropertyIndex("blue"), PropertyIndex("alpha") };
+			hasNormals = hasNormals || (isVertex && normal[0] >= 0 && normal[1] >= 0 && normal[2] >= 0);
+
+			values.resize(element.m_properties.size());
+			for (uint32_t e = 0; e < element.m_count; ++e)
+			{
+				for (size_t i = 0; i < element.m_properties.size(); ++i)
+				{
+					PlyProperty const& property = element.m_properties[i];
+					if (property.m_countType == PlyType::Invalid)
+					{
+						values[i] = reader.Read(property.m_type);
+						continue;
+					}
+
+					uint32_t count = uint32_t(reader.Read(property.m_countType));
+					bool isIndices = isFace && (property.m_name == "vertex_indices" || property.m_name == "vertex_index");
+					polygon.clear();
+					for (uint32_t c = 0; c < count; ++c)
+					{
+						double value = reader.Read(property.m_type);
+						if (isIndices)
+							polygon.push_back(uint32_t(value));
+					}
+					if (isIndices)
+					{
+						for (uint32_t index : polygon)
+						{
+							if (index >= mesh.GetVertexCount())
+							{
+								std::cerr << filepath << ": face references missing vertex " << index << std::endl;
+								return false;
+							}
+						}
+						AddPolygon(mesh, polygon);
+					}
+				}
+
+				if (!reader.Good())
+				{
+					std::cerr << filepath << " is truncated" << std::endl;
+					return false;
+				}
+
+				if (isVertex)
+				{
+					for (uint32_t k = 0; k < 3; ++k)
+						mesh.m_positions.push_back(position[k] >= 0 ? float(values[position[k]]) : 0.0f);
+					if (hasNormals)
+					{
+						for (uint32_t k = 0; k < 3; ++k)
+							mesh.m_normals.push_back(float(values[normal[k]]));
+					}
+
+					// integer colors are 0..255, floating point ones 0..1
+					float c[4] = { 1, 1, 1, 1 };
+					for (uint32_t k = 0; k < 4; ++k)
+					{
+						if (color[k] < 0)
+							continue;
+						bool isFloat = element.m_properties[color[k]].m_type == PlyType::Float32 || element.m_properties[color[k]].m_type == PlyType::Float64;
+						c[k] = float(isFloat ? values[color[k]] : values[color[k]] / 255.0);
+					}
+					mesh.m_colors.push_back(PackColor(c[0], c[1], c[2], c[3]));
+				}
+			}
+		}
+
+		if (!hasNormals)
+			ComputeNormals(mesh);
+		return true;
+	}
+}
+
+auto LoadTriangleMesh(std::string const& filepath, TriangleMesh& mesh) -> bool
+{
+	mesh = {};
+
+	bool loaded;
+	if (HasExtension(filepath, ".obj"))
+		loaded = LoadObj(filepath, mesh);
+	else if (HasExtension(filepath, ".ply"))
+		loaded = LoadPly(filepath, mesh);
+	else
+	{
+		std::cerr << "unsupported mesh format for " << filepath << " (expected .obj or .ply)" << std::endl;
+		return false;
+	}
+
+	if (loaded && mesh.GetTriangleCount() == 0)
+	{
+		std::cerr << filepath << " has no triangles" << std::endl;
+		return false;
+	}
+
+	return loaded;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// indexed triangle mesh as read from disk, with one normal and one color per vertex
+struct TriangleMesh
+{
+	std::vector<float> m_positions; // xyz
+	std::vector<float> m_normals;   // xyz, computed from the triangles when the file has none
+	std::vector<uint32_t> m_colors; // rgba8, white when the file has none
+	std::vector<uint32_t> m_indices;
+
+	auto GetVertexCount() const -> uint32_t { return uint32_t(m_positions.size() / 3); }
+	auto GetTriangleCount() const -> uint32_t { return uint32_t(m_indices.size() / 3); }
+};
+
+// loads a Wavefront OBJ (with the common "v x y z r g b" vertex color extension) or a PLY file (ascii or binary little endian)
+// polygons are triangulated as fans
+auto LoadTriangleMesh(std::string const& filepath, TriangleMesh& mesh) -> bool;
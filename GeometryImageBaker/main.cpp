@@ -0,0 +1,246 @@
+#include "GeometryImageBaker.h"
+#include "MeshRayCaster.h"
+#include "TriangleMesh.h"
+#include "../MeshShaderRasterization/GeometryImageEncoding.h"
+#include "../MeshShaderRasterization/GeometryImageFile.h"
+#include "../MeshShaderRasterization/GeometryImageMipChain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// the renderer dispatches task groups of 8x8 megatiles of 64x64 quads
+const uint32_t sizeGranularity = 64 * 8;
+
+auto PrintUsage() -> void
+{
+	std::cerr << "usage: GeometryImageBaker <input.obj|input.ply> <output.gimg> [options]" << std::endl;
+	std::cerr << "  -size <n>                             geometry image size, a power of two >= " << sizeGranularity << " (default 2048)" << std::endl;
+	std::cerr << "  -parameterization octahedral|spherical (default octahedral)" << std::endl;
+	std::cerr << "  -threads <n>                          worker threads (default: every core)" << std::endl;
+	std::cerr << "  -albedo rgba8|bc1|bc7                 albedo encoding (default: the one the renderer is built with)" << std::endl;
+	std::cerr << "  -measureError                         decodes mip 0 back and prints the encoding error, checks the folds of every mip" << std::endl;
+	std::cerr << "the mesh should be star shaped around its centroid: texels are found by casting rays from it" << std::endl;
+}
+
+auto MillisecondsSince(std::chrono::steady_clock::time_point start) -> double
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// compares the border vertices of every mip with their fold partners (a different position opens a crack along the fold, different
+// attributes a shading seam) and prints the mismatches, returns false if there is any
+auto CheckFolds(Parameterization parameterization, uint32_t size, uint32_t mipCount, std::vector<GeometryImageBorderVertex> const& borderVertices) -> bool
+{
+	uint64_t vertexCount = 0;
+	uint64_t positionMismatchCount = 0;
+	uint64_t attributeMismatchCount = 0;
+	GeometryImageBorderVertex const* mipVertices = borderVertices.data();
+	for (uint32_t mip = 0; mip < mipCount; ++mip)
+	{
+		uint32_t mipSize = GetGeometryImageMipSize(size, mip);
+		uint32_t positionMismatches = 0;
+		uint32_t attributeMismatches = 0;
+		float maxGap = 0;
+		for (uint32_t y = 0; y <= mipSize; ++y)
+		{
+			for (uint32_t x = 0; x <= mipSize; x += (y == 0 || y == mipSize) ? 1 : mipSize)
+			{
+				uint32_t partnerX;
+				uint32_t partnerY;
+				GetParameterizationFoldPartner(parameterization, mipSize, x, y, partnerX, partnerY);
+				GeometryImageBorderVertex const& vertex = mipVertices[GetGeometryImageBorderVertexIndex(mipSize, x, y)];
+				GeometryImageBorderVertex const& partner = mipVertices[GetGeometryImageBorderVertexIndex(mipSize, partnerX, partnerY)];
+
+				if (std::memcmp(vertex.position, partner.position, sizeof(vertex.position)) != 0)
+				{
+					float gap[3] = { vertex.position[0] - partner.position[0], vertex.position[1] - partner.position[1], vertex.position[2] - partner.position[2] };
+					maxGap = std::max(maxGap, std::sqrt(gap[0] * gap[0] + gap[1] * gap[1] + gap[2] * gap[2]));
+					++positionMismatches;
+				}
+				if (vertex.albedo != partner.albedo || std::memcmp(vertex.normal, partner.normal, sizeof(vertex.normal)) != 0)
+					++attributeMismatches;
+			}
+		}
+
+		if (positionMismatches > 0 || attributeMismatches > 0)
+		{
+			std::cout << "  mip " << mip << " (" << mipSize << "x" << mipSize << "): " << positionMismatches << " positions (max gap " << maxGap << ") and "
+			          << attributeMismatches << " attributes differ from their fold partners" << std::endl;
+		}
+		vertexCount += 4 * mipSize;
+		positionMismatchCount += positionMismatches;
+		attributeMismatchCount += attributeMismatches;
+		mipVertices += 4 * mipSize;
+	}
+
+	std::cout << "folds: " << vertexCount << " border vertices in " << mipCount << " mips, " << positionMismatchCount << " positions and "
+	          << attributeMismatchCount << " attributes differ from their fold partners" << std::endl;
+	return positionMismatchCount == 0 && attributeMismatchCount == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return -1;
+	}
+
+	std::string inputFilepath = argv[1];
+	std::string outputFilepath = argv[2];
+
+	GeometryImageBakeSettings settings;
+	settings.m_size = 2048;
+	settings.m_parameterization = Parameterization::Octahedral;
+	settings.m_threadCount = 0;
+	GeometryImageAlbedoEncoding albedoEncoding = geometryImageAlbedoEncoding;
+	bool measureError = false;
+
+	try
+	{
+		for (int i = 3; i < argc; ++i)
+		{
+			if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+				settings.m_size = uint32_t(std::stoul(argv[++i]));
+			else if (strcmp(argv[i], "-parameterization") == 0 && i + 1 < argc)
+			{
+				std::string parameterization = argv[++i];
+				if (parameterization == "octahedral")
+					settings.m_parameterization = Parameterization::Octahedral;
+				else if (parameterization == "spherical")
+					settings.m_parameterization = Parameterization::Spherical;
+				else
+				{
+					PrintUsage();
+					return -1;
+				}
+			}
+			else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+				settings.m_threadCount = uint32_t(std::stoul(argv[++i]));
+			else if (strcmp(argv[i], "-albedo") == 0 && i + 1 < argc)
+			{
+				std::string albedo = argv[++i];
+				if (albedo == "rgba8")
+					albedoEncoding = GeometryImageAlbedoEncoding_Rgba8;
+				else if (albedo == "bc1")
+					albedoEncoding = GeometryImageAlbedoEncoding_Bc1;
+				else if (albedo == "bc7")
+					albedoEncoding = GeometryImageAlbedoEncoding_Bc7;
+				else
+				{
+					PrintUsage();
+					return -1;
+				}
+			}
+			else if (strcmp(argv[i], "-measureError") == 0)
+				measureError = true;
+			else
+			{
+				PrintUsage();
+				return -1;
+			}
+		}
+	}
+	catch (std::logic_error const&) // a value std::stoul or std::stof cannot read
+	{
+		PrintUsage();
+		return -1;
+	}
+
+	if (settings.m_size < sizeGranularity || (settings.m_size & (settings.m_size - 1)) != 0)
+	{
+		std::cerr << "size must be a power of two >= " << sizeGranularity << std::endl;
+		return -1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	TriangleMesh mesh;
+	if (!LoadTriangleMesh(inputFilepath, mesh))
+		return -2;
+	std::cout << "loaded " << inputFilepath << ": " << mesh.GetVertexCount() << " vertices, " << mesh.GetTriangleCount() << " triangles in " << MillisecondsSince(start) << " ms" << std::endl;
+
+	auto bvhStart = std::chrono::steady_clock::now();
+	MeshRayCaster rayCaster(mesh);
+	std::cout << "built bvh in " << MillisecondsSince(bvhStart) << " ms" << std::endl;
+
+	float positionBoundsMin[3];
+	float positionBoundsMax[3];
+	ComputeSurfaceCentroid(mesh, settings.m_center);
+	ComputeMeshBounds(mesh, positionBoundsMin, positionBoundsMax);
+
+	const uint32_t size = settings.m_size;
+	const uint32_t mipCount = GetGeometryImageMipCount(size);
+
+	auto bakeStart = std::chrono::steady_clock::now();
+
+	// position and normal encodings are the ones the renderer is built with, the renderer takes any albedo encoding
+	// the renderer stitches megatiles across the folds of the parameterization
+	GeometryImageParameterization parameterization = settings.m_parameterization == Parameterization::Spherical ? GeometryImageParameterization_Spherical : GeometryImageParameterization_Octahedral;
+	GeometryImageFileWriter writer;
+	if (!writer.Open(outputFilepath, size, mipCount, geometryImagePositionEncoding, albedoEncoding, geometryImageNormalEncoding, parameterization, positionBoundsMin, positionBoundsMax))
+		return -3;
+
+	bool written = true;
+	GeometryImageEncoder encoder(size, mipCount, geometryImagePositionEncoding, albedoEncoding, geometryImageNormalEncoding, positionBoundsMin, positionBoundsMax,
+		[&](GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload, uint64_t payloadSize)
+	{
+		written = writer.WriteMegatiles(megatiles, megatileCount, payload, payloadSize) && written;
+	}, settings.m_threadCount
+	);
+	if (measureError)
+		encoder.EnableErrorMeasurement();
+
+	GeometryImageMipChainBuilder mipChainBuilder(size, mipCount,
+		[&](uint32_t mip, uint32_t, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal)
+	{
+		encoder.PushRows(mip, rowCount, position, albedo, normal);
+	}
+	);
+
+	// bands keep memory bounded at any size while giving every thread plenty of rows
+	const uint32_t bandRows = 256;
+	std::vector<float> position(size_t(bandRows) * (size + 1) * 3);
+	std::vector<uint32_t> albedo(size_t(bandRows) * (size + 1));
+	std::vector<float> normal(size_t(bandRows) * (size + 1) * 3);
+	uint64_t missCount = 0;
+
+	for (uint32_t firstRow = 0; firstRow <= size && written; firstRow += bandRows)
+	{
+		uint32_t rowCount = std::min(bandRows, size + 1 - firstRow);
+		missCount += BakeGeometryImageRows(mesh, rayCaster, settings, firstRow, rowCount, position.data(), albedo.data(), normal.data());
+		encoder.PushRows(0, rowCount, position.data(), albedo.data(), normal.data());
+		mipChainBuilder.PushRows(firstRow, rowCount, position.data(), albedo.data(), normal.data());
+	}
+
+	written = writer.Close(encoder.GetBounds(), encoder.GetBorderVertices()) && written;
+	if (!written)
+		return -3;
+
+	double bakeMilliseconds = MillisecondsSince(bakeStart);
+	std::cout << "baked " << size << "x" << size << " geometry image (" << mipCount << " mips) to " << outputFilepath << " in " << bakeMilliseconds << " ms"
+	          << " (" << (double(size) * size / (bakeMilliseconds * 1000)) << " Mtexels/s)" << std::endl;
+	std::cout << "position bounds: (" << positionBoundsMin[0] << ", " << positionBoundsMin[1] << ", " << positionBoundsMin[2] << ") - ("
+	          << positionBoundsMax[0] << ", " << positionBoundsMax[1] << ", " << positionBoundsMax[2] << ")" << std::endl;
+	std::cout << "encodings: " << GetGeometryImagePositionEncodingName(geometryImagePositionEncoding) << " positions, " << GetGeometryImageAlbedoEncodingName(albedoEncoding) << " albedo, "
+	          << GetGeometryImageNormalEncodingName(geometryImageNormalEncoding) << " normals" << std::endl;
+	bool foldsMatch = true;
+	if (measureError)
+	{
+		GeometryImageEncodingError const& error = encoder.GetError();
+		std::cout << "encoding error: position max " << error.m_positionMaxError << " rms " << error.GetPositionRmsError()
+		          << ", normal max " << error.m_normalMaxAngle << " mean " << error.GetNormalMeanAngle() << " degrees"
+		          << ", albedo max " << error.m_albedoMaxError << " PSNR " << error.GetAlbedoPsnr() << " dB" << std::endl;
+		foldsMatch = CheckFolds(settings.m_parameterization, size, mipCount, encoder.GetBorderVertices());
+	}
+	if (missCount > 0)
+		std::cout << "warning: " << missCount << " vertices found no surface, the mesh is probably not star shaped around its centroid" << std::endl;
+
+	return foldsMatch ? 0 : -4;
+}
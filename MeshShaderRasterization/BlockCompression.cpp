@@ -0,0 +1,623 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSION_SSE2 1
+#endif
+
+namespace
+{
+	// 4 bit BC7 interpolation weights, out of 64
+	const uint32_t bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// pixels and palette are structures of arrays: channel c of pixel i is pixels[c][i], of entry j is palette[c][j]
+	// writes the closest palette entry of every pixel and returns the total squared error
+	template<uint32_t channelCount>
+	auto FindClosestEntries(float const pixels[channelCount][16], float const palette[channelCount][16], uint32_t paletteSize, uint8_t indices[16]) -> float
+	{
+#if BLOCK_COMPRESSION_SSE2
+		__m128 totalError = _mm_setzero_ps();
+		for (uint32_t i = 0; i < 16; i += 4)
+		{
+			__m128 pixel[channelCount];
+			for (uint32_t c = 0; c < channelCount; ++c)
+				pixel[c] = _mm_loadu_ps(&pixels[c][i]);
+
+			__m128 bestError = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (uint32_t j = 0; j < paletteSize; ++j)
+			{
+				__m128 error = _mm_setzero_ps();
+				for (uint32_t c = 0; c < channelCount; ++c)
+				{
+					__m128 difference = _mm_sub_ps(pixel[c], _mm_set1_ps(palette[c][j]));
+					error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+				}
+
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(int(j))), _mm_andnot_si128(closer, bestIndex));
+				bestError = _mm_min_ps(error, bestError);
+			}
+
+			alignas(16) int32_t bestIndices[4];
+			_mm_store_si128((__m128i*)bestIndices, bestIndex);
+			for (uint32_t k = 0; k < 4; ++k)
+				indices[i + k] = uint8_t(bestIndices[k]);
+			totalError = _mm_add_ps(totalError, bestError);
+		}
+
+		alignas(16) float errors[4];
+		_mm_store_ps(errors, totalError);
+		return errors[0] + errors[1] + errors[2] + errors[3];
+#else
+		float totalError = 0;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float bestError = FLT_MAX;
+			for (uint32_t j = 0; j < paletteSize; ++j)
+			{
+				float error = 0;
+				for (uint32_t c = 0; c < channelCount; ++c)
+					error += (pixels[c][i] - palette[c][j]) * (pixels[c][i] - palette[c][j]);
+				if (error < bestError)
+				{
+					bestError = error;
+					indices[i] = uint8_t(j);
+				}
+			}
+			totalError += bestError;
+		}
+		return totalError;
+#endif
+	}
+
+	// principal axis of the pixels through their mean, by power iteration on the covariance matrix
+	// returns the extreme pixels along it, projected back on the axis
+	template<uint32_t channelCount>
+	auto FindPrincipalEndpoints(float const pixels[channelCount][16], float endpoint0[channelCount], float endpoint1[channelCount]) -> void
+	{
+		float mean[channelCount];
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			mean[c] = 0;
+			for (uint32_t i = 0; i < 16; ++i)
+				mean[c] += pixels[c][i];
+			mean[c] /= 16;
+		}
+
+		float covariance[channelCount][channelCount];
+		for (uint32_t a = 0; a < channelCount; ++a)
+		{
+			for (uint32_t b = 0; b < channelCount; ++b)
+			{
+				covariance[a][b] = 0;
+				for (uint32_t i = 0; i < 16; ++i)
+					covariance[a][b] += (pixels[a][i] - mean[a]) * (pixels[b][i] - mean[b]);
+			}
+		}
+
+		float axis[channelCount];
+		for (uint32_t c = 0; c < channelCount; ++c)
+			axis[c] = 1;
+		for (uint32_t iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[channelCount];
+			float length = 0;
+			for (uint32_t a = 0; a < channelCount; ++a)
+			{
+				next[a] = 0;
+				for (uint32_t b = 0; b < channelCount; ++b)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::fabs(next[a]));
+			}
+			if (length == 0)
+				break;
+			for (uint32_t c = 0; c < channelCount; ++c)
+				axis[c] = next[c] / length;
+		}
+
+		float axisLength = 0;
+		for (uint32_t c = 0; c < channelCount; ++c)
+			axisLength += axis[c] * axis[c];
+		axisLength = std::sqrt(axisLength);
+		for (uint32_t c = 0; c < channelCount; ++c)
+			axis[c] /= axisLength;
+
+		float minimum = FLT_MAX;
+		float maximum = -FLT_MAX;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float t = 0;
+			for (uint32_t c = 0; c < channelCount; ++c)
+				t += (pixels[c][i] - mean[c]) * axis[c];
+			minimum = std::min(minimum, t);
+			maximum = std::max(maximum, t);
+		}
+
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			endpoint0[c] = mean[c] + axis[c] * minimum;
+			endpoint1[c] = mean[c] + axis[c] * maximum;
+		}
+	}
+
+	// least squares endpoints for fixed indices, pixel i being weights[i] * endpoint1 + (1 - weights[i]) * endpoint0
+	// returns false if every pixel uses the same weight, in which case the endpoints are left as they are
+	template<uint32_t channelCount>
+	auto FitEndpoints(float const pixels[channelCount][16], float const weights[16], float endpoint0[channelCount], float endpoint1[channelCount]) -> bool
+	{
+		float aa = 0, ab = 0, bb = 0;
+		float ax[channelCount] = {};
+		float bx[channelCount] = {};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float b = weights[i];
+			float a = 1 - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (uint32_t c = 0; c < channelCount; ++c)
+			{
+				ax[c] += a * pixels[c][i];
+				bx[c] += b * pixels[c][i];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+			endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+		}
+		return true;
+	}
+
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(uint8_t* data) : m_data(data), m_position(0) {}
+
+		auto Write(uint32_t value, uint32_t bitCount) -> void
+		{
+			for (uint32_t i = 0; i < bitCount; ++i, ++m_position)
+			{
+				if ((value >> i) & 1)
+					m_data[m_position >> 3] |= uint8_t(1 << (m_position & 7));
+			}
+		}
+
+	private:
+		uint8_t* m_data;
+		uint32_t m_position;
+	};
+
+	class BitReader
+	{
+	public:
+		explicit BitReader(uint8_t const* data) : m_data(data), m_position(0) {}
+
+		auto Read(uint32_t bitCount) -> uint32_t
+		{
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < bitCount; ++i, ++m_position)
+				value |= uint32_t((m_data[m_position >> 3] >> (m_position & 7)) & 1) << i;
+			return value;
+		}
+
+	private:
+		uint8_t const* m_data;
+		uint32_t m_position;
+	};
+
+	inline auto UnpackRgba8(uint32_t const pixels[16], float channels[4][16]) -> void
+	{
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+				channels[c][i] = float((pixels[i] >> (8 * c)) & 0xff);
+		}
+	}
+
+	inline auto PackRgba8(uint32_t const channels[4]) -> uint32_t
+	{
+		return channels[0] | (channels[1] << 8) | (channels[2] << 16) | (channels[3] << 24);
+	}
+
+	// BC1
+
+	inline auto PackRgb565(float const color[3]) -> uint16_t
+	{
+		uint32_t r = uint32_t(std::clamp(color[0], 0.0f, 255.0f) * 31 / 255 + 0.5f);
+		uint32_t g = uint32_t(std::clamp(color[1], 0.0f, 255.0f) * 63 / 255 + 0.5f);
+		uint32_t b = uint32_t(std::clamp(color[2], 0.0f, 255.0f) * 31 / 255 + 0.5f);
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	inline auto UnpackRgb565(uint16_t color, uint32_t rgb[3]) -> void
+	{
+		uint32_t r = (color >> 11) & 0x1f;
+		uint32_t g = (color >> 5) & 0x3f;
+		uint32_t b = color & 0x1f;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// palette of the 4 color mode, entry order as in the format: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+	const float bc1Weights[4] = { 0.0f, 1.0f, 1.0f / 3, 2.0f / 3 };
+
+	auto EvaluateBc1Endpoints(float const pixels[3][16], uint16_t color0, uint16_t color1, uint8_t indices[16]) -> float
+	{
+		uint32_t rgb0[3], rgb1[3];
+		UnpackRgb565(color0, rgb0);
+		UnpackRgb565(color1, rgb1);
+
+		float palette[3][16];
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			for (uint32_t j = 0; j < 4; ++j)
+				palette[c][j] = rgb0[c] + (float(rgb1[c]) - float(rgb0[c])) * bc1Weights[j];
+		}
+		return FindClosestEntries<3>(pixels, palette, 4, indices);
+	}
+
+	auto WriteBc1Block(uint16_t color0, uint16_t color1, uint8_t const indices[16], uint8_t block[8]) -> void
+	{
+		// the 4 color mode needs color0 > color1, swapping the endpoints swaps 0 with 1 and 2 with 3
+		uint8_t const remap[4] = { 1, 0, 3, 2 };
+		bool swap = color0 < color1;
+		if (swap)
+			std::swap(color0, color1);
+
+		uint32_t bits = 0;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			uint32_t index = color0 == color1 ? 0 : (swap ? remap[indices[i]] : indices[i]);
+			bits |= index << (2 * i);
+		}
+
+		block[0] = uint8_t(color0);
+		block[1] = uint8_t(color0 >> 8);
+		block[2] = uint8_t(color1);
+		block[3] = uint8_t(color1 >> 8);
+		std::memcpy(block + 4, &bits, 4);
+	}
+
+	// BC7 mode 6
+
+	// 8 bit endpoint from 7 bits and a p bit shared by the 4 channels, the p bit is chosen for the smallest error
+	auto QuantizeBc7Mode6Endpoint(float const endpoint[4], uint32_t quantized[4], uint32_t& pBit) -> void
+	{
+		float bestError = FLT_MAX;
+		for (uint32_t p = 0; p < 2; ++p)
+		{
+			uint32_t candidate[4];
+			float error = 0;
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				candidate[c] = uint32_t(std::clamp((endpoint[c] - p) / 2 + 0.5f, 0.0f, 127.0f));
+				float value = float(candidate[c] * 2 + p);
+				error += (value - endpoint[c]) * (value - endpoint[c]);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				pBit = p;
+				std::memcpy(quantized, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	struct Bc7Mode6Endpoints
+	{
+		uint32_t m_quantized[2][4];
+		uint32_t m_pBits[2];
+	};
+
+	auto EvaluateBc7Mode6Endpoints(float const pixels[4][16], Bc7Mode6Endpoints const& endpoints, uint8_t indices[16]) -> float
+	{
+		float palette[4][16];
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			uint32_t value0 = endpoints.m_quantized[0][c] * 2 + endpoints.m_pBits[0];
+			uint32_t value1 = endpoints.m_quantized[1][c] * 2 + endpoints.m_pBits[1];
+			for (uint32_t j = 0; j < 16; ++j)
+				palette[c][j] = float(((64 - bc7Weights[j]) * value0 + bc7Weights[j] * value1 + 32) >> 6);
+		}
+		return FindClosestEntries<4>(pixels, palette, 16, indices);
+	}
+
+	// BC4 snorm
+
+	inline auto QuantizeSnorm8(float value) -> int32_t
+	{
+		return int32_t(std::round(std::clamp(value, -1.0f, 1.0f) * 127));
+	}
+
+	// decoded palette of the 8 value mode (red0 > red1) or of the 6 value mode
+	auto GetBc4SnormPalette(int32_t red0, int32_t red1, float palette[16]) -> void
+	{
+		float value0 = std::max(red0 / 127.0f, -1.0f);
+		float value1 = std::max(red1 / 127.0f, -1.0f);
+		palette[0] = value0;
+		palette[1] = value1;
+		if (red0 > red1)
+		{
+			for (uint32_t j = 2; j < 8; ++j)
+				palette[j] = (value0 * (8 - j) + value1 * (j - 1)) / 7;
+		}
+		else
+		{
+			for (uint32_t j = 2; j < 6; ++j)
+				palette[j] = (value0 * (6 - j) + value1 * (j - 1)) / 5;
+			palette[6] = -1;
+			palette[7] = 1;
+		}
+	}
+
+	auto EncodeBc4SnormBlock(float const values[16], uint8_t block[8]) -> void
+	{
+		float pixels[1][16];
+		float minimum = FLT_MAX;
+		float maximum = -FLT_MAX;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			pixels[0][i] = std::clamp(values[i], -1.0f, 1.0f);
+			minimum = std::min(minimum, pixels[0][i]);
+			maximum = std::max(maximum, pixels[0][i]);
+		}
+
+		int32_t red0 = QuantizeSnorm8(maximum);
+		int32_t red1 = QuantizeSnorm8(minimum);
+		uint8_t indices[16] = {};
+
+		if (red0 > red1)
+		{
+			float palette[1][16];
+			GetBc4SnormPalette(red0, red1, palette[0]);
+			float error = FindClosestEntries<1>(pixels, palette, 8, indices);
+
+			// one least squares pass on the endpoints, kept only if it helps
+			float weights[16];
+			for (uint32_t i = 0; i < 16; ++i)
+				weights[i] = indices[i] == 0 ? 0.0f : (indices[i] == 1 ? 1.0f : (indices[i] - 1) / 7.0f);
+
+			float endpoint0[1] = { red0 / 127.0f };
+			float endpoint1[1] = { red1 / 127.0f };
+			if (FitEndpoints<1>(pixels, weights, endpoint0, endpoint1))
+			{
+				int32_t fittedRed0 = QuantizeSnorm8(endpoint0[0]);
+				int32_t fittedRed1 = QuantizeSnorm8(endpoint1[0]);
+				if (fittedRed0 > fittedRed1)
+				{
+					uint8_t fittedIndices[16];
+					GetBc4SnormPalette(fittedRed0, fittedRed1, palette[0]);
+					if (FindClosestEntries<1>(pixels, palette, 8, fittedIndices) < error)
+					{
+						red0 = fittedRed0;
+						red1 = fittedRed1;
+						std::memcpy(indices, fittedIndices, sizeof(indices));
+					}
+				}
+			}
+		}
+
+		uint64_t bits = 0;
+		for (uint32_t i = 0; i < 16; ++i)
+			bits |= uint64_t(indices[i]) << (3 * i);
+
+		block[0] = uint8_t(int8_t(red0));
+		block[1] = uint8_t(int8_t(red1));
+		for (uint32_t k = 0; k < 6; ++k)
+			block[2 + k] = uint8_t(bits >> (8 * k));
+	}
+
+	auto DecodeBc4SnormBlock(uint8_t const block[8], float values[16]) -> void
+	{
+		int32_t red0 = std::max(int32_t(int8_t(block[0])), -127);
+		int32_t red1 = std::max(int32_t(int8_t(block[1])), -127);
+
+		float palette[16];
+		GetBc4SnormPalette(red0, red1, palette);
+
+		uint64_t bits = 0;
+		for (uint32_t k = 0; k < 6; ++k)
+			bits |= uint64_t(block[2 + k]) << (8 * k);
+		for (uint32_t i = 0; i < 16; ++i)
+			values[i] = palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+auto EncodeBc1Block(uint32_t const pixels[16], uint8_t block[8]) -> void
+{
+	float channels[4][16];
+	UnpackRgba8(pixels, channels);
+
+	float endpoint0[3], endpoint1[3];
+	FindPrincipalEndpoints<3>(channels, endpoint0, endpoint1);
+
+	uint16_t color0 = PackRgb565(endpoint0);
+	uint16_t color1 = PackRgb565(endpoint1);
+	uint8_t indices[16];
+	float error = EvaluateBc1Endpoints(channels, color0, color1, indices);
+
+	// least squares refinement of the endpoints for the indices found, kept only if it helps
+	for (uint32_t iteration = 0; iteration < 2; ++iteration)
+	{
+		float weights[16];
+		for (uint32_t i = 0; i < 16; ++i)
+			weights[i] = bc1Weights[indices[i]];
+		if (!FitEndpoints<3>(channels, weights, endpoint0, endpoint1))
+			break;
+
+		uint16_t fittedColor0 = PackRgb565(endpoint0);
+		uint16_t fittedColor1 = PackRgb565(endpoint1);
+		uint8_t fittedIndices[16];
+		float fittedError = EvaluateBc1Endpoints(channels, fittedColor0, fittedColor1, fittedIndices);
+		if (fittedError >= error)
+			break;
+
+		color0 = fittedColor0;
+		color1 = fittedColor1;
+		error = fittedError;
+		std::memcpy(indices, fittedIndices, sizeof(indices));
+	}
+
+	WriteBc1Block(color0, color1, indices, block);
+}
+
+auto DecodeBc1Block(uint8_t const block[8], uint32_t pixels[16]) -> void
+{
+	uint16_t color0 = uint16_t(block[0] | (block[1] << 8));
+	uint16_t color1 = uint16_t(block[2] | (block[3] << 8));
+
+	uint32_t palette[4][4];
+	UnpackRgb565(color0, palette[0]);
+	UnpackRgb565(color1, palette[1]);
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	for (uint32_t j = 0; j < 4; ++j)
+		palette[j][3] = (color0 <= color1 && j == 3) ? 0 : 255;
+
+	uint32_t bits;
+	std::memcpy(&bits, block + 4, 4);
+	for (uint32_t i = 0; i < 16; ++i)
+		pixels[i] = PackRgba8(palette[(bits >> (2 * i)) & 3]);
+}
+
+auto EncodeBc7Block(uint32_t const pixels[16], uint8_t block[16]) -> void
+{
+	float channels[4][16];
+	UnpackRgba8(pixels, channels);
+
+	float endpoints[2][4];
+	FindPrincipalEndpoints<4>(channels, endpoints[0], endpoints[1]);
+
+	Bc7Mode6Endpoints quantized;
+	for (uint32_t e = 0; e < 2; ++e)
+		QuantizeBc7Mode6Endpoint(endpoints[e], quantized.m_quantized[e], quantized.m_pBits[e]);
+
+	uint8_t indices[16];
+	float error = EvaluateBc7Mode6Endpoints(channels, quantized, indices);
+
+	for (uint32_t iteration = 0; iteration < 2; ++iteration)
+	{
+		float weights[16];
+		for (uint32_t i = 0; i < 16; ++i)
+			weights[i] = bc7Weights[indices[i]] / 64.0f;
+		if (!FitEndpoints<4>(channels, weights, endpoints[0], endpoints[1]))
+			break;
+
+		Bc7Mode6Endpoints fitted;
+		for (uint32_t e = 0; e < 2; ++e)
+			QuantizeBc7Mode6Endpoint(endpoints[e], fitted.m_quantized[e], fitted.m_pBits[e]);
+
+		uint8_t fittedIndices[16];
+		float fittedError = EvaluateBc7Mode6Endpoints(channels, fitted, fittedIndices);
+		if (fittedError >= error)
+			break;
+
+		quantized = fitted;
+		error = fittedError;
+		std::memcpy(indices, fittedIndices, sizeof(indices));
+	}
+
+	// the most significant index bit of the first pixel is implicit and must be 0: swapping the endpoints flips every index
+	if (indices[0] >= 8)
+	{
+		std::swap(quantized.m_quantized[0], quantized.m_quantized[1]);
+		std::swap(quantized.m_pBits[0], quantized.m_pBits[1]);
+		for (uint32_t i = 0; i < 16; ++i)
+			indices[i] = uint8_t(15 - indices[i]);
+	}
+
+	std::memset(block, 0, 16);
+	BitWriter writer(block);
+	writer.Write(1 << 6, 7);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		writer.Write(quantized.m_quantized[0][c], 7);
+		writer.Write(quantized.m_quantized[1][c], 7);
+	}
+	writer.Write(quantized.m_pBits[0], 1);
+	writer.Write(quantized.m_pBits[1], 1);
+	writer.Write(indices[0], 3);
+	for (uint32_t i = 1; i < 16; ++i)
+		writer.Write(indices[i], 4);
+}
+
+auto DecodeBc7Block(uint8_t const block[16], uint32_t pixels[16]) -> void
+{
+	if ((block[0] & 0x7f) != 0x40)
+	{
+		std::memset(pixels, 0, 16 * sizeof(uint32_t));
+		return;
+	}
+
+	BitReader reader(block);
+	reader.Read(7);
+
+	uint32_t values[2][4];
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		values[0][c] = reader.Read(7) << 1;
+		values[1][c] = reader.Read(7) << 1;
+	}
+	uint32_t pBit0 = reader.Read(1);
+	uint32_t pBit1 = reader.Read(1);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		values[0][c] |= pBit0;
+		values[1][c] |= pBit1;
+	}
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		uint32_t index = reader.Read(i == 0 ? 3 : 4);
+		uint32_t channels[4];
+		for (uint32_t c = 0; c < 4; ++c)
+			channels[c] = ((64 - bc7Weights[index]) * values[0][c] + bc7Weights[index] * values[1][c] + 32) >> 6;
+		pixels[i] = PackRgba8(channels);
+	}
+}
+
+auto EncodeBc5SnormBlock(float const pixels[16][2], uint8_t block[16]) -> void
+{
+	for (uint32_t c = 0; c < 2; ++c)
+	{
+		float values[16];
+		for (uint32_t i = 0; i < 16; ++i)
+			values[i] = pixels[i][c];
+		EncodeBc4SnormBlock(values, block + 8 * c);
+	}
+}
+
+auto DecodeBc5SnormBlock(uint8_t const block[16], float pixels[16][2]) -> void
+{
+	for (uint32_t c = 0; c < 2; ++c)
+	{
+		float values[16];
+		DecodeBc4SnormBlock(block + 8 * c, values);
+		for (uint32_t i = 0; i < 16; ++i)
+			pixels[i][c] = values[i];
+	}
+}
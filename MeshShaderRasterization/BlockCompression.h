@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU encoders (and reference decoders) for the BC formats used by geometry images, one 4x4 block at a time
+// callers spread blocks over threads, the encoders use SSE2 within a block (best palette entry for 4 texels at once)
+// pixels are 16 texels in row order, blocks crossing an image edge should replicate the edge texels
+
+const uint32_t bcBlockSize = 4; // texels per side
+
+// BC1 without alpha: 565 endpoints, 2 bit indices (8 bytes)
+auto EncodeBc1Block(uint32_t const pixels[16], uint8_t block[8]) -> void;
+auto DecodeBc1Block(uint8_t const block[8], uint32_t pixels[16]) -> void;
+
+// BC7 mode 6 only: one subset, RGBA 7777 endpoints with a p bit each, 4 bit indices (16 bytes)
+// mode 6 alone is what fast BC7 encoders fall back on for smooth content, which geometry image albedo mostly is
+auto EncodeBc7Block(uint32_t const pixels[16], uint8_t block[16]) -> void;
+// only decodes mode 6, the one EncodeBc7Block writes (other modes decode to 0)
+auto DecodeBc7Block(uint8_t const block[16], uint32_t pixels[16]) -> void;
+
+// BC5 snorm: two BC4 channels with 8 bit endpoints and 3 bit indices (16 bytes), values are in [-1, 1]
+auto EncodeBc5SnormBlock(float const pixels[16][2], uint8_t block[16]) -> void;
+auto DecodeBc5SnormBlock(uint8_t const block[16], float pixels[16][2]) -> void;
@@ -0,0 +1,389 @@
+#include "DepthAtomicBenchmark.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <string>
+
+const uint32_t DepthAtomicBenchmark::footprintSizes[DepthAtomicBenchmark::footprintCount] = { 8, 32, 128 };
+
+namespace
+{
+	const uint32_t atomicsPerInvocation = 16; // depth_atomic_benchmark.glsl
+	const uint32_t workgroupSize = 64;
+	const uint32_t dispatchSize = 256;        // workgroups per side, 64M atomics per dispatch
+	const uint32_t runCount = 3;              // the best one is kept
+}
+
+DepthAtomicBenchmark::DepthAtomicBenchmark()
+	: m_device(VK_NULL_HANDLE)
+	, m_queue(VK_NULL_HANDLE)
+	, m_allocator(VK_NULL_HANDLE)
+	, m_timestampPeriod(1)
+	, m_commandPool(VK_NULL_HANDLE)
+	, m_commandBuffer(VK_NULL_HANDLE)
+	, m_completed(VK_NULL_HANDLE)
+	, m_timestampQueryPool(VK_NULL_HANDLE)
+	, m_depthImage(VK_NULL_HANDLE)
+	, m_depthImageAllocation(VK_NULL_HANDLE)
+	, m_depthImageView(VK_NULL_HANDLE)
+	, m_tiledDepthBuffer(VK_NULL_HANDLE)
+	, m_tiledDepthAllocation(VK_NULL_HANDLE)
+	, m_resourcesLayout(VK_NULL_HANDLE)
+	, m_pipelineLayout(VK_NULL_HANDLE)
+	, m_pipelines{ VK_NULL_HANDLE, VK_NULL_HANDLE }
+{
+}
+
+DepthAtomicBenchmark::~DepthAtomicBenchmark()
+{
+	Uninitialize();
+}
+
+auto DepthAtomicBenchmark::Initialize(InstanceDeviceAndSwapchain const& device) -> bool
+{
+	VkResult result;
+
+	m_device = device.GetDevice();
+	m_queue = device.GetQueue();
+	m_allocator = device.GetAllocator();
+	m_timestampPeriod = device.GetTimestampPeriod();
+
+	{
+		VkCommandPoolCreateInfo commandPoolCreateInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		commandPoolCreateInfo.queueFamilyIndex = device.GetQueueFamily();
+		result = vkCreateCommandPool(m_device, &commandPoolCreateInfo, nullptr, &m_commandPool);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark command pool");
+
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+		commandBufferAllocateInfo.commandPool = m_commandPool;
+		commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferAllocateInfo.commandBufferCount = 1;
+		result = vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, &m_commandBuffer);
+		CHECK_ERROR_AND_RETURN("could not allocate depth atomic benchmark command buffer");
+
+		VkFenceCreateInfo fenceCreateInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+		fenceCreateInfo.flags = 0;
+		result = vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_completed);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark fence");
+
+		VkQueryPoolCreateInfo queryPoolCreateInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, nullptr };
+		queryPoolCreateInfo.flags = 0;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = Layout_Count * footprintCount * 2;
+		queryPoolCreateInfo.pipelineStatistics = 0;
+		result = vkCreateQueryPool(m_device, &queryPoolCreateInfo, nullptr, &m_timestampQueryPool);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark timestamp query pool");
+	}
+
+	{
+		VmaAllocationCreateInfo allocationCreateInfo;
+		allocationCreateInfo.flags = 0;
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		allocationCreateInfo.requiredFlags = 0;
+		allocationCreateInfo.preferredFlags = 0;
+		allocationCreateInfo.memoryTypeBits = 0;
+		allocationCreateInfo.pool = VK_NULL_HANDLE;
+		allocationCreateInfo.pUserData = nullptr;
+
+		// as m_depthStorageBuffer of the render loop
+		VkImageCreateInfo imageCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
+		imageCreateInfo.flags = 0;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = VK_FORMAT_R32_UINT;
+		imageCreateInfo.extent.width = width;
+		imageCreateInfo.extent.height = height;
+		imageCreateInfo.extent.depth = 1;
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.queueFamilyIndexCount = 0;
+		imageCreateInfo.pQueueFamilyIndices = nullptr;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		result = vmaCreateImage(m_allocator, &imageCreateInfo, &allocationCreateInfo, &m_depthImage, &m_depthImageAllocation, nullptr);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark image");
+
+		VkImageViewCreateInfo imageViewCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, nullptr };
+		imageViewCreateInfo.flags = 0;
+		imageViewCreateInfo.image = m_depthImage;
+		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCreateInfo.format = VK_FORMAT_R32_UINT;
+		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+		imageViewCreateInfo.subresourceRange.levelCount = 1;
+		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		imageViewCreateInfo.subresourceRange.layerCount = 1;
+		result = vkCreateImageView(m_device, &imageViewCreateInfo, nullptr, &m_depthImageView);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark image view");
+
+		// as m_tiledDepthBuffer of the render loop
+		VkBufferCreateInfo bufferCreateInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+		bufferCreateInfo.flags = 0;
+		bufferCreateInfo.size = tiledDepthTileCount * sizeof(uint32_t) + tiledDepthTileCount * 64 * sizeof(uint32_t);
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+		result = vmaCreateBuffer(m_allocator, &bufferCreateInfo, &allocationCreateInfo, &m_tiledDepthBuffer, &m_tiledDepthAllocation, nullptr);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark buffer");
+	}
+
+	{
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[2];
+		descriptorSetLayoutBinding[0].binding = 0;
+		descriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorSetLayoutBinding[0].descriptorCount = 1;
+		descriptorSetLayoutBinding[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[0].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[1].binding = 1;
+		descriptorSetLayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[1].descriptorCount = 1;
+		descriptorSetLayoutBinding[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[1].pImmutableSamplers = nullptr;
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
+		descriptorSetLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		descriptorSetLayoutCreateInfo.bindingCount = uint32_t(std::size(descriptorSetLayoutBinding));
+		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBinding;
+		result = vkCreateDescriptorSetLayout(m_device, &descriptorSetLayoutCreateInfo, nullptr, &m_resourcesLayout);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark descriptor set layout");
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(BenchmarkConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
+		pipelineLayoutCreateInfo.flags = 0;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &m_resourcesLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		result = vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark pipeline layout");
+	}
+
+	// the layout of the render loop, for the shader
+	std::string screenWidthDefine = "SCREEN_WIDTH=" + std::to_string(width);
+	std::string screenHeightDefine = "SCREEN_HEIGHT=" + std::to_string(height);
+	std::string tiledDepthBlocksPerRowDefine = "TILED_DEPTH_BLOCKS_PER_ROW=" + std::to_string(tiledDepthBlocksPerRow);
+	std::string tiledDepthTileCountDefine = "TILED_DEPTH_TILE_COUNT=" + std::to_string(tiledDepthTileCount);
+	for (uint32_t layout = 0; layout < Layout_Count; ++layout)
+	{
+		if (!m_shaders[layout].Initialize(m_device, "shaders/depth_atomic_benchmark.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {layout == Layout_Tiled ? "TILED_DEPTH=1" : "TILED_DEPTH=0",
+		                                  screenWidthDefine.c_str(), screenHeightDefine.c_str(), tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str()}))
+			return false;
+
+		VkComputePipelineCreateInfo computePipelineInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+		computePipelineInfo.flags = 0;
+		computePipelineInfo.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+		computePipelineInfo.stage.flags = 0;
+		computePipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineInfo.stage.module = m_shaders[layout].GetShaderModule();
+		computePipelineInfo.stage.pName = "main";
+		computePipelineInfo.stage.pSpecializationInfo = nullptr;
+		computePipelineInfo.layout = m_pipelineLayout;
+		computePipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		computePipelineInfo.basePipelineIndex = 0;
+		result = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &m_pipelines[layout]);
+		CHECK_ERROR_AND_RETURN("could not create depth atomic benchmark pipeline");
+	}
+
+	return true;
+}
+
+auto DepthAtomicBenchmark::Uninitialize() -> void
+{
+	if (m_device == VK_NULL_HANDLE)
+		return;
+
+	vkDeviceWaitIdle(m_device);
+
+	for (uint32_t layout = 0; layout < Layout_Count; ++layout)
+	{
+		vkDestroyPipeline(m_device, m_pipelines[layout], nullptr);
+		m_shaders[layout].Unitialize(m_device);
+		m_pipelines[layout] = VK_NULL_HANDLE;
+	}
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_resourcesLayout, nullptr);
+
+	vkDestroyImageView(m_device, m_depthImageView, nullptr);
+	vmaDestroyImage(m_allocator, m_depthImage, m_depthImageAllocation);
+	vmaDestroyBuffer(m_allocator, m_tiledDepthBuffer, m_tiledDepthAllocation);
+
+	vkDestroyQueryPool(m_device, m_timestampQueryPool, nullptr);
+	vkDestroyFence(m_device, m_completed, nullptr);
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_resourcesLayout = VK_NULL_HANDLE;
+	m_depthImageView = VK_NULL_HANDLE;
+	m_depthImage = VK_NULL_HANDLE;
+	m_depthImageAllocation = VK_NULL_HANDLE;
+	m_tiledDepthBuffer = VK_NULL_HANDLE;
+	m_tiledDepthAllocation = VK_NULL_HANDLE;
+	m_timestampQueryPool = VK_NULL_HANDLE;
+	m_completed = VK_NULL_HANDLE;
+	m_commandBuffer = VK_NULL_HANDLE;
+	m_commandPool = VK_NULL_HANDLE;
+	m_device = VK_NULL_HANDLE;
+}
+
+auto DepthAtomicBenchmark::Run() -> bool
+{
+	VkResult result;
+
+	double bestSeconds[Layout_Count][footprintCount];
+	std::fill_n(&bestSeconds[0][0], Layout_Count * footprintCount, 1e30);
+
+	for (uint32_t run = 0; run < runCount; ++run)
+	{
+		result = vkResetCommandBuffer(m_commandBuffer, 0);
+		CHECK_ERROR_AND_RETURN("could not reset depth atomic benchmark command buffer");
+
+		VkCommandBufferBeginInfo commandBufferBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		commandBufferBeginInfo.pInheritanceInfo = nullptr;
+		result = vkBeginCommandBuffer(m_commandBuffer, &commandBufferBeginInfo);
+		CHECK_ERROR_AND_RETURN("could not begin depth atomic benchmark command buffer");
+
+		vkCmdResetQueryPool(m_commandBuffer, m_timestampQueryPool, 0, Layout_Count * footprintCount * 2);
+
+		// both start at the farthest depth, as after the clear of a frame
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.image = m_depthImage;
+			imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+			imageMemoryBarrier.subresourceRange.levelCount = 1;
+			imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+			imageMemoryBarrier.subresourceRange.layerCount = 1;
+			vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+			VkClearColorValue clearColor;
+			clearColor.float32[0] = 1;
+			clearColor.float32[1] = 1;
+			clearColor.float32[2] = 1;
+			clearColor.float32[3] = 1;
+			vkCmdClearColorImage(m_commandBuffer, m_depthImage, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &imageMemoryBarrier.subresourceRange);
+			vkCmdFillBuffer(m_commandBuffer, m_tiledDepthBuffer, 0, VK_WHOLE_SIZE, 0x3f800000);
+
+			VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		VkDescriptorImageInfo imageInfo;
+		imageInfo.sampler = VK_NULL_HANDLE;
+		imageInfo.imageView = m_depthImageView;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorBufferInfo bufferInfo;
+		bufferInfo.buffer = m_tiledDepthBuffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet writeDescriptorSets[2];
+		for (uint32_t i = 0; i < std::size(writeDescriptorSets); ++i)
+		{
+			writeDescriptorSets[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+			writeDescriptorSets[i].dstSet = VK_NULL_HANDLE;
+			writeDescriptorSets[i].dstBinding = i;
+			writeDescriptorSets[i].dstArrayElement = 0;
+			writeDescriptorSets[i].descriptorCount = 1;
+			writeDescriptorSets[i].pTexelBufferView = nullptr;
+		}
+		writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeDescriptorSets[0].pImageInfo = &imageInfo;
+		writeDescriptorSets[0].pBufferInfo = nullptr;
+		writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[1].pImageInfo = nullptr;
+		writeDescriptorSets[1].pBufferInfo = &bufferInfo;
+
+		for (uint32_t layout = 0; layout < Layout_Count; ++layout)
+		{
+			vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[layout]);
+			vkCmdPushDescriptorSetKHR(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, uint32_t(std::size(writeDescriptorSets)), writeDescriptorSets);
+
+			for (uint32_t footprint = 0; footprint < footprintCount; ++footprint)
+			{
+				BenchmarkConstants benchmarkConstants;
+				benchmarkConstants.footprintSize = footprintSizes[footprint];
+				benchmarkConstants.seed = run * 0x9e3779b9;
+				vkCmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(benchmarkConstants), &benchmarkConstants);
+
+				// one dispatch at a time, so that each is timed alone
+				VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+				uint32_t query = (layout * footprintCount + footprint) * 2;
+				vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampQueryPool, query);
+				vkCmdDispatch(m_commandBuffer, dispatchSize, dispatchSize, 1);
+				vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, query + 1);
+			}
+		}
+
+		result = vkEndCommandBuffer(m_commandBuffer);
+		CHECK_ERROR_AND_RETURN("could not end depth atomic benchmark command buffer");
+
+		VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+		submitInfo.waitSemaphoreCount = 0;
+		submitInfo.pWaitSemaphores = nullptr;
+		submitInfo.pWaitDstStageMask = nullptr;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &m_commandBuffer;
+		submitInfo.signalSemaphoreCount = 0;
+		submitInfo.pSignalSemaphores = nullptr;
+		result = vkQueueSubmit(m_queue, 1, &submitInfo, m_completed);
+		CHECK_ERROR_AND_RETURN("could not submit depth atomic benchmark");
+
+		result = vkWaitForFences(m_device, 1, &m_completed, VK_TRUE, UINT64_MAX);
+		CHECK_ERROR_AND_RETURN("could not wait for depth atomic benchmark fence");
+		result = vkResetFences(m_device, 1, &m_completed);
+		CHECK_ERROR_AND_RETURN("could not reset depth atomic benchmark fence");
+
+		uint64_t timestamps[Layout_Count * footprintCount * 2];
+		result = vkGetQueryPoolResults(m_device, m_timestampQueryPool, 0, uint32_t(std::size(timestamps)), sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		CHECK_ERROR_AND_RETURN("could not read depth atomic benchmark timestamps");
+
+		for (uint32_t layout = 0; layout < Layout_Count; ++layout)
+		{
+			for (uint32_t footprint = 0; footprint < footprintCount; ++footprint)
+			{
+				uint32_t query = (layout * footprintCount + footprint) * 2;
+				double seconds = double(timestamps[query + 1] - timestamps[query]) * m_timestampPeriod * 1e-9;
+				bestSeconds[layout][footprint] = std::min(bestSeconds[layout][footprint], seconds);
+			}
+		}
+	}
+
+	double atomicCount = double(dispatchSize) * dispatchSize * workgroupSize * atomicsPerInvocation;
+	std::cout << "depth atomics of " << width << "x" << height << ", " << atomicCount / 1e6 << "M per dispatch, best of " << runCount << " runs" << std::endl;
+	for (uint32_t footprint = 0; footprint < footprintCount; ++footprint)
+	{
+		double imageRate = atomicCount / bestSeconds[Layout_Image][footprint] * 1e-9;
+		double tiledRate = atomicCount / bestSeconds[Layout_Tiled][footprint] * 1e-9;
+		std::cout << std::fixed << std::setprecision(2)
+			<< footprintSizes[footprint] << "x" << footprintSizes[footprint] << " footprints: image " << imageRate << " Gatomics/s, tiled buffer "
+			<< tiledRate << " Gatomics/s (x" << tiledRate / imageRate << ")" << std::endl;
+	}
+
+	return true;
+}
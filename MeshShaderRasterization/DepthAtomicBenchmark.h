@@ -0,0 +1,59 @@
+#pragma once
+
+#include "InstanceDeviceAndSwapchain.h"
+#include "ShaderModule.h"
+#include "MeshShadingRenderLoop.h"
+
+// throughput of the depth atomics of the software rasterizer, in the R32_UINT image and in the tiled buffer
+// (MeshShadingRenderLoop::SetTiledDepth), both 3840x2160: each workgroup scatters atomics in a footprint of 8, 32 or 128 pixels
+// across, as a mesh shader tile does, at a random place of the screen (depth_atomic_benchmark.glsl)
+class DepthAtomicBenchmark
+{
+public:
+	DepthAtomicBenchmark();
+	~DepthAtomicBenchmark();
+
+	auto Initialize(InstanceDeviceAndSwapchain const& device) -> bool;
+	auto Uninitialize() -> void;
+
+	// times every layout and footprint a few times and prints the best atomics per second of each
+	auto Run() -> bool;
+
+	static const uint32_t width = MeshShadingRenderLoop::maxWidth;
+	static const uint32_t height = MeshShadingRenderLoop::maxHeight;
+	static const uint32_t footprintCount = 3;
+	static const uint32_t footprintSizes[footprintCount];
+
+private:
+	enum Layout
+	{
+		Layout_Image,
+		Layout_Tiled,
+		Layout_Count
+	};
+
+	struct BenchmarkConstants
+	{
+		uint32_t footprintSize;
+		uint32_t seed;
+	};
+
+	VkDevice m_device;
+	VkQueue m_queue;
+	VmaAllocator m_allocator;
+	float m_timestampPeriod;
+
+	VkCommandPool m_commandPool;
+	VkCommandBuffer m_commandBuffer;
+	VkFence m_completed;
+	VkQueryPool m_timestampQueryPool; // before and after each dispatch
+
+	VkImage m_depthImage; VmaAllocation m_depthImageAllocation;
+	VkImageView m_depthImageView;
+	VkBuffer m_tiledDepthBuffer; VmaAllocation m_tiledDepthAllocation;
+
+	VkDescriptorSetLayout m_resourcesLayout; // push descriptors
+	VkPipelineLayout m_pipelineLayout;
+	ShaderModule m_shaders[Layout_Count];
+	VkPipeline m_pipelines[Layout_Count];
+};
@@ -0,0 +1,655 @@
+#include "GeometryImageEncoding.h"
+#include "BlockCompression.h"
+#include "GeometryImageMipChain.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const double pi = 3.14159265358979;
+
+	inline auto Quantize(float value, float scale) -> uint32_t
+	{
+		return uint32_t(std::clamp(value, 0.0f, 1.0f) * scale + 0.5f);
+	}
+
+	inline auto QuantizeSnorm(float value, float scale) -> int32_t
+	{
+		return int32_t(std::round(std::clamp(value, -1.0f, 1.0f) * scale));
+	}
+
+	inline auto DequantizeSnorm(int32_t value, float scale) -> float
+	{
+		return std::max(value / scale, -1.0f);
+	}
+
+	inline auto Normalize(float v[3]) -> void
+	{
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		float scale = length > 0 ? 1 / length : 0;
+		for (uint32_t k = 0; k < 3; ++k)
+			v[k] *= scale;
+	}
+
+	// unit vector to [-1, 1]^2: the upper half (z >= 0) is the inner diamond, the lower half is folded over its corners
+	inline auto EncodeOctahedral(float const n[3], float e[2]) -> void
+	{
+		float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+		float x = l1 > 0 ? n[0] / l1 : 0;
+		float y = l1 > 0 ? n[1] / l1 : 0;
+		if (n[2] < 0)
+		{
+			float foldedX = (1 - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+			float foldedY = (1 - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		e[0] = x;
+		e[1] = y;
+	}
+
+	// same as decodeNormal in test_ms.glsl
+	inline auto DecodeOctahedral(float const e[2], float n[3]) -> void
+	{
+		n[0] = e[0];
+		n[1] = e[1];
+		n[2] = 1 - std::fabs(e[0]) - std::fabs(e[1]);
+		float t = std::max(-n[2], 0.0f);
+		n[0] += n[0] >= 0 ? -t : t;
+		n[1] += n[1] >= 0 ? -t : t;
+		Normalize(n);
+	}
+
+	inline auto GetPositionBoundsExtent(float const boundsMin[3], float const boundsMax[3], float extent[3]) -> void
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+			extent[k] = boundsMax[k] - boundsMin[k];
+	}
+}
+
+auto GetGeometryImagePositionEncodingName(GeometryImagePositionEncoding encoding) -> char const*
+{
+	switch (encoding)
+	{
+	case GeometryImagePositionEncoding_Absolute10: return "absolute 10 bits";
+	case GeometryImagePositionEncoding_MegatileRelative10: return "megatile relative 10 bits";
+	case GeometryImagePositionEncoding_MegatileRelative16: return "megatile relative 16 bits";
+	default: return "unknown";
+	}
+}
+
+auto GetGeometryImageAlbedoEncodingName(GeometryImageAlbedoEncoding encoding) -> char const*
+{
+	switch (encoding)
+	{
+	case GeometryImageAlbedoEncoding_Rgba8: return "RGBA8";
+	case GeometryImageAlbedoEncoding_Bc1: return "BC1";
+	case GeometryImageAlbedoEncoding_Bc7: return "BC7";
+	default: return "unknown";
+	}
+}
+
+auto GetGeometryImageNormalEncodingName(GeometryImageNormalEncoding encoding) -> char const*
+{
+	switch (encoding)
+	{
+	case GeometryImageNormalEncoding_Xyz8: return "xyz 8 bits";
+	case GeometryImageNormalEncoding_Octahedral8: return "octahedral 8 bits";
+	case GeometryImageNormalEncoding_Octahedral16: return "octahedral 16 bits";
+	case GeometryImageNormalEncoding_OctahedralBc5: return "octahedral BC5";
+	default: return "unknown";
+	}
+}
+
+auto EncodeGeometryImagePosition(GeometryImagePositionEncoding encoding, float const position[3], float const boundsMin[3], float const boundsMax[3], void* texel) -> void
+{
+	float extent[3];
+	GetPositionBoundsExtent(boundsMin, boundsMax, extent);
+
+	float t[3];
+	for (uint32_t k = 0; k < 3; ++k)
+		t[k] = extent[k] > 0 ? (position[k] - boundsMin[k]) / extent[k] : 0;
+
+	if (encoding == GeometryImagePositionEncoding_MegatileRelative16)
+	{
+		uint16_t* texel16 = (uint16_t*)texel;
+		for (uint32_t k = 0; k < 3; ++k)
+			texel16[k] = uint16_t(Quantize(t[k], 65535.0f));
+		texel16[3] = 0;
+		return;
+	}
+
+	*(uint32_t*)texel = (Quantize(t[0], 1023.0f) << 0)
+	                  | (Quantize(t[1], 1023.0f) << 10)
+	                  | (Quantize(t[2], 1023.0f) << 20)
+	                  ;
+}
+
+auto DecodeGeometryImagePosition(GeometryImagePositionEncoding encoding, void const* texel, float const boundsMin[3], float const boundsMax[3], float position[3]) -> void
+{
+	float extent[3];
+	GetPositionBoundsExtent(boundsMin, boundsMax, extent);
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		float t;
+		if (encoding == GeometryImagePositionEncoding_MegatileRelative16)
+			t = ((uint16_t const*)texel)[k] / 65535.0f;
+		else
+			t = ((*(uint32_t const*)texel >> (10 * k)) & 0x3ff) / 1023.0f;
+		position[k] = t * extent[k] + boundsMin[k];
+	}
+}
+
+auto EncodeGeometryImageNormal(GeometryImageNormalEncoding encoding, float const normal[3], void* texel) -> void
+{
+	if (encoding == GeometryImageNormalEncoding_Xyz8)
+	{
+		*(uint32_t*)texel = (Quantize(normal[0] / 2 + 0.5f, 255.0f) << 0)
+		                  | (Quantize(normal[1] / 2 + 0.5f, 255.0f) << 8)
+		                  | (Quantize(normal[2] / 2 + 0.5f, 255.0f) << 16)
+		                  ;
+		return;
+	}
+
+	float e[2];
+	EncodeOctahedral(normal, e);
+
+	if (encoding == GeometryImageNormalEncoding_Octahedral16)
+	{
+		int16_t* texel16 = (int16_t*)texel;
+		texel16[0] = int16_t(QuantizeSnorm(e[0], 32767.0f));
+		texel16[1] = int16_t(QuantizeSnorm(e[1], 32767.0f));
+		return;
+	}
+
+	// at 8 bits, rounding each coordinate on its own is noticeably worse than the best of the 4 surrounding codes
+	int32_t base[2] = { int32_t(std::floor(std::clamp(e[0], -1.0f, 1.0f) * 127)), int32_t(std::floor(std::clamp(e[1], -1.0f, 1.0f) * 127)) };
+	int32_t best[2] = { base[0], base[1] };
+	float bestCosine = -2;
+	for (int32_t dy = 0; dy < 2; ++dy)
+	{
+		for (int32_t dx = 0; dx < 2; ++dx)
+		{
+			int32_t code[2] = { std::min(base[0] + dx, 127), std::min(base[1] + dy, 127) };
+			float decodedE[2] = { DequantizeSnorm(code[0], 127.0f), DequantizeSnorm(code[1], 127.0f) };
+			float decoded[3];
+			DecodeOctahedral(decodedE, decoded);
+
+			float cosine = decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2];
+			if (cosine > bestCosine)
+			{
+				bestCosine = cosine;
+				best[0] = code[0];
+				best[1] = code[1];
+			}
+		}
+	}
+
+	int8_t* texel8 = (int8_t*)texel;
+	texel8[0] = int8_t(best[0]);
+	texel8[1] = int8_t(best[1]);
+}
+
+auto DecodeGeometryImageNormal(GeometryImageNormalEncoding encoding, void const* texel, float normal[3]) -> void
+{
+	if (encoding == GeometryImageNormalEncoding_Xyz8)
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+			normal[k] = ((*(uint32_t const*)texel >> (8 * k)) & 0xff) / 255.0f * 2 - 1;
+		Normalize(normal);
+		return;
+	}
+
+	float e[2];
+	if (encoding == GeometryImageNormalEncoding_Octahedral16)
+	{
+		e[0] = DequantizeSnorm(((int16_t const*)texel)[0], 32767.0f);
+		e[1] = DequantizeSnorm(((int16_t const*)texel)[1], 32767.0f);
+	}
+	else
+	{
+		e[0] = DequantizeSnorm(((int8_t const*)texel)[0], 127.0f);
+		e[1] = DequantizeSnorm(((int8_t const*)texel)[1], 127.0f);
+	}
+	DecodeOctahedral(e, normal);
+}
+
+auto GeometryImageEncodingError::GetPositionRmsError() const -> double
+{
+	return m_texelCount > 0 ? std::sqrt(m_positionSquaredErrorSum / m_texelCount) : 0;
+}
+
+auto GeometryImageEncodingError::GetNormalMeanAngle() const -> double
+{
+	return m_texelCount > 0 ? m_normalAngleSum / m_texelCount : 0;
+}
+
+auto GeometryImageEncodingError::GetAlbedoPsnr() const -> double
+{
+	double meanSquaredError = m_texelCount > 0 ? m_albedoSquaredErrorSum / (4 * m_texelCount) : 0;
+	return meanSquaredError > 0 ? 10 * std::log10(255 * 255 / meanSquaredError) : INFINITY;
+}
+
+namespace
+{
+	// gathers the 4x4 block at (blockX, blockY) of a width x height image, replicating the edge texels past the right and bottom edges
+	template<typename Texel, typename Gather>
+	inline auto GatherBlock(uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Texel block[16], Gather gather) -> void
+	{
+		for (uint32_t j = 0; j < bcBlockSize; ++j)
+		{
+			uint32_t y = std::min(blockY * bcBlockSize + j, height - 1);
+			for (uint32_t i = 0; i < bcBlockSize; ++i)
+				gather(std::min(blockX * bcBlockSize + i, width - 1), y, block[j * bcBlockSize + i]);
+		}
+	}
+
+	// albedo rows are stride texels apart, planes are tightly packed (blocks in row order for block compressed encodings)
+	auto EncodeAlbedoPlane(GeometryImageAlbedoEncoding encoding, uint32_t const* albedo, size_t stride, uint32_t width, uint32_t height, uint8_t* plane) -> void
+	{
+		if (encoding == GeometryImageAlbedoEncoding_Rgba8)
+		{
+			for (uint32_t y = 0; y < height; ++y)
+				std::memcpy(plane + size_t(y) * width * sizeof(uint32_t), albedo + y * stride, width * sizeof(uint32_t));
+			return;
+		}
+
+		const uint32_t blockSize = GetGeometryImageFormatBlockSize(GetGeometryImageAlbedoFormat(encoding));
+		const uint32_t blocksPerRow = (width + bcBlockSize - 1) / bcBlockSize;
+		const uint32_t blocksPerColumn = (height + bcBlockSize - 1) / bcBlockSize;
+		for (uint32_t blockY = 0; blockY < blocksPerColumn; ++blockY)
+		{
+			for (uint32_t blockX = 0; blockX < blocksPerRow; ++blockX)
+			{
+				uint32_t pixels[16];
+				GatherBlock(width, height, blockX, blockY, pixels, [&](uint32_t x, uint32_t y, uint32_t& pixel) { pixel = albedo[y * stride + x]; });
+
+				uint8_t* block = plane + (size_t(blockY) * blocksPerRow + blockX) * blockSize;
+				if (encoding == GeometryImageAlbedoEncoding_Bc1)
+					EncodeBc1Block(pixels, block);
+				else
+					EncodeBc7Block(pixels, block);
+			}
+		}
+	}
+
+	auto DecodeAlbedoPlane(GeometryImageAlbedoEncoding encoding, uint8_t const* plane, uint32_t width, uint32_t height, uint32_t* albedo) -> void
+	{
+		if (encoding == GeometryImageAlbedoEncoding_Rgba8)
+		{
+			std::memcpy(albedo, plane, size_t(width) * height * sizeof(uint32_t));
+			return;
+		}
+
+		const uint32_t blockSize = GetGeometryImageFormatBlockSize(GetGeometryImageAlbedoFormat(encoding));
+		const uint32_t blocksPerRow = (width + bcBlockSize - 1) / bcBlockSize;
+		for (uint32_t y = 0; y < height; y += bcBlockSize)
+		{
+			for (uint32_t x = 0; x < width; x += bcBlockSize)
+			{
+				uint8_t const* block = plane + (size_t(y / bcBlockSize) * blocksPerRow + x / bcBlockSize) * blockSize;
+				uint32_t pixels[16];
+				if (encoding == GeometryImageAlbedoEncoding_Bc1)
+					DecodeBc1Block(block, pixels);
+				else
+					DecodeBc7Block(block, pixels);
+
+				for (uint32_t j = 0; j < bcBlockSize && y + j < height; ++j)
+				{
+					for (uint32_t i = 0; i < bcBlockSize && x + i < width; ++i)
+						albedo[size_t(y + j) * width + x + i] = pixels[j * bcBlockSize + i];
+				}
+			}
+		}
+	}
+
+	// normal rows are 3 * stride floats apart
+	auto EncodeNormalPlane(GeometryImageNormalEncoding encoding, float const* normal, size_t stride, uint32_t width, uint32_t height, uint8_t* plane) -> void
+	{
+		if (encoding != GeometryImageNormalEncoding_OctahedralBc5)
+		{
+			const uint32_t texelSize = GetGeometryImageFormatTexelSize(GetGeometryImageNormalFormat(encoding));
+			for (uint32_t y = 0; y < height; ++y)
+			{
+				for (uint32_t x = 0; x < width; ++x)
+					EncodeGeometryImageNormal(encoding, normal + 3 * (y * stride + x), plane + (size_t(y) * width + x) * texelSize);
+			}
+			return;
+		}
+
+		const uint32_t blockSize = GetGeometryImageFormatBlockSize(GeometryImageFormat_BC5Snorm);
+		const uint32_t blocksPerRow = (width + bcBlockSize - 1) / bcBlockSize;
+		const uint32_t blocksPerColumn = (height + bcBlockSize - 1) / bcBlockSize;
+		for (uint32_t blockY = 0; blockY < blocksPerColumn; ++blockY)
+		{
+			for (uint32_t blockX = 0; blockX < blocksPerRow; ++blockX)
+			{
+				float pixels[16][2];
+				GatherBlock(width, height, blockX, blockY, pixels, [&](uint32_t x, uint32_t y, float (&pixel)[2]) { EncodeOctahedral(normal + 3 * (y * stride + x), pixel); });
+				EncodeBc5SnormBlock(pixels, plane + (size_t(blockY) * blocksPerRow + blockX) * blockSize);
+			}
+		}
+	}
+
+	// normals are tightly packed
+	auto DecodeNormalPlane(GeometryImageNormalEncoding encoding, uint8_t const* plane, uint32_t width, uint32_t height, float* normal) -> void
+	{
+		if (encoding != GeometryImageNormalEncoding_OctahedralBc5)
+		{
+			const uint32_t texelSize = GetGeometryImageFormatTexelSize(GetGeometryImageNormalFormat(encoding));
+			for (size_t i = 0; i < size_t(width) * height; ++i)
+				DecodeGeometryImageNormal(encoding, plane + i * texelSize, normal + 3 * i);
+			return;
+		}
+
+		const uint32_t blockSize = GetGeometryImageFormatBlockSize(GeometryImageFormat_BC5Snorm);
+		const uint32_t blocksPerRow = (width + bcBlockSize - 1) / bcBlockSize;
+		for (uint32_t y = 0; y < height; y += bcBlockSize)
+		{
+			for (uint32_t x = 0; x < width; x += bcBlockSize)
+			{
+				float pixels[16][2];
+				DecodeBc5SnormBlock(plane + (size_t(y / bcBlockSize) * blocksPerRow + x / bcBlockSize) * blockSize, pixels);
+
+				for (uint32_t j = 0; j < bcBlockSize && y + j < height; ++j)
+				{
+					for (uint32_t i = 0; i < bcBlockSize && x + i < width; ++i)
+						DecodeOctahedral(pixels[j * bcBlockSize + i], normal + 3 * (size_t(y + j) * width + x + i));
+				}
+			}
+		}
+	}
+}
+
+GeometryImageEncoder::GeometryImageEncoder(uint32_t size, uint32_t mipCount, GeometryImagePositionEncoding positionEncoding, GeometryImageAlbedoEncoding albedoEncoding,
+	GeometryImageNormalEncoding normalEncoding, float const positionBoundsMin[3], float const positionBoundsMax[3], MegatilesCallback callback, uint32_t threadCount)
+	: m_size(size)
+	, m_positionEncoding(positionEncoding)
+	, m_albedoEncoding(albedoEncoding)
+	, m_normalEncoding(normalEncoding)
+	, m_formats{ GetGeometryImagePositionFormat(positionEncoding), GetGeometryImageAlbedoFormat(albedoEncoding), GetGeometryImageNormalFormat(normalEncoding) }
+	, m_callback(std::move(callback))
+	, m_threadCount(threadCount)
+	, m_measureError(false)
+	, m_error{}
+	, m_pendingRows(mipCount)
+{
+	// decoded positions are off by up to half a quantization step, and megatiles never span more than the mesh
+	const float quantizationSteps = positionEncoding == GeometryImagePositionEncoding_MegatileRelative16 ? 65535.0f : 1023.0f;
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		m_positionBoundsMin[k] = positionBoundsMin[k];
+		m_positionBoundsMax[k] = positionBoundsMax[k];
+		m_boundsPadding[k] = (positionBoundsMax[k] - positionBoundsMin[k]) / quantizationSteps / 2;
+	}
+
+	uint32_t megatileCount = 0;
+	uint32_t borderVertexCount = 0;
+	for (uint32_t mip = 0; mip < mipCount; ++mip)
+	{
+		uint32_t mipSize = GetGeometryImageMipSize(size, mip);
+		size_t texelCount = size_t(std::min(mipSize, geometryImageMegatileSize)) * (mipSize + 1);
+		m_pendingRows[mip].m_position.resize(texelCount * 3);
+		m_pendingRows[mip].m_albedo.resize(texelCount);
+		m_pendingRows[mip].m_normal.resize(texelCount * 3);
+		m_pendingRows[mip].m_seamPosition.resize(size_t(2) * (mipSize + 1) * 3);
+		m_pendingRows[mip].m_firstRow = 0;
+		m_pendingRows[mip].m_rowCount = 0;
+
+		uint32_t megatilesPerRow = (mipSize + geometryImageMegatileSize - 1) / geometryImageMegatileSize;
+		m_boundsMipOffsets.push_back(megatileCount);
+		megatileCount += megatilesPerRow * megatilesPerRow;
+
+		m_borderMipOffsets.push_back(borderVertexCount);
+		borderVertexCount += 4 * mipSize;
+	}
+	m_bounds.assign(megatileCount, {});
+	m_borderVertices.assign(borderVertexCount, {});
+}
+
+auto GeometryImageEncoder::PushRows(uint32_t mip, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal) -> void
+{
+	const uint32_t mipSize = GetGeometryImageMipSize(m_size, mip);
+	const uint32_t width = mipSize + 1;
+	const uint32_t megatileRows = std::min(mipSize, geometryImageMegatileSize);
+
+	PendingMegatileRow& pending = m_pendingRows[mip];
+
+	uint32_t row = 0;
+	while (row < rowCount)
+	{
+		size_t sourceOffset = size_t(row) * width;
+
+		// the last row of the mip belongs to no megatile: it closes the bounds of the last row of megatiles, and the border
+		if (pending.m_firstRow == mipSize)
+		{
+			const uint32_t megatileCount = (mipSize + geometryImageMegatileSize - 1) / geometryImageMegatileSize;
+			float* seam = pending.m_seamPosition.data();
+			std::memcpy(seam + 3 * size_t(width), position + 3 * sourceOffset, size_t(width) * 3 * sizeof(float));
+			for (uint32_t x = 0; x < megatileCount; ++x)
+			{
+				const uint32_t firstColumn = x * geometryImageMegatileSize;
+				ExtendMegatileBounds(seam + 3 * firstColumn, std::min(geometryImageMegatileSize, mipSize - firstColumn) + 1, 2, width, m_boundsPadding,
+					m_bounds[m_boundsMipOffsets[mip] + (megatileCount - 1) * megatileCount + x]);
+			}
+
+			StoreBorderVertices(mip, mipSize, position + 3 * sourceOffset, albedo + sourceOffset, normal + 3 * sourceOffset);
+			++pending.m_firstRow;
+			++row;
+			continue;
+		}
+
+		uint32_t copiedRows = std::min(rowCount - row, megatileRows - pending.m_rowCount);
+		size_t destinationOffset = size_t(pending.m_rowCount) * width;
+		size_t copiedTexels = size_t(copiedRows) * width;
+		std::memcpy(pending.m_position.data() + 3 * destinationOffset, position + 3 * sourceOffset, copiedTexels * 3 * sizeof(float));
+		std::memcpy(pending.m_albedo.data() + destinationOffset, albedo + sourceOffset, copiedTexels * sizeof(uint32_t));
+		std::memcpy(pending.m_normal.data() + 3 * destinationOffset, normal + 3 * sourceOffset, copiedTexels * 3 * sizeof(float));
+		pending.m_rowCount += copiedRows;
+		row += copiedRows;
+
+		if (pending.m_rowCount == megatileRows || pending.m_firstRow + pending.m_rowCount == mipSize)
+			EncodeMegatileRow(mip);
+	}
+}
+
+auto GeometryImageEncoder::StoreBorderVertices(uint32_t mip, uint32_t row, float const* position, uint32_t const* albedo, float const* normal) -> void
+{
+	const uint32_t mipSize = GetGeometryImageMipSize(m_size, mip);
+
+	// the whole first and last rows, the two ends of the others
+	const uint32_t step = row == 0 || row == mipSize ? 1 : mipSize;
+	for (uint32_t x = 0; x <= mipSize; x += step)
+	{
+		GeometryImageBorderVertex& vertex = m_borderVertices[m_borderMipOffsets[mip] + GetGeometryImageBorderVertexIndex(mipSize, x, row)];
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			vertex.position[k] = position[3 * x + k];
+			vertex.normal[k] = normal[3 * x + k];
+		}
+		vertex.albedo = albedo[x];
+		vertex.reserved = 0;
+	}
+}
+
+auto GeometryImageEncoder::EncodeMegatileRow(uint32_t mip) -> void
+{
+	const uint32_t mipSize = GetGeometryImageMipSize(m_size, mip);
+	const uint32_t width = mipSize + 1;
+	const uint32_t megatileCount = (mipSize + geometryImageMegatileSize - 1) / geometryImageMegatileSize;
+
+	PendingMegatileRow& pending = m_pendingRows[mip];
+
+	// sizes only depend on the layout, so every megatile knows where its payload goes before any is encoded
+	m_megatiles.resize(megatileCount);
+	uint64_t payloadSize = 0;
+	for (uint32_t x = 0; x < megatileCount; ++x)
+	{
+		GeometryImageFileMegatile& megatile = m_megatiles[x];
+		megatile = {};
+		megatile.x = uint16_t(x);
+		megatile.y = uint16_t(pending.m_firstRow / geometryImageMegatileSize);
+		megatile.mip = uint16_t(mip);
+		megatile.width = uint16_t(std::min(geometryImageMegatileSize, mipSize - x * geometryImageMegatileSize));
+		megatile.height = uint16_t(pending.m_rowCount);
+		for (uint32_t k = 0; k < 3; ++k)
+			megatile.payloadSize += GetGeometryImagePlaneSize(m_formats[k], megatile.width, megatile.height);
+		megatile.payloadOffset = payloadSize;
+		payloadSize += megatile.payloadSize;
+	}
+	m_payload.assign(payloadSize, 0);
+	m_megatileErrors.assign(megatileCount, {});
+
+	// the megatiles above read the first row of these ones
+	const uint32_t megatileRow = pending.m_firstRow / geometryImageMegatileSize;
+	float* seam = pending.m_seamPosition.data();
+	if (megatileRow > 0)
+		std::memcpy(seam + 3 * size_t(width), pending.m_position.data(), size_t(width) * 3 * sizeof(float));
+
+	for (uint32_t row = 0; row < pending.m_rowCount; ++row)
+	{
+		size_t offset = size_t(row) * width;
+		StoreBorderVertices(mip, pending.m_firstRow + row, &pending.m_position[3 * offset], &pending.m_albedo[offset], &pending.m_normal[3 * offset]);
+	}
+
+	ParallelFor(megatileCount, [&](uint32_t x)
+	{
+		GeometryImageFileMegatile& megatile = m_megatiles[x];
+		const uint32_t firstColumn = x * geometryImageMegatileSize;
+
+		if (m_positionEncoding == GeometryImagePositionEncoding_Absolute10)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				megatile.positionBoundsMin[k] = m_positionBoundsMin[k];
+				megatile.positionBoundsMax[k] = m_positionBoundsMax[k];
+			}
+		}
+		else
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				megatile.positionBoundsMin[k] = FLT_MAX;
+				megatile.positionBoundsMax[k] = -FLT_MAX;
+			}
+			for (uint32_t row = 0; row < megatile.height; ++row)
+			{
+				float const* position = pending.m_position.data() + 3 * (size_t(row) * width + firstColumn);
+				for (uint32_t j = 0; j < megatile.width; ++j)
+				{
+					for (uint32_t k = 0; k < 3; ++k)
+					{
+						megatile.positionBoundsMin[k] = std::min(megatile.positionBoundsMin[k], position[3 * j + k]);
+						megatile.positionBoundsMax[k] = std::max(megatile.positionBoundsMax[k], position[3 * j + k]);
+					}
+				}
+			}
+		}
+
+		// mesh workgroups also read the first column of the megatile on the right (the last column of the mip past the last megatile)
+		const uint32_t boundsWidth = megatile.width + 1;
+		ComputeMegatileBounds(&pending.m_position[3 * firstColumn], boundsWidth, megatile.height, width, m_boundsPadding,
+			m_bounds[m_boundsMipOffsets[mip] + megatileRow * megatileCount + x]);
+		if (megatileRow > 0)
+			ExtendMegatileBounds(seam + 3 * firstColumn, boundsWidth, 2, width, m_boundsPadding, m_bounds[m_boundsMipOffsets[mip] + (megatileRow - 1) * megatileCount + x]);
+
+		uint8_t* positionTexels = m_payload.data() + megatile.payloadOffset;
+		uint8_t* albedoTexels = positionTexels + GetGeometryImagePlaneSize(m_formats[0], megatile.width, megatile.height);
+		uint8_t* normalTexels = albedoTexels + GetGeometryImagePlaneSize(m_formats[1], megatile.width, megatile.height);
+		const uint32_t positionTexelSize = GetGeometryImageFormatTexelSize(m_formats[0]);
+
+		for (uint32_t row = 0; row < megatile.height; ++row)
+		{
+			size_t source = size_t(row) * width + firstColumn;
+			size_t destination = size_t(row) * megatile.width;
+
+			for (uint32_t j = 0; j < megatile.width; ++j)
+			{
+				EncodeGeometryImagePosition(m_positionEncoding, &pending.m_position[3 * (source + j)], megatile.positionBoundsMin, megatile.positionBoundsMax,
+					positionTexels + (destination + j) * positionTexelSize);
+			}
+		}
+		EncodeAlbedoPlane(m_albedoEncoding, &pending.m_albedo[firstColumn], width, megatile.width, megatile.height, albedoTexels);
+		EncodeNormalPlane(m_normalEncoding, &pending.m_normal[3 * firstColumn], width, megatile.width, megatile.height, normalTexels);
+
+		if (!m_measureError || mip != 0)
+			return;
+
+		std::vector<uint32_t> decodedAlbedos(size_t(megatile.width) * megatile.height);
+		std::vector<float> decodedNormals(size_t(megatile.width) * megatile.height * 3);
+		DecodeAlbedoPlane(m_albedoEncoding, albedoTexels, megatile.width, megatile.height, decodedAlbedos.data());
+		DecodeNormalPlane(m_normalEncoding, normalTexels, megatile.width, megatile.height, decodedNormals.data());
+
+		GeometryImageEncodingError& error = m_megatileErrors[x];
+		for (uint32_t row = 0; row < megatile.height; ++row)
+		{
+			size_t source = size_t(row) * width + firstColumn;
+			size_t destination = size_t(row) * megatile.width;
+
+			for (uint32_t j = 0; j < megatile.width; ++j)
+			{
+				float const* position = &pending.m_position[3 * (source + j)];
+				float const* normal = &pending.m_normal[3 * (source + j)];
+				uint32_t albedo = pending.m_albedo[source + j];
+
+				float decodedPosition[3];
+				float const* decodedNormal = &decodedNormals[3 * (destination + j)];
+				uint32_t decodedAlbedo = decodedAlbedos[destination + j];
+				DecodeGeometryImagePosition(m_positionEncoding, positionTexels + (destination + j) * positionTexelSize, megatile.positionBoundsMin, megatile.positionBoundsMax, decodedPosition);
+
+				double squaredError = 0;
+				double cosine = 0;
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					squaredError += double(decodedPosition[k] - position[k]) * (decodedPosition[k] - position[k]);
+					cosine += double(decodedNormal[k]) * normal[k];
+				}
+
+				// acos is too ill conditioned near 1 to measure 16 bit codes
+				double cross[3] =
+				{
+					double(decodedNormal[1]) * normal[2] - double(decodedNormal[2]) * normal[1],
+					double(decodedNormal[2]) * normal[0] - double(decodedNormal[0]) * normal[2],
+					double(decodedNormal[0]) * normal[1] - double(decodedNormal[1]) * normal[0],
+				};
+				double sine = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+				double angle = std::atan2(sine, cosine) * 180 / pi;
+
+				error.m_positionMaxError = std::max(error.m_positionMaxError, std::sqrt(squaredError));
+				error.m_positionSquaredErrorSum += squaredError;
+				error.m_normalMaxAngle = std::max(error.m_normalMaxAngle, angle);
+				error.m_normalAngleSum += angle;
+
+				for (uint32_t k = 0; k < 4; ++k)
+				{
+					double difference = double((decodedAlbedo >> (8 * k)) & 0xff) - double((albedo >> (8 * k)) & 0xff);
+					error.m_albedoMaxError = std::max(error.m_albedoMaxError, std::fabs(difference));
+					error.m_albedoSquaredErrorSum += difference * difference;
+				}
+				++error.m_texelCount;
+			}
+		}
+	}, m_threadCount);
+
+	for (GeometryImageEncodingError const& error : m_megatileErrors)
+	{
+		m_error.m_positionMaxError = std::max(m_error.m_positionMaxError, error.m_positionMaxError);
+		m_error.m_positionSquaredErrorSum += error.m_positionSquaredErrorSum;
+		m_error.m_normalMaxAngle = std::max(m_error.m_normalMaxAngle, error.m_normalMaxAngle);
+		m_error.m_normalAngleSum += error.m_normalAngleSum;
+		m_error.m_albedoMaxError = std::max(m_error.m_albedoMaxError, error.m_albedoMaxError);
+		m_error.m_albedoSquaredErrorSum += error.m_albedoSquaredErrorSum;
+		m_error.m_texelCount += error.m_texelCount;
+	}
+
+	m_callback(m_megatiles.data(), megatileCount, m_payload.data(), payloadSize);
+
+	std::memcpy(seam, pending.m_position.data() + 3 * size_t(pending.m_rowCount - 1) * width, size_t(width) * 3 * sizeof(float));
+	pending.m_firstRow += pending.m_rowCount;
+	pending.m_rowCount = 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "GeometryImageFile.h"
+#include "MegatileBounds.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// build time selection of the GPU encodings of geometry images (values of GeometryImagePositionEncoding, GeometryImageAlbedoEncoding and
+// GeometryImageNormalEncoding)
+// the mesh shader is compiled with the same values as POSITION_ENCODING and NORMAL_ENCODING, so the encoder and the decoder always agree
+// albedo needs no shader variant (block compressed views are sampled like the others), so files may use any albedo encoding
+//
+//   position                          bytes  precision
+//   0 absolute 10 bits                4      mesh extent / 1023
+//   1 megatile relative 10 bits       4      megatile extent / 1023
+//   2 megatile relative 16 bits       8      megatile extent / 65535
+//
+//   normal                            bytes
+//   0 xyz 8 bits                      4
+//   1 octahedral 8 bits               2
+//   2 octahedral 16 bits              4
+//   3 octahedral BC5                  1      needs textureCompressionBC
+//
+//   albedo                            bytes
+//   0 RGBA8                           4
+//   1 BC1                             0.5    needs textureCompressionBC, no alpha
+//   2 BC7                             1      needs textureCompressionBC
+//
+// run the renderer with -reportGeometryImageEncodings for the measured errors of every mode
+#ifndef GEOMETRY_IMAGE_POSITION_ENCODING
+#define GEOMETRY_IMAGE_POSITION_ENCODING 1
+#endif
+#ifndef GEOMETRY_IMAGE_ALBEDO_ENCODING
+#define GEOMETRY_IMAGE_ALBEDO_ENCODING 0
+#endif
+#ifndef GEOMETRY_IMAGE_NORMAL_ENCODING
+#define GEOMETRY_IMAGE_NORMAL_ENCODING 1
+#endif
+
+#define GEOMETRY_IMAGE_STRINGIFY_(x) #x
+#define GEOMETRY_IMAGE_STRINGIFY(x) GEOMETRY_IMAGE_STRINGIFY_(x)
+
+// shader defines matching the build time encodings
+#define GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE "POSITION_ENCODING=" GEOMETRY_IMAGE_STRINGIFY(GEOMETRY_IMAGE_POSITION_ENCODING)
+#define GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE "NORMAL_ENCODING=" GEOMETRY_IMAGE_STRINGIFY(GEOMETRY_IMAGE_NORMAL_ENCODING)
+
+const GeometryImagePositionEncoding geometryImagePositionEncoding = GeometryImagePositionEncoding(GEOMETRY_IMAGE_POSITION_ENCODING);
+const GeometryImageAlbedoEncoding geometryImageAlbedoEncoding = GeometryImageAlbedoEncoding(GEOMETRY_IMAGE_ALBEDO_ENCODING);
+const GeometryImageNormalEncoding geometryImageNormalEncoding = GeometryImageNormalEncoding(GEOMETRY_IMAGE_NORMAL_ENCODING);
+
+static_assert(geometryImagePositionEncoding < GeometryImagePositionEncoding_Count, "unknown GEOMETRY_IMAGE_POSITION_ENCODING");
+static_assert(geometryImageAlbedoEncoding < GeometryImageAlbedoEncoding_Count, "unknown GEOMETRY_IMAGE_ALBEDO_ENCODING");
+static_assert(geometryImageNormalEncoding < GeometryImageNormalEncoding_Count, "unknown GEOMETRY_IMAGE_NORMAL_ENCODING");
+
+auto GetGeometryImagePositionEncodingName(GeometryImagePositionEncoding encoding) -> char const*;
+auto GetGeometryImageAlbedoEncodingName(GeometryImageAlbedoEncoding encoding) -> char const*;
+auto GetGeometryImageNormalEncodingName(GeometryImageNormalEncoding encoding) -> char const*;
+
+// single texel codecs, decoding does exactly what the mesh shader does
+// block compressed normals go through GeometryImageEncoder only, these codecs take the other normal encodings
+auto EncodeGeometryImagePosition(GeometryImagePositionEncoding encoding, float const position[3], float const boundsMin[3], float const boundsMax[3], void* texel) -> void;
+auto DecodeGeometryImagePosition(GeometryImagePositionEncoding encoding, void const* texel, float const boundsMin[3], float const boundsMax[3], float position[3]) -> void;
+auto EncodeGeometryImageNormal(GeometryImageNormalEncoding encoding, float const normal[3], void* texel) -> void;
+auto DecodeGeometryImageNormal(GeometryImageNormalEncoding encoding, void const* texel, float normal[3]) -> void;
+
+// error of the encoded texels against the full precision ones, over mip 0
+struct GeometryImageEncodingError
+{
+	double m_positionMaxError;        // object space distance
+	double m_positionSquaredErrorSum;
+	double m_normalMaxAngle;          // degrees
+	double m_normalAngleSum;
+	double m_albedoMaxError;          // 8 bit units, worst channel
+	double m_albedoSquaredErrorSum;   // over the 4 channels
+	uint64_t m_texelCount;
+
+	auto GetPositionRmsError() const -> double;
+	auto GetNormalMeanAngle() const -> double;
+	auto GetAlbedoPsnr() const -> double; // dB, infinite when lossless
+};
+
+// cuts full precision rows of every mip (as produced by the generator, the baker or the mip chain builder) in megatiles and encodes them
+// rows of a mip of size s are s + 1 vertices wide and there are s + 1 of them: the first s x s are the texels of the megatiles, the
+// vertices on the border of the mip are also kept apart at full precision (GeometryImageBorderVertex), which is what the mesh
+// shader reads for them
+// relative encodings quantize each megatile in the bounds of the texels it owns: the vertices a mesh workgroup reads past the
+// right or bottom edge of its megatile are decoded with the bounds of their own megatile, so neighbours still agree on them
+// block compressed images are encoded one 4x4 block at a time (see BlockCompression.h), megatiles spread over threads
+// the culling bounds of the megatiles are computed in the same pass, those of a row of megatiles are complete once the first row of
+// the next one comes in
+class GeometryImageEncoder
+{
+public:
+	// receives a row of megatiles of a mip, payload offsets are relative to payload (see GeometryImageFileWriter::WriteMegatiles)
+	using MegatilesCallback = std::function<void(GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload, uint64_t payloadSize)>;
+
+	GeometryImageEncoder(uint32_t size, uint32_t mipCount, GeometryImagePositionEncoding positionEncoding, GeometryImageAlbedoEncoding albedoEncoding,
+		GeometryImageNormalEncoding normalEncoding, float const positionBoundsMin[3], float const positionBoundsMax[3], MegatilesCallback callback, uint32_t threadCount = 0);
+
+	// rows of a given mip must be pushed in order, from the first one and without gaps, mips may be interleaved
+	auto PushRows(uint32_t mip, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal) -> void;
+
+	// decodes every mip 0 texel back after encoding it, which about doubles the encoding time
+	auto EnableErrorMeasurement() -> void { m_measureError = true; }
+	auto GetError() const -> GeometryImageEncodingError const& { return m_error; }
+
+	// bounds of every megatile, mip by mip and row by row (see GeometryImageFileWriter::Close), once every row of every mip was pushed
+	auto GetBounds() const -> std::vector<MegatileBounds> const& { return m_bounds; }
+	// border vertices of every mip, mip by mip (see GeometryImageFileWriter::Close), once every row of every mip was pushed
+	auto GetBorderVertices() const -> std::vector<GeometryImageBorderVertex> const& { return m_borderVertices; }
+
+private:
+	auto EncodeMegatileRow(uint32_t mip) -> void;
+	auto StoreBorderVertices(uint32_t mip, uint32_t row, float const* position, uint32_t const* albedo, float const* normal) -> void;
+
+	struct PendingMegatileRow
+	{
+		std::vector<float> m_position;
+		std::vector<uint32_t> m_albedo;
+		std::vector<float> m_normal;
+		std::vector<float> m_seamPosition; // last row of the previous megatile row, then the first row of this one (or the last row of the mip)
+		uint32_t m_firstRow;
+		uint32_t m_rowCount;
+	};
+
+	uint32_t m_size;
+	GeometryImagePositionEncoding m_positionEncoding;
+	GeometryImageAlbedoEncoding m_albedoEncoding;
+	GeometryImageNormalEncoding m_normalEncoding;
+	GeometryImageFormat m_formats[3];
+	float m_positionBoundsMin[3];
+	float m_positionBoundsMax[3];
+	MegatilesCallback m_callback;
+	uint32_t m_threadCount;
+	bool m_measureError;
+	GeometryImageEncodingError m_error;
+
+	std::vector<PendingMegatileRow> m_pendingRows; // per mip
+	std::vector<GeometryImageFileMegatile> m_megatiles;
+	std::vector<uint8_t> m_payload;
+	std::vector<GeometryImageEncodingError> m_megatileErrors;
+
+	std::vector<MegatileBounds> m_bounds;
+	std::vector<uint32_t> m_boundsMipOffsets;
+	float m_boundsPadding[3];
+
+	std::vector<GeometryImageBorderVertex> m_borderVertices;
+	std::vector<uint32_t> m_borderMipOffsets;
+};
@@ -0,0 +1,326 @@
+#include "GeometryImageFile.h"
+#include "GeometryImageMipChain.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// the payload starts on a cache line
+	const uint64_t payloadAlignment = 64;
+}
+
+auto GetGeometryImageFormatTexelSize(GeometryImageFormat format) -> uint32_t
+{
+	switch (format)
+	{
+	case GeometryImageFormat_A2B10G10R10: return 4;
+	case GeometryImageFormat_RGBA8: return 4;
+	case GeometryImageFormat_RGBA16: return 8;
+	case GeometryImageFormat_RG8Snorm: return 2;
+	case GeometryImageFormat_RG16Snorm: return 4;
+	default: return 0;
+	}
+}
+
+auto GetGeometryImageFormatBlockSize(GeometryImageFormat format) -> uint32_t
+{
+	switch (format)
+	{
+	case GeometryImageFormat_BC1: return 8;
+	case GeometryImageFormat_BC7: return 16;
+	case GeometryImageFormat_BC5Snorm: return 16;
+	default: return 0;
+	}
+}
+
+auto GetGeometryImagePositionFormat(GeometryImagePositionEncoding encoding) -> GeometryImageFormat
+{
+	return encoding == GeometryImagePositionEncoding_MegatileRelative16 ? GeometryImageFormat_RGBA16 : GeometryImageFormat_A2B10G10R10;
+}
+
+auto GetGeometryImageAlbedoFormat(GeometryImageAlbedoEncoding encoding) -> GeometryImageFormat
+{
+	switch (encoding)
+	{
+	case GeometryImageAlbedoEncoding_Bc1: return GeometryImageFormat_BC1;
+	case GeometryImageAlbedoEncoding_Bc7: return GeometryImageFormat_BC7;
+	default: return GeometryImageFormat_RGBA8;
+	}
+}
+
+auto GetGeometryImageNormalFormat(GeometryImageNormalEncoding encoding) -> GeometryImageFormat
+{
+	switch (encoding)
+	{
+	case GeometryImageNormalEncoding_Octahedral8: return GeometryImageFormat_RG8Snorm;
+	case GeometryImageNormalEncoding_Octahedral16: return GeometryImageFormat_RG16Snorm;
+	case GeometryImageNormalEncoding_OctahedralBc5: return GeometryImageFormat_BC5Snorm;
+	default: return GeometryImageFormat_RGBA8;
+	}
+}
+
+auto GetGeometryImagePlaneSize(GeometryImageFormat format, uint32_t width, uint32_t height) -> uint32_t
+{
+	uint32_t blockSize = GetGeometryImageFormatBlockSize(format);
+	uint32_t size = blockSize > 0
+		? ((width + 3) / 4) * ((height + 3) / 4) * blockSize
+		: width * height * GetGeometryImageFormatTexelSize(format);
+	return (size + geometryImagePlaneAlignment - 1) & ~(geometryImagePlaneAlignment - 1);
+}
+
+auto GetGeometryImageBorderVertexCount(uint32_t size, uint32_t mipCount) -> uint32_t
+{
+	uint32_t count = 0;
+	for (uint32_t mip = 0; mip < mipCount; ++mip)
+		count += 4 * GetGeometryImageMipSize(size, mip);
+	return count;
+}
+
+GeometryImageFile::GeometryImageFile()
+	: m_data(nullptr)
+	, m_fileSize(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+#else
+	, m_file(-1)
+#endif
+{
+}
+
+GeometryImageFile::~GeometryImageFile()
+{
+	Close();
+}
+
+auto GeometryImageFile::Open(std::string const& filepath) -> bool
+{
+	Close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "could not open geometry image file " << filepath << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < LONGLONG(sizeof(GeometryImageFileHeader)))
+	{
+		std::cerr << "geometry image file " << filepath << " is too small" << std::endl;
+		Close();
+		return false;
+	}
+	m_fileSize = uint64_t(fileSize.QuadPart);
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping)
+	{
+		std::cerr << "could not map geometry image file " << filepath << std::endl;
+		Close();
+		return false;
+	}
+
+	m_data = (uint8_t const*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data)
+	{
+		std::cerr << "could not map geometry image file " << filepath << std::endl;
+		Close();
+		return false;
+	}
+#else
+	m_file = open(filepath.c_str(), O_RDONLY);
+	if (m_file < 0)
+	{
+		std::cerr << "could not open geometry image file " << filepath << std::endl;
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(m_file, &fileStat) != 0 || fileStat.st_size < off_t(sizeof(GeometryImageFileHeader)))
+	{
+		std::cerr << "geometry image file " << filepath << " is too small" << std::endl;
+		Close();
+		return false;
+	}
+	m_fileSize = uint64_t(fileStat.st_size);
+
+	void* data = mmap(nullptr, m_fileSize, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		std::cerr << "could not map geometry image file " << filepath << std::endl;
+		Close();
+		return false;
+	}
+	m_data = (uint8_t const*)data;
+
+	// the payload is read once, front to back
+	madvise(data, m_fileSize, MADV_SEQUENTIAL);
+#endif
+
+	GeometryImageFileHeader const& header = GetHeader();
+	bool valid = header.magic == geometryImageFileMagic && header.version == geometryImageFileVersion
+		&& header.size > 0 && header.mipCount > 0 && header.mipCount <= GetGeometryImageMipCount(header.size)
+		&& header.payloadOffset + header.payloadSize <= m_fileSize
+		&& header.megatileTableOffset + uint64_t(header.megatileCount) * sizeof(GeometryImageFileMegatile) <= m_fileSize
+		&& header.boundsTableOffset + uint64_t(header.megatileCount) * sizeof(MegatileBounds) <= m_fileSize
+		&& header.borderTableOffset + uint64_t(GetGeometryImageBorderVertexCount(header.size, header.mipCount)) * sizeof(GeometryImageBorderVertex) <= m_fileSize;
+	for (uint32_t i = 0; valid && i < header.megatileCount; ++i)
+	{
+		GeometryImageFileMegatile const& megatile = GetMegatiles()[i];
+		valid = megatile.mip < header.mipCount && megatile.payloadOffset + megatile.payloadSize <= header.payloadSize
+			&& megatile.payloadOffset % geometryImagePlaneAlignment == 0;
+	}
+	valid = valid && header.positionEncoding < GeometryImagePositionEncoding_Count && header.albedoEncoding < GeometryImageAlbedoEncoding_Count
+		&& header.normalEncoding < GeometryImageNormalEncoding_Count && header.parameterization < GeometryImageParameterization_Count
+		&& header.formats[0] == GetGeometryImagePositionFormat(header.positionEncoding)
+		&& header.formats[1] == GetGeometryImageAlbedoFormat(header.albedoEncoding)
+		&& header.formats[2] == GetGeometryImageNormalFormat(header.normalEncoding);
+
+	if (!valid)
+	{
+		std::cerr << "geometry image file " << filepath << " is invalid or of an unsupported version" << std::endl;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+auto GeometryImageFile::Close() -> void
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data)
+		munmap((void*)m_data, m_fileSize);
+	if (m_file >= 0)
+		close(m_file);
+	m_file = -1;
+#endif
+	m_data = nullptr;
+	m_fileSize = 0;
+}
+
+GeometryImageFileWriter::GeometryImageFileWriter()
+	: m_file(nullptr)
+	, m_header{}
+{
+}
+
+GeometryImageFileWriter::~GeometryImageFileWriter()
+{
+	if (m_file)
+		fclose(m_file);
+}
+
+auto GeometryImageFileWriter::Open(std::string const& filepath, uint32_t size, uint32_t mipCount, GeometryImagePositionEncoding positionEncoding, GeometryImageAlbedoEncoding albedoEncoding,
+	GeometryImageNormalEncoding normalEncoding, GeometryImageParameterization parameterization, float const positionBoundsMin[3], float const positionBoundsMax[3]) -> bool
+{
+	m_file = fopen(filepath.c_str(), "wb");
+	if (!m_file)
+	{
+		std::cerr << "could not create geometry image file " << filepath << std::endl;
+		return false;
+	}
+
+	m_header = {};
+	m_header.magic = geometryImageFileMagic;
+	m_header.version = geometryImageFileVersion;
+	m_header.size = size;
+	m_header.mipCount = mipCount;
+	m_header.formats[0] = GetGeometryImagePositionFormat(positionEncoding);
+	m_header.formats[1] = GetGeometryImageAlbedoFormat(albedoEncoding);
+	m_header.formats[2] = GetGeometryImageNormalFormat(normalEncoding);
+	m_header.positionEncoding = positionEncoding;
+	m_header.albedoEncoding = albedoEncoding;
+	m_header.normalEncoding = normalEncoding;
+	m_header.parameterization = parameterization;
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		m_header.positionBoundsMin[k] = positionBoundsMin[k];
+		m_header.positionBoundsMax[k] = positionBoundsMax[k];
+	}
+	m_header.payloadOffset = (sizeof(GeometryImageFileHeader) + payloadAlignment - 1) & ~(payloadAlignment - 1);
+
+	m_megatiles.clear();
+	m_megatileCounts.assign(mipCount, 0);
+
+	// the header is written last, once the tables are known
+	return fseek(m_file, long(m_header.payloadOffset), SEEK_SET) == 0;
+}
+
+auto GeometryImageFileWriter::WriteMegatiles(GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload, uint64_t payloadSize) -> bool
+{
+	if (fwrite(payload, 1, payloadSize, m_file) != payloadSize)
+	{
+		std::cerr << "could not write geometry image file payload" << std::endl;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < megatileCount; ++i)
+	{
+		GeometryImageFileMegatile megatile = megatiles[i];
+		megatile.payloadOffset += m_header.payloadSize;
+		m_megatiles.push_back(megatile);
+		++m_megatileCounts[megatile.mip];
+	}
+	m_header.payloadSize += payloadSize;
+
+	return true;
+}
+
+auto GeometryImageFileWriter::Close(std::vector<MegatileBounds> const& bounds, std::vector<GeometryImageBorderVertex> const& borderVertices) -> bool
+{
+	if (!m_file)
+		return false;
+
+	bool complete = true;
+	for (uint32_t mip = 0; mip < m_header.mipCount; ++mip)
+	{
+		uint32_t megatilesPerRow = (GetGeometryImageMipSize(m_header.size, mip) + geometryImageMegatileSize - 1) / geometryImageMegatileSize;
+		complete = complete && m_megatileCounts[mip] == megatilesPerRow * megatilesPerRow;
+	}
+	complete = complete && bounds.size() == m_megatiles.size() && borderVertices.size() == GetGeometryImageBorderVertexCount(m_header.size, m_header.mipCount);
+	if (!complete)
+		std::cerr << "geometry image file closed before every megatile was written" << std::endl;
+
+	m_header.megatileCount = uint32_t(m_megatiles.size());
+	m_header.megatileTableOffset = m_header.payloadOffset + m_header.payloadSize;
+	m_header.boundsTableOffset = m_header.megatileTableOffset + m_megatiles.size() * sizeof(GeometryImageFileMegatile);
+	m_header.borderTableOffset = m_header.boundsTableOffset + bounds.size() * sizeof(MegatileBounds);
+
+	bool written = fwrite(m_megatiles.data(), sizeof(GeometryImageFileMegatile), m_megatiles.size(), m_file) == m_megatiles.size()
+		&& fwrite(bounds.data(), sizeof(MegatileBounds), bounds.size(), m_file) == bounds.size()
+		&& fwrite(borderVertices.data(), sizeof(GeometryImageBorderVertex), borderVertices.size(), m_file) == borderVertices.size()
+		&& fseek(m_file, 0, SEEK_SET) == 0
+		&& fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+	if (!written)
+		std::cerr << "could not write geometry image file tables" << std::endl;
+
+	written = fclose(m_file) == 0 && written;
+	m_file = nullptr;
+
+	return complete && written;
+}
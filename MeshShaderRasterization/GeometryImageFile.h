@@ -0,0 +1,235 @@
+#pragma once
+
+#include "MegatileBounds.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// binary container for geometry images, meant to be memory mapped and streamed to staging memory as is
+//
+// layout:
+// * GeometryImageFileHeader
+// * payload: the images cut in megatiles (64x64 texels, smaller for mips under 64), in upload order
+//   each megatile stores its position texels, then its albedo texels, then its normal texels, rows tightly packed and each image
+//   padded to geometryImagePlaneAlignment bytes; block compressed images store rows of 4x4 blocks instead, edge blocks of megatiles
+//   under 4 texels replicating the edge texels
+// * megatile table: one GeometryImageFileMegatile per megatile of every mip, in payload order
+// * bounds table: one MegatileBounds per megatile, mip by mip from mip 0 and row by row (the order of megatileBuffer)
+// * border table: the border vertices of every mip from mip 0, at full precision (see GetGeometryImageBorderVertexIndex)
+//
+// all values are little endian
+
+enum GeometryImageFormat : uint32_t
+{
+	GeometryImageFormat_A2B10G10R10 = 0,
+	GeometryImageFormat_RGBA8 = 1,
+	GeometryImageFormat_RGBA16 = 2,
+	GeometryImageFormat_RG8Snorm = 3,
+	GeometryImageFormat_RG16Snorm = 4,
+	GeometryImageFormat_BC1 = 5,      // RGB unorm, 8 bytes per block
+	GeometryImageFormat_BC7 = 6,      // RGBA unorm, 16 bytes per block
+	GeometryImageFormat_BC5Snorm = 7, // RG snorm, 16 bytes per block
+};
+
+// how position texels map to object space, see GeometryImageEncoding.h
+enum GeometryImagePositionEncoding : uint32_t
+{
+	GeometryImagePositionEncoding_Absolute10 = 0,         // A2B10G10R10 in the mesh bounds
+	GeometryImagePositionEncoding_MegatileRelative10 = 1, // A2B10G10R10 in the bounds of the megatile owning the texel
+	GeometryImagePositionEncoding_MegatileRelative16 = 2, // RGBA16 in the bounds of the megatile owning the texel
+	GeometryImagePositionEncoding_Count
+};
+
+// how normal texels map to unit vectors, see GeometryImageEncoding.h
+enum GeometryImageNormalEncoding : uint32_t
+{
+	GeometryImageNormalEncoding_Xyz8 = 0,         // RGBA8, xyz * 0.5 + 0.5
+	GeometryImageNormalEncoding_Octahedral8 = 1,  // RG8 snorm octahedral
+	GeometryImageNormalEncoding_Octahedral16 = 2, // RG16 snorm octahedral
+	GeometryImageNormalEncoding_OctahedralBc5 = 3, // BC5 snorm octahedral, decoded like the other octahedral encodings
+	GeometryImageNormalEncoding_Count
+};
+
+// how albedo texels are stored, see GeometryImageEncoding.h
+enum GeometryImageAlbedoEncoding : uint32_t
+{
+	GeometryImageAlbedoEncoding_Rgba8 = 0, // RGBA8
+	GeometryImageAlbedoEncoding_Bc1 = 1,   // BC1, 4 bits per texel
+	GeometryImageAlbedoEncoding_Bc7 = 2,   // BC7, 8 bits per texel
+	GeometryImageAlbedoEncoding_Count
+};
+
+// how the vertices of the image map to the surface, which decides the border vertices the image folds onto each other (see
+// GetParameterizationFoldPartner in GeometryImageBaker.h)
+enum GeometryImageParameterization : uint32_t
+{
+	GeometryImageParameterization_Octahedral = 0, // each half edge of the image folds onto the other half
+	GeometryImageParameterization_Spherical = 1,  // the first and last columns are the same, the first and last rows are poles
+	GeometryImageParameterization_Periodic = 2,   // the first and last columns are the same, so are the first and last rows (the procedural sphere)
+	GeometryImageParameterization_Count
+};
+
+// 0 for block compressed formats
+auto GetGeometryImageFormatTexelSize(GeometryImageFormat format) -> uint32_t;
+// bytes per 4x4 block of block compressed formats, 0 for the others
+auto GetGeometryImageFormatBlockSize(GeometryImageFormat format) -> uint32_t;
+auto GetGeometryImagePositionFormat(GeometryImagePositionEncoding encoding) -> GeometryImageFormat;
+auto GetGeometryImageAlbedoFormat(GeometryImageAlbedoEncoding encoding) -> GeometryImageFormat;
+auto GetGeometryImageNormalFormat(GeometryImageNormalEncoding encoding) -> GeometryImageFormat;
+
+// size of one image of a megatile payload, padding included
+auto GetGeometryImagePlaneSize(GeometryImageFormat format, uint32_t width, uint32_t height) -> uint32_t;
+
+const uint32_t geometryImageFileMagic = 0x474d4947; // "GIMG"
+const uint32_t geometryImageFileVersion = 7;
+const uint32_t geometryImageMegatileSize = 64;
+const uint32_t geometryImagePlaneAlignment = 16; // keeps texels aligned wherever a megatile lands in staging memory
+
+struct GeometryImageFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;          // width and height of mip 0
+	uint32_t mipCount;
+	GeometryImageFormat formats[3]; // position, albedo, normal
+	GeometryImagePositionEncoding positionEncoding;
+	GeometryImageAlbedoEncoding albedoEncoding;
+	GeometryImageNormalEncoding normalEncoding;
+	GeometryImageParameterization parameterization;
+	float positionBoundsMin[3];     // bounds of the whole mesh, absolute position texels are dequantized as min + texel * (max - min)
+	float positionBoundsMax[3];
+	uint32_t megatileCount;
+	uint64_t payloadOffset;
+	uint64_t payloadSize;
+	uint64_t megatileTableOffset;
+	uint64_t boundsTableOffset;
+	uint64_t borderTableOffset;
+};
+
+struct GeometryImageFileMegatile
+{
+	uint16_t x;             // in megatiles, as in packMegatile
+	uint16_t y;
+	uint16_t mip;
+	uint16_t reserved;
+	uint16_t width;         // in texels
+	uint16_t height;
+	uint32_t payloadSize;   // all three images
+	uint64_t payloadOffset; // from the start of the payload
+	float positionBoundsMin[3]; // bounds of the position texels of the megatile, relative position texels are dequantized in these
+	float positionBoundsMax[3];
+};
+
+// a mip of size s is a grid of (s + 1) x (s + 1) vertices: megatiles store the first s x s, the vertices on the border of the grid
+// (its first and last rows and columns) are stored apart without encoding, so that the vertices the parameterization maps to the same
+// point (the two halves of an edge, or the two ends of a row) are read bit for bit identical and the surface closes at every mip
+// laid out for std430 (borderBuffer)
+struct GeometryImageBorderVertex
+{
+	float position[3];
+	uint32_t albedo;    // RGBA8
+	float normal[3];
+	float reserved;
+};
+
+// 4 * s border vertices per mip of size s
+auto GetGeometryImageBorderVertexCount(uint32_t size, uint32_t mipCount) -> uint32_t;
+// index of vertex (x, y) on the border of a mip of size s among the border vertices of the mip: the first row, the last row, then
+// the first and last vertices of the rows in between (same as borderVertexIndex in test_ms.glsl)
+inline auto GetGeometryImageBorderVertexIndex(uint32_t mipSize, uint32_t x, uint32_t y) -> uint32_t
+{
+	if (y == 0 || y == mipSize)
+		return (y == 0 ? 0 : mipSize + 1) + x;
+	return 2 * (mipSize + 1) + 2 * (y - 1) + (x == 0 ? 0 : 1);
+}
+
+// megatile (x, y) of mip 0, at most one megatile out of the image on one axis: the megatile of the image the parameterization folds
+// its edge onto (the two share the vertices of that edge, see GetParameterizationFoldPartner), itself when it is in the image, false
+// when there is none (past a corner, which is a single vertex, or past a pole row, which is one) (foldedMegatile in test_ts.glsl)
+inline auto GetGeometryImageFoldedMegatile(GeometryImageParameterization parameterization, int32_t megatilesPerRow, int32_t x, int32_t y, int32_t& foldedX, int32_t& foldedY) -> bool
+{
+	int32_t last = megatilesPerRow - 1;
+	bool outsideX = x < 0 || x > last;
+	bool outsideY = y < 0 || y > last;
+	foldedX = x;
+	foldedY = y;
+	if (outsideX == outsideY)
+		return !outsideX;
+	if (parameterization == GeometryImageParameterization_Spherical)
+	{
+		// the last column is the first one
+		foldedX = x < 0 ? last : 0;
+		return outsideX;
+	}
+	if (parameterization == GeometryImageParameterization_Periodic)
+	{
+		// the last column is the first one, the last row too
+		foldedX = x < 0 ? last : x > last ? 0 : x;
+		foldedY = y < 0 ? last : y > last ? 0 : y;
+		return true;
+	}
+
+	// octahedral: (x, 0) is (size - x, 0) and (0, y) is (0, size - y), same for the last row and column
+	if (outsideY)
+	{
+		foldedX = last - x;
+		foldedY = y < 0 ? 0 : last;
+	}
+	else
+	{
+		foldedX = x < 0 ? 0 : last;
+		foldedY = last - y;
+	}
+	return true;
+}
+
+// read only memory mapping of a geometry image file
+class GeometryImageFile
+{
+public:
+	GeometryImageFile();
+	~GeometryImageFile();
+
+	auto Open(std::string const& filepath) -> bool;
+	auto Close() -> void;
+
+	auto GetHeader() const -> GeometryImageFileHeader const& { return *(GeometryImageFileHeader const*)m_data; }
+	auto GetMegatiles() const -> GeometryImageFileMegatile const* { return (GeometryImageFileMegatile const*)(m_data + GetHeader().megatileTableOffset); }
+	auto GetPayload() const -> uint8_t const* { return m_data + GetHeader().payloadOffset; }
+	auto GetBounds() const -> MegatileBounds const* { return (MegatileBounds const*)(m_data + GetHeader().boundsTableOffset); }
+	auto GetBorderVertices() const -> GeometryImageBorderVertex const* { return (GeometryImageBorderVertex const*)(m_data + GetHeader().borderTableOffset); }
+
+private:
+	uint8_t const* m_data;
+	uint64_t m_fileSize;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+};
+
+// writes a geometry image file from encoded megatiles (see GeometryImageEncoder)
+class GeometryImageFileWriter
+{
+public:
+	GeometryImageFileWriter();
+	~GeometryImageFileWriter();
+
+	auto Open(std::string const& filepath, uint32_t size, uint32_t mipCount, GeometryImagePositionEncoding positionEncoding, GeometryImageAlbedoEncoding albedoEncoding,
+		GeometryImageNormalEncoding normalEncoding, GeometryImageParameterization parameterization, float const positionBoundsMin[3], float const positionBoundsMax[3]) -> bool;
+	// megatiles must come in upload order, their payload offsets are relative to payload
+	auto WriteMegatiles(GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload, uint64_t payloadSize) -> bool;
+	// writes the megatile table, the bounds of every megatile, the border vertices of every mip (see GeometryImageEncoder::GetBounds
+	// and GetBorderVertices) and the final header
+	auto Close(std::vector<MegatileBounds> const& bounds, std::vector<GeometryImageBorderVertex> const& borderVertices) -> bool;
+
+private:
+	FILE* m_file;
+	GeometryImageFileHeader m_header;
+	std::vector<GeometryImageFileMegatile> m_megatiles;
+	std::vector<uint32_t> m_megatileCounts; // per mip, to check every megatile was written
+};
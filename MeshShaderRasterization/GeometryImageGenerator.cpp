@@ -0,0 +1,159 @@
+#include "GeometryImageGenerator.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GEOMETRY_IMAGE_GENERATOR_SSE2 1
+#endif
+
+namespace
+{
+	const float pi = 3.14159265359f;
+
+	// rows are handed out to worker threads by tiles of this many rows
+	const uint32_t tileRows = 16;
+
+	// the angle expression must stay exactly the one of the reference loop for the results to be bit exact
+	inline auto Angle(uint32_t i, uint32_t size) -> float
+	{
+		return i % size / float(size) * 2 * pi;
+	}
+
+	inline auto GenerateTexel(uint32_t i, uint32_t j, float y, float r, float sinj, float cosj, float* position, uint32_t* albedo, float* normal) -> void
+	{
+		normal[0] = r * cosj;
+		normal[1] = y;
+		normal[2] = r * sinj;
+		for (uint32_t k = 0; k < 3; ++k)
+			position[k] = normal[k] / 2.0f + 0.5f;
+
+		*albedo = 0xff000000
+		        | ((i & 0xff) << 0)
+		        | ((j & 0xff) << 8)
+		        | ((0xff - (i & 0xff)/2 - (j & 0xff)/2) << 16)
+		        ;
+	}
+
+	auto GenerateRow(uint32_t i, uint32_t width, float const* sinTable, float const* cosTable, float* position, uint32_t* albedo, float* normal) -> void
+	{
+		float y = sinTable[i];
+		float r = cosTable[i];
+
+		uint32_t j = 0;
+
+#if GEOMETRY_IMAGE_GENERATOR_SSE2
+		// dividing by 2 and multiplying by 0.5 are both exact, so this matches the scalar path bit for bit
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128i byteMask = _mm_set1_epi32(0xff);
+		const __m128i alpha = _mm_set1_epi32(int(0xff000000));
+		const __m128i four = _mm_set1_epi32(4);
+
+		const __m128 rv = _mm_set1_ps(r);
+		const __m128 yv = _mm_set1_ps(y);
+
+		const __m128i iv = _mm_set1_epi32(int(i & 0xff));
+		const __m128i albedoRow = _mm_or_si128(alpha, iv);
+		const __m128i blueRow = _mm_sub_epi32(_mm_set1_epi32(0xff), _mm_srli_epi32(iv, 1));
+
+		__m128i jv = _mm_setr_epi32(0, 1, 2, 3);
+		for (; j + 4 <= width; j += 4)
+		{
+			__m128 nx = _mm_mul_ps(rv, _mm_loadu_ps(cosTable + j));
+			__m128 ny = yv;
+			__m128 nz = _mm_mul_ps(rv, _mm_loadu_ps(sinTable + j));
+			__m128 nw = _mm_setzero_ps();
+			__m128 px = _mm_add_ps(_mm_mul_ps(nx, half), half);
+			__m128 py = _mm_add_ps(_mm_mul_ps(ny, half), half);
+			__m128 pz = _mm_add_ps(_mm_mul_ps(nz, half), half);
+			__m128 pw = _mm_setzero_ps();
+
+			// structure of arrays to xyz triplets: after the transposes, register k holds texel j + k
+			_MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+			// overlapping 4 wide stores, the last texel only writes its 3 floats so nothing past the row is touched
+			float* n = normal + 3 * j;
+			_mm_storeu_ps(n + 0, nx);
+			_mm_storeu_ps(n + 3, ny);
+			_mm_storeu_ps(n + 6, nz);
+			_mm_storel_pi((__m64*)(n + 9), nw);
+			_mm_store_ss(n + 11, _mm_movehl_ps(nw, nw));
+
+			float* p = position + 3 * j;
+			_mm_storeu_ps(p + 0, px);
+			_mm_storeu_ps(p + 3, py);
+			_mm_storeu_ps(p + 6, pz);
+			_mm_storel_pi((__m64*)(p + 9), pw);
+			_mm_store_ss(p + 11, _mm_movehl_ps(pw, pw));
+
+			__m128i jm = _mm_and_si128(jv, byteMask);
+			__m128i blue = _mm_sub_epi32(blueRow, _mm_srli_epi32(jm, 1));
+			__m128i a = _mm_or_si128(_mm_or_si128(albedoRow, _mm_slli_epi32(jm, 8)), _mm_slli_epi32(blue, 16));
+			_mm_storeu_si128((__m128i*)(albedo + j), a);
+
+			jv = _mm_add_epi32(jv, four);
+		}
+#endif
+
+		for (; j < width; ++j)
+		{
+			GenerateTexel(i, j, y, r, sinTable[j], cosTable[j], position + 3 * j, albedo + j, normal + 3 * j);
+		}
+	}
+}
+
+auto GenerateSphereGeometryImage(uint32_t size, uint32_t firstRow, uint32_t rowCount, float* position, uint32_t* albedo, float* normal, uint32_t threadCount) -> void
+{
+	// sin/cos only depend on the row or on the column, so size + 1 entries are enough for the whole image
+	const uint32_t width = size + 1;
+	std::vector<float> sinTable(width);
+	std::vector<float> cosTable(width);
+	for (uint32_t i = 0; i < width; ++i)
+	{
+		sinTable[i] = std::sin(Angle(i, size));
+		cosTable[i] = std::cos(Angle(i, size));
+	}
+
+	uint32_t tileCount = (rowCount + tileRows - 1) / tileRows;
+	ParallelFor(tileCount, [&](uint32_t tile)
+	{
+		uint32_t begin = tile * tileRows;
+		uint32_t end = std::min(begin + tileRows, rowCount);
+		for (uint32_t row = begin; row < end; ++row)
+		{
+			size_t offset = size_t(row) * width;
+			GenerateRow(firstRow + row, width, sinTable.data(), cosTable.data(), position + 3 * offset, albedo + offset, normal + 3 * offset);
+		}
+	}, threadCount);
+}
+
+auto GenerateSphereGeometryImageReference(uint32_t size, uint32_t firstRow, uint32_t rowCount, float* position, uint32_t* albedo, float* normal) -> void
+{
+	for (uint32_t i = firstRow; i < firstRow + rowCount; ++i)
+	{
+		float y = std::sin(i % size / float(size) * 2 * pi);
+		float r = std::cos(i % size / float(size) * 2 * pi);
+		for (uint32_t j = 0; j <= size; ++j)
+		{
+			float z = r * std::sin(j % size / float(size) * 2 * pi);
+			float x = r * std::cos(j % size / float(size) * 2 * pi);
+			*(normal++) = x;
+			*(normal++) = y;
+			*(normal++) = z;
+
+			*(position++) = x / 2.0f + 0.5f;
+			*(position++) = y / 2.0f + 0.5f;
+			*(position++) = z / 2.0f + 0.5f;
+
+			*(albedo++) = 0xff000000
+			            | ((i & 0xff) << 0)
+			            | ((j & 0xff) << 8)
+			            | ((0xff - (i & 0xff)/2 - (j & 0xff)/2) << 16)
+			            ;
+		}
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU generation of the procedural sphere geometry image, at full precision (see GeometryImageEncoding.h for the GPU formats)
+// position is xyz floats in the unit cube, albedo is RGBA8, normal is unit xyz floats
+// rows [firstRow, firstRow + rowCount) of the (size + 1) x (size + 1) vertices are written tightly packed to caller provided memory
+// (position[0] is vertex (0, firstRow)), so this can run without any GPU
+// both angles wrap around at size, so the last row and column are the first ones again, bit for bit
+
+// tile parallel version: the transcendental functions are hoisted into per row/per column tables and texels are written 4 at a time
+// its output is bit for bit identical to GenerateSphereGeometryImageReference
+auto GenerateSphereGeometryImage(uint32_t size, uint32_t firstRow, uint32_t rowCount, float* position, uint32_t* albedo, float* normal, uint32_t threadCount = 0) -> void;
+
+// scalar, single threaded reference of the version above, kept to validate and time it
+auto GenerateSphereGeometryImageReference(uint32_t size, uint32_t firstRow, uint32_t rowCount, float* position, uint32_t* albedo, float* normal) -> void;
@@ -0,0 +1,153 @@
+#include "GeometryImageMipChain.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	inline auto AverageRgba8(uint32_t a, uint32_t b, uint32_t c, uint32_t d) -> uint32_t
+	{
+		uint32_t result = 0;
+		for (uint32_t shift = 0; shift < 32; shift += 8)
+		{
+			uint32_t sum = ((a >> shift) & 0xff) + ((b >> shift) & 0xff) + ((c >> shift) & 0xff) + ((d >> shift) & 0xff);
+			result |= ((sum + 2) / 4) << shift;
+		}
+		return result;
+	}
+
+	inline auto AverageNormal(float const* a, float const* b, float const* c, float const* d, float* result) -> void
+	{
+		float n[3];
+		for (uint32_t k = 0; k < 3; ++k)
+			n[k] = a[k] + b[k] + c[k] + d[k];
+
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float scale = length > 0 ? 1 / length : 0;
+		for (uint32_t k = 0; k < 3; ++k)
+			result[k] = n[k] * scale;
+	}
+}
+
+auto GetGeometryImageMipCount(uint32_t size) -> uint32_t
+{
+	uint32_t mipCount = 1;
+	while ((size >> mipCount) > 0)
+		++mipCount;
+	return mipCount;
+}
+
+auto DownsampleGeometryImageRow(uint32_t width, bool borderRow,
+	float const* sourcePosition0, uint32_t const* sourceAlbedo0, float const* sourceNormal0,
+	uint32_t const* sourceAlbedo1, float const* sourceNormal1,
+	float* destinationPosition, uint32_t* destinationAlbedo, float* destinationNormal) -> void
+{
+	for (uint32_t j = 0; j <= width; ++j)
+	{
+		uint32_t j0 = 2 * j;
+		uint32_t j1 = std::min(2 * j + 1, 2 * width);
+		for (uint32_t k = 0; k < 3; ++k)
+			destinationPosition[3 * j + k] = sourcePosition0[3 * j0 + k];
+		if (borderRow || j == 0 || j == width)
+		{
+			destinationAlbedo[j] = sourceAlbedo0[j0];
+			for (uint32_t k = 0; k < 3; ++k)
+				destinationNormal[3 * j + k] = sourceNormal0[3 * j0 + k];
+			continue;
+		}
+		destinationAlbedo[j] = AverageRgba8(sourceAlbedo0[j0], sourceAlbedo0[j1], sourceAlbedo1[j0], sourceAlbedo1[j1]);
+		AverageNormal(sourceNormal0 + 3 * j0, sourceNormal0 + 3 * j1, sourceNormal1 + 3 * j0, sourceNormal1 + 3 * j1, destinationNormal + 3 * j);
+	}
+}
+
+GeometryImageMipChainBuilder::GeometryImageMipChainBuilder(uint32_t size, uint32_t mipCount, RowsCallback callback)
+	: m_size(size)
+	, m_mipCount(mipCount)
+	, m_callback(std::move(callback))
+	, m_pendingRows(mipCount)
+{
+	for (uint32_t mip = 0; mip < mipCount; ++mip)
+	{
+		size_t width = GetGeometryImageMipSize(size, mip) + 1;
+		m_pendingRows[mip].m_position.resize(width * 3);
+		m_pendingRows[mip].m_albedo.resize(width);
+		m_pendingRows[mip].m_normal.resize(width * 3);
+	}
+}
+
+auto GeometryImageMipChainBuilder::PushRows(uint32_t firstRow, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal) -> void
+{
+	PushMipRows(0, firstRow, rowCount, position, albedo, normal);
+}
+
+auto GeometryImageMipChainBuilder::PushMipRows(uint32_t mip, uint32_t firstRow, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal) -> void
+{
+	if (mip + 1 >= m_mipCount || rowCount == 0)
+		return;
+
+	const uint32_t mipSize = GetGeometryImageMipSize(m_size, mip);
+	const uint32_t width = mipSize + 1;
+	const uint32_t nextSize = GetGeometryImageMipSize(m_size, mip + 1);
+
+	PendingRow& pendingRow = m_pendingRows[mip];
+
+	// row 2k and 2k+1 give row k, the first one may be the row kept from the previous push
+	// the last row gives the last row of the next mip on its own
+	uint32_t end = firstRow + rowCount;
+	uint32_t nextFirstRow = firstRow / 2;
+	uint32_t nextEnd = end == mipSize + 1 ? nextSize + 1 : end / 2;
+	uint32_t nextRowCount = nextEnd > nextFirstRow ? nextEnd - nextFirstRow : 0;
+
+	size_t nextTexelCount = size_t(nextRowCount) * (nextSize + 1);
+	std::vector<float> nextPosition(nextTexelCount * 3);
+	std::vector<uint32_t> nextAlbedo(nextTexelCount);
+	std::vector<float> nextNormal(nextTexelCount * 3);
+
+	struct SourceRow
+	{
+		float const* m_position;
+		uint32_t const* m_albedo;
+		float const* m_normal;
+	};
+
+	auto GetSourceRow = [&](uint32_t row) -> SourceRow
+	{
+		row = std::min(row, mipSize);
+		if (row < firstRow)
+			return { pendingRow.m_position.data(), pendingRow.m_albedo.data(), pendingRow.m_normal.data() };
+
+		size_t offset = size_t(row - firstRow) * width;
+		return { position + 3 * offset, albedo + offset, normal + 3 * offset };
+	};
+
+	ParallelFor(nextRowCount, [&](uint32_t index)
+	{
+		uint32_t nextRow = nextFirstRow + index;
+		SourceRow sourceRow0 = GetSourceRow(2 * nextRow);
+		SourceRow sourceRow1 = GetSourceRow(2 * nextRow + 1);
+
+		size_t offset = size_t(index) * (nextSize + 1);
+		DownsampleGeometryImageRow(nextSize, nextRow == 0 || nextRow == nextSize,
+			sourceRow0.m_position, sourceRow0.m_albedo, sourceRow0.m_normal,
+			sourceRow1.m_albedo, sourceRow1.m_normal,
+			nextPosition.data() + 3 * offset, nextAlbedo.data() + offset, nextNormal.data() + 3 * offset);
+	});
+
+	// keep the unpaired last row for the next push
+	if ((end & 1) != 0)
+	{
+		size_t offset = size_t(rowCount - 1) * width;
+		std::memcpy(pendingRow.m_position.data(), position + 3 * offset, width * 3 * sizeof(float));
+		std::memcpy(pendingRow.m_albedo.data(), albedo + offset, width * sizeof(uint32_t));
+		std::memcpy(pendingRow.m_normal.data(), normal + 3 * offset, width * 3 * sizeof(float));
+	}
+
+	if (nextRowCount == 0)
+		return;
+
+	m_callback(mip + 1, nextFirstRow, nextRowCount, nextPosition.data(), nextAlbedo.data(), nextNormal.data());
+
+	PushMipRows(mip + 1, nextFirstRow, nextRowCount, nextPosition.data(), nextAlbedo.data(), nextNormal.data());
+}
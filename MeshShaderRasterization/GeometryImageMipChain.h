@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// number of mips of a full pyramid for a size x size geometry image
+auto GetGeometryImageMipCount(uint32_t size) -> uint32_t;
+
+// size of one side of the given mip level, in quads: a mip of size s is a grid of (s + 1) x (s + 1) vertices, the texels of its
+// megatiles are the first s x s and the last row and column only live in the border vertices (see GeometryImageFile.h)
+inline auto GetGeometryImageMipSize(uint32_t size, uint32_t mip) -> uint32_t { return (size >> mip) > 0 ? (size >> mip) : 1; }
+
+// builds mip levels 1..mipCount-1 of a geometry image while its level 0 is streamed in by bands of rows
+// rows are at full precision, before encoding: position is xyz floats, albedo is RGBA8, normal is unit xyz floats
+// rows of a mip of size s are s + 1 vertices wide and there are s + 1 of them
+// * position uses vertex preserving decimation: vertex (i, j) of mip n+1 is vertex (2i, 2j) of mip n, so every coarse vertex
+//   lies exactly on the finer surface, every mip spans the whole image up to its last row and column, and vertices the
+//   parameterization folds onto each other at mip 0 (x and size - x along an edge) stay paired at every mip
+// * albedo is box filtered
+// * normal is box filtered and renormalized
+// * the border vertices keep the albedo and normal of the vertex they decimate, like the position: a box across a fold would only
+//   see one side of it, and the two vertices of a fold pair must stay identical
+// only one pending row per level is kept between bands, so memory does not depend on the image size
+class GeometryImageMipChainBuilder
+{
+public:
+	// receives complete rows [firstRow, firstRow + rowCount) of a mip, tightly packed
+	using RowsCallback = std::function<void(uint32_t mip, uint32_t firstRow, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal)>;
+
+	GeometryImageMipChainBuilder(uint32_t size, uint32_t mipCount, RowsCallback callback);
+
+	// rows of mip 0 must be pushed in order, without gaps
+	auto PushRows(uint32_t firstRow, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal) -> void;
+
+private:
+	auto PushMipRows(uint32_t mip, uint32_t firstRow, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal) -> void;
+
+	struct PendingRow
+	{
+		std::vector<float> m_position;
+		std::vector<uint32_t> m_albedo;
+		std::vector<float> m_normal;
+	};
+
+	uint32_t m_size;
+	uint32_t m_mipCount;
+	RowsCallback m_callback;
+	std::vector<PendingRow> m_pendingRows; // per mip
+};
+
+// reduces rows 2k and 2k+1 of a mip to row k of the next mip (width is the size of the next mip, rows are width + 1 vertices wide)
+// positions only come from row 2k, the last row of a mip pairs with itself; the first and last vertices, and every vertex of a border
+// row (the first and last rows of the next mip), only come from row 2k too
+auto DownsampleGeometryImageRow(uint32_t width, bool borderRow,
+	float const* sourcePosition0, uint32_t const* sourceAlbedo0, float const* sourceNormal0,
+	uint32_t const* sourceAlbedo1, float const* sourceNormal1,
+	float* destinationPosition, uint32_t* destinationAlbedo, float* destinationNormal) -> void;
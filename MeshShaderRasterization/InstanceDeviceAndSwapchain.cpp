@@ -4,6 +4,7 @@
 #include "volk/volk.c" // unorthodox way of not adding volk.c to the project
 
 #include <algorithm>
+#include <cstring>
 
 InstanceDeviceAndSwapchain::InstanceDeviceAndSwapchain()
 	: m_instance(VK_NULL_HANDLE)
@@ -11,7 +12,13 @@ InstanceDeviceAndSwapchain::InstanceDeviceAndSwapchain()
 	, m_queue(VK_NULL_HANDLE)
 	, m_surface(VK_NULL_HANDLE)
 	, m_swapchain(VK_NULL_HANDLE)
+	, m_headless(false)
 	, m_supportsNvMeshShader(false)
+	, m_supportsTextureCompressionBc(false)
+	, m_supportsImageInt64Atomics(false)
+	, m_timestampPeriod(1)
+	, m_currentFrameExecutionContext(0)
+	, m_frameNumber(1)
 {
 
 }
@@ -21,10 +28,19 @@ InstanceDeviceAndSwapchain::~InstanceDeviceAndSwapchain()
 	Uninitialize();
 }
 
-auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void* platformWindowHandle) -> bool
+auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void* platformWindowHandle, VkExtent2D headlessExtent) -> bool
 {
 	VkResult result;
 
+	m_headless = platformWindowHandle == nullptr;
+#ifndef _WIN32
+	if (!m_headless)
+	{
+		std::cerr << "windows are not supported on this platform, render headless" << std::endl;
+		return false;
+	}
+#endif
+
 	result = volkInitialize();
 	CHECK_ERROR_AND_RETURN("could not initialized volk (vulkan loader)");
 
@@ -36,12 +52,13 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	applicationCreateInfo.apiVersion = VK_API_VERSION_1_1;
 
 	std::vector<char const*> instanceExtensions;
-	instanceExtensions.emplace_back(VK_KHR_SURFACE_EXTENSION_NAME);
+	if (!m_headless)
+	{
+		instanceExtensions.emplace_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #ifdef _WIN32
-	instanceExtensions.emplace_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-#else
-#error "platform not supported. please implement me"
+		instanceExtensions.emplace_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #endif
+	}
 
 	VkInstanceCreateInfo instanceCreateInfo{ VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, nullptr };
 	instanceCreateInfo.flags = 0;
@@ -64,15 +81,16 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	CHECK_ERROR_AND_RETURN("could not enumerate physical devices");
 
 #if _WIN32
-	VkWin32SurfaceCreateInfoKHR surfaceCreateInfo{ VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR, nullptr };
-	surfaceCreateInfo.flags = 0;
-	surfaceCreateInfo.hinstance = HINSTANCE(GetModuleHandle(nullptr));
-	surfaceCreateInfo.hwnd = HWND(platformWindowHandle);
-
-	result = vkCreateWin32SurfaceKHR(m_instance, &surfaceCreateInfo, nullptr, &m_surface);
-	CHECK_ERROR_AND_RETURN("could not create surface");
-#else
-#error "platform not supported. please implement me"
+	if (!m_headless)
+	{
+		VkWin32SurfaceCreateInfoKHR surfaceCreateInfo{ VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR, nullptr };
+		surfaceCreateInfo.flags = 0;
+		surfaceCreateInfo.hinstance = HINSTANCE(GetModuleHandle(nullptr));
+		surfaceCreateInfo.hwnd = HWND(platformWindowHandle);
+
+		result = vkCreateWin32SurfaceKHR(m_instance, &surfaceCreateInfo, nullptr, &m_surface);
+		CHECK_ERROR_AND_RETURN("could not create surface");
+	}
 #endif
 
 	struct PhysicalDevice
@@ -80,6 +98,8 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 		VkPhysicalDevice physicalDevice;
 		VkPhysicalDeviceProperties physicalDeviceProperties;
 		bool supportsNvMeshShader;
+		bool supportsDrawIndirectCount; // the mesh shader passes draw as many task groups as the culling pre-pass kept
+		bool supportsImageInt64Atomics; // optional, for the visibility buffer
 		uint32_t preferredQueueFamily;
 	};
 
@@ -90,6 +110,8 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 		PhysicalDevice physicalDevice;
 		physicalDevice.physicalDevice = vkPhysicalDevice;
 		physicalDevice.supportsNvMeshShader = false;
+		physicalDevice.supportsDrawIndirectCount = false;
+		physicalDevice.supportsImageInt64Atomics = false;
 		physicalDevice.preferredQueueFamily = UINT32_MAX;
 		vkGetPhysicalDeviceProperties(physicalDevice.physicalDevice, &physicalDevice.physicalDeviceProperties);
 
@@ -103,10 +125,11 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 		for (VkExtensionProperties const& extensionProperties : deviceExtensionProperties)
 		{
 			if (strcmp(extensionProperties.extensionName, VK_NV_MESH_SHADER_EXTENSION_NAME) == 0)
-			{
 				physicalDevice.supportsNvMeshShader = true;
-				break;
-			}
+			if (strcmp(extensionProperties.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+				physicalDevice.supportsDrawIndirectCount = true;
+			if (strcmp(extensionProperties.extensionName, VK_EXT_SHADER_IMAGE_ATOMIC_INT64_EXTENSION_NAME) == 0)
+				physicalDevice.supportsImageInt64Atomics = true;
 		}
 
 		uint32_t queueFamilyCount;
@@ -119,29 +142,33 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 			if ((queueFamilyProperties[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
 				continue;
 
-			VkBool32 surfaceSupported;
-			result = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice.physicalDevice, i, m_surface, &surfaceSupported);
-			CHECK_ERROR_AND_RETURN("could not check if a physical device and queue supports the surface");
-			if (!surfaceSupported)
-				continue;
-
-			VkSurfaceCapabilitiesKHR surfaceCapabilities;
-			result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice.physicalDevice, m_surface, &surfaceCapabilities);
-			CHECK_ERROR_AND_RETURN("could not check device format capabilities");
-			if ((surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
-				continue;
+			// headless, any queue drawing and dispatching will do (the offscreen images support storage)
+			if (!m_headless)
+			{
+				VkBool32 surfaceSupported;
+				result = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice.physicalDevice, i, m_surface, &surfaceSupported);
+				CHECK_ERROR_AND_RETURN("could not check if a physical device and queue supports the surface");
+				if (!surfaceSupported)
+					continue;
+
+				VkSurfaceCapabilitiesKHR surfaceCapabilities;
+				result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice.physicalDevice, m_surface, &surfaceCapabilities);
+				CHECK_ERROR_AND_RETURN("could not check device format capabilities");
+				if ((surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
+					continue;
 
 #ifdef _WIN32
-			if (!vkGetPhysicalDeviceWin32PresentationSupportKHR(physicalDevice.physicalDevice, i))
-				continue;
-#else
-#error "platform not supported. please implement me"
+				if (!vkGetPhysicalDeviceWin32PresentationSupportKHR(physicalDevice.physicalDevice, i))
+					continue;
 #endif
+			}
 
 			physicalDevice.preferredQueueFamily = i;
 		}
 
-		if (physicalDevice.supportsNvMeshShader && physicalDevice.preferredQueueFamily != UINT32_MAX)
+		// devices without mesh shaders (or without the indirect count draws they need) use the compute rasterizer
+		physicalDevice.supportsNvMeshShader = physicalDevice.supportsNvMeshShader && physicalDevice.supportsDrawIndirectCount;
+		if (physicalDevice.preferredQueueFamily != UINT32_MAX)
 			physicalDevices.emplace_back(physicalDevice);
 	}
 
@@ -165,6 +192,9 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 			default: break;
 			}
 
+			if (physicalDevice.supportsNvMeshShader)
+				score |= 1ull << 61;
+
 			score |= physicalDevice.physicalDeviceProperties.driverVersion;
 
 			return score;
@@ -188,14 +218,34 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 
 	PhysicalDevice &physicalDevice = physicalDevices[preferredDeviceIndex];
 	m_physicalDevice = physicalDevice.physicalDevice;
+	m_physicalDeviceProperties = physicalDevice.physicalDeviceProperties;
 	m_supportsNvMeshShader = physicalDevice.supportsNvMeshShader;
+	m_timestampPeriod = physicalDevice.physicalDeviceProperties.limits.timestampPeriod;
+
+	// block compressed geometry images need it, uncompressed ones do not
+	VkPhysicalDeviceShaderImageAtomicInt64FeaturesEXT supportedImageAtomicInt64Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_IMAGE_ATOMIC_INT64_FEATURES_EXT, nullptr };
+	VkPhysicalDeviceFeatures2 supportedFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, nullptr };
+	if (physicalDevice.supportsImageInt64Atomics)
+		supportedFeatures.pNext = &supportedImageAtomicInt64Features;
+	vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supportedFeatures);
+	m_supportsTextureCompressionBc = supportedFeatures.features.textureCompressionBC == VK_TRUE;
+
+	// the visibility buffer packs depth and triangle ids in 64-bit image atomics
+	m_supportsImageInt64Atomics = physicalDevice.supportsImageInt64Atomics && supportedFeatures.features.shaderInt64 == VK_TRUE
+		&& supportedImageAtomicInt64Features.shaderImageInt64Atomics == VK_TRUE;
 
 	std::vector<char const*> enabledDeviceExtensions;
-	enabledDeviceExtensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	if (!m_headless)
+		enabledDeviceExtensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 	enabledDeviceExtensions.emplace_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
 	enabledDeviceExtensions.emplace_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
 	if (m_supportsNvMeshShader)
+	{
+		enabledDeviceExtensions.emplace_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
 		enabledDeviceExtensions.emplace_back(VK_NV_MESH_SHADER_EXTENSION_NAME);
+	}
+	if (m_supportsImageInt64Atomics)
+		enabledDeviceExtensions.emplace_back(VK_EXT_SHADER_IMAGE_ATOMIC_INT64_EXTENSION_NAME);
 
 	float queuePriorities[] = { 1.0f };
 	VkDeviceQueueCreateInfo queueCreateInfo{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, nullptr };
@@ -212,6 +262,15 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	float16int8Features.shaderFloat16 = VK_FALSE;
 	float16int8Features.shaderInt8 = VK_TRUE;
 
+	VkPhysicalDeviceShaderImageAtomicInt64FeaturesEXT imageAtomicInt64Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_IMAGE_ATOMIC_INT64_FEATURES_EXT, nullptr };
+	imageAtomicInt64Features.shaderImageInt64Atomics = VK_TRUE;
+	imageAtomicInt64Features.sparseImageInt64Atomics = VK_FALSE;
+
+	VkPhysicalDeviceFeatures enabledFeatures{};
+	enabledFeatures.textureCompressionBC = m_supportsTextureCompressionBc ? VK_TRUE : VK_FALSE;
+	enabledFeatures.shaderInt64 = m_supportsImageInt64Atomics ? VK_TRUE : VK_FALSE;
+	enabledFeatures.shaderInt16 = supportedFeatures.features.shaderInt16; // the footprints the mesh shaders rasterize are packed 2x16
+
 	VkDeviceCreateInfo deviceCreateInfo{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO, nullptr };
 	deviceCreateInfo.flags = 0;
 	deviceCreateInfo.queueCreateInfoCount = 1;
@@ -220,13 +279,21 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	deviceCreateInfo.ppEnabledLayerNames = nullptr;
 	deviceCreateInfo.enabledExtensionCount = uint32_t(enabledDeviceExtensions.size());
 	deviceCreateInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
-	deviceCreateInfo.pEnabledFeatures = nullptr;
+	deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
 	// pNext chain (redundant lines, but allows commenting/decommenting)
-	meshShaderFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
-	deviceCreateInfo.pNext = &meshShaderFeatures;
+	if (m_supportsNvMeshShader)
+	{
+		meshShaderFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+		deviceCreateInfo.pNext = &meshShaderFeatures;
+	}
 	float16int8Features.pNext = const_cast<void*>(deviceCreateInfo.pNext);
 	deviceCreateInfo.pNext = &float16int8Features;
+	if (m_supportsImageInt64Atomics)
+	{
+		imageAtomicInt64Features.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+		deviceCreateInfo.pNext = &imageAtomicInt64Features;
+	}
 
 	result = vkCreateDevice(m_physicalDevice, &deviceCreateInfo, nullptr, &m_device);
 	CHECK_ERROR_AND_RETURN("could not create device");
@@ -236,32 +303,35 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	m_queueFamily = physicalDevice.preferredQueueFamily;
 	vkGetDeviceQueue(m_device, m_queueFamily, 0, &m_queue);
 
-	uint32_t presentModeCount;
-	result = vkGetPhysicalDeviceSurfacePresentModesKHR(m_physicalDevice, m_surface, &presentModeCount, nullptr);
-	CHECK_ERROR_AND_RETURN("could not check supported present modes");
-	m_presentModes.resize(presentModeCount);
-	result = vkGetPhysicalDeviceSurfacePresentModesKHR(m_physicalDevice, m_surface, &presentModeCount, m_presentModes.data());
-	CHECK_ERROR_AND_RETURN("could not check supported present modes");
-
-	std::sort(m_presentModes.begin(), m_presentModes.end(),
-		[](VkPresentModeKHR a, VkPresentModeKHR b)
+	if (!m_headless)
 	{
-		auto PresentModeScore = [](VkPresentModeKHR presentMode) -> uint32_t
+		uint32_t presentModeCount;
+		result = vkGetPhysicalDeviceSurfacePresentModesKHR(m_physicalDevice, m_surface, &presentModeCount, nullptr);
+		CHECK_ERROR_AND_RETURN("could not check supported present modes");
+		m_presentModes.resize(presentModeCount);
+		result = vkGetPhysicalDeviceSurfacePresentModesKHR(m_physicalDevice, m_surface, &presentModeCount, m_presentModes.data());
+		CHECK_ERROR_AND_RETURN("could not check supported present modes");
+
+		std::sort(m_presentModes.begin(), m_presentModes.end(),
+			[](VkPresentModeKHR a, VkPresentModeKHR b)
 		{
-			switch (presentMode)
+			auto PresentModeScore = [](VkPresentModeKHR presentMode) -> uint32_t
 			{
-			case VK_PRESENT_MODE_FIFO_KHR: return 40;
-			case VK_PRESENT_MODE_MAILBOX_KHR: return 30;
-			case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return 20;
-			case VK_PRESENT_MODE_IMMEDIATE_KHR: return 10;
-			default: return 0;
-			}
-		};
-
-		return PresentModeScore(a) > PresentModeScore(b);
+				switch (presentMode)
+				{
+				case VK_PRESENT_MODE_FIFO_KHR: return 40;
+				case VK_PRESENT_MODE_MAILBOX_KHR: return 30;
+				case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return 20;
+				case VK_PRESENT_MODE_IMMEDIATE_KHR: return 10;
+				default: return 0;
+				}
+			};
+
+			return PresentModeScore(a) > PresentModeScore(b);
+		}
+		);
+		m_currentPresentMode = m_presentModes[0];
 	}
-	);
-	m_currentPresentMode = m_presentModes[0];
 
 	for (uint32_t i = 0; i < 3; ++i)
 	{
@@ -270,7 +340,8 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	}
 
 	// TODO (this may differ based on monitor/surface)
-	m_surfaceFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	// offscreen images have the format combine_and_light.glsl writes (rgba8), which every device supports for storage
+	m_surfaceFormat = m_headless ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_B8G8R8A8_UNORM;
 
 	{
 		VmaVulkanFunctions vmaVulkanFunctions;
@@ -320,6 +391,9 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 		CHECK_ERROR_AND_RETURN("could not initialize vulkan memory allocator");
 	}
 
+	if (m_headless && !CreateOffscreenImages(headlessExtent))
+		return false;
+
 	{
 		VkSamplerCreateInfo samplerCreateInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, nullptr };
 		samplerCreateInfo.flags = 0;
@@ -339,17 +413,28 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 		samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
 		samplerCreateInfo.unnormalizedCoordinates = VK_FALSE; // spec states can't be used with mips
 		result = vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_pointWrapSampler);
+
+		// geometry images are fetched texel by texel, the last row and column of vertices of each mip come from the border buffer
+		// rather than from wrapped or clamped reads (parameterizations that are not periodic would otherwise get a seam across the mesh)
+		samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		result = vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_pointClampSampler);
 	}
 
 	{
 		// let's create a pool big enough for all we would ever need in this demo
-		VkDescriptorPoolSize descriptorPoolSize[3];
+		VkDescriptorPoolSize descriptorPoolSize[5];
 		descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		descriptorPoolSize[0].descriptorCount = 64;
 		descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 		descriptorPoolSize[1].descriptorCount = 64;
 		descriptorPoolSize[2].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
 		descriptorPoolSize[2].descriptorCount = 64;
+		descriptorPoolSize[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorPoolSize[3].descriptorCount = 64;
+		descriptorPoolSize[4].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorPoolSize[4].descriptorCount = 64;
 		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, nullptr };
 		descriptorPoolCreateInfo.flags = 0;
 		descriptorPoolCreateInfo.maxSets = 64;
@@ -360,22 +445,45 @@ auto InstanceDeviceAndSwapchain::Initialize(int32_t preferredDeviceIndex, void*
 	}
 
 	{
-		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[3];
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[7];
+		// compute: the material pass of the visibility buffer, and the compute rasterizer in place of the task and mesh shaders
+		VkShaderStageFlags taskStage = m_supportsNvMeshShader ? VK_SHADER_STAGE_TASK_BIT_NV : 0;
+		VkShaderStageFlags meshStage = m_supportsNvMeshShader ? VK_SHADER_STAGE_MESH_BIT_NV : 0;
 		descriptorSetLayoutBinding[0].binding = 0;
 		descriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorSetLayoutBinding[0].descriptorCount = 1;
-		descriptorSetLayoutBinding[0].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
-		descriptorSetLayoutBinding[0].pImmutableSamplers = &m_pointWrapSampler;
+		descriptorSetLayoutBinding[0].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[0].pImmutableSamplers = &m_pointClampSampler;
 		descriptorSetLayoutBinding[1].binding = 1;
 		descriptorSetLayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorSetLayoutBinding[1].descriptorCount = 1;
-		descriptorSetLayoutBinding[1].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
-		descriptorSetLayoutBinding[1].pImmutableSamplers = &m_pointWrapSampler;
+		descriptorSetLayoutBinding[1].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[1].pImmutableSamplers = &m_pointClampSampler;
 		descriptorSetLayoutBinding[2].binding = 2;
 		descriptorSetLayoutBinding[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorSetLayoutBinding[2].descriptorCount = 1;
-		descriptorSetLayoutBinding[2].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
-		descriptorSetLayoutBinding[2].pImmutableSamplers = &m_pointWrapSampler;
+		descriptorSetLayoutBinding[2].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[2].pImmutableSamplers = &m_pointClampSampler;
+		descriptorSetLayoutBinding[3].binding = 3;
+		descriptorSetLayoutBinding[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[3].descriptorCount = 1;
+		descriptorSetLayoutBinding[3].stageFlags = taskStage | meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[3].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[4].binding = 4; // page table
+		descriptorSetLayoutBinding[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[4].descriptorCount = 1;
+		descriptorSetLayoutBinding[4].stageFlags = taskStage | meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[4].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[5].binding = 5; // residency requests
+		descriptorSetLayoutBinding[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[5].descriptorCount = 1;
+		descriptorSetLayoutBinding[5].stageFlags = taskStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[5].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[6].binding = 6; // border vertices
+		descriptorSetLayoutBinding[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[6].descriptorCount = 1;
+		descriptorSetLayoutBinding[6].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[6].pImmutableSamplers = nullptr;
 
 		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
 		descriptorSetLayoutCreateInfo.flags = 0;
@@ -396,9 +504,20 @@ auto InstanceDeviceAndSwapchain::Uninitialize() -> void
 		frameExecutionContext.Uninitialize(m_device);
 	m_frameExecutionContexts.clear();
 
+	for (VkImageView imageView : m_swapchainImageViews)
+		vkDestroyImageView(m_device, imageView, nullptr);
+	m_swapchainImageViews.clear();
+	for (uint32_t i = 0; i < m_offscreenImageAllocations.size(); ++i)
+		vmaDestroyImage(m_allocator, m_swapchainImages[i], m_offscreenImageAllocations[i]);
+	m_offscreenImageAllocations.clear();
+	m_swapchainImages.clear();
+
 	vmaDestroyAllocator(m_allocator);
-	vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
-	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	// the surface and swapchain functions are not loaded headless
+	if (m_swapchain != VK_NULL_HANDLE)
+		vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+	if (m_surface != VK_NULL_HANDLE)
+		vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 	vkDestroyDevice(m_device, nullptr);
 	vkDestroyInstance(m_instance, nullptr);
 }
@@ -430,6 +549,13 @@ auto InstanceDeviceAndSwapchain::AcquireSwapchainImage() -> bool
 {
 	VkResult result;
 
+	// the offscreen image of the frame execution context, which the GPU is done with since BeginFrame waited for its fence
+	if (m_headless)
+	{
+		m_acquiredImageIndex = m_currentFrameExecutionContext;
+		return true;
+	}
+
 	if (!HasSwapchain())
 		RecreateSwapChain();
 	if (!HasSwapchain())
@@ -490,28 +616,32 @@ auto InstanceDeviceAndSwapchain::EndFrame() -> bool
 		submitInfo[0].pCommandBuffers = &m_frameExecutionContexts[m_currentFrameExecutionContext].m_preAcquireCommandBuffer;
 		submitInfo[0].signalSemaphoreCount = 0;
 		submitInfo[0].pSignalSemaphores = nullptr;
+		// headless, nothing is acquired or presented: both command buffers are submitted without semaphores
 		submitInfo[1] = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
-		submitInfo[1].waitSemaphoreCount = 1;
+		submitInfo[1].waitSemaphoreCount = m_headless ? 0 : 1;
 		submitInfo[1].pWaitSemaphores = &m_frameExecutionContexts[m_currentFrameExecutionContext].m_semaphore;
 		submitInfo[1].pWaitDstStageMask = pipelineStageFlags;
 		submitInfo[1].commandBufferCount = 1;
 		submitInfo[1].pCommandBuffers = &m_frameExecutionContexts[m_currentFrameExecutionContext].m_postAcquireCommandBuffer;
-		submitInfo[1].signalSemaphoreCount = 1;
+		submitInfo[1].signalSemaphoreCount = m_headless ? 0 : 1;
 		submitInfo[1].pSignalSemaphores = &m_frameExecutionContexts[m_currentFrameExecutionContext].m_semaphore;
 		result = vkQueueSubmit(m_queue, uint32_t(std::size(submitInfo)), submitInfo, m_frameExecutionContexts[m_currentFrameExecutionContext].m_allCommandsCompleted);
 
-		VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, nullptr };
-		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = &m_frameExecutionContexts[m_currentFrameExecutionContext].m_semaphore;
-		presentInfo.swapchainCount = 1;
-		presentInfo.pSwapchains = &m_swapchain;
-		presentInfo.pImageIndices = &m_acquiredImageIndex;
-		presentInfo.pResults = nullptr;
-		result = vkQueuePresentKHR(m_queue, &presentInfo);
-		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT)
-			; // these results will be handled when acquiring the next image
-		else
-			CHECK_ERROR_AND_RETURN("could not check device format capabilities");
+		if (!m_headless)
+		{
+			VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, nullptr };
+			presentInfo.waitSemaphoreCount = 1;
+			presentInfo.pWaitSemaphores = &m_frameExecutionContexts[m_currentFrameExecutionContext].m_semaphore;
+			presentInfo.swapchainCount = 1;
+			presentInfo.pSwapchains = &m_swapchain;
+			presentInfo.pImageIndices = &m_acquiredImageIndex;
+			presentInfo.pResults = nullptr;
+			result = vkQueuePresentKHR(m_queue, &presentInfo);
+			if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT)
+				; // these results will be handled when acquiring the next image
+			else
+				CHECK_ERROR_AND_RETURN("could not check device format capabilities");
+		}
 	}
 	else
 	{
@@ -527,6 +657,7 @@ auto InstanceDeviceAndSwapchain::EndFrame() -> bool
 		result = vkQueueSubmit(m_queue, 1, &submitInfo, m_frameExecutionContexts[m_currentFrameExecutionContext].m_allCommandsCompleted);
 	}
 
+	++m_frameNumber;
 	++m_currentFrameExecutionContext;
 	if (m_currentFrameExecutionContext >= m_frameExecutionContexts.size())
 		m_currentFrameExecutionContext = 0;
@@ -618,6 +749,64 @@ auto InstanceDeviceAndSwapchain::RecreateSwapChain() -> bool
 	return true;
 }
 
+auto InstanceDeviceAndSwapchain::CreateOffscreenImages(VkExtent2D extent) -> bool
+{
+	VkResult result;
+
+	// one per frame execution context, a frame only writes (and reads back) the image of its own
+	m_swapchainExtent = extent;
+	m_swapchainImages.resize(m_frameExecutionContexts.size());
+	m_offscreenImageAllocations.resize(m_frameExecutionContexts.size());
+	for (uint32_t i = 0; i < m_swapchainImages.size(); ++i)
+	{
+		VkImageCreateInfo imageCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
+		imageCreateInfo.flags = 0;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = m_surfaceFormat;
+		imageCreateInfo.extent = { extent.width, extent.height, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.queueFamilyIndexCount = 0;
+		imageCreateInfo.pQueueFamilyIndices = nullptr;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VmaAllocationCreateInfo allocationCreateInfo;
+		allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		allocationCreateInfo.requiredFlags = 0;
+		allocationCreateInfo.preferredFlags = 0;
+		allocationCreateInfo.memoryTypeBits = 0;
+		allocationCreateInfo.pool = VK_NULL_HANDLE;
+		allocationCreateInfo.pUserData = nullptr;
+
+		result = vmaCreateImage(m_allocator, &imageCreateInfo, &allocationCreateInfo, &m_swapchainImages[i], &m_offscreenImageAllocations[i], nullptr);
+		CHECK_ERROR_AND_RETURN("could not create offscreen image");
+
+		VkImageViewCreateInfo imageViewCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, nullptr };
+		imageViewCreateInfo.flags = 0;
+		imageViewCreateInfo.image = m_swapchainImages[i];
+		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCreateInfo.format = m_surfaceFormat;
+		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+		imageViewCreateInfo.subresourceRange.levelCount = 1;
+		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		imageViewCreateInfo.subresourceRange.layerCount = 1;
+		result = vkCreateImageView(m_device, &imageViewCreateInfo, nullptr, &m_swapchainImageViews.emplace_back());
+		CHECK_ERROR_AND_RETURN("could not create image view");
+	}
+
+	return true;
+}
+
 InstanceDeviceAndSwapchain::FrameExecutionContext::FrameExecutionContext()
 	: m_commandPool(VK_NULL_HANDLE)
 	, m_preAcquireCommandBuffer(VK_NULL_HANDLE)
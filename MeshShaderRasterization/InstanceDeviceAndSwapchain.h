@@ -1,9 +1,8 @@
 #pragma once
 
+// other platforms only render headless
 #ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
-#else
-#error "platform not supported. please implement me"
 #endif
 
 #include "volk/volk.h"
@@ -19,14 +18,25 @@ public:
 	InstanceDeviceAndSwapchain();
 	~InstanceDeviceAndSwapchain();
 
-	auto Initialize(int32_t preferredDeviceIndex, void* platformWindowHandle) -> bool;
+	// without a window (platformWindowHandle null) no surface extension is needed: frames are rendered to offscreen images of
+	// headlessExtent, acquired and released in place of the swapchain's
+	auto Initialize(int32_t preferredDeviceIndex, void* platformWindowHandle, VkExtent2D headlessExtent = { 1280, 720 }) -> bool;
 	auto Uninitialize() -> void;
 
 	auto GetInstance() const -> VkInstance const& { return m_instance; }
 	auto GetDevice() const -> VkDevice const& { return m_device; }
 	auto SupportsNvMeshShader() const -> bool { return m_supportsNvMeshShader; }
+	// the task and mesh shader stages when the device has them, none otherwise (the compute rasterizer runs in their place)
+	auto GetMeshShadingPipelineStages() const -> VkPipelineStageFlags { return m_supportsNvMeshShader ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV | VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV : 0; }
+	auto SupportsTextureCompressionBc() const -> bool { return m_supportsTextureCompressionBc; }
+	auto SupportsImageInt64Atomics() const -> bool { return m_supportsImageInt64Atomics; }
+	auto GetTimestampPeriod() const -> float { return m_timestampPeriod; } // nanoseconds per timestamp tick
+	auto GetPhysicalDeviceProperties() const -> VkPhysicalDeviceProperties const& { return m_physicalDeviceProperties; }
 	auto GetAllocator() const -> VmaAllocator const& { return m_allocator; }
+	auto GetQueue() const -> VkQueue const& { return m_queue; }
+	auto GetQueueFamily() const -> uint32_t { return m_queueFamily; }
 	auto GetPointWrapSampler() const -> VkSampler const& { return m_pointWrapSampler; }
+	auto GetPointClampSampler() const -> VkSampler const& { return m_pointClampSampler; }
 	auto GetDescriptorPool() const -> VkDescriptorPool const& { return m_descriptorPool; }
 	auto GetParameterizedMeshDescriptorSetLayout() const -> VkDescriptorSetLayout const& { return m_parameterizedMeshResourcesLayout; }
 
@@ -35,22 +45,34 @@ public:
 	auto WaitForSwapchainImage() -> bool;
 	auto EndFrame() -> bool;
 	auto WaitIdle() -> bool;
-	auto HasSwapchain() const -> bool { return m_swapchain != VK_NULL_HANDLE; }
+	auto IsHeadless() const -> bool { return m_headless; }
+	auto HasSwapchain() const -> bool { return m_swapchain != VK_NULL_HANDLE || m_headless; }
 	auto GetSwapchainExtent() const -> VkExtent2D const& { return m_swapchainExtent; }
+	auto GetSwapchainFormat() const -> VkFormat { return m_surfaceFormat; }
 	auto GetAcquiredImage() const -> VkImage const& { return m_swapchainImages[m_acquiredImageIndex]; }
 	auto GetAcquiredImageView() const -> VkImageView const& { return m_swapchainImageViews[m_acquiredImageIndex]; }
+	// frames are numbered from 1, each uses one of a few execution contexts that it only gets back once the GPU is done with it
+	auto GetFrameNumber() const -> uint32_t { return m_frameNumber; }
+	auto GetFrameExecutionContextIndex() const -> uint32_t { return m_currentFrameExecutionContext; }
+	auto GetFrameExecutionContextCount() const -> uint32_t { return uint32_t(m_frameExecutionContexts.size()); }
 	auto GetCommandBuffer() const -> VkCommandBuffer const& { return m_postWaitForSwapchainImage ? m_frameExecutionContexts[m_currentFrameExecutionContext].m_postAcquireCommandBuffer : m_frameExecutionContexts[m_currentFrameExecutionContext].m_preAcquireCommandBuffer; }
 
 private:
 	auto RecreateSwapChain() -> bool;
+	auto CreateOffscreenImages(VkExtent2D extent) -> bool;
 
 	VkInstance m_instance;
 	VkPhysicalDevice m_physicalDevice;
+	VkPhysicalDeviceProperties m_physicalDeviceProperties;
 	VkDevice m_device;
 	bool m_supportsNvMeshShader;
+	bool m_supportsTextureCompressionBc;
+	bool m_supportsImageInt64Atomics;
+	float m_timestampPeriod;
 
 	VmaAllocator m_allocator;
 	VkSampler m_pointWrapSampler;
+	VkSampler m_pointClampSampler;
 	VkDescriptorPool m_descriptorPool;
 	VkDescriptorSetLayout m_parameterizedMeshResourcesLayout;
 
@@ -67,6 +89,8 @@ private:
 	uint32_t m_acquiredImageIndex;
 	std::vector<VkImage> m_swapchainImages;
 	std::vector<VkImageView> m_swapchainImageViews;
+	bool m_headless;
+	std::vector<VmaAllocation> m_offscreenImageAllocations; // of the swapchain images when headless
 
 	struct FrameExecutionContext
 	{
@@ -90,5 +114,6 @@ private:
 	};
 	std::vector<FrameExecutionContext> m_frameExecutionContexts;
 	uint32_t m_currentFrameExecutionContext;
+	uint32_t m_frameNumber;
 	bool m_postWaitForSwapchainImage;
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "MegatileBounds.h"
+#include "GeometryImageFile.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// unit normal of the triangle, false if it is degenerate
+	auto GetTriangleNormal(float const* a, float const* b, float const* c, float normal[3]) -> bool
+	{
+		float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+		normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+		normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (!(length > 0))
+			return false;
+
+		for (uint32_t k = 0; k < 3; ++k)
+			normal[k] /= length;
+		return true;
+	}
+
+	// calls function(normal) for both triangles of every quad of the grid
+	template<typename Function>
+	auto ForEachTriangleNormal(float const* position, uint32_t width, uint32_t height, size_t rowStride, Function const& function) -> void
+	{
+		for (uint32_t row = 0; row + 1 < height; ++row)
+		{
+			for (uint32_t j = 0; j + 1 < width; ++j)
+			{
+				float const* a = position + 3 * (row * rowStride + j);
+				float const* b = a + 3;
+				float const* c = a + 3 * rowStride;
+				float const* d = c + 3;
+
+				float normal[3];
+				if (GetTriangleNormal(a, b, c, normal))
+					function(normal);
+				if (GetTriangleNormal(b, d, c, normal))
+					function(normal);
+			}
+		}
+	}
+}
+
+auto ComputeMegatileBounds(float const* position, uint32_t width, uint32_t height, size_t rowStride, float const padding[3], MegatileBounds& bounds) -> void
+{
+	// the sphere is centered on the box, the cone around the mean normal
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t row = 0; row < height; ++row)
+	{
+		for (uint32_t j = 0; j < width; ++j)
+		{
+			float const* p = position + 3 * (row * rowStride + j);
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				boundsMin[k] = std::min(boundsMin[k], p[k]);
+				boundsMax[k] = std::max(boundsMax[k], p[k]);
+			}
+		}
+	}
+
+	double axis[3] = { 0, 0, 0 };
+	ForEachTriangleNormal(position, width, height, rowStride, [&](float const normal[3])
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+			axis[k] += normal[k];
+	});
+	double axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		bounds.boundsMin[k] = FLT_MAX;
+		bounds.boundsMax[k] = -FLT_MAX;
+		bounds.boundingSphere[k] = width > 0 && height > 0 ? (boundsMin[k] + boundsMax[k]) / 2 : 0;
+		// opposite normals cancel out: any axis does, the cutoff tells the cone is useless
+		bounds.normalCone[k] = axisLength > 0 ? float(axis[k] / axisLength) : (k == 2 ? 1.0f : 0.0f);
+	}
+	bounds.boundsMin[3] = 0;
+	bounds.boundsMax[3] = 0;
+	bounds.boundingSphere[3] = 0;
+	bounds.normalCone[3] = 1;
+
+	ExtendMegatileBounds(position, width, height, rowStride, padding, bounds);
+}
+
+auto ExtendMegatileBounds(float const* position, uint32_t width, uint32_t height, size_t rowStride, float const padding[3], MegatileBounds& bounds) -> void
+{
+	float paddingLength = std::sqrt(padding[0] * padding[0] + padding[1] * padding[1] + padding[2] * padding[2]);
+
+	for (uint32_t row = 0; row < height; ++row)
+	{
+		for (uint32_t j = 0; j < width; ++j)
+		{
+			float const* p = position + 3 * (row * rowStride + j);
+
+			float squaredDistance = 0;
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				bounds.boundsMin[k] = std::min(bounds.boundsMin[k], p[k] - padding[k]);
+				bounds.boundsMax[k] = std::max(bounds.boundsMax[k], p[k] + padding[k]);
+				squaredDistance += (p[k] - bounds.boundingSphere[k]) * (p[k] - bounds.boundingSphere[k]);
+			}
+			bounds.boundingSphere[3] = std::max(bounds.boundingSphere[3], std::sqrt(squaredDistance) + paddingLength);
+		}
+	}
+
+	ForEachTriangleNormal(position, width, height, rowStride, [&](float const normal[3])
+	{
+		float cosine = normal[0] * bounds.normalCone[0] + normal[1] * bounds.normalCone[1] + normal[2] * bounds.normalCone[2];
+		bounds.normalCone[3] = std::min(bounds.normalCone[3], cosine);
+	});
+}
+
+auto ExtendCoarseMegatileBoxes(MegatileBounds* bounds, uint32_t size, uint32_t mipCount) -> void
+{
+	auto megatilesPerRow = [&](uint32_t mip) { return (std::max(size >> mip, 1u) + geometryImageMegatileSize - 1) / geometryImageMegatileSize; };
+
+	// from the finest mip up, each megatile takes the 2x2 of the finer mip covering it (a single one once the finer mip fits in one)
+	MegatileBounds* finerBounds = bounds;
+	for (uint32_t mip = 1; mip < mipCount; ++mip)
+	{
+		uint32_t finerPerRow = megatilesPerRow(mip - 1);
+		uint32_t perRow = megatilesPerRow(mip);
+		MegatileBounds* mipBounds = finerBounds + finerPerRow * finerPerRow;
+		for (uint32_t y = 0; y < perRow; ++y)
+		{
+			for (uint32_t x = 0; x < perRow; ++x)
+			{
+				MegatileBounds& megatileBounds = mipBounds[y * perRow + x];
+				for (uint32_t finerY = 2 * y; finerY < std::min(2 * y + 2, finerPerRow); ++finerY)
+				{
+					for (uint32_t finerX = 2 * x; finerX < std::min(2 * x + 2, finerPerRow); ++finerX)
+					{
+						MegatileBounds const& finer = finerBounds[finerY * finerPerRow + finerX];
+						for (uint32_t k = 0; k < 3; ++k)
+						{
+							megatileBounds.boundsMin[k] = std::min(megatileBounds.boundsMin[k], finer.boundsMin[k]);
+							megatileBounds.boundsMax[k] = std::max(megatileBounds.boundsMax[k], finer.boundsMax[k]);
+						}
+					}
+				}
+			}
+		}
+		finerBounds = mipBounds;
+	}
+}
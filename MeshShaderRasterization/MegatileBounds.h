@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// coarse culling data of a megatile, covering every vertex and triangle its mesh workgroups produce: its own texels plus the column
+// and the row they read from its right and bottom neighbours (or from the last column and row of the mip)
+// laid out for std430 (megatileBuffer) and stored as is in the bounds table of geometry image files
+struct MegatileBounds
+{
+	float boundsMin[4];      // object space box, w unused
+	float boundsMax[4];
+	float boundingSphere[4]; // object space center and radius
+	float normalCone[4];     // axis, and the smallest cosine between it and a triangle normal: 0 or less when the normals span a hemisphere
+};
+
+// quads of a grid of positions are split in triangles as the mesh shader does: (a, b, c) and (b, d, c) with a the top left corner,
+// b right of it, c below it and d diagonal; the normal cone bounds their object space normals cross(b - a, c - a)
+// degenerate triangles (clamped reads past the last vertex of mips smaller than a mesh tile) are ignored, the mesh shader culls them anyway
+// positions are full precision: padding widens the box and the sphere by the quantization error of the position encoding
+
+// bounds of a grid of width x height positions (3 floats each), rows rowStride texels apart
+auto ComputeMegatileBounds(float const* position, uint32_t width, uint32_t height, size_t rowStride, float const padding[3], MegatileBounds& bounds) -> void;
+// grows bounds to cover another grid, keeping the sphere center and the cone axis
+auto ExtendMegatileBounds(float const* position, uint32_t width, uint32_t height, size_t rowStride, float const padding[3], MegatileBounds& bounds) -> void;
+
+// grows the box of every megatile past mip 0 to cover the boxes of the megatiles of the finer mip in its region, so that it bounds the
+// surface its quads stand for rather than only its decimated vertices (the single quad of the last mip is flat): lodMip in
+// test_ts.glsl measures the screen-space size of the quads with it, and culling only gets more conservative
+// bounds is the table of every mip of a size x size geometry image, laid out as in geometry image files
+auto ExtendCoarseMegatileBoxes(MegatileBounds* bounds, uint32_t size, uint32_t mipCount) -> void;
@@ -0,0 +1,95 @@
+#include "MegatileResidency.h"
+
+#include <algorithm>
+
+auto MegatileResidency::Initialize(uint32_t megatileCount, uint32_t pageCount) -> void
+{
+	m_pageTable.assign(megatileCount, invalidMegatilePage);
+	m_pages.assign(pageCount, { invalidMegatilePage, 0, false });
+
+	// handed out from the back, page 0 first
+	m_freePages.resize(pageCount);
+	for (uint32_t i = 0; i < pageCount; ++i)
+		m_freePages[i] = pageCount - 1 - i;
+}
+
+auto MegatileResidency::Allocate(uint32_t megatile, bool pinned) -> uint32_t
+{
+	if (m_pageTable[megatile] != invalidMegatilePage)
+	{
+		m_pages[m_pageTable[megatile]].m_pinned |= pinned;
+		return m_pageTable[megatile];
+	}
+
+	if (m_freePages.empty())
+		return invalidMegatilePage;
+
+	uint32_t page = m_freePages.back();
+	m_freePages.pop_back();
+
+	m_pages[page] = { megatile, 0, pinned };
+	m_pageTable[megatile] = page;
+	return page;
+}
+
+auto MegatileResidency::Update(uint32_t const* requestFrames, uint32_t requestFrame, uint32_t maxLoads, std::vector<Load>& loads) -> void
+{
+	loads.clear();
+
+	m_missingMegatiles.clear();
+	for (uint32_t megatile = uint32_t(m_pageTable.size()); megatile-- > 0;)
+	{
+		if (requestFrames[megatile] != requestFrame)
+			continue;
+
+		uint32_t page = m_pageTable[megatile];
+		if (page != invalidMegatilePage)
+			m_pages[page].m_lastRequestFrame = requestFrame;
+		else if (m_missingMegatiles.size() < maxLoads)
+			m_missingMegatiles.push_back(megatile);
+	}
+
+	if (m_missingMegatiles.empty())
+		return;
+
+	// least recently requested first, pages requested this frame are never evicted (a pool too small for a frame stops loading instead of thrashing)
+	m_evictionCandidates.clear();
+	if (m_missingMegatiles.size() > m_freePages.size())
+	{
+		for (uint32_t page = 0; page < m_pages.size(); ++page)
+		{
+			if (!m_pages[page].m_pinned && m_pages[page].m_megatile != invalidMegatilePage && m_pages[page].m_lastRequestFrame != requestFrame)
+				m_evictionCandidates.push_back(page);
+		}
+
+		size_t evictionCount = std::min(m_evictionCandidates.size(), m_missingMegatiles.size() - m_freePages.size());
+		std::partial_sort(m_evictionCandidates.begin(), m_evictionCandidates.begin() + evictionCount, m_evictionCandidates.end(), [&](uint32_t a, uint32_t b)
+		{
+			return m_pages[a].m_lastRequestFrame < m_pages[b].m_lastRequestFrame;
+		});
+		m_evictionCandidates.resize(evictionCount);
+		std::reverse(m_evictionCandidates.begin(), m_evictionCandidates.end());
+	}
+
+	for (uint32_t megatile : m_missingMegatiles)
+	{
+		uint32_t page;
+		if (!m_freePages.empty())
+		{
+			page = m_freePages.back();
+			m_freePages.pop_back();
+		}
+		else if (!m_evictionCandidates.empty())
+		{
+			page = m_evictionCandidates.back();
+			m_evictionCandidates.pop_back();
+			m_pageTable[m_pages[page].m_megatile] = invalidMegatilePage;
+		}
+		else
+			break;
+
+		m_pages[page] = { megatile, requestFrame, false };
+		m_pageTable[megatile] = page;
+		loads.push_back({ megatile, page });
+	}
+}
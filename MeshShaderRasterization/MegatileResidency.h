@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+const uint32_t invalidMegatilePage = 0xffffffff;
+
+// decides which megatiles of a geometry image live in the pages of a fixed size pool
+// the task shader stamps the megatiles it wants with the frame number, the stamps come back a few frames later:
+// missing megatiles are loaded, evicting the pages requested the longest time ago
+// megatiles are indexed mip by mip from mip 0 (as in megatileBuffer), higher indices are loaded first so coarse mips,
+// which the task shader falls back on, arrive before the fine ones
+class MegatileResidency
+{
+public:
+	struct Load
+	{
+		uint32_t m_megatile;
+		uint32_t m_page;
+	};
+
+	auto Initialize(uint32_t megatileCount, uint32_t pageCount) -> void;
+
+	// gives a free page to the megatile, or returns invalidMegatilePage once the pool is full (nothing is evicted)
+	// pinned megatiles are never evicted
+	auto Allocate(uint32_t megatile, bool pinned) -> uint32_t;
+
+	// requestFrames holds one stamp per megatile, the megatiles stamped with requestFrame are the ones wanted that frame
+	// at most maxLoads missing megatiles get a page, loads lists them (their contents must be copied to the page)
+	auto Update(uint32_t const* requestFrames, uint32_t requestFrame, uint32_t maxLoads, std::vector<Load>& loads) -> void;
+
+	auto GetPage(uint32_t megatile) const -> uint32_t { return m_pageTable[megatile]; }
+	// one page per megatile (invalidMegatilePage if not resident), what the shaders read
+	auto GetPageTable() const -> std::vector<uint32_t> const& { return m_pageTable; }
+	auto GetPageCount() const -> uint32_t { return uint32_t(m_pages.size()); }
+	auto GetResidentCount() const -> uint32_t { return uint32_t(m_pages.size() - m_freePages.size()); }
+
+private:
+	struct Page
+	{
+		uint32_t m_megatile;
+		uint32_t m_lastRequestFrame;
+		bool m_pinned;
+	};
+
+	std::vector<uint32_t> m_pageTable;
+	std::vector<Page> m_pages;
+	std::vector<uint32_t> m_freePages;
+	std::vector<uint32_t> m_missingMegatiles;
+	std::vector<uint32_t> m_evictionCandidates;
+};
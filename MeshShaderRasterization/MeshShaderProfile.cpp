@@ -0,0 +1,105 @@
+#include "MeshShaderProfile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+auto IsMeshShaderPermutationSupported(MeshShaderPermutation const& permutation, bool computeRasterizer) -> bool
+{
+	// 8x8 quads is the largest tile under the 256 vertices of a mesh shader, software rasterized footprints fit 4 bits per axis
+	bool tileSupported = permutation.tileSize == 4 || permutation.tileSize == 8;
+	bool workgroupSupported = computeRasterizer
+		? permutation.workgroupSize == 32 || permutation.workgroupSize == 64 || permutation.workgroupSize == 128
+		: permutation.workgroupSize == 32;
+	return tileSupported && workgroupSupported && permutation.softwareRasterMaxSize <= 8;
+}
+
+auto GetMeshShaderPermutationCandidates(bool computeRasterizer) -> std::vector<MeshShaderPermutation>
+{
+	uint32_t const tileSizes[] = { 8, 4 };
+	uint32_t const workgroupSizes[] = { 32, 64, 128 };
+	uint32_t const softwareRasterMaxSizes[] = { 0, 1, 2, 4 };
+
+	std::vector<MeshShaderPermutation> candidates;
+	for (uint32_t tileSize : tileSizes)
+	{
+		for (uint32_t workgroupSize : workgroupSizes)
+		{
+			for (uint32_t softwareRasterMaxSize : softwareRasterMaxSizes)
+			{
+				MeshShaderPermutation permutation = { tileSize, workgroupSize, softwareRasterMaxSize };
+				if (IsMeshShaderPermutationSupported(permutation, computeRasterizer))
+					candidates.push_back(permutation);
+			}
+		}
+	}
+	return candidates;
+}
+
+auto GetMeshShaderProfileKey(uint32_t vendorId, uint32_t deviceId, uint32_t driverVersion, bool computeRasterizer) -> std::string
+{
+	char key[64];
+	snprintf(key, sizeof(key), "%04x:%04x:%08x:%s", vendorId, deviceId, driverVersion, computeRasterizer ? "compute" : "mesh");
+	return key;
+}
+
+auto LoadMeshShaderProfile(std::string const& filepath, std::string const& key, bool computeRasterizer, MeshShaderPermutation& permutation) -> bool
+{
+	std::ifstream file(filepath);
+	if (!file.good())
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string lineKey;
+		MeshShaderPermutation linePermutation;
+		if (!(fields >> lineKey) || lineKey != key)
+			continue;
+		if (!(fields >> linePermutation.tileSize >> linePermutation.workgroupSize >> linePermutation.softwareRasterMaxSize))
+		{
+			std::cerr << "malformed mesh shader profile line in " << filepath << ": " << line << std::endl;
+			return false;
+		}
+		if (!IsMeshShaderPermutationSupported(linePermutation, computeRasterizer))
+		{
+			std::cerr << "unsupported mesh shader permutation in " << filepath << ": " << line << std::endl;
+			return false;
+		}
+		permutation = linePermutation;
+		return true;
+	}
+	return false;
+}
+
+auto SaveMeshShaderProfile(std::string const& filepath, std::string const& key, MeshShaderPermutation const& permutation, std::string const& comment) -> bool
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(filepath);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string lineKey;
+			if (!(fields >> lineKey) || lineKey != key)
+				lines.push_back(line);
+		}
+	}
+
+	std::ostringstream line;
+	line << key << " " << permutation.tileSize << " " << permutation.workgroupSize << " " << permutation.softwareRasterMaxSize << " " << comment;
+	lines.push_back(line.str());
+
+	std::ofstream file(filepath, std::ios::trunc);
+	for (std::string const& kept : lines)
+		file << kept << "\n";
+	if (!file.good())
+	{
+		std::cerr << "could not write " << filepath << std::endl;
+		return false;
+	}
+	return true;
+}
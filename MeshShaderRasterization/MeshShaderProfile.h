@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// shape of the task and mesh shaders: the tile and workgroup sizes are compiled in (TILE_SIZE and WORKGROUP_SIZE in test_ts.glsl,
+// test_ms.glsl and resolve_visibility.glsl), the software raster size is a specialization constant
+// the fastest one differs between GPU generations: main.cpp -autotune times the candidates on the device and keeps the fastest in a
+// profile, loaded on the next start
+struct MeshShaderPermutation
+{
+	uint32_t tileSize;              // quads per side of the tile of a mesh shader workgroup: 8 (81 vertices, 128 triangles) or 4 (25, 32)
+	uint32_t workgroupSize;         // invocations of the mesh shader workgroup, one subgroup of 32 with mesh shaders
+	uint32_t softwareRasterMaxSize; // see MeshShadingRenderLoop::SetSoftwareRasterMaxSize
+};
+
+const MeshShaderPermutation defaultMeshShaderPermutation = { 8, 32, 1 };
+
+// the mesh shader path runs its workgroup as one subgroup (subgroup ballots instead of shared atomics), the compute rasterizer can
+// take 32, 64 or 128 invocations
+auto IsMeshShaderPermutationSupported(MeshShaderPermutation const& permutation, bool computeRasterizer) -> bool;
+auto GetMeshShaderPermutationCandidates(bool computeRasterizer) -> std::vector<MeshShaderPermutation>;
+
+// a text file of one line per device, driver and rasterizer:
+// "<vendorID>:<deviceID>:<driverVersion>:<mesh|compute> <tileSize> <workgroupSize> <softwareRasterMaxSize> <comment>"
+// the driver is part of the key as it changes what is fastest, a new driver tunes again
+auto GetMeshShaderProfileKey(uint32_t vendorId, uint32_t deviceId, uint32_t driverVersion, bool computeRasterizer) -> std::string;
+// false when the file has no line for the key, or an unsupported permutation on it
+auto LoadMeshShaderProfile(std::string const& filepath, std::string const& key, bool computeRasterizer, MeshShaderPermutation& permutation) -> bool;
+// replaces the line of the key, the lines of other devices stay
+auto SaveMeshShaderProfile(std::string const& filepath, std::string const& key, MeshShaderPermutation const& permutation, std::string const& comment) -> bool;
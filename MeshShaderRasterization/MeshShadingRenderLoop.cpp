@@ -1,11 +1,100 @@
 #include "MeshShadingRenderLoop.h"
+#include "GeometryImageEncoding.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
 
 struct ViewportConstants
 {
 	float projectionMatrix[4][4];
 	float viewportSize[4];
+	uint32_t statisticsSlot;   // frame execution context, where the task shader counts culled megatiles
+	uint32_t occlusionCulling; // whether the task shader tests megatiles against the depth pyramids
+	float lodPixelError;       // screen size in pixels the task shader lets quads grow to before drawing a finer mip
+	uint32_t depthEpoch;       // tags the software rasterized depth of this frame with reversed-Z
+};
+
+struct MeshConstants
+{
+	float positionScale[4]; // dequantizes position texels to object space
+	float positionBias[4];
+	uint32_t taskGroupsPerRow; // each task group covers 8x8 megatiles
+	uint32_t mipCount;
+	uint32_t requestOffset;    // where this frame stamps the megatiles it wants in the request buffer
+	uint32_t requestFrame;
+	uint32_t firstVisibleTaskGroup; // where the task groups of the mesh the culling pre-pass kept start
+	uint32_t cullingPass;      // CullingPass, which depth pyramids the task shader tests megatiles against
+	uint32_t meshId;           // the material pass of the visibility buffer shades the pixels of this mesh, the compute rasterizer counts its work per mesh
+	uint32_t parameterization; // GeometryImageParameterization, the task shader stitches megatiles across its folds
+};
+
+struct TaskGroupCullingConstants
+{
+	uint32_t meshId;
+	uint32_t firstInstance;    // instances of the mesh are consecutive in the instance buffer
+	uint32_t instanceCount;
+	uint32_t taskGroupsPerRow;
+	uint32_t firstVisibleTaskGroup;
+	uint32_t firstDraw;
+	uint32_t maxDrawCount;
+	uint32_t reserved;
+};
+
+struct DepthPyramidConstants
+{
+	int32_t sourceSize[2];
+	int32_t destinationSize[2];
+	uint32_t depthEpoch;       // the first level decodes the software rasterized depth of this frame with reversed-Z
+	uint32_t reserved;
+};
+
+struct CombineAndLightConstants
+{
+	uint32_t depthEpoch;
 };
 
+// written at the start of the frame and after each pass: early depth, early depth pyramid, late depth, depth pyramid, G-buffer (or
+// the material pass of the visibility buffer)
+static const uint32_t passTimestampCount = 7;
+
+// the spec guarantees at least 2^16 - 1 task groups per draw, more instances take several draws
+static const uint32_t maxTaskGroupsPerDraw = 0xffff;
+
+// the draw buffer holds the visible task group count of each mesh, then its draw count, then the dispatch of the compute rasterizer's
+// task shader, then the draws of every mesh
+static const VkDeviceSize drawCountsOffset = maxMeshCount * sizeof(uint32_t);
+static const VkDeviceSize taskDispatchesOffset = 2 * maxMeshCount * sizeof(uint32_t);
+static const VkDeviceSize drawsOffset = taskDispatchesOffset + maxMeshCount * sizeof(VkDispatchIndirectCommand);
+
+// the compute rasterizer's geometry buffer starts with its draw and allocation counters (32 bytes, as a vertex)
+static const VkDeviceSize computeRasterVerticesOffset = sizeof(ComputeRasterVertex);
+static const VkDeviceSize computeRasterIndicesOffset = computeRasterVerticesOffset + 81 * maxComputeRasterExportTileCount * sizeof(ComputeRasterVertex);
+static const uint32_t maxDrawCount = maxTaskGroupCount / maxTaskGroupsPerDraw + maxMeshCount;
+
+static auto GetMeshConstants(ParameterizedMesh const& mesh, InstanceDeviceAndSwapchain const& device) -> MeshConstants
+{
+	MeshConstants meshConstants;
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		meshConstants.positionScale[k] = mesh.GetPositionBoundsMax()[k] - mesh.GetPositionBoundsMin()[k];
+		meshConstants.positionBias[k] = mesh.GetPositionBoundsMin()[k];
+	}
+	meshConstants.positionScale[3] = 0;
+	meshConstants.positionBias[3] = 1;
+	meshConstants.taskGroupsPerRow = mesh.GetSize() / (64 * 8);
+	meshConstants.mipCount = mesh.GetMipCount();
+	meshConstants.requestOffset = mesh.GetRequestOffset(device.GetFrameExecutionContextIndex());
+	meshConstants.requestFrame = device.GetFrameNumber();
+	meshConstants.firstVisibleTaskGroup = 0;
+	meshConstants.cullingPass = CullingPass_EarlyDepth;
+	meshConstants.meshId = 0;
+	meshConstants.parameterization = mesh.GetParameterization();
+	return meshConstants;
+}
+
 auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device) -> bool
 {
 	VkResult result;
@@ -13,11 +102,43 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 	VkDevice vkDevice = device.GetDevice();
 	VmaAllocator allocator = device.GetAllocator();
 
-	m_taskShader.Initialize(vkDevice, "shaders/test_ts.glsl", VK_SHADER_STAGE_TASK_BIT_NV, {});
-	m_depthPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_MESH_BIT_NV, {"DEPTH_PASS"});
-	m_gbufferPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_MESH_BIT_NV, {"GBUFFER_PASS"});
+	// the task and mesh shaders run as compute shaders on devices without them, their exported triangles drawn by a vertex shader
+	m_computeRasterizer = m_computeRasterizer || !device.SupportsNvMeshShader();
+	m_taskShaderStage = m_computeRasterizer ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV;
+	m_meshShaderStage = m_computeRasterizer ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV;
+	if (m_computeRasterizer)
+	{
+		m_depthPassVertexShader.Initialize(vkDevice, "shaders/test_vs.glsl", VK_SHADER_STAGE_VERTEX_BIT, {"DEPTH_PASS"});
+		m_gbufferPassVertexShader.Initialize(vkDevice, "shaders/test_vs.glsl", VK_SHADER_STAGE_VERTEX_BIT, {"GBUFFER_PASS"});
+	}
+	// the passes reading the software rasterized depth read the image or the tiled buffer
+	char const* depthLayoutDefine = m_tiledDepth ? "TILED_DEPTH=1" : "TILED_DEPTH=0";
+	std::string tiledDepthBlocksPerRowDefine = "TILED_DEPTH_BLOCKS_PER_ROW=" + std::to_string(tiledDepthBlocksPerRow);
+	std::string tiledDepthTileCountDefine = "TILED_DEPTH_TILE_COUNT=" + std::to_string(tiledDepthTileCount);
+	// and every pass comparing depths knows which way is nearer
+	char const* depthDirectionDefine = m_reversedZ ? "REVERSED_Z=1" : "REVERSED_Z=0";
 	m_gbufferPassFragmentShader.Initialize(vkDevice, "shaders/test_fs.glsl", VK_SHADER_STAGE_FRAGMENT_BIT, {});
-	m_combineAndLightComputeShader.Initialize(vkDevice, "shaders/combine_and_light.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {});
+	m_combineAndLightComputeShader.Initialize(vkDevice, "shaders/combine_and_light.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine});
+	m_depthPyramidFirstLevelShader.Initialize(vkDevice, "shaders/build_depth_pyramid.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {"FIRST_LEVEL", depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine});
+	m_depthPyramidShader.Initialize(vkDevice, "shaders/build_depth_pyramid.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {depthDirectionDefine});
+	m_cullTaskGroupsShader.Initialize(vkDevice, "shaders/cull_task_groups.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {});
+	m_writeTaskGroupDrawsShader.Initialize(vkDevice, "shaders/cull_task_groups.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {"WRITE_DRAWS"});
+
+	// the visibility buffer packs depth and triangle ids in 64-bit image atomics, devices without them keep the G-buffer pass
+	m_supportsVisibilityBuffer = device.SupportsImageInt64Atomics() && !m_computeRasterizer;
+	if (m_visibilityBuffer && m_computeRasterizer)
+		std::cerr << "the compute rasterizer has no visibility buffer, drawing the G-buffer pass instead" << std::endl;
+	else if (m_visibilityBuffer && !m_supportsVisibilityBuffer)
+		std::cerr << "visibility buffer needs 64-bit image atomics, drawing the G-buffer pass instead" << std::endl;
+	if (m_supportsVisibilityBuffer)
+	{
+		m_visibilityPassFragmentShader.Initialize(vkDevice, "shaders/test_fs.glsl", VK_SHADER_STAGE_FRAGMENT_BIT, {"VISIBILITY_PASS", depthDirectionDefine});
+		m_depthPyramidFirstLevelVisibilityShader.Initialize(vkDevice, "shaders/build_depth_pyramid.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {"FIRST_LEVEL", "VISIBILITY_BUFFER", depthDirectionDefine});
+	}
+	if (m_tiledDepth && !m_reversedZ)
+	{
+		m_clearTiledDepthShader.Initialize(vkDevice, "shaders/clear_tiled_depth.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str()});
+	}
 
 	{
 		VmaAllocationCreateInfo allocationCreateInfo;
@@ -38,6 +159,71 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		bufferCreateInfo.pQueueFamilyIndices = nullptr;
 		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_viewportConstantsBuffer, &m_viewportConstantsAllocation, nullptr);
 
+		bufferCreateInfo.size = maxMeshInstanceCount * sizeof(MeshInstance);
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_instanceBuffer, &m_instanceAllocation, nullptr);
+
+		bufferCreateInfo.size = maxTaskGroupCount * sizeof(uint32_t);
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_visibleTaskGroupBuffer, &m_visibleTaskGroupAllocation, nullptr);
+		CHECK_ERROR_AND_RETURN("could not create visible task group buffer");
+
+		bufferCreateInfo.size = drawsOffset + maxDrawCount * sizeof(VkDrawMeshTasksIndirectCommandNV);
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_drawBuffer, &m_drawAllocation, nullptr);
+		CHECK_ERROR_AND_RETURN("could not create task group draw buffer");
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+		if (m_supportsVisibilityBuffer)
+		{
+			bufferCreateInfo.size = 4 * sizeof(uint32_t) + maxVisibilityClusterCount * sizeof(VisibilityCluster);
+			result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_visibilityClusterBuffer, &m_visibilityClusterAllocation, nullptr);
+			CHECK_ERROR_AND_RETURN("could not create visibility cluster buffer");
+		}
+
+		if (m_computeRasterizer)
+		{
+			bufferCreateInfo.size = maxMeshCount * sizeof(ComputeRasterCounters) + maxComputeRasterPayloadCount * sizeof(ComputeRasterPayload) + maxComputeRasterTileCount * sizeof(uint32_t);
+			bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_computeRasterWorkBuffer, &m_computeRasterWorkAllocation, nullptr);
+			CHECK_ERROR_AND_RETURN("could not create compute rasterizer work buffer");
+
+			bufferCreateInfo.size = computeRasterIndicesOffset + 384 * maxComputeRasterExportTileCount * sizeof(uint32_t);
+			bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_computeRasterGeometryBuffer, &m_computeRasterGeometryAllocation, nullptr);
+			CHECK_ERROR_AND_RETURN("could not create compute rasterizer geometry buffer");
+			bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		}
+
+		if (m_tiledDepth)
+		{
+			bufferCreateInfo.size = tiledDepthTileCount * sizeof(uint32_t) + tiledDepthTileCount * 64 * sizeof(uint32_t);
+			result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_tiledDepthBuffer, &m_tiledDepthAllocation, nullptr);
+			CHECK_ERROR_AND_RETURN("could not create tiled depth buffer");
+		}
+
+		// read back once the frame execution context comes around again, as the residency requests
+		VmaAllocationCreateInfo readbackAllocationCreateInfo = allocationCreateInfo;
+		readbackAllocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		readbackAllocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+		readbackAllocationCreateInfo.requiredFlags = 0;
+
+		VmaAllocationInfo allocationInfo;
+		bufferCreateInfo.size = device.GetFrameExecutionContextCount() * CullingPass_Count * sizeof(CullingStatistics);
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &readbackAllocationCreateInfo, &m_statisticsBuffer, &m_statisticsAllocation, &allocationInfo);
+		CHECK_ERROR_AND_RETURN("could not create culling statistics buffer");
+		m_statistics = (CullingStatistics const*)allocationInfo.pMappedData;
+		m_statisticsFrames.assign(device.GetFrameExecutionContextCount(), 0);
+		m_statisticsOcclusionCulling.assign(device.GetFrameExecutionContextCount(), false);
+
+		VkQueryPoolCreateInfo queryPoolCreateInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, nullptr };
+		queryPoolCreateInfo.flags = 0;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = device.GetFrameExecutionContextCount() * passTimestampCount;
+		queryPoolCreateInfo.pipelineStatistics = 0;
+		result = vkCreateQueryPool(vkDevice, &queryPoolCreateInfo, nullptr, &m_timestampQueryPool);
+		CHECK_ERROR_AND_RETURN("could not create timestamp query pool");
+		m_timestampPeriod = device.GetTimestampPeriod();
+
 		VkImageCreateInfo imageCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
 		imageCreateInfo.flags = 0;
 		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -67,6 +253,27 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 
 		result = vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &m_normalBuffer, &m_normalAllocation, nullptr);
 
+		if (m_supportsVisibilityBuffer)
+		{
+			imageCreateInfo.arrayLayers = 1;
+			imageCreateInfo.format = VK_FORMAT_R64_UINT;
+			imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			result = vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &m_visibilityImage, &m_visibilityAllocation, nullptr);
+			CHECK_ERROR_AND_RETURN("could not create visibility buffer");
+		}
+
+		imageCreateInfo.extent.width = depthPyramidSize;
+		imageCreateInfo.extent.height = depthPyramidSize;
+		imageCreateInfo.mipLevels = depthPyramidLevelCount;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		for (uint32_t i = 0; i < std::size(m_depthPyramids); ++i)
+		{
+			result = vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &m_depthPyramids[i], &m_depthPyramidAllocations[i], nullptr);
+			CHECK_ERROR_AND_RETURN("could not create depth pyramid");
+		}
+
 		VkImageViewCreateInfo imageViewCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, nullptr };
 		imageViewCreateInfo.flags = 0;
 		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -109,6 +316,37 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		result = vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_combineAndLightViews[0]);
 		imageViewCreateInfo.image = m_normalBuffer;
 		result = vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_combineAndLightViews[1]);
+
+		if (m_supportsVisibilityBuffer)
+		{
+			imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			imageViewCreateInfo.format = VK_FORMAT_R64_UINT;
+			imageViewCreateInfo.subresourceRange.layerCount = 1;
+			imageViewCreateInfo.image = m_visibilityImage;
+			result = vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_visibilityView);
+			CHECK_ERROR_AND_RETURN("could not create visibility buffer view");
+		}
+
+		// the task shader samples every level, the pyramid is built one level at a time
+		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageViewCreateInfo.subresourceRange.layerCount = 1;
+		for (uint32_t i = 0; i < std::size(m_depthPyramids); ++i)
+		{
+			imageViewCreateInfo.image = m_depthPyramids[i];
+			imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+			imageViewCreateInfo.subresourceRange.levelCount = depthPyramidLevelCount;
+			result = vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_depthPyramidViews[i]);
+			CHECK_ERROR_AND_RETURN("could not create depth pyramid view");
+
+			imageViewCreateInfo.subresourceRange.levelCount = 1;
+			for (uint32_t level = 0; level < depthPyramidLevelCount; ++level)
+			{
+				imageViewCreateInfo.subresourceRange.baseMipLevel = level;
+				result = vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_depthPyramidLevelViews[i][level]);
+				CHECK_ERROR_AND_RETURN("could not create depth pyramid level view");
+			}
+		}
 	}
 
 	{
@@ -162,6 +400,9 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		subpassDescription.preserveAttachmentCount = 0;
 		subpassDescription.pPreserveAttachments = nullptr;
 
+		// the triangles the compute rasterizer exports are drawn by a vertex shader, its own writes are synchronized outside the render pass
+		VkPipelineStageFlags geometryStage = m_computeRasterizer ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV;
+
 		VkSubpassDependency subpassDependency[3];
 		subpassDependency[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 		subpassDependency[0].dstSubpass = 0;
@@ -172,14 +413,14 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		subpassDependency[0].dependencyFlags = 0;
 		subpassDependency[1].srcSubpass = 0;
 		subpassDependency[1].dstSubpass = 0;
-		subpassDependency[1].srcStageMask = VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV;
-		subpassDependency[1].dstStageMask = VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV;
+		subpassDependency[1].srcStageMask = geometryStage;
+		subpassDependency[1].dstStageMask = geometryStage;
 		subpassDependency[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 		subpassDependency[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 		subpassDependency[1].dependencyFlags = 0;
 		subpassDependency[2].srcSubpass = 0;
 		subpassDependency[2].dstSubpass = VK_SUBPASS_EXTERNAL;
-		subpassDependency[2].srcStageMask = VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		subpassDependency[2].srcStageMask = geometryStage | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		subpassDependency[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		subpassDependency[2].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 		subpassDependency[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
@@ -194,6 +435,16 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		renderPassCreateInfo.dependencyCount = uint32_t(std::size(subpassDependency));
 		renderPassCreateInfo.pDependencies = subpassDependency;
 		result = vkCreateRenderPass(vkDevice, &renderPassCreateInfo, nullptr, &m_renderPass);
+
+		// the passes after a depth pyramid was built keep the depth, and wait for the pyramid to be done reading it
+		// (the software rasterized depth and the visibility buffer included)
+		attachmentDescription[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachmentDescription[0].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		subpassDependency[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		subpassDependency[0].dstStageMask = geometryStage | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		subpassDependency[0].srcAccessMask = 0;
+		subpassDependency[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		result = vkCreateRenderPass(vkDevice, &renderPassCreateInfo, nullptr, &m_resumeRenderPass);
 	}
 
 	{
@@ -209,27 +460,85 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 	}
 
 	{
-		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[4];
+		// compute: the material pass of the visibility buffer, and the compute rasterizer in place of the task and mesh shaders
+		VkShaderStageFlags taskStage = device.SupportsNvMeshShader() ? VK_SHADER_STAGE_TASK_BIT_NV : 0;
+		VkShaderStageFlags meshStage = device.SupportsNvMeshShader() ? VK_SHADER_STAGE_MESH_BIT_NV : 0;
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[15];
 		descriptorSetLayoutBinding[0].binding = 0;
 		descriptorSetLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		descriptorSetLayoutBinding[0].descriptorCount = 1;
-		descriptorSetLayoutBinding[0].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
+		descriptorSetLayoutBinding[0].stageFlags = taskStage | meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
 		descriptorSetLayoutBinding[0].pImmutableSamplers = nullptr;
 		descriptorSetLayoutBinding[1].binding = 1;
 		descriptorSetLayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 		descriptorSetLayoutBinding[1].descriptorCount = 1;
-		descriptorSetLayoutBinding[1].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
+		descriptorSetLayoutBinding[1].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
 		descriptorSetLayoutBinding[1].pImmutableSamplers = nullptr;
 		descriptorSetLayoutBinding[2].binding = 2;
 		descriptorSetLayoutBinding[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 		descriptorSetLayoutBinding[2].descriptorCount = 1;
-		descriptorSetLayoutBinding[2].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
+		descriptorSetLayoutBinding[2].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
 		descriptorSetLayoutBinding[2].pImmutableSamplers = nullptr;
 		descriptorSetLayoutBinding[3].binding = 3;
 		descriptorSetLayoutBinding[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 		descriptorSetLayoutBinding[3].descriptorCount = 1;
-		descriptorSetLayoutBinding[3].stageFlags = VK_SHADER_STAGE_MESH_BIT_NV;
+		descriptorSetLayoutBinding[3].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
 		descriptorSetLayoutBinding[3].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[4].binding = 4;
+		descriptorSetLayoutBinding[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[4].descriptorCount = 1;
+		descriptorSetLayoutBinding[4].stageFlags = taskStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[4].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[5].binding = 5;
+		descriptorSetLayoutBinding[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[5].descriptorCount = 1;
+		descriptorSetLayoutBinding[5].stageFlags = taskStage | meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[5].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[6].binding = 6;
+		descriptorSetLayoutBinding[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorSetLayoutBinding[6].descriptorCount = 1;
+		descriptorSetLayoutBinding[6].stageFlags = taskStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[6].pImmutableSamplers = &device.GetPointClampSampler();
+		descriptorSetLayoutBinding[7].binding = 7;
+		descriptorSetLayoutBinding[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorSetLayoutBinding[7].descriptorCount = 1;
+		descriptorSetLayoutBinding[7].stageFlags = taskStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[7].pImmutableSamplers = &device.GetPointClampSampler();
+		descriptorSetLayoutBinding[8].binding = 8;
+		descriptorSetLayoutBinding[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[8].descriptorCount = 1;
+		descriptorSetLayoutBinding[8].stageFlags = taskStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[8].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[9].binding = 9; // visibility buffer, only written with 64-bit image atomics
+		descriptorSetLayoutBinding[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorSetLayoutBinding[9].descriptorCount = 1;
+		descriptorSetLayoutBinding[9].stageFlags = meshStage | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[9].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[10].binding = 10; // visibility clusters
+		descriptorSetLayoutBinding[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[10].descriptorCount = 1;
+		descriptorSetLayoutBinding[10].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[10].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[11].binding = 11; // draw buffer, the visible task group counts
+		descriptorSetLayoutBinding[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[11].descriptorCount = 1;
+		descriptorSetLayoutBinding[11].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[11].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[12].binding = 12; // compute rasterizer payloads and tiles
+		descriptorSetLayoutBinding[12].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[12].descriptorCount = 1;
+		descriptorSetLayoutBinding[12].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[12].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[13].binding = 13; // compute rasterizer exported triangles
+		descriptorSetLayoutBinding[13].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[13].descriptorCount = 1;
+		descriptorSetLayoutBinding[13].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[13].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[14].binding = 14; // tiled depth, in place of the depth image of binding 1
+		descriptorSetLayoutBinding[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[14].descriptorCount = 1;
+		descriptorSetLayoutBinding[14].stageFlags = meshStage | VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorSetLayoutBinding[14].pImmutableSamplers = nullptr;
 
 		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
 		descriptorSetLayoutCreateInfo.flags = 0;
@@ -241,13 +550,22 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 	{
 		VkDescriptorSetLayout descriptorSetLayouts[] = { m_viewportResourcesLayout, device.GetParameterizedMeshDescriptorSetLayout()};
 
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = m_computeRasterizer ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(MeshConstants);
+
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
 		pipelineLayoutCreateInfo.flags = 0;
 		pipelineLayoutCreateInfo.setLayoutCount = uint32_t(std::size(descriptorSetLayouts));
 		pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts;
-		pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-		pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &m_graphicPipelineLayout);
+
+		// the same resources for the material pass of the visibility buffer and the compute rasterizer
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &m_meshComputePipelineLayout);
 	}
 
 	{
@@ -261,6 +579,18 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		bufferInfo.buffer = m_viewportConstantsBuffer;
 		bufferInfo.offset = 0;
 		bufferInfo.range = VK_WHOLE_SIZE;
+		VkDescriptorBufferInfo instanceBufferInfo;
+		instanceBufferInfo.buffer = m_instanceBuffer;
+		instanceBufferInfo.offset = 0;
+		instanceBufferInfo.range = VK_WHOLE_SIZE;
+		VkDescriptorBufferInfo statisticsBufferInfo;
+		statisticsBufferInfo.buffer = m_statisticsBuffer;
+		statisticsBufferInfo.offset = 0;
+		statisticsBufferInfo.range = VK_WHOLE_SIZE;
+		VkDescriptorBufferInfo visibleTaskGroupBufferInfo;
+		visibleTaskGroupBufferInfo.buffer = m_visibleTaskGroupBuffer;
+		visibleTaskGroupBufferInfo.offset = 0;
+		visibleTaskGroupBufferInfo.range = VK_WHOLE_SIZE;
 		VkDescriptorImageInfo imageInfo[3];
 		for (uint32_t i = 0; i < std::size(imageInfo); ++i)
 		{
@@ -268,8 +598,37 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 			imageInfo[i].imageView = m_meshShaderViews[i];
 			imageInfo[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 		}
+		VkDescriptorImageInfo depthPyramidInfo[2];
+		for (uint32_t i = 0; i < std::size(depthPyramidInfo); ++i)
+		{
+			depthPyramidInfo[i].sampler = VK_NULL_HANDLE;
+			depthPyramidInfo[i].imageView = m_depthPyramidViews[i];
+			depthPyramidInfo[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkDescriptorImageInfo visibilityInfo;
+		visibilityInfo.sampler = VK_NULL_HANDLE;
+		visibilityInfo.imageView = m_supportsVisibilityBuffer ? m_visibilityView : VK_NULL_HANDLE;
+		visibilityInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		VkDescriptorBufferInfo visibilityClusterBufferInfo;
+		visibilityClusterBufferInfo.buffer = m_supportsVisibilityBuffer ? m_visibilityClusterBuffer : VK_NULL_HANDLE;
+		visibilityClusterBufferInfo.offset = 0;
+		visibilityClusterBufferInfo.range = VK_WHOLE_SIZE;
+		VkDescriptorBufferInfo computeRasterBufferInfo[3];
+		computeRasterBufferInfo[0].buffer = m_drawBuffer;
+		computeRasterBufferInfo[1].buffer = m_computeRasterizer ? m_computeRasterWorkBuffer : VK_NULL_HANDLE;
+		computeRasterBufferInfo[2].buffer = m_computeRasterizer ? m_computeRasterGeometryBuffer : VK_NULL_HANDLE;
+		for (uint32_t i = 0; i < std::size(computeRasterBufferInfo); ++i)
+		{
+			computeRasterBufferInfo[i].offset = 0;
+			computeRasterBufferInfo[i].range = VK_WHOLE_SIZE;
+		}
+		VkDescriptorBufferInfo tiledDepthBufferInfo;
+		tiledDepthBufferInfo.buffer = m_tiledDepth ? m_tiledDepthBuffer : VK_NULL_HANDLE;
+		tiledDepthBufferInfo.offset = 0;
+		tiledDepthBufferInfo.range = VK_WHOLE_SIZE;
 
-		VkWriteDescriptorSet writeDescriptorSets[4];
+		VkWriteDescriptorSet writeDescriptorSets[15];
 		writeDescriptorSets[0] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
 		writeDescriptorSets[0].dstSet = m_viewportResources;
 		writeDescriptorSets[0].dstBinding = 0;
@@ -306,185 +665,106 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		writeDescriptorSets[3].pImageInfo = &imageInfo[2];
 		writeDescriptorSets[3].pBufferInfo = nullptr;
 		writeDescriptorSets[3].pTexelBufferView = nullptr;
-		vkUpdateDescriptorSets(vkDevice, uint32_t(std::size(writeDescriptorSets)), writeDescriptorSets, 0, nullptr);
-	}
-
-	{
-		VkPipelineShaderStageCreateInfo depthPipelineStages[2];
-		depthPipelineStages[0] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
-		depthPipelineStages[0].flags = 0;
-		depthPipelineStages[0].stage = VK_SHADER_STAGE_TASK_BIT_NV;
-		depthPipelineStages[0].module = m_taskShader.GetShaderModule();
-		depthPipelineStages[0].pName = "main";
-		depthPipelineStages[0].pSpecializationInfo = nullptr;
-		depthPipelineStages[1] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
-		depthPipelineStages[1].flags = 0;
-		depthPipelineStages[1].stage = VK_SHADER_STAGE_MESH_BIT_NV;
-		depthPipelineStages[1].module = m_depthPassMeshShader.GetShaderModule();
-		depthPipelineStages[1].pName = "main";
-		depthPipelineStages[1].pSpecializationInfo = nullptr;
-
-		VkPipelineShaderStageCreateInfo gbufferPipelineStages[3];
-		gbufferPipelineStages[0] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
-		gbufferPipelineStages[0].flags = 0;
-		gbufferPipelineStages[0].stage = VK_SHADER_STAGE_TASK_BIT_NV;
-		gbufferPipelineStages[0].module = m_taskShader.GetShaderModule();
-		gbufferPipelineStages[0].pName = "main";
-		gbufferPipelineStages[0].pSpecializationInfo = nullptr;
-		gbufferPipelineStages[1] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
-		gbufferPipelineStages[1].flags = 0;
-		gbufferPipelineStages[1].stage = VK_SHADER_STAGE_MESH_BIT_NV;
-		gbufferPipelineStages[1].module = m_gbufferPassMeshShader.GetShaderModule();
-		gbufferPipelineStages[1].pName = "main";
-		gbufferPipelineStages[1].pSpecializationInfo = nullptr;
-		gbufferPipelineStages[2] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
-		gbufferPipelineStages[2].flags = 0;
-		gbufferPipelineStages[2].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		gbufferPipelineStages[2].module = m_gbufferPassFragmentShader.GetShaderModule();
-		gbufferPipelineStages[2].pName = "main";
-		gbufferPipelineStages[2].pSpecializationInfo = nullptr;
-
-		VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, nullptr };
-		viewportState.flags = 0;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = nullptr;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = nullptr;
-
-		VkPipelineRasterizationStateCreateInfo rasterizationState{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO, nullptr };
-		rasterizationState.flags = 0;
-		rasterizationState.depthClampEnable = VK_FALSE;
-		rasterizationState.rasterizerDiscardEnable = VK_FALSE;
-		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizationState.cullMode = VK_CULL_MODE_NONE;
-		rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizationState.depthBiasEnable = VK_FALSE;
-		rasterizationState.depthBiasConstantFactor = 0;
-		rasterizationState.depthBiasClamp = 0;
-		rasterizationState.depthBiasSlopeFactor = 0;
-		rasterizationState.lineWidth = 1;
-
-		VkPipelineMultisampleStateCreateInfo multisampleState{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO, nullptr };
-		multisampleState.flags = 0;
-		multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisampleState.sampleShadingEnable = VK_FALSE;
-		multisampleState.minSampleShading = 0;
-		multisampleState.pSampleMask = nullptr;
-		multisampleState.alphaToCoverageEnable = VK_FALSE;
-		multisampleState.alphaToOneEnable = VK_FALSE;
-
-		VkPipelineDepthStencilStateCreateInfo depthPassDepthStencilState{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO, nullptr };
-		depthPassDepthStencilState.flags = 0;
-		depthPassDepthStencilState.depthTestEnable = VK_TRUE;
-		depthPassDepthStencilState.depthWriteEnable = VK_TRUE;
-		depthPassDepthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
-		depthPassDepthStencilState.depthBoundsTestEnable = VK_FALSE;
-		depthPassDepthStencilState.stencilTestEnable = VK_FALSE;
-		depthPassDepthStencilState.minDepthBounds = 0;
-		depthPassDepthStencilState.maxDepthBounds = 1;
-
-		VkPipelineDepthStencilStateCreateInfo gbufferPassDepthStencilState{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO, nullptr };
-		gbufferPassDepthStencilState.flags = 0;
-		gbufferPassDepthStencilState.depthTestEnable = VK_TRUE;
-		gbufferPassDepthStencilState.depthWriteEnable = VK_FALSE;
-		gbufferPassDepthStencilState.depthCompareOp = VK_COMPARE_OP_EQUAL;
-		gbufferPassDepthStencilState.depthBoundsTestEnable = VK_FALSE;
-		gbufferPassDepthStencilState.stencilTestEnable = VK_FALSE;
-		gbufferPassDepthStencilState.minDepthBounds = 0;
-		gbufferPassDepthStencilState.maxDepthBounds = 1;
-
-		VkPipelineColorBlendAttachmentState colorBlendAttachmentState[2];
-		colorBlendAttachmentState[0].blendEnable = VK_FALSE;
-		colorBlendAttachmentState[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachmentState[0].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachmentState[0].colorBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachmentState[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachmentState[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachmentState[0].alphaBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachmentState[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachmentState[1].blendEnable = VK_FALSE;
-		colorBlendAttachmentState[1].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachmentState[1].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachmentState[1].colorBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachmentState[1].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachmentState[1].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachmentState[1].alphaBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachmentState[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-		VkPipelineColorBlendStateCreateInfo colorBlendState{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO, nullptr };
-		colorBlendState.flags = 0;
-		colorBlendState.logicOpEnable = VK_FALSE;
-		colorBlendState.logicOp = VK_LOGIC_OP_COPY;
-		colorBlendState.attachmentCount = uint32_t(std::size(colorBlendAttachmentState));
-		colorBlendState.pAttachments = colorBlendAttachmentState;
-		colorBlendState.blendConstants[0] = 0;
-		colorBlendState.blendConstants[1] = 0;
-		colorBlendState.blendConstants[2] = 0;
-		colorBlendState.blendConstants[3] = 0;
-
-		VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-		VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO, nullptr };
-		dynamicState.flags = 0;
-		dynamicState.dynamicStateCount = uint32_t(std::size(dynamicStates));
-		dynamicState.pDynamicStates = dynamicStates;
-
-		VkPipelineInputAssemblyStateCreateInfo iaState{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO, nullptr };
-		iaState.flags = 0;
-		iaState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		iaState.primitiveRestartEnable = VK_FALSE;
-
-		VkGraphicsPipelineCreateInfo graphicsPipelineInfo[2];
-		graphicsPipelineInfo[0] = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, nullptr };
-		graphicsPipelineInfo[0].flags = 0;
-		graphicsPipelineInfo[0].stageCount = uint32_t(std::size(depthPipelineStages));
-		graphicsPipelineInfo[0].pStages = depthPipelineStages;
-		graphicsPipelineInfo[0].pVertexInputState = nullptr;
-		graphicsPipelineInfo[0].pInputAssemblyState = &iaState;
-		graphicsPipelineInfo[0].pTessellationState = nullptr;
-		graphicsPipelineInfo[0].pViewportState = &viewportState;
-		graphicsPipelineInfo[0].pRasterizationState = &rasterizationState;
-		graphicsPipelineInfo[0].pMultisampleState = &multisampleState;
-		graphicsPipelineInfo[0].pDepthStencilState = &depthPassDepthStencilState;
-		graphicsPipelineInfo[0].pColorBlendState = &colorBlendState;
-		graphicsPipelineInfo[0].pDynamicState = &dynamicState;
-		graphicsPipelineInfo[0].layout = m_graphicPipelineLayout;
-		graphicsPipelineInfo[0].renderPass = m_renderPass;
-		graphicsPipelineInfo[0].subpass = 0;
-		graphicsPipelineInfo[0].basePipelineHandle = VK_NULL_HANDLE;
-		graphicsPipelineInfo[0].basePipelineIndex = 0;
-		graphicsPipelineInfo[1] = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, nullptr };
-		graphicsPipelineInfo[1].flags = 0;
-		graphicsPipelineInfo[1].stageCount = uint32_t(std::size(gbufferPipelineStages));
-		graphicsPipelineInfo[1].pStages = gbufferPipelineStages;
-		graphicsPipelineInfo[1].pVertexInputState = nullptr;
-		graphicsPipelineInfo[1].pInputAssemblyState = &iaState;
-		graphicsPipelineInfo[1].pTessellationState = nullptr;
-		graphicsPipelineInfo[1].pViewportState = &viewportState;
-		graphicsPipelineInfo[1].pRasterizationState = &rasterizationState;
-		graphicsPipelineInfo[1].pMultisampleState = &multisampleState;
-		graphicsPipelineInfo[1].pDepthStencilState = &gbufferPassDepthStencilState;
-		graphicsPipelineInfo[1].pColorBlendState = &colorBlendState;
-		graphicsPipelineInfo[1].pDynamicState = &dynamicState;
-		graphicsPipelineInfo[1].layout = m_graphicPipelineLayout;
-		graphicsPipelineInfo[1].renderPass = m_renderPass;
-		graphicsPipelineInfo[1].subpass = 0;
-		graphicsPipelineInfo[1].basePipelineHandle = VK_NULL_HANDLE;
-		graphicsPipelineInfo[1].basePipelineIndex = 0;
-
-		// pInputAssemblyState is supposed to be ignored if we use a mesh shader
-		// but we get a GPU crash along with a validation error if we don't specify it (probably need to report this):
-		// Validation Error: [ UNASSIGNED-CoreValidation-Shader-PointSizeMissing ]
-		// false positive? "Pipeline topology is set to POINT_LIST, but PointSize is not written to in the shader corresponding to VK_SHADER_STAGE_MESH_BIT_NV"
-		// the mesh shader declares "layout(triangles) out;"
-		// POINT_LIST may be assumed default by validation since we don't have a pInputAssemblyState (member is ignored if we use a mesh shader)
-		VkPipeline pipelines[uint32_t(std::size(graphicsPipelineInfo))];
-		result = vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, uint32_t(std::size(graphicsPipelineInfo)), graphicsPipelineInfo, nullptr, pipelines);
-		m_meshDepthPass = pipelines[0];
-		m_meshGbufferPass = pipelines[1];
-	}
-
-	{
-		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[4];
+		writeDescriptorSets[4] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[4].dstSet = m_viewportResources;
+		writeDescriptorSets[4].dstBinding = 4;
+		writeDescriptorSets[4].dstArrayElement = 0;
+		writeDescriptorSets[4].descriptorCount = 1;
+		writeDescriptorSets[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[4].pImageInfo = nullptr;
+		writeDescriptorSets[4].pBufferInfo = &instanceBufferInfo;
+		writeDescriptorSets[4].pTexelBufferView = nullptr;
+		writeDescriptorSets[5] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[5].dstSet = m_viewportResources;
+		writeDescriptorSets[5].dstBinding = 5;
+		writeDescriptorSets[5].dstArrayElement = 0;
+		writeDescriptorSets[5].descriptorCount = 1;
+		writeDescriptorSets[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[5].pImageInfo = nullptr;
+		writeDescriptorSets[5].pBufferInfo = &statisticsBufferInfo;
+		writeDescriptorSets[5].pTexelBufferView = nullptr;
+		for (uint32_t i = 0; i < std::size(depthPyramidInfo); ++i)
+		{
+			writeDescriptorSets[6 + i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+			writeDescriptorSets[6 + i].dstSet = m_viewportResources;
+			writeDescriptorSets[6 + i].dstBinding = 6 + i;
+			writeDescriptorSets[6 + i].dstArrayElement = 0;
+			writeDescriptorSets[6 + i].descriptorCount = 1;
+			writeDescriptorSets[6 + i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeDescriptorSets[6 + i].pImageInfo = &depthPyramidInfo[i];
+			writeDescriptorSets[6 + i].pBufferInfo = nullptr;
+			writeDescriptorSets[6 + i].pTexelBufferView = nullptr;
+		}
+		writeDescriptorSets[8] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[8].dstSet = m_viewportResources;
+		writeDescriptorSets[8].dstBinding = 8;
+		writeDescriptorSets[8].dstArrayElement = 0;
+		writeDescriptorSets[8].descriptorCount = 1;
+		writeDescriptorSets[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[8].pImageInfo = nullptr;
+		writeDescriptorSets[8].pBufferInfo = &visibleTaskGroupBufferInfo;
+		writeDescriptorSets[8].pTexelBufferView = nullptr;
+		writeDescriptorSets[9] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[9].dstSet = m_viewportResources;
+		writeDescriptorSets[9].dstBinding = 9;
+		writeDescriptorSets[9].dstArrayElement = 0;
+		writeDescriptorSets[9].descriptorCount = 1;
+		writeDescriptorSets[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeDescriptorSets[9].pImageInfo = &visibilityInfo;
+		writeDescriptorSets[9].pBufferInfo = nullptr;
+		writeDescriptorSets[9].pTexelBufferView = nullptr;
+		writeDescriptorSets[10] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[10].dstSet = m_viewportResources;
+		writeDescriptorSets[10].dstBinding = 10;
+		writeDescriptorSets[10].dstArrayElement = 0;
+		writeDescriptorSets[10].descriptorCount = 1;
+		writeDescriptorSets[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[10].pImageInfo = nullptr;
+		writeDescriptorSets[10].pBufferInfo = &visibilityClusterBufferInfo;
+		writeDescriptorSets[10].pTexelBufferView = nullptr;
+		for (uint32_t i = 0; i < std::size(computeRasterBufferInfo); ++i)
+		{
+			writeDescriptorSets[11 + i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+			writeDescriptorSets[11 + i].dstSet = m_viewportResources;
+			writeDescriptorSets[11 + i].dstBinding = 11 + i;
+			writeDescriptorSets[11 + i].dstArrayElement = 0;
+			writeDescriptorSets[11 + i].descriptorCount = 1;
+			writeDescriptorSets[11 + i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[11 + i].pImageInfo = nullptr;
+			writeDescriptorSets[11 + i].pBufferInfo = &computeRasterBufferInfo[i];
+			writeDescriptorSets[11 + i].pTexelBufferView = nullptr;
+		}
+		writeDescriptorSets[14] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[14].dstSet = m_viewportResources;
+		writeDescriptorSets[14].dstBinding = 14;
+		writeDescriptorSets[14].dstArrayElement = 0;
+		writeDescriptorSets[14].descriptorCount = 1;
+		writeDescriptorSets[14].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[14].pImageInfo = nullptr;
+		writeDescriptorSets[14].pBufferInfo = &tiledDepthBufferInfo;
+		writeDescriptorSets[14].pTexelBufferView = nullptr;
+		// the visibility buffer bindings stay unwritten without 64-bit image atomics, the compute rasterizer ones without it, the
+		// tiled depth one without it, no pipeline uses them then
+		uint32_t writeDescriptorSetCount = m_supportsVisibilityBuffer ? 11 : 9;
+		if (m_computeRasterizer)
+		{
+			std::copy_n(writeDescriptorSets + 11, 3, writeDescriptorSets + writeDescriptorSetCount);
+			writeDescriptorSetCount += 3;
+		}
+		if (m_tiledDepth)
+		{
+			writeDescriptorSets[writeDescriptorSetCount] = writeDescriptorSets[14];
+			writeDescriptorSetCount += 1;
+		}
+		vkUpdateDescriptorSets(vkDevice, writeDescriptorSetCount, writeDescriptorSets, 0, nullptr);
+	}
+
+	if (!CreateMeshShaderPipelines(device))
+		return false;
+
+	{
+		// framebuffer depth, mesh shader depth, albedo, normal, tiled mesh shader depth
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[5];
 		for (uint32_t i = 0; i < std::size(descriptorSetLayoutBinding); ++i)
 		{
 			descriptorSetLayoutBinding[i].binding = i;
@@ -493,6 +773,8 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 			descriptorSetLayoutBinding[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 			descriptorSetLayoutBinding[i].pImmutableSamplers = &device.GetPointWrapSampler();
 		}
+		descriptorSetLayoutBinding[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[4].pImmutableSamplers = nullptr;
 
 		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
 		descriptorSetLayoutCreateInfo.flags = 0;
@@ -519,12 +801,17 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 	{
 		VkDescriptorSetLayout layouts[] = { m_combineAndLightResourcesLayout, m_swapchainResourcesLayout };
 
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CombineAndLightConstants);
+
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
 		pipelineLayoutCreateInfo.flags = 0;
 		pipelineLayoutCreateInfo.setLayoutCount = uint32_t(std::size(layouts));
 		pipelineLayoutCreateInfo.pSetLayouts = layouts;
-		pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-		pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &m_combineAndLightPipelineLayout);
 	}
 	{
@@ -548,7 +835,12 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		imageInfo[3].imageView = m_combineAndLightViews[1];
 		imageInfo[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		VkWriteDescriptorSet writeDescriptorSets[4];
+		VkDescriptorBufferInfo tiledDepthBufferInfo;
+		tiledDepthBufferInfo.buffer = m_tiledDepth ? m_tiledDepthBuffer : VK_NULL_HANDLE;
+		tiledDepthBufferInfo.offset = 0;
+		tiledDepthBufferInfo.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet writeDescriptorSets[5];
 		for (uint32_t i = 0; i < std::size(writeDescriptorSets); ++i)
 		{
 			writeDescriptorSets[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
@@ -557,12 +849,15 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 			writeDescriptorSets[i].dstArrayElement = 0;
 			writeDescriptorSets[i].descriptorCount = 1;
 			writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			writeDescriptorSets[i].pImageInfo = &imageInfo[i];
+			writeDescriptorSets[i].pImageInfo = i < 4 ? &imageInfo[i] : nullptr;
 			writeDescriptorSets[i].pBufferInfo = nullptr;
 			writeDescriptorSets[i].pTexelBufferView = nullptr;
 		}
+		writeDescriptorSets[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[4].pBufferInfo = &tiledDepthBufferInfo;
 
-		vkUpdateDescriptorSets(vkDevice, uint32_t(std::size(writeDescriptorSets)), writeDescriptorSets, 0, nullptr);
+		// the tiled depth binding stays unwritten without it
+		vkUpdateDescriptorSets(vkDevice, m_tiledDepth ? 5 : 4, writeDescriptorSets, 0, nullptr);
 	}
 
 	{
@@ -580,9 +875,493 @@ auto MeshShadingRenderLoop::Initialize(InstanceDeviceAndSwapchain const& device)
 		result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &m_combineAndLight);
 	}
 
+	{
+		// framebuffer depth (or previous level), mesh shader depth, destination level, visibility buffer, tiled mesh shader depth
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[5];
+		for (uint32_t i = 0; i < std::size(descriptorSetLayoutBinding); ++i)
+		{
+			descriptorSetLayoutBinding[i].binding = i;
+			descriptorSetLayoutBinding[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorSetLayoutBinding[i].descriptorCount = 1;
+			descriptorSetLayoutBinding[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			descriptorSetLayoutBinding[i].pImmutableSamplers = &device.GetPointClampSampler();
+		}
+		descriptorSetLayoutBinding[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorSetLayoutBinding[2].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorSetLayoutBinding[3].pImmutableSamplers = nullptr;
+		descriptorSetLayoutBinding[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorSetLayoutBinding[4].pImmutableSamplers = nullptr;
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
+		descriptorSetLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		descriptorSetLayoutCreateInfo.bindingCount = uint32_t(std::size(descriptorSetLayoutBinding));
+		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBinding;
+		result = vkCreateDescriptorSetLayout(vkDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_depthPyramidResourcesLayout);
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(DepthPyramidConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
+		pipelineLayoutCreateInfo.flags = 0;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &m_depthPyramidResourcesLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &m_depthPyramidPipelineLayout);
+
+		VkComputePipelineCreateInfo computePipelineInfo[2];
+		for (uint32_t i = 0; i < std::size(computePipelineInfo); ++i)
+		{
+			computePipelineInfo[i] = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+			computePipelineInfo[i].flags = 0;
+			computePipelineInfo[i].stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+			computePipelineInfo[i].stage.flags = 0;
+			computePipelineInfo[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			computePipelineInfo[i].stage.pName = "main";
+			computePipelineInfo[i].stage.pSpecializationInfo = nullptr;
+			computePipelineInfo[i].layout = m_depthPyramidPipelineLayout;
+			computePipelineInfo[i].basePipelineHandle = VK_NULL_HANDLE;
+			computePipelineInfo[i].basePipelineIndex = 0;
+		}
+		computePipelineInfo[0].stage.module = m_depthPyramidFirstLevelShader.GetShaderModule();
+		computePipelineInfo[1].stage.module = m_depthPyramidShader.GetShaderModule();
+
+		VkPipeline pipelines[uint32_t(std::size(computePipelineInfo))];
+		result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, uint32_t(std::size(computePipelineInfo)), computePipelineInfo, nullptr, pipelines);
+		m_buildDepthPyramidFirstLevel = pipelines[0];
+		m_buildDepthPyramid = pipelines[1];
+
+		if (m_supportsVisibilityBuffer)
+		{
+			computePipelineInfo[0].stage.module = m_depthPyramidFirstLevelVisibilityShader.GetShaderModule();
+			result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, computePipelineInfo, nullptr, &m_buildDepthPyramidFirstLevelVisibility);
+			CHECK_ERROR_AND_RETURN("could not create visibility buffer depth pyramid pipeline");
+		}
+	}
+
+	if (m_tiledDepth && !m_reversedZ)
+	{
+		// over the tiled depth binding of the viewport resources
+		VkComputePipelineCreateInfo computePipelineInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+		computePipelineInfo.flags = 0;
+		computePipelineInfo.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+		computePipelineInfo.stage.flags = 0;
+		computePipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineInfo.stage.module = m_clearTiledDepthShader.GetShaderModule();
+		computePipelineInfo.stage.pName = "main";
+		computePipelineInfo.stage.pSpecializationInfo = nullptr;
+		computePipelineInfo.layout = m_meshComputePipelineLayout;
+		computePipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		computePipelineInfo.basePipelineIndex = 0;
+		result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &m_clearTiledDepth);
+		CHECK_ERROR_AND_RETURN("could not create tiled depth clear pipeline");
+	}
+
+	{
+		// scene constants, instances, task group bounds of the mesh, draws, visible task groups, statistics
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[6];
+		for (uint32_t i = 0; i < std::size(descriptorSetLayoutBinding); ++i)
+		{
+			descriptorSetLayoutBinding[i].binding = i;
+			descriptorSetLayoutBinding[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorSetLayoutBinding[i].descriptorCount = 1;
+			descriptorSetLayoutBinding[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			descriptorSetLayoutBinding[i].pImmutableSamplers = nullptr;
+		}
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
+		descriptorSetLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		descriptorSetLayoutCreateInfo.bindingCount = uint32_t(std::size(descriptorSetLayoutBinding));
+		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBinding;
+		result = vkCreateDescriptorSetLayout(vkDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_taskGroupCullingResourcesLayout);
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(TaskGroupCullingConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
+		pipelineLayoutCreateInfo.flags = 0;
+		pipelineLayoutCreateInfo.setLayoutCount = 1;
+		pipelineLayoutCreateInfo.pSetLayouts = &m_taskGroupCullingResourcesLayout;
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		result = vkCreatePipelineLayout(vkDevice, &pipelineLayoutCreateInfo, nullptr, &m_taskGroupCullingPipelineLayout);
+
+		VkComputePipelineCreateInfo computePipelineInfo[2];
+		for (uint32_t i = 0; i < std::size(computePipelineInfo); ++i)
+		{
+			computePipelineInfo[i] = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+			computePipelineInfo[i].flags = 0;
+			computePipelineInfo[i].stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+			computePipelineInfo[i].stage.flags = 0;
+			computePipelineInfo[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			computePipelineInfo[i].stage.pName = "main";
+			computePipelineInfo[i].stage.pSpecializationInfo = nullptr;
+			computePipelineInfo[i].layout = m_taskGroupCullingPipelineLayout;
+			computePipelineInfo[i].basePipelineHandle = VK_NULL_HANDLE;
+			computePipelineInfo[i].basePipelineIndex = 0;
+		}
+		computePipelineInfo[0].stage.module = m_cullTaskGroupsShader.GetShaderModule();
+		computePipelineInfo[1].stage.module = m_writeTaskGroupDrawsShader.GetShaderModule();
+
+		VkPipeline pipelines[uint32_t(std::size(computePipelineInfo))];
+		result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, uint32_t(std::size(computePipelineInfo)), computePipelineInfo, nullptr, pipelines);
+		m_cullTaskGroups = pipelines[0];
+		m_writeTaskGroupDraws = pipelines[1];
+	}
+
+	return true;
+}
+
+auto MeshShadingRenderLoop::CreateMeshShaderPipelines(InstanceDeviceAndSwapchain const& device) -> bool
+{
+	VkResult result;
+
+	VkDevice vkDevice = device.GetDevice();
+
+	// the task and mesh shaders of the permutation, and the material pass rebuilding the tiles of its visibility pass
+	if (!IsMeshShaderPermutationSupported(m_meshShaderPermutation, m_computeRasterizer))
+	{
+		std::cerr << "unsupported mesh shader permutation (tile size " << m_meshShaderPermutation.tileSize << ", workgroup size "
+		          << m_meshShaderPermutation.workgroupSize << ", software raster size " << m_meshShaderPermutation.softwareRasterMaxSize << "), using the default" << std::endl;
+		m_meshShaderPermutation = defaultMeshShaderPermutation;
+	}
+	std::string tileSizeDefine = "TILE_SIZE=" + std::to_string(m_meshShaderPermutation.tileSize);
+	std::string workgroupSizeDefine = "WORKGROUP_SIZE=" + std::to_string(m_meshShaderPermutation.workgroupSize);
+	char const* depthLayoutDefine = m_tiledDepth ? "TILED_DEPTH=1" : "TILED_DEPTH=0";
+	std::string tiledDepthBlocksPerRowDefine = "TILED_DEPTH_BLOCKS_PER_ROW=" + std::to_string(tiledDepthBlocksPerRow);
+	std::string tiledDepthTileCountDefine = "TILED_DEPTH_TILE_COUNT=" + std::to_string(tiledDepthTileCount);
+	char const* depthDirectionDefine = m_reversedZ ? "REVERSED_Z=1" : "REVERSED_Z=0";
+
+	if (m_computeRasterizer)
+	{
+		m_taskShader.Initialize(vkDevice, "shaders/test_ts.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {"COMPUTE_RASTERIZER", tileSizeDefine.c_str(), depthDirectionDefine});
+		m_depthPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {"DEPTH_PASS", "COMPUTE_RASTERIZER", tileSizeDefine.c_str(), workgroupSizeDefine.c_str(), depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine, GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE, GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE});
+		m_gbufferPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {"GBUFFER_PASS", "COMPUTE_RASTERIZER", tileSizeDefine.c_str(), workgroupSizeDefine.c_str(), depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine, GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE, GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE});
+	}
+	else
+	{
+		m_taskShader.Initialize(vkDevice, "shaders/test_ts.glsl", VK_SHADER_STAGE_TASK_BIT_NV, {tileSizeDefine.c_str(), depthDirectionDefine});
+		m_depthPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_MESH_BIT_NV, {"DEPTH_PASS", tileSizeDefine.c_str(), workgroupSizeDefine.c_str(), depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine, GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE, GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE});
+		m_gbufferPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_MESH_BIT_NV, {"GBUFFER_PASS", tileSizeDefine.c_str(), workgroupSizeDefine.c_str(), depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine, GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE, GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE});
+	}
+	if (m_supportsVisibilityBuffer)
+	{
+		m_visibilityPassMeshShader.Initialize(vkDevice, "shaders/test_ms.glsl", VK_SHADER_STAGE_MESH_BIT_NV, {"VISIBILITY_PASS", tileSizeDefine.c_str(), workgroupSizeDefine.c_str(), depthDirectionDefine, GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE, GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE});
+		m_resolveVisibilityShader.Initialize(vkDevice, "shaders/resolve_visibility.glsl", VK_SHADER_STAGE_COMPUTE_BIT, {tileSizeDefine.c_str(), depthLayoutDefine, tiledDepthBlocksPerRowDefine.c_str(), tiledDepthTileCountDefine.c_str(), depthDirectionDefine, GEOMETRY_IMAGE_POSITION_ENCODING_DEFINE, GEOMETRY_IMAGE_NORMAL_ENCODING_DEFINE});
+	}
+
+	// the footprint of the triangles the mesh shaders rasterize themselves, sweepable per GPU without editing the shader
+	VkSpecializationMapEntry meshSpecializationMapEntry;
+	meshSpecializationMapEntry.constantID = 0;
+	meshSpecializationMapEntry.offset = 0;
+	meshSpecializationMapEntry.size = sizeof(m_meshShaderPermutation.softwareRasterMaxSize);
+
+	VkSpecializationInfo meshSpecializationInfo;
+	meshSpecializationInfo.mapEntryCount = 1;
+	meshSpecializationInfo.pMapEntries = &meshSpecializationMapEntry;
+	meshSpecializationInfo.dataSize = sizeof(m_meshShaderPermutation.softwareRasterMaxSize);
+	meshSpecializationInfo.pData = &m_meshShaderPermutation.softwareRasterMaxSize;
+
+	VkPipelineShaderStageCreateInfo depthPipelineStages[2];
+	depthPipelineStages[0] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+	depthPipelineStages[0].flags = 0;
+	depthPipelineStages[0].stage = VK_SHADER_STAGE_TASK_BIT_NV;
+	depthPipelineStages[0].module = m_taskShader.GetShaderModule();
+	depthPipelineStages[0].pName = "main";
+	depthPipelineStages[0].pSpecializationInfo = nullptr;
+	depthPipelineStages[1] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+	depthPipelineStages[1].flags = 0;
+	depthPipelineStages[1].stage = VK_SHADER_STAGE_MESH_BIT_NV;
+	depthPipelineStages[1].module = m_depthPassMeshShader.GetShaderModule();
+	depthPipelineStages[1].pName = "main";
+	depthPipelineStages[1].pSpecializationInfo = &meshSpecializationInfo;
+
+	VkPipelineShaderStageCreateInfo gbufferPipelineStages[3];
+	gbufferPipelineStages[0] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+	gbufferPipelineStages[0].flags = 0;
+	gbufferPipelineStages[0].stage = VK_SHADER_STAGE_TASK_BIT_NV;
+	gbufferPipelineStages[0].module = m_taskShader.GetShaderModule();
+	gbufferPipelineStages[0].pName = "main";
+	gbufferPipelineStages[0].pSpecializationInfo = nullptr;
+	gbufferPipelineStages[1] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+	gbufferPipelineStages[1].flags = 0;
+	gbufferPipelineStages[1].stage = VK_SHADER_STAGE_MESH_BIT_NV;
+	gbufferPipelineStages[1].module = m_gbufferPassMeshShader.GetShaderModule();
+	gbufferPipelineStages[1].pName = "main";
+	gbufferPipelineStages[1].pSpecializationInfo = &meshSpecializationInfo;
+	gbufferPipelineStages[2] = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+	gbufferPipelineStages[2].flags = 0;
+	gbufferPipelineStages[2].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	gbufferPipelineStages[2].module = m_gbufferPassFragmentShader.GetShaderModule();
+	gbufferPipelineStages[2].pName = "main";
+	gbufferPipelineStages[2].pSpecializationInfo = nullptr;
+
+	VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, nullptr };
+	viewportState.flags = 0;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = nullptr;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = nullptr;
+
+	VkPipelineRasterizationStateCreateInfo rasterizationState{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO, nullptr };
+	rasterizationState.flags = 0;
+	rasterizationState.depthClampEnable = VK_FALSE;
+	rasterizationState.rasterizerDiscardEnable = VK_FALSE;
+	rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizationState.cullMode = VK_CULL_MODE_NONE;
+	rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizationState.depthBiasEnable = VK_FALSE;
+	rasterizationState.depthBiasConstantFactor = 0;
+	rasterizationState.depthBiasClamp = 0;
+	rasterizationState.depthBiasSlopeFactor = 0;
+	rasterizationState.lineWidth = 1;
+
+	VkPipelineMultisampleStateCreateInfo multisampleState{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO, nullptr };
+	multisampleState.flags = 0;
+	multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampleState.sampleShadingEnable = VK_FALSE;
+	multisampleState.minSampleShading = 0;
+	multisampleState.pSampleMask = nullptr;
+	multisampleState.alphaToCoverageEnable = VK_FALSE;
+	multisampleState.alphaToOneEnable = VK_FALSE;
+
+	VkPipelineDepthStencilStateCreateInfo depthPassDepthStencilState{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO, nullptr };
+	depthPassDepthStencilState.flags = 0;
+	depthPassDepthStencilState.depthTestEnable = VK_TRUE;
+	depthPassDepthStencilState.depthWriteEnable = VK_TRUE;
+	depthPassDepthStencilState.depthCompareOp = m_reversedZ ? VK_COMPARE_OP_GREATER : VK_COMPARE_OP_LESS;
+	depthPassDepthStencilState.depthBoundsTestEnable = VK_FALSE;
+	depthPassDepthStencilState.stencilTestEnable = VK_FALSE;
+	depthPassDepthStencilState.minDepthBounds = 0;
+	depthPassDepthStencilState.maxDepthBounds = 1;
+
+	VkPipelineDepthStencilStateCreateInfo gbufferPassDepthStencilState{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO, nullptr };
+	gbufferPassDepthStencilState.flags = 0;
+	gbufferPassDepthStencilState.depthTestEnable = VK_TRUE;
+	gbufferPassDepthStencilState.depthWriteEnable = VK_FALSE;
+	gbufferPassDepthStencilState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+	gbufferPassDepthStencilState.depthBoundsTestEnable = VK_FALSE;
+	gbufferPassDepthStencilState.stencilTestEnable = VK_FALSE;
+	gbufferPassDepthStencilState.minDepthBounds = 0;
+	gbufferPassDepthStencilState.maxDepthBounds = 1;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachmentState[2];
+	colorBlendAttachmentState[0].blendEnable = VK_FALSE;
+	colorBlendAttachmentState[0].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachmentState[0].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachmentState[0].colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachmentState[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachmentState[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachmentState[0].alphaBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachmentState[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachmentState[1].blendEnable = VK_FALSE;
+	colorBlendAttachmentState[1].srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachmentState[1].dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachmentState[1].colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachmentState[1].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachmentState[1].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachmentState[1].alphaBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachmentState[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendState{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO, nullptr };
+	colorBlendState.flags = 0;
+	colorBlendState.logicOpEnable = VK_FALSE;
+	colorBlendState.logicOp = VK_LOGIC_OP_COPY;
+	colorBlendState.attachmentCount = uint32_t(std::size(colorBlendAttachmentState));
+	colorBlendState.pAttachments = colorBlendAttachmentState;
+	colorBlendState.blendConstants[0] = 0;
+	colorBlendState.blendConstants[1] = 0;
+	colorBlendState.blendConstants[2] = 0;
+	colorBlendState.blendConstants[3] = 0;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO, nullptr };
+	dynamicState.flags = 0;
+	dynamicState.dynamicStateCount = uint32_t(std::size(dynamicStates));
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineInputAssemblyStateCreateInfo iaState{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO, nullptr };
+	iaState.flags = 0;
+	iaState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	iaState.primitiveRestartEnable = VK_FALSE;
+
+	VkGraphicsPipelineCreateInfo graphicsPipelineInfo[2];
+	graphicsPipelineInfo[0] = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, nullptr };
+	graphicsPipelineInfo[0].flags = 0;
+	graphicsPipelineInfo[0].stageCount = uint32_t(std::size(depthPipelineStages));
+	graphicsPipelineInfo[0].pStages = depthPipelineStages;
+	graphicsPipelineInfo[0].pVertexInputState = nullptr;
+	graphicsPipelineInfo[0].pInputAssemblyState = &iaState;
+	graphicsPipelineInfo[0].pTessellationState = nullptr;
+	graphicsPipelineInfo[0].pViewportState = &viewportState;
+	graphicsPipelineInfo[0].pRasterizationState = &rasterizationState;
+	graphicsPipelineInfo[0].pMultisampleState = &multisampleState;
+	graphicsPipelineInfo[0].pDepthStencilState = &depthPassDepthStencilState;
+	graphicsPipelineInfo[0].pColorBlendState = &colorBlendState;
+	graphicsPipelineInfo[0].pDynamicState = &dynamicState;
+	graphicsPipelineInfo[0].layout = m_graphicPipelineLayout;
+	graphicsPipelineInfo[0].renderPass = m_renderPass;
+	graphicsPipelineInfo[0].subpass = 0;
+	graphicsPipelineInfo[0].basePipelineHandle = VK_NULL_HANDLE;
+	graphicsPipelineInfo[0].basePipelineIndex = 0;
+	graphicsPipelineInfo[1] = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, nullptr };
+	graphicsPipelineInfo[1].flags = 0;
+	graphicsPipelineInfo[1].stageCount = uint32_t(std::size(gbufferPipelineStages));
+	graphicsPipelineInfo[1].pStages = gbufferPipelineStages;
+	graphicsPipelineInfo[1].pVertexInputState = nullptr;
+	graphicsPipelineInfo[1].pInputAssemblyState = &iaState;
+	graphicsPipelineInfo[1].pTessellationState = nullptr;
+	graphicsPipelineInfo[1].pViewportState = &viewportState;
+	graphicsPipelineInfo[1].pRasterizationState = &rasterizationState;
+	graphicsPipelineInfo[1].pMultisampleState = &multisampleState;
+	graphicsPipelineInfo[1].pDepthStencilState = &gbufferPassDepthStencilState;
+	graphicsPipelineInfo[1].pColorBlendState = &colorBlendState;
+	graphicsPipelineInfo[1].pDynamicState = &dynamicState;
+	graphicsPipelineInfo[1].layout = m_graphicPipelineLayout;
+	graphicsPipelineInfo[1].renderPass = m_renderPass;
+	graphicsPipelineInfo[1].subpass = 0;
+	graphicsPipelineInfo[1].basePipelineHandle = VK_NULL_HANDLE;
+	graphicsPipelineInfo[1].basePipelineIndex = 0;
+
+	// pInputAssemblyState is supposed to be ignored if we use a mesh shader
+	// but we get a GPU crash along with a validation error if we don't specify it (probably need to report this):
+	// Validation Error: [ UNASSIGNED-CoreValidation-Shader-PointSizeMissing ]
+	// false positive? "Pipeline topology is set to POINT_LIST, but PointSize is not written to in the shader corresponding to VK_SHADER_STAGE_MESH_BIT_NV"
+	// the mesh shader declares "layout(triangles) out;"
+	// POINT_LIST may be assumed default by validation since we don't have a pInputAssemblyState (member is ignored if we use a mesh shader)
+	// the compute rasterizer draws its exported triangles with the same states: vertices pulled from the geometry buffer, with the
+	// index of the indexed draw
+	VkPipelineVertexInputStateCreateInfo vertexInputState{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO, nullptr };
+	vertexInputState.flags = 0;
+	vertexInputState.vertexBindingDescriptionCount = 0;
+	vertexInputState.pVertexBindingDescriptions = nullptr;
+	vertexInputState.vertexAttributeDescriptionCount = 0;
+	vertexInputState.pVertexAttributeDescriptions = nullptr;
+	if (m_computeRasterizer)
+	{
+		depthPipelineStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		depthPipelineStages[0].module = m_depthPassVertexShader.GetShaderModule();
+		gbufferPipelineStages[1] = gbufferPipelineStages[2];
+		gbufferPipelineStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		gbufferPipelineStages[0].module = m_gbufferPassVertexShader.GetShaderModule();
+		for (uint32_t i = 0; i < std::size(graphicsPipelineInfo); ++i)
+		{
+			graphicsPipelineInfo[i].stageCount = i + 1;
+			graphicsPipelineInfo[i].pVertexInputState = &vertexInputState;
+		}
+	}
+
+	VkPipeline pipelines[uint32_t(std::size(graphicsPipelineInfo))];
+	result = vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, uint32_t(std::size(graphicsPipelineInfo)), graphicsPipelineInfo, nullptr, pipelines);
+	m_meshDepthPass = pipelines[0];
+	m_meshGbufferPass = pipelines[1];
+
+	if (m_computeRasterizer)
+	{
+		// the task shader, then the mesh shader of each pass (with the same software raster size)
+		VkComputePipelineCreateInfo computePipelineInfo[3];
+		for (uint32_t i = 0; i < std::size(computePipelineInfo); ++i)
+		{
+			computePipelineInfo[i] = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+			computePipelineInfo[i].flags = 0;
+			computePipelineInfo[i].stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+			computePipelineInfo[i].stage.flags = 0;
+			computePipelineInfo[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			computePipelineInfo[i].stage.pName = "main";
+			computePipelineInfo[i].stage.pSpecializationInfo = i == 0 ? nullptr : &meshSpecializationInfo;
+			computePipelineInfo[i].layout = m_meshComputePipelineLayout;
+			computePipelineInfo[i].basePipelineHandle = VK_NULL_HANDLE;
+			computePipelineInfo[i].basePipelineIndex = 0;
+		}
+		computePipelineInfo[0].stage.module = m_taskShader.GetShaderModule();
+		computePipelineInfo[1].stage.module = m_depthPassMeshShader.GetShaderModule();
+		computePipelineInfo[2].stage.module = m_gbufferPassMeshShader.GetShaderModule();
+
+		VkPipeline computePipelines[uint32_t(std::size(computePipelineInfo))];
+		result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, uint32_t(std::size(computePipelineInfo)), computePipelineInfo, nullptr, computePipelines);
+		CHECK_ERROR_AND_RETURN("could not create compute rasterizer pipelines");
+		m_computeRasterTasks = computePipelines[0];
+		m_computeRasterDepthPass = computePipelines[1];
+		m_computeRasterGbufferPass = computePipelines[2];
+	}
+
+	if (m_supportsVisibilityBuffer)
+	{
+		// the depth passes of the visibility buffer: depth tested as the depth pass, the color attachments are left alone
+		VkPipelineShaderStageCreateInfo visibilityPipelineStages[3];
+		std::copy_n(gbufferPipelineStages, 3, visibilityPipelineStages);
+		visibilityPipelineStages[1].module = m_visibilityPassMeshShader.GetShaderModule();
+		visibilityPipelineStages[2].module = m_visibilityPassFragmentShader.GetShaderModule();
+
+		VkPipelineColorBlendAttachmentState visibilityColorBlendAttachmentState[2];
+		std::copy_n(colorBlendAttachmentState, 2, visibilityColorBlendAttachmentState);
+		visibilityColorBlendAttachmentState[0].colorWriteMask = 0;
+		visibilityColorBlendAttachmentState[1].colorWriteMask = 0;
+		VkPipelineColorBlendStateCreateInfo visibilityColorBlendState = colorBlendState;
+		visibilityColorBlendState.pAttachments = visibilityColorBlendAttachmentState;
+
+		VkGraphicsPipelineCreateInfo visibilityPipelineInfo = graphicsPipelineInfo[0];
+		visibilityPipelineInfo.stageCount = uint32_t(std::size(visibilityPipelineStages));
+		visibilityPipelineInfo.pStages = visibilityPipelineStages;
+		visibilityPipelineInfo.pColorBlendState = &visibilityColorBlendState;
+		result = vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &visibilityPipelineInfo, nullptr, &m_meshVisibilityPass);
+		CHECK_ERROR_AND_RETURN("could not create visibility pass pipeline");
+
+		VkComputePipelineCreateInfo computePipelineInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr };
+		computePipelineInfo.flags = 0;
+		computePipelineInfo.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+		computePipelineInfo.stage.flags = 0;
+		computePipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineInfo.stage.module = m_resolveVisibilityShader.GetShaderModule();
+		computePipelineInfo.stage.pName = "main";
+		computePipelineInfo.stage.pSpecializationInfo = nullptr;
+		computePipelineInfo.layout = m_meshComputePipelineLayout;
+		computePipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		computePipelineInfo.basePipelineIndex = 0;
+		result = vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &m_resolveVisibility);
+		CHECK_ERROR_AND_RETURN("could not create visibility resolve pipeline");
+	}
+
 	return true;
 }
 
+auto MeshShadingRenderLoop::DestroyMeshShaderPipelines(VkDevice device) -> void
+{
+	vkDestroyPipeline(device, m_meshDepthPass, nullptr);
+	vkDestroyPipeline(device, m_meshGbufferPass, nullptr);
+	if (m_computeRasterizer)
+	{
+		vkDestroyPipeline(device, m_computeRasterTasks, nullptr);
+		vkDestroyPipeline(device, m_computeRasterDepthPass, nullptr);
+		vkDestroyPipeline(device, m_computeRasterGbufferPass, nullptr);
+	}
+	if (m_supportsVisibilityBuffer)
+	{
+		vkDestroyPipeline(device, m_meshVisibilityPass, nullptr);
+		vkDestroyPipeline(device, m_resolveVisibility, nullptr);
+		m_visibilityPassMeshShader.Unitialize(device);
+		m_resolveVisibilityShader.Unitialize(device);
+	}
+	m_taskShader.Unitialize(device);
+	m_depthPassMeshShader.Unitialize(device);
+	m_gbufferPassMeshShader.Unitialize(device);
+}
+
+auto MeshShadingRenderLoop::RecreateMeshShaders(InstanceDeviceAndSwapchain& device) -> bool
+{
+	// the frames in flight may still use the pipelines
+	if (!device.WaitIdle())
+		return false;
+
+	DestroyMeshShaderPipelines(device.GetDevice());
+	return CreateMeshShaderPipelines(device);
+}
+
 auto MeshShadingRenderLoop::Uninitialize() -> void
 {
 
@@ -598,14 +1377,86 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		return true;
 
 	VkExtent2D swapchainExtent = deviceAndSwapchain.GetSwapchainExtent();
+	bool visibilityBuffer = m_visibilityBuffer && m_supportsVisibilityBuffer;
+
+	// STREAM MEGATILES REQUESTED BY EARLIER FRAMES
+	{
+		for (ParameterizedMesh* mesh : m_meshes)
+		{
+			if (!mesh->UpdateResidency(deviceAndSwapchain))
+				return false;
+		}
+
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_taskShaderStage | m_meshShaderStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	uint32_t frameExecutionContext = deviceAndSwapchain.GetFrameExecutionContextIndex();
+	uint32_t firstTimestamp = frameExecutionContext * passTimestampCount;
+
+	// READ BACK AND RESET CULLING STATISTICS AND PASS TIMESTAMPS (BeginFrame waited for the last frame that used this context)
+	{
+		VkDeviceSize offset = frameExecutionContext * CullingPass_Count * sizeof(CullingStatistics);
+		VkDeviceSize size = CullingPass_Count * sizeof(CullingStatistics);
+		if (m_statisticsFrames[frameExecutionContext] != 0)
+		{
+			vmaInvalidateAllocation(deviceAndSwapchain.GetAllocator(), m_statisticsAllocation, offset, size);
+			std::copy_n(m_statistics + frameExecutionContext * CullingPass_Count, CullingPass_Count, m_cullingStatistics);
+
+			uint64_t timestamps[passTimestampCount];
+			VkResult result = vkGetQueryPoolResults(deviceAndSwapchain.GetDevice(), m_timestampQueryPool, firstTimestamp, passTimestampCount, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_SUCCESS)
+			{
+				auto milliseconds = [&](uint32_t pass) -> double { return double(timestamps[pass + 1] - timestamps[pass]) * m_timestampPeriod * 1e-6; };
+				m_passTimings.earlyDepthPass = milliseconds(0);
+				m_passTimings.earlyDepthPyramid = milliseconds(1);
+				m_passTimings.lateDepthPass = milliseconds(2);
+				m_passTimings.depthPyramid = milliseconds(3);
+				m_passTimings.gbufferPass = milliseconds(4);
+				m_passTimings.materialResolve = milliseconds(5);
+				m_passTimings.occlusionCulling = m_statisticsOcclusionCulling[frameExecutionContext];
+			}
+		}
+		m_statisticsFrames[frameExecutionContext] = deviceAndSwapchain.GetFrameNumber();
+		m_statisticsOcclusionCulling[frameExecutionContext] = m_occlusionCulling;
+
+		vkCmdResetQueryPool(commandBuffer, m_timestampQueryPool, firstTimestamp, passTimestampCount);
+		vkCmdFillBuffer(commandBuffer, m_statisticsBuffer, offset, size, 0);
+
+		VkBufferMemoryBarrier bufferMemoryBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr };
+		bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.buffer = m_statisticsBuffer;
+		bufferMemoryBarrier.offset = offset;
+		bufferMemoryBarrier.size = size;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_taskShaderStage | m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+	}
 
 	// UPDATE CONSTANTS
 	{
 		ViewportConstants constants;
-		constants.projectionMatrix[0][0] = 1; constants.projectionMatrix[0][1] = 0; constants.projectionMatrix[0][2] = 0; constants.projectionMatrix[0][3] = 0;
-		constants.projectionMatrix[1][0] = 0; constants.projectionMatrix[1][1] = 1; constants.projectionMatrix[1][2] = 0; constants.projectionMatrix[1][3] = 0;
-		constants.projectionMatrix[2][0] = 0; constants.projectionMatrix[2][1] = 0; constants.projectionMatrix[2][2] = 1; constants.projectionMatrix[2][3] = 0.5f;
-		constants.projectionMatrix[3][0] = 0; constants.projectionMatrix[3][1] = 0; constants.projectionMatrix[3][2] = 0; constants.projectionMatrix[3][3] = 1;
+		if (m_reversedZ)
+		{
+			// seen from z = -cameraDistance, scaled so that the plane z = 0 covers the viewport as the orthographic projection does;
+			// depth is nearPlane / w, 1 at the near plane and 0 at infinity
+			const float cameraDistance = 2.0f;
+			const float nearPlane = 0.05f;
+			constants.projectionMatrix[0][0] = cameraDistance; constants.projectionMatrix[0][1] = 0; constants.projectionMatrix[0][2] = 0; constants.projectionMatrix[0][3] = 0;
+			constants.projectionMatrix[1][0] = 0; constants.projectionMatrix[1][1] = cameraDistance; constants.projectionMatrix[1][2] = 0; constants.projectionMatrix[1][3] = 0;
+			constants.projectionMatrix[2][0] = 0; constants.projectionMatrix[2][1] = 0; constants.projectionMatrix[2][2] = 0; constants.projectionMatrix[2][3] = nearPlane;
+			constants.projectionMatrix[3][0] = 0; constants.projectionMatrix[3][1] = 0; constants.projectionMatrix[3][2] = 1; constants.projectionMatrix[3][3] = cameraDistance;
+		}
+		else
+		{
+			constants.projectionMatrix[0][0] = 1; constants.projectionMatrix[0][1] = 0; constants.projectionMatrix[0][2] = 0; constants.projectionMatrix[0][3] = 0;
+			constants.projectionMatrix[1][0] = 0; constants.projectionMatrix[1][1] = 1; constants.projectionMatrix[1][2] = 0; constants.projectionMatrix[1][3] = 0;
+			constants.projectionMatrix[2][0] = 0; constants.projectionMatrix[2][1] = 0; constants.projectionMatrix[2][2] = 1; constants.projectionMatrix[2][3] = 0.5f;
+			constants.projectionMatrix[3][0] = 0; constants.projectionMatrix[3][1] = 0; constants.projectionMatrix[3][2] = 0; constants.projectionMatrix[3][3] = 1;
+		}
 
 		constants.projectionMatrix[1][1] *= float(swapchainExtent.width) / float(swapchainExtent.height);
 		
@@ -614,6 +1465,12 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		constants.viewportSize[2] = 1.0f / float(swapchainExtent.width);
 		constants.viewportSize[3] = 1.0f / float(swapchainExtent.height);
 
+		constants.statisticsSlot = frameExecutionContext;
+		constants.occlusionCulling = m_occlusionCulling ? 1 : 0;
+		constants.lodPixelError = m_lodPixelError;
+		m_depthEpoch = m_depthEpoch % depthEpochCount + 1;
+		constants.depthEpoch = m_depthEpoch;
+
 		VkBufferMemoryBarrier bufferMemoryBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr };
 		bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
@@ -629,12 +1486,181 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 
 		bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		bufferMemoryBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV | VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_taskShaderStage | m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
 
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicPipelineLayout, 0, 1, &m_viewportResources, 0, nullptr);
 	}
 
-	// CLEAR MESH SHADER DEPTH
+	// UPLOAD INSTANCES (only when they changed)
+	if (m_instancesChanged)
+	{
+		// grouped by mesh, each mesh draws its instances at once
+		m_meshFirstInstances.assign(m_meshes.size() + 1, 0);
+		for (MeshInstance const& instance : m_instances)
+			++m_meshFirstInstances[instance.meshId + 1];
+		for (uint32_t i = 0; i < m_meshes.size(); ++i)
+			m_meshFirstInstances[i + 1] += m_meshFirstInstances[i];
+
+		// the visible task groups of a mesh may fill its whole region, its draws take up to maxTaskGroupsPerDraw each
+		m_meshFirstVisibleTaskGroups.assign(m_meshes.size() + 1, 0);
+		m_meshFirstDraws.assign(m_meshes.size() + 1, 0);
+		for (uint32_t i = 0; i < m_meshes.size(); ++i)
+		{
+			uint32_t taskGroupsPerRow = m_meshes[i]->GetSize() / (64 * 8);
+			uint32_t taskGroupCount = taskGroupsPerRow * taskGroupsPerRow * (m_meshFirstInstances[i + 1] - m_meshFirstInstances[i]);
+			m_meshFirstVisibleTaskGroups[i + 1] = m_meshFirstVisibleTaskGroups[i] + taskGroupCount;
+			m_meshFirstDraws[i + 1] = m_meshFirstDraws[i] + (taskGroupCount + maxTaskGroupsPerDraw - 1) / maxTaskGroupsPerDraw;
+		}
+
+		std::vector<uint32_t> nextInstances(m_meshFirstInstances.begin(), m_meshFirstInstances.end() - 1);
+		m_sortedInstances.resize(m_instances.size());
+		for (MeshInstance const& instance : m_instances)
+			m_sortedInstances[nextInstances[instance.meshId]++] = instance;
+
+		VkBufferMemoryBarrier bufferMemoryBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr };
+		bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.buffer = m_instanceBuffer;
+		bufferMemoryBarrier.offset = 0;
+		bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+
+		bufferMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		bufferMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, m_taskShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+		// vkCmdUpdateBuffer takes at most 64 KB at a time
+		const VkDeviceSize maxUpdateSize = 65536;
+		VkDeviceSize instancesSize = m_sortedInstances.size() * sizeof(MeshInstance);
+		for (VkDeviceSize offset = 0; offset < instancesSize; offset += maxUpdateSize)
+			vkCmdUpdateBuffer(commandBuffer, m_instanceBuffer, offset, std::min(maxUpdateSize, instancesSize - offset), (uint8_t const*)m_sortedInstances.data() + offset);
+
+		bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_taskShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+		m_instancesChanged = false;
+	}
+
+	// CULL TASK GROUPS (once for every pass: the visible task groups and the indirect draws of each mesh)
+	CullTaskGroups(commandBuffer);
+
+	// RESET DEPTH PYRAMIDS (the depth they hold is from another swapchain size, or from before occlusion culling was turned off)
+	if (!m_occlusionCulling)
+	{
+		m_depthPyramidExtent = {};
+	}
+	else if (m_depthPyramidExtent.width != swapchainExtent.width || m_depthPyramidExtent.height != swapchainExtent.height)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier[2];
+		for (uint32_t i = 0; i < std::size(imageMemoryBarrier); ++i)
+		{
+			imageMemoryBarrier[i] = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
+			imageMemoryBarrier[i].srcAccessMask = 0;
+			imageMemoryBarrier[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageMemoryBarrier[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageMemoryBarrier[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier[i].image = m_depthPyramids[i];
+			imageMemoryBarrier[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageMemoryBarrier[i].subresourceRange.baseMipLevel = 0;
+			imageMemoryBarrier[i].subresourceRange.levelCount = depthPyramidLevelCount;
+			imageMemoryBarrier[i].subresourceRange.baseArrayLayer = 0;
+			imageMemoryBarrier[i].subresourceRange.layerCount = 1;
+		}
+		vkCmdPipelineBarrier(commandBuffer, m_taskShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
+
+		// the farthest depth hides nothing: the early depth pass of this frame draws every megatile the other tests keep
+		float farthestDepth = m_reversedZ ? 0.0f : 1.0f;
+		VkClearColorValue clearColor;
+		clearColor.float32[0] = farthestDepth;
+		clearColor.float32[1] = farthestDepth;
+		clearColor.float32[2] = farthestDepth;
+		clearColor.float32[3] = farthestDepth;
+		vkCmdClearColorImage(commandBuffer, m_depthPyramids[0], VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &imageMemoryBarrier[0].subresourceRange);
+
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_taskShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		m_depthPyramidExtent = swapchainExtent;
+	}
+
+	// CLEAR MESH SHADER DEPTH (only when the epoch starts over with reversed-Z, the tiles the previous frame wrote with the tiled depth)
+	if (m_reversedZ)
+	{
+		// the previous frame is done reading the depth this frame overwrites
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		if (m_depthEpoch == 1)
+		{
+			// the depth of every epoch is above 0, the tile flags are not used
+			if (m_tiledDepth)
+			{
+				vkCmdFillBuffer(commandBuffer, m_tiledDepthBuffer, 0, VK_WHOLE_SIZE, 0);
+			}
+			else
+			{
+				VkImageMemoryBarrier imageMemoryBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
+				imageMemoryBarrier.srcAccessMask = 0;
+				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+				imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				imageMemoryBarrier.image = m_depthStorageBuffer;
+				imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+				imageMemoryBarrier.subresourceRange.levelCount = 1;
+				imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+				imageMemoryBarrier.subresourceRange.layerCount = 1;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+				VkClearColorValue clearColor;
+				clearColor.uint32[0] = 0;
+				clearColor.uint32[1] = 0;
+				clearColor.uint32[2] = 0;
+				clearColor.uint32[3] = 0;
+				vkCmdClearColorImage(commandBuffer, m_depthStorageBuffer, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &imageMemoryBarrier.subresourceRange);
+			}
+
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	}
+	else if (m_tiledDepth)
+	{
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		if (!m_tiledDepthFilled)
+		{
+			// the farthest depth everywhere, and every tile flagged (as 1.0f is not zero) so that the clear below resets the flags
+			vkCmdFillBuffer(commandBuffer, m_tiledDepthBuffer, 0, VK_WHOLE_SIZE, 0x3f800000);
+
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			m_tiledDepthFilled = true;
+		}
+
+		// a workgroup per 8x8 tile, most of them only read their flag
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_clearTiledDepth);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_meshComputePipelineLayout, 0, 1, &m_viewportResources, 0, nullptr);
+		vkCmdDispatch(commandBuffer, 64, tiledDepthBlocksPerRow * tiledDepthBlockRows, 1);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+	else
 	{
 		VkImageMemoryBarrier imageMemoryBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
 		imageMemoryBarrier.srcAccessMask = 0;
@@ -671,7 +1697,41 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
 		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
 		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	}
+
+	// CLEAR VISIBILITY BUFFER AND CLUSTERS
+	if (visibilityBuffer)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
+		imageMemoryBarrier.srcAccessMask = 0;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = m_visibilityImage;
+		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+		imageMemoryBarrier.subresourceRange.levelCount = 1;
+		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+		imageMemoryBarrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(commandBuffer, m_meshShaderStage | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+		// the farthest depth and no triangle: a 64-bit clear value takes its low half from uint32[0] and its high half from uint32[1]
+		VkClearColorValue clearColor;
+		clearColor.uint32[0] = 0xffffffff;
+		clearColor.uint32[1] = m_reversedZ ? 0 : 0x3f800000; // 1.0f
+		clearColor.uint32[2] = 0;
+		clearColor.uint32[3] = 0;
+		vkCmdClearColorImage(commandBuffer, m_visibilityImage, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &imageMemoryBarrier.subresourceRange);
+
+		vkCmdFillBuffer(commandBuffer, m_visibilityClusterBuffer, 0, 4 * sizeof(uint32_t), 0);
+
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, m_meshShaderStage | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 	}
 
 	// TRANSITION MESH SHADER BUFFERS TO WRITE
@@ -694,64 +1754,103 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		}
 		imageMemoryBarrier[0].image = m_albedoBuffer;
 		imageMemoryBarrier[1].image = m_normalBuffer;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
+		vkCmdPipelineBarrier(commandBuffer, m_meshShaderStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
 	}
 
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp);
+
+	// the compute rasterizer runs the task and mesh shaders of each pass before its render pass, which draws what they exported
+	if (m_computeRasterizer)
+		ComputeRasterMeshInstances(commandBuffer, deviceAndSwapchain, CullingPass_EarlyDepth);
+
 	// BEGIN RENDER PASS
+	BeginRenderPass(commandBuffer, m_renderPass, swapchainExtent);
+
+	// EARLY DEPTH PASS (what the depth pyramid of the previous frame does not hide)
+	VkPipeline depthPass = visibilityBuffer ? m_meshVisibilityPass : m_meshDepthPass;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass);
+
+	DrawMeshInstances(commandBuffer, deviceAndSwapchain, CullingPass_EarlyDepth);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 1);
+
+	if (m_occlusionCulling)
 	{
-		VkClearValue clearValue;
-		clearValue.depthStencil.depth = 1;
+		vkCmdEndRenderPass(commandBuffer);
 
-		VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO, nullptr };
-		renderPassBeginInfo.renderPass = m_renderPass;
-		renderPassBeginInfo.framebuffer = m_framebuffer;
-		renderPassBeginInfo.renderArea.offset.x = 0;
-		renderPassBeginInfo.renderArea.offset.y = 0;
-		renderPassBeginInfo.renderArea.extent = swapchainExtent;
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = &clearValue;
+		// EARLY DEPTH PYRAMID
+		BuildDepthPyramid(commandBuffer, swapchainExtent, 1);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 2);
 
-		VkViewport viewport;
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = float(swapchainExtent.width);
-		viewport.height = float(swapchainExtent.height);
-		viewport.minDepth = 0;
-		viewport.maxDepth = 1;
-		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-		vkCmdSetScissor(commandBuffer, 0, 1, &renderPassBeginInfo.renderArea);
+		// LATE DEPTH PASS (what the early depth pass rejected and its depth does not hide)
+		if (m_computeRasterizer)
+			ComputeRasterMeshInstances(commandBuffer, deviceAndSwapchain, CullingPass_LateDepth);
+		BeginRenderPass(commandBuffer, m_resumeRenderPass, swapchainExtent);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass);
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	}
+		DrawMeshInstances(commandBuffer, deviceAndSwapchain, CullingPass_LateDepth);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 3);
+
+		vkCmdEndRenderPass(commandBuffer);
 
-	// DEPTH PASS
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshDepthPass);
+		// DEPTH PYRAMID (of the complete depth: culls the G-buffer pass, then the early depth pass of the next frame)
+		BuildDepthPyramid(commandBuffer, swapchainExtent, 0);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 4);
 
-	for (ParameterizedMesh const* mesh : m_meshInstances)
+		if (!visibilityBuffer && !m_computeRasterizer)
+			BeginRenderPass(commandBuffer, m_resumeRenderPass, swapchainExtent);
+	}
+	else
 	{
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicPipelineLayout, 1, 1, &mesh->GetDescriptorSet(), 0, nullptr);
-		vkCmdDrawMeshTasksNV(commandBuffer, 256, 0);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 3);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 4);
+
+		if (visibilityBuffer || m_computeRasterizer)
+			vkCmdEndRenderPass(commandBuffer);
 	}
 
-	// TRANSITION DEPTH
+	if (visibilityBuffer)
 	{
-		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
-		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
-		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		// MATERIAL PASS (shades the triangles the visibility buffer kept, instead of drawing them again), timed apart from the geometry
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 5);
+		ResolveVisibility(commandBuffer, deviceAndSwapchain, swapchainExtent);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 6);
 	}
+	else
+	{
+		if (m_computeRasterizer)
+		{
+			// the compute passes synchronize the software rasterized depth themselves
+			ComputeRasterMeshInstances(commandBuffer, deviceAndSwapchain, CullingPass_Gbuffer);
+			BeginRenderPass(commandBuffer, m_resumeRenderPass, swapchainExtent);
+		}
+		else
+		{
+			// TRANSITION DEPTH
+			VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
 
-	// GBUFFER PASS
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshGbufferPass);
+		// GBUFFER PASS
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshGbufferPass);
 
-	for (ParameterizedMesh const* mesh : m_meshInstances)
-	{
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicPipelineLayout, 1, 1, &mesh->GetDescriptorSet(), 0, nullptr);
-		vkCmdDrawMeshTasksNV(commandBuffer, 256, 0);
+		DrawMeshInstances(commandBuffer, deviceAndSwapchain, CullingPass_Gbuffer);
+
+		// END RENDER PASS
+		vkCmdEndRenderPass(commandBuffer);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 5);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, firstTimestamp + 6);
 	}
 
-	// END RENDER PASS
-	vkCmdEndRenderPass(commandBuffer);
+	// MAKE RESIDENCY REQUESTS AND CULLING STATISTICS VISIBLE TO THE HOST (read once this frame execution context comes around again)
+	{
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, m_taskShaderStage | m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
 
 	// TRANSITION MESH SHADER BUFFERS TO READ
 	{
@@ -773,7 +1872,7 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		}
 		imageMemoryBarrier[0].image = m_albedoBuffer;
 		imageMemoryBarrier[1].image = m_normalBuffer;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
+		vkCmdPipelineBarrier(commandBuffer, m_meshShaderStage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
 	}
 
 	// WAIT FOR SWAPCHAIN
@@ -816,17 +1915,22 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		writeDescriptorSets.pTexelBufferView = nullptr;
 		vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_combineAndLightPipelineLayout, 1, 1, &writeDescriptorSets);
 
+		CombineAndLightConstants constants;
+		constants.depthEpoch = m_depthEpoch;
+		vkCmdPushConstants(commandBuffer, m_combineAndLightPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_combineAndLight);
 		vkCmdDispatch(commandBuffer, (swapchainExtent.width + 7) / 8, (swapchainExtent.height + 7) / 8, 1);
 	}
 
-	// TRANSITION SWAPCHAIN TO PRESENT
+	// TRANSITION SWAPCHAIN TO PRESENT (headless, to the readback copy: the present layout needs the swapchain extension)
 	{
+		bool headless = deviceAndSwapchain.IsHeadless();
 		VkImageMemoryBarrier imageMemoryBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
-		imageMemoryBarrier.srcAccessMask = 0;
-		imageMemoryBarrier.dstAccessMask = 0;
+		imageMemoryBarrier.srcAccessMask = headless ? VK_ACCESS_SHADER_WRITE_BIT : 0;
+		imageMemoryBarrier.dstAccessMask = headless ? VK_ACCESS_TRANSFER_READ_BIT : 0;
 		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		imageMemoryBarrier.newLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		imageMemoryBarrier.image = deviceAndSwapchain.GetAcquiredImage();
@@ -835,13 +1939,371 @@ auto MeshShadingRenderLoop::RenderLoop(InstanceDeviceAndSwapchain& deviceAndSwap
 		imageMemoryBarrier.subresourceRange.levelCount = 1;
 		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
 		imageMemoryBarrier.subresourceRange.layerCount = 1;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		vkCmdPipelineBarrier(commandBuffer, headless ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, headless ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 	}
 
 	return true;
 }
 
-auto MeshShadingRenderLoop::AddMeshInstance(ParameterizedMesh const* meshInstance) -> void
+auto MeshShadingRenderLoop::BeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkExtent2D extent) -> void
+{
+	VkClearValue clearValue;
+	clearValue.depthStencil.depth = m_reversedZ ? 0.0f : 1.0f;
+
+	VkRenderPassBeginInfo renderPassBeginInfo{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO, nullptr };
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.framebuffer = m_framebuffer;
+	renderPassBeginInfo.renderArea.offset.x = 0;
+	renderPassBeginInfo.renderArea.offset.y = 0;
+	renderPassBeginInfo.renderArea.extent = extent;
+	renderPassBeginInfo.clearValueCount = 1;
+	renderPassBeginInfo.pClearValues = &clearValue;
+
+	VkViewport viewport;
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = float(extent.width);
+	viewport.height = float(extent.height);
+	viewport.minDepth = 0;
+	viewport.maxDepth = 1;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &renderPassBeginInfo.renderArea);
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+auto MeshShadingRenderLoop::BuildDepthPyramid(VkCommandBuffer commandBuffer, VkExtent2D extent, uint32_t pyramid) -> void
+{
+	// the task shaders of the passes before are done reading the pyramid
+	vkCmdPipelineBarrier(commandBuffer, m_taskShaderStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	bool visibilityBuffer = m_visibilityBuffer && m_supportsVisibilityBuffer;
+
+	DepthPyramidConstants constants;
+	constants.depthEpoch = m_depthEpoch;
+	constants.reserved = 0;
+	constants.sourceSize[0] = int32_t(extent.width);
+	constants.sourceSize[1] = int32_t(extent.height);
+	for (uint32_t level = 0; level < depthPyramidLevelCount; ++level)
+	{
+		constants.destinationSize[0] = (constants.sourceSize[0] + 1) / 2;
+		constants.destinationSize[1] = (constants.sourceSize[1] + 1) / 2;
+
+		VkDescriptorImageInfo imageInfo[4];
+		imageInfo[0].sampler = VK_NULL_HANDLE;
+		imageInfo[0].imageView = level == 0 ? m_framebufferViews[0] : m_depthPyramidLevelViews[pyramid][level - 1];
+		imageInfo[0].imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		imageInfo[1].sampler = VK_NULL_HANDLE;
+		imageInfo[1].imageView = m_meshShaderViews[0];
+		imageInfo[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageInfo[2].sampler = VK_NULL_HANDLE;
+		imageInfo[2].imageView = m_depthPyramidLevelViews[pyramid][level];
+		imageInfo[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageInfo[3].sampler = VK_NULL_HANDLE;
+		imageInfo[3].imageView = visibilityBuffer ? m_visibilityView : VK_NULL_HANDLE;
+		imageInfo[3].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorBufferInfo tiledDepthBufferInfo;
+		tiledDepthBufferInfo.buffer = m_tiledDepth ? m_tiledDepthBuffer : VK_NULL_HANDLE;
+		tiledDepthBufferInfo.offset = 0;
+		tiledDepthBufferInfo.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet writeDescriptorSets[5];
+		for (uint32_t i = 0; i < std::size(writeDescriptorSets); ++i)
+		{
+			writeDescriptorSets[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+			writeDescriptorSets[i].dstSet = VK_NULL_HANDLE;
+			writeDescriptorSets[i].dstBinding = i;
+			writeDescriptorSets[i].dstArrayElement = 0;
+			writeDescriptorSets[i].descriptorCount = 1;
+			writeDescriptorSets[i].descriptorType = i >= 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeDescriptorSets[i].pImageInfo = i < 4 ? &imageInfo[i] : nullptr;
+			writeDescriptorSets[i].pBufferInfo = nullptr;
+			writeDescriptorSets[i].pTexelBufferView = nullptr;
+		}
+		writeDescriptorSets[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[4].pBufferInfo = &tiledDepthBufferInfo;
+		// the software rasterized depth is only read by the first level, which reads the visibility buffer instead of both depths with it
+		VkPipeline pipeline = m_buildDepthPyramid;
+		uint32_t writeDescriptorSetCount = 2;
+		if (level > 0)
+		{
+			writeDescriptorSets[1] = writeDescriptorSets[2];
+		}
+		else if (visibilityBuffer)
+		{
+			pipeline = m_buildDepthPyramidFirstLevelVisibility;
+			writeDescriptorSets[0] = writeDescriptorSets[2];
+			writeDescriptorSets[1] = writeDescriptorSets[3];
+		}
+		else
+		{
+			pipeline = m_buildDepthPyramidFirstLevel;
+			writeDescriptorSetCount = 3;
+			if (m_tiledDepth)
+			{
+				writeDescriptorSets[3] = writeDescriptorSets[4];
+				writeDescriptorSetCount = 4;
+			}
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_depthPyramidPipelineLayout, 0, writeDescriptorSetCount, writeDescriptorSets);
+		vkCmdPushConstants(commandBuffer, m_depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (constants.destinationSize[0] + 7) / 8, (constants.destinationSize[1] + 7) / 8, 1);
+
+		// the next level reads this one, the task shaders read the whole pyramid
+		VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		VkPipelineStageFlags dstStageMask = level + 1 < depthPyramidLevelCount ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : m_taskShaderStage;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		constants.sourceSize[0] = constants.destinationSize[0];
+		constants.sourceSize[1] = constants.destinationSize[1];
+	}
+}
+
+auto MeshShadingRenderLoop::ResolveVisibility(VkCommandBuffer commandBuffer, InstanceDeviceAndSwapchain const& device, VkExtent2D extent) -> void
+{
+	// the render pass dependency made the visibility buffer and clusters visible; the mesh shader depth, albedo and normal layers
+	// the combine pass reads are written here instead of in the mesh shaders
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_resolveVisibility);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_meshComputePipelineLayout, 0, 1, &m_viewportResources, 0, nullptr);
+
+	// each mesh has its own geometry image: one dispatch per mesh over the viewport, shading the pixels its instances won
+	for (uint32_t meshId = 0; meshId < m_meshes.size(); ++meshId)
+	{
+		if (m_meshFirstInstances[meshId + 1] == m_meshFirstInstances[meshId])
+			continue;
+
+		ParameterizedMesh const* mesh = m_meshes[meshId];
+		MeshConstants meshConstants = GetMeshConstants(*mesh, device);
+		meshConstants.firstVisibleTaskGroup = m_meshFirstVisibleTaskGroups[meshId];
+		meshConstants.meshId = meshId;
+		vkCmdPushConstants(commandBuffer, m_meshComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(meshConstants), &meshConstants);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_meshComputePipelineLayout, 1, 1, &mesh->GetDescriptorSet(), 0, nullptr);
+		vkCmdDispatch(commandBuffer, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+	}
+
+	// the combine pass reads the resolved depth
+	VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+auto MeshShadingRenderLoop::CullTaskGroups(VkCommandBuffer commandBuffer) -> void
+{
+	// the passes of the previous frame are done drawing from the draw buffer and reading the visible task groups
+	VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+	memoryBarrier.srcAccessMask = 0;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | m_taskShaderStage, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdFillBuffer(commandBuffer, m_drawBuffer, 0, drawCountsOffset, 0);
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	VkDescriptorBufferInfo bufferInfo[6];
+	bufferInfo[0].buffer = m_viewportConstantsBuffer;
+	bufferInfo[1].buffer = m_instanceBuffer;
+	bufferInfo[2].buffer = VK_NULL_HANDLE;
+	bufferInfo[3].buffer = m_drawBuffer;
+	bufferInfo[4].buffer = m_visibleTaskGroupBuffer;
+	bufferInfo[5].buffer = m_statisticsBuffer;
+
+	VkWriteDescriptorSet writeDescriptorSets[6];
+	for (uint32_t i = 0; i < std::size(writeDescriptorSets); ++i)
+	{
+		bufferInfo[i].offset = 0;
+		bufferInfo[i].range = VK_WHOLE_SIZE;
+
+		writeDescriptorSets[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSets[i].dstSet = VK_NULL_HANDLE;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].dstArrayElement = 0;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[i].pImageInfo = nullptr;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfo[i];
+		writeDescriptorSets[i].pTexelBufferView = nullptr;
+	}
+
+	auto getConstants = [&](uint32_t meshId) -> TaskGroupCullingConstants
+	{
+		TaskGroupCullingConstants constants;
+		constants.meshId = meshId;
+		constants.firstInstance = m_meshFirstInstances[meshId];
+		constants.instanceCount = m_meshFirstInstances[meshId + 1] - m_meshFirstInstances[meshId];
+		constants.taskGroupsPerRow = m_meshes[meshId]->GetSize() / (64 * 8);
+		constants.firstVisibleTaskGroup = m_meshFirstVisibleTaskGroups[meshId];
+		constants.firstDraw = m_meshFirstDraws[meshId];
+		constants.maxDrawCount = m_meshFirstDraws[meshId + 1] - m_meshFirstDraws[meshId];
+		constants.reserved = 0;
+		return constants;
+	};
+
+	// one invocation per task group of every instance, appended to the visible task groups of the mesh
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullTaskGroups);
+	for (uint32_t meshId = 0; meshId < m_meshes.size(); ++meshId)
+	{
+		TaskGroupCullingConstants constants = getConstants(meshId);
+		if (constants.instanceCount == 0)
+			continue;
+
+		bufferInfo[2].buffer = m_meshes[meshId]->GetTaskGroupBuffer();
+		vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_taskGroupCullingPipelineLayout, 0, uint32_t(std::size(writeDescriptorSets)), writeDescriptorSets);
+		vkCmdPushConstants(commandBuffer, m_taskGroupCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (m_meshFirstVisibleTaskGroups[meshId + 1] - m_meshFirstVisibleTaskGroups[meshId] + 255) / 256, 1, 1);
+	}
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	// then the visible task group count of each mesh into its draws (the pushed descriptors stay, the bounds are not read)
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_writeTaskGroupDraws);
+	for (uint32_t meshId = 0; meshId < m_meshes.size(); ++meshId)
+	{
+		TaskGroupCullingConstants constants = getConstants(meshId);
+		if (constants.instanceCount == 0)
+			continue;
+
+		vkCmdPushConstants(commandBuffer, m_taskGroupCullingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (constants.maxDrawCount + 63) / 64, 1, 1);
+	}
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | m_taskShaderStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+auto MeshShadingRenderLoop::ComputeRasterMeshInstances(VkCommandBuffer commandBuffer, InstanceDeviceAndSwapchain const& device, CullingPass pass) -> void
+{
+	// the pass before is done drawing from the geometry buffer and rasterizing (the depth passes' software depth is read by the next
+	// ones), the counters and the draw are reset
+	VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	// no indices yet, one instance
+	uint32_t geometryHeader[8] = { 0, 1, 0, 0, 0, 0, 0, 0 };
+	vkCmdUpdateBuffer(commandBuffer, m_computeRasterGeometryBuffer, 0, sizeof(geometryHeader), geometryHeader);
+	vkCmdFillBuffer(commandBuffer, m_computeRasterWorkBuffer, 0, maxMeshCount * sizeof(ComputeRasterCounters), 0);
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_meshComputePipelineLayout, 0, 1, &m_viewportResources, 0, nullptr);
+	VkPipeline rasterPipeline = pass == CullingPass_Gbuffer ? m_computeRasterGbufferPass : m_computeRasterDepthPass;
+
+	// per mesh, the task shader over its visible task groups lists the tiles the mesh shader then runs over (both dispatches indirect)
+	for (uint32_t meshId = 0; meshId < m_meshes.size(); ++meshId)
+	{
+		uint32_t instanceCount = m_meshFirstInstances[meshId + 1] - m_meshFirstInstances[meshId];
+		if (instanceCount == 0)
+			continue;
+
+		ParameterizedMesh const* mesh = m_meshes[meshId];
+		MeshConstants meshConstants = GetMeshConstants(*mesh, device);
+		meshConstants.firstVisibleTaskGroup = m_meshFirstVisibleTaskGroups[meshId];
+		meshConstants.cullingPass = pass;
+		meshConstants.meshId = meshId;
+		vkCmdPushConstants(commandBuffer, m_meshComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(meshConstants), &meshConstants);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_meshComputePipelineLayout, 1, 1, &mesh->GetDescriptorSet(), 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_computeRasterTasks);
+		vkCmdDispatchIndirect(commandBuffer, m_drawBuffer, taskDispatchesOffset + meshId * sizeof(VkDispatchIndirectCommand));
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rasterPipeline);
+		vkCmdDispatchIndirect(commandBuffer, m_computeRasterWorkBuffer, meshId * sizeof(ComputeRasterCounters) + offsetof(ComputeRasterCounters, tileDispatch));
+
+		// the geometry buffer allocations and the software depth carry over to the next mesh
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// the render pass draws the exported triangles, the depth pyramids and the next passes read the software rasterized depth
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+auto MeshShadingRenderLoop::DrawMeshInstances(VkCommandBuffer commandBuffer, InstanceDeviceAndSwapchain const& device, CullingPass pass) -> void
 {
-	m_meshInstances.emplace_back(meshInstance);
+	if (m_computeRasterizer)
+	{
+		// every mesh at once: the triangles ComputeRasterMeshInstances exported for this pass
+		vkCmdBindIndexBuffer(commandBuffer, m_computeRasterGeometryBuffer, computeRasterIndicesOffset, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexedIndirect(commandBuffer, m_computeRasterGeometryBuffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
+
+	for (uint32_t meshId = 0; meshId < m_meshes.size(); ++meshId)
+	{
+		uint32_t instanceCount = m_meshFirstInstances[meshId + 1] - m_meshFirstInstances[meshId];
+		if (instanceCount == 0)
+			continue;
+
+		ParameterizedMesh const* mesh = m_meshes[meshId];
+		MeshConstants meshConstants = GetMeshConstants(*mesh, device);
+		meshConstants.firstVisibleTaskGroup = m_meshFirstVisibleTaskGroups[meshId];
+		meshConstants.cullingPass = pass;
+		vkCmdPushConstants(commandBuffer, m_graphicPipelineLayout, VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV, 0, sizeof(meshConstants), &meshConstants);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicPipelineLayout, 1, 1, &mesh->GetDescriptorSet(), 0, nullptr);
+
+		// as many draws as the culling pre-pass kept task groups for, at most maxTaskGroupsPerDraw each
+		uint32_t firstDraw = m_meshFirstDraws[meshId];
+		uint32_t meshMaxDrawCount = m_meshFirstDraws[meshId + 1] - firstDraw;
+		vkCmdDrawMeshTasksIndirectCountNV(commandBuffer, m_drawBuffer, drawsOffset + firstDraw * sizeof(VkDrawMeshTasksIndirectCommandNV),
+			m_drawBuffer, drawCountsOffset + meshId * sizeof(uint32_t), meshMaxDrawCount, sizeof(VkDrawMeshTasksIndirectCommandNV));
+	}
+}
+
+auto MeshShadingRenderLoop::AddMeshInstance(ParameterizedMesh* mesh, float const modelToWorldMatrix[3][4]) -> bool
+{
+	if (m_instances.size() == maxMeshInstanceCount)
+	{
+		std::cerr << "cannot add more than " << maxMeshInstanceCount << " mesh instances" << std::endl;
+		return false;
+	}
+
+	uint32_t meshId = uint32_t(std::find(m_meshes.begin(), m_meshes.end(), mesh) - m_meshes.begin());
+	if (meshId == maxMeshCount)
+	{
+		std::cerr << "cannot add more than " << maxMeshCount << " meshes" << std::endl;
+		return false;
+	}
+
+	uint32_t taskGroupsPerRow = mesh->GetSize() / (64 * 8);
+	if (m_taskGroupCount + taskGroupsPerRow * taskGroupsPerRow > maxTaskGroupCount)
+	{
+		std::cerr << "cannot add more than " << maxTaskGroupCount << " task groups of mesh instances" << std::endl;
+		return false;
+	}
+	m_taskGroupCount += taskGroupsPerRow * taskGroupsPerRow;
+
+	if (meshId == m_meshes.size())
+		m_meshes.push_back(mesh);
+
+	MeshInstance instance{};
+	std::memcpy(instance.modelToWorldMatrix, modelToWorldMatrix, sizeof(instance.modelToWorldMatrix));
+	instance.meshId = meshId;
+	m_instances.push_back(instance);
+	m_instancesChanged = true;
+
+	return true;
 }
\ No newline at end of file
@@ -3,27 +3,234 @@
 #include "InstanceDeviceAndSwapchain.h"
 #include "ShaderModule.h"
 #include "ParameterizedMesh.h"
+#include "MeshShaderProfile.h"
+
+#include <vector>
+
+// one copy of a mesh in the scene (instanceBuffer, std430)
+struct MeshInstance
+{
+	float modelToWorldMatrix[3][4]; // rows of the affine transform, a mat3x4 in the shaders
+	uint32_t meshId;                // index of the mesh in the render loop
+	uint32_t reserved[3];
+};
+
+const uint32_t maxMeshInstanceCount = 65536;
+const uint32_t maxMeshCount = 256;             // maxMeshCount in cull_task_groups.glsl must match
+const uint32_t maxTaskGroupCount = 1 << 22;    // over the instances of every mesh, each takes (size / 512)^2
+
+// the tile a mesh shader workgroup of the visibility pass drew, for the material pass to rebuild its triangles (visibilityClusterBuffer, std430)
+struct VisibilityCluster
+{
+	uint32_t instance;
+	uint32_t megatile;      // packed as in the task payload
+	uint32_t tile;          // mesh shader workgroup of the megatile
+	uint32_t aroundMips[13]; // of the task payload, for stitching
+};
+
+// visibility ids are cluster << 7 | triangle, workgroups past this draw nothing
+const uint32_t maxVisibilityClusterCount = 1 << 20; // maxVisibilityClusterCount in test_ms.glsl must match
+
+// the compute rasterizer's task shader writes its payloads to the work buffer and lists the mesh shader workgroups they launch as
+// tiles, which its mesh shader then runs over (computeRasterWorkBuffer, std430): per mesh its counters, then the payloads, then the tiles
+struct ComputeRasterCounters
+{
+	uint32_t payloadCount;
+	uint32_t tileAllocation;
+	uint32_t tileCount;       // tiles written, the first ones allocated
+	VkDispatchIndirectCommand tileDispatch; // of the mesh shader, in rows of 256 tiles
+	uint32_t reserved[2];
+};
+
+// a task payload in the work buffer, mat3x4 and arrays laid out as std430
+struct ComputeRasterPayload
+{
+	float modelToWorldMatrix[3][4];
+	uint32_t megatileCount;
+	uint32_t instance;
+	uint32_t megatile[64];
+	uint32_t firstTask[64];
+	uint32_t aroundMips[13];
+	uint32_t reserved;
+};
+
+// a vertex of the triangles the compute rasterizer leaves to the hardware rasterizer (computeRasterGeometryBuffer, std430): a
+// VkDrawIndexedIndirectCommand and the allocation counters, then the vertices, then the indices
+struct ComputeRasterVertex
+{
+	float position[4];  // clip space
+	uint32_t albedo;    // packUnorm4x8
+	uint32_t normal;    // packSnorm4x8
+	uint32_t reserved[2];
+};
+
+// work past these is dropped, the names in test_ts.glsl, test_ms.glsl and test_vs.glsl must match
+const uint32_t maxComputeRasterPayloadCount = 1 << 15;
+const uint32_t maxComputeRasterTileCount = 1 << 20;
+const uint32_t maxComputeRasterExportTileCount = 1 << 14; // 8x8 quad tiles exporting all their triangles, 81 vertices and 384 indices each
+
+// the task shader culls megatiles each time the meshes are drawn
+// occlusion culling is two-phase: the early depth pass draws what the pyramid of the previous frame's depth does not hide, the late
+// depth pass re-tests what it rejected against a pyramid of the early depth, then the G-buffer pass culls against this frame's depth
+enum CullingPass : uint32_t
+{
+	CullingPass_EarlyDepth = 0,
+	CullingPass_LateDepth = 1,
+	CullingPass_Gbuffer = 2,
+	CullingPass_Count
+};
+
+// megatile culling counters of a pass, summed by the task shader, and the software rasterization ones by the mesh shader
+// (statisticsBuffer, std430)
+struct CullingStatistics
+{
+	uint32_t megatilesTested;         // mip 0 megatiles that would draw something (late depth pass: the ones the early pass found occluded)
+	uint32_t megatilesFrustumCulled;
+	uint32_t megatilesBackfaceCulled;
+	uint32_t megatilesOcclusionCulled;
+	uint32_t tilesLaunched;           // mesh shader workgroups
+	uint32_t tilesCulled;             // mesh shader workgroups the culled megatiles would have launched
+	uint32_t taskGroupsCulled;        // out of the frustum before the passes (counted with the early depth pass)
+	uint32_t pixelsRasterized;        // covered by the triangles rasterized in the mesh shader (depth passes)
+	uint32_t depthAtomics;            // depth buffer atomics they took, one per pixel a workgroup covers rather than per triangle
+	uint32_t reserved0;
+	uint32_t reserved1;
+	uint32_t reserved2;
+};
+
+// GPU time of the passes of a frame in milliseconds, the depth pyramids and the late depth pass take none without occlusion culling
+struct PassTimings
+{
+	double earlyDepthPass;
+	double earlyDepthPyramid;
+	double lateDepthPass;
+	double depthPyramid;
+	double gbufferPass;      // none with the visibility buffer, its visibility pass draws everything
+	double materialResolve;  // the material pass of the visibility buffer, none without (the G-buffer pass writes the attributes)
+	bool occlusionCulling;
+};
+
+// the depth pyramid mip 0 has a texel per 2x2 pixels, this covers maxWidth x maxHeight
+const uint32_t depthPyramidSize = 2048;
+const uint32_t depthPyramidLevelCount = 12;
+
+// the software rasterized depth of the tiled layout (SetTiledDepth): 64x64 pixel blocks in rows covering maxWidth x maxHeight, the
+// pixels of a block in Morton order so that each 8x8 tile is 64 consecutive uints (256 bytes), as are the 2x2, 4x4... tiles within
+// the buffer starts with a flag per 8x8 tile, set when depth is written there and reset when the next frame clears the tile
+// (tiledDepthBuffer, std430)
+const uint32_t tiledDepthBlocksPerRow = 60; // the shaders get it and tiledDepthTileCount as TILED_DEPTH_BLOCKS_PER_ROW and TILED_DEPTH_TILE_COUNT
+const uint32_t tiledDepthBlockRows = 34;
+const uint32_t tiledDepthTileCount = tiledDepthBlocksPerRow * tiledDepthBlockRows * 64;
+
+// with reversed-Z the software rasterized depth is tagged with the epoch of the frame writing it (encodeDepth in test_ms.glsl):
+// epochs run from 1 to depthEpochCount, the depth is cleared to 0 (the far plane of no epoch) when they start over
+const uint32_t depthEpochCount = 255;
 
 class MeshShadingRenderLoop
 {
 public:
+	// the size of the offscreen images and of the software rasterized depth, the largest the window or -resolution can be
+	static const uint32_t maxWidth = 3840;
+	static const uint32_t maxHeight = 2160;
+
 	auto Initialize(InstanceDeviceAndSwapchain const& device) -> bool;
 	auto Uninitialize() -> void;
 
 	auto RenderLoop(InstanceDeviceAndSwapchain& device) -> bool;
 
-	auto AddMeshInstance(ParameterizedMesh const* meshInstance) -> void;
+	// meshes stream their megatiles in as the frames request them
+	// instances of the same mesh share its geometry image and are drawn with one dispatch
+	auto AddMeshInstance(ParameterizedMesh* mesh, float const modelToWorldMatrix[3][4]) -> bool;
+
+	// on by default, off draws everything the frustum and backface tests keep in the early depth pass
+	auto SetOcclusionCulling(bool enabled) -> void { m_occlusionCulling = enabled; }
+	// megatiles are drawn at the coarsest mip whose quads stay within that many pixels on screen, 0 always draws mip 0
+	auto SetLodPixelError(float pixels) -> void { m_lodPixelError = pixels; }
+	// triangles covering at most that many pixels across (up to 8) are rasterized in the mesh shader, 0 leaves all of them to the
+	// rasterizer; a specialization constant of the mesh shaders, set before Initialize
+	auto SetSoftwareRasterMaxSize(uint32_t pixels) -> void { m_meshShaderPermutation.softwareRasterMaxSize = pixels; }
+	// tile and workgroup sizes the task and mesh shaders are compiled with, and the software raster size; set before Initialize, or
+	// after it followed by RecreateMeshShaders (unsupported ones fall back to the default)
+	auto SetMeshShaderPermutation(MeshShaderPermutation const& permutation) -> void { m_meshShaderPermutation = permutation; }
+	auto GetMeshShaderPermutation() const -> MeshShaderPermutation const& { return m_meshShaderPermutation; }
+	// waits for the GPU, then recompiles the task and mesh shaders and rebuilds the pipelines using them
+	auto RecreateMeshShaders(InstanceDeviceAndSwapchain& device) -> bool;
+	// off by default, on draws the depth passes into a 64-bit visibility buffer (depth and triangle ids) and replaces the G-buffer
+	// pass with a compute material pass; needs 64-bit image atomics, ignored without
+	auto SetVisibilityBuffer(bool enabled) -> void { m_visibilityBuffer = enabled; }
+	// off by default, on runs the task and mesh shaders as compute shaders and draws the triangles they export with a vertex shader;
+	// forced on devices without mesh shaders, no visibility buffer with it; set before Initialize
+	auto SetComputeRasterizer(bool enabled) -> void { m_computeRasterizer = enabled; }
+	// off by default, on keeps the software rasterized depth in a storage buffer of Morton ordered blocks rather than an image, so
+	// that the atomics of a mesh shader tile stay within a few cache lines, and clears only the 8x8 tiles the previous frame wrote
+	// rather than the whole 4K depth; set before Initialize
+	auto SetTiledDepth(bool enabled) -> void { m_tiledDepth = enabled; }
+	// off by default, on maps the near plane to depth 1 and an infinite far plane to 0, through a perspective projection of the
+	// scene the size of the orthographic one at z = 0; the software rasterized depth is tagged with the frame's epoch so that only
+	// the pixels this frame wrote read as nearer than the far plane, and is cleared once every depthEpochCount frames rather than
+	// every frame; set before Initialize
+	auto SetReversedZ(bool enabled) -> void { m_reversedZ = enabled; }
+
+	// counters and timings of the last frame known to be complete (a few frames behind)
+	auto GetCullingStatistics(CullingPass pass) const -> CullingStatistics const& { return m_cullingStatistics[pass]; }
+	auto GetPassTimings() const -> PassTimings const& { return m_passTimings; }
 
 private:
-	const uint32_t maxWidth = 3840;
-	const uint32_t maxHeight = 2160;
+	auto CullTaskGroups(VkCommandBuffer commandBuffer) -> void;
+	auto DrawMeshInstances(VkCommandBuffer commandBuffer, InstanceDeviceAndSwapchain const& device, CullingPass pass) -> void;
+	auto BuildDepthPyramid(VkCommandBuffer commandBuffer, VkExtent2D extent, uint32_t pyramid) -> void;
+	auto ResolveVisibility(VkCommandBuffer commandBuffer, InstanceDeviceAndSwapchain const& device, VkExtent2D extent) -> void;
+	auto ComputeRasterMeshInstances(VkCommandBuffer commandBuffer, InstanceDeviceAndSwapchain const& device, CullingPass pass) -> void;
+	auto BeginRenderPass(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkExtent2D extent) -> void;
+	auto CreateMeshShaderPipelines(InstanceDeviceAndSwapchain const& device) -> bool;
+	auto DestroyMeshShaderPipelines(VkDevice device) -> void;
 
 	VkBuffer m_viewportConstantsBuffer; VmaAllocation m_viewportConstantsAllocation;
+	VkBuffer m_instanceBuffer; VmaAllocation m_instanceAllocation;
+	VkBuffer m_statisticsBuffer; VmaAllocation m_statisticsAllocation;
+	VkBuffer m_visibleTaskGroupBuffer; VmaAllocation m_visibleTaskGroupAllocation; // instance << 16 | task group, a region per mesh
+	VkBuffer m_drawBuffer; VmaAllocation m_drawAllocation; // per mesh its visible task group count and draw count, then the indirect draws
+	CullingStatistics const* m_statistics; // persistently mapped, one slot of CullingPass_Count per frame execution context
+	std::vector<uint32_t> m_statisticsFrames; // per frame execution context, the frame its slot counts (0: none)
+	std::vector<bool> m_statisticsOcclusionCulling; // per frame execution context, whether its frame culled occluded megatiles
+	CullingStatistics m_cullingStatistics[CullingPass_Count] = {};
+
+	// timestamps around the passes, passTimestampCount per frame execution context
+	VkQueryPool m_timestampQueryPool;
+	double m_timestampPeriod;
+	PassTimings m_passTimings = {};
 
 	VkImage m_depthBuffer;  VmaAllocation m_depthAllocation;
 	VkImage m_depthStorageBuffer;  VmaAllocation m_depthStorageAllocation;
 	VkImage m_albedoBuffer; VmaAllocation m_albedoAllocation;
 	VkImage m_normalBuffer; VmaAllocation m_normalAllocation;
+	VkImage m_visibilityImage; VmaAllocation m_visibilityAllocation; // R64_UINT, stays in VK_IMAGE_LAYOUT_GENERAL
+	VkImageView m_visibilityView;
+	VkBuffer m_visibilityClusterBuffer; VmaAllocation m_visibilityClusterAllocation; // cluster count, then VisibilityCluster
+	VkBuffer m_computeRasterWorkBuffer; VmaAllocation m_computeRasterWorkAllocation; // ComputeRasterCounters per mesh, payloads, tiles
+	VkBuffer m_computeRasterGeometryBuffer; VmaAllocation m_computeRasterGeometryAllocation; // indexed draw, vertices, indices
+	VkBuffer m_tiledDepthBuffer; VmaAllocation m_tiledDepthAllocation; // tile flags, then the depth of the blocks
+
+	// max depth of the combined hardware and software depth, [0] of the last complete depth (the previous frame until the late depth
+	// pass is done), [1] of the early depth pass; both stay in VK_IMAGE_LAYOUT_GENERAL
+	VkImage m_depthPyramids[2]; VmaAllocation m_depthPyramidAllocations[2];
+	VkImageView m_depthPyramidViews[2];
+	VkImageView m_depthPyramidLevelViews[2][depthPyramidLevelCount];
+	VkExtent2D m_depthPyramidExtent = {}; // swapchain extent of the depth in m_depthPyramids[0], zero when it holds none
+	bool m_occlusionCulling = true;
+	float m_lodPixelError = 2.0f;
+	MeshShaderPermutation m_meshShaderPermutation = defaultMeshShaderPermutation;
+	bool m_visibilityBuffer = false;
+	bool m_supportsVisibilityBuffer = false;
+	bool m_computeRasterizer = false;
+	bool m_tiledDepth = false;
+	bool m_tiledDepthFilled = false; // the tiled depth buffer is undefined until the first frame fills it
+	bool m_reversedZ = false;
+	uint32_t m_depthEpoch = 0;        // of the last frame, the first one clears the software rasterized depth
+
+	// where the task and mesh shaders run: their own stages, or the compute stage with the compute rasterizer
+	VkPipelineStageFlags m_taskShaderStage = VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV;
+	VkPipelineStageFlags m_meshShaderStage = VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV;
 
 	VkImageView m_framebufferViews[3];
 	VkImageView m_meshShaderViews[3];
@@ -31,13 +238,25 @@ private:
 
 	VkFramebuffer m_framebuffer;
 
-	VkRenderPass m_renderPass;
+	VkRenderPass m_renderPass;       // clears depth
+	VkRenderPass m_resumeRenderPass; // loads depth, after a depth pyramid was built
 
 	ShaderModule m_taskShader;
 	ShaderModule m_depthPassMeshShader;
 	ShaderModule m_gbufferPassMeshShader;
 	ShaderModule m_gbufferPassFragmentShader;
+	ShaderModule m_visibilityPassMeshShader;
+	ShaderModule m_visibilityPassFragmentShader;
+	ShaderModule m_resolveVisibilityShader;
+	ShaderModule m_depthPyramidFirstLevelVisibilityShader;
 	ShaderModule m_combineAndLightComputeShader;
+	ShaderModule m_depthPyramidFirstLevelShader;
+	ShaderModule m_depthPyramidShader;
+	ShaderModule m_cullTaskGroupsShader;
+	ShaderModule m_writeTaskGroupDrawsShader;
+	ShaderModule m_depthPassVertexShader;
+	ShaderModule m_gbufferPassVertexShader;
+	ShaderModule m_clearTiledDepthShader;
 
 	VkDescriptorSetLayout m_viewportResourcesLayout;
 	VkPipelineLayout m_graphicPipelineLayout;
@@ -48,9 +267,35 @@ private:
 	VkPipelineLayout m_combineAndLightPipelineLayout;
 	VkDescriptorSet m_combineAndLightResources;
 
-	VkPipeline m_meshDepthPass;
+	VkDescriptorSetLayout m_depthPyramidResourcesLayout; // push descriptors, one level at a time
+	VkPipelineLayout m_depthPyramidPipelineLayout;
+
+	VkPipelineLayout m_meshComputePipelineLayout; // the viewport and mesh resources of the graphic pipelines, for compute
+
+	VkDescriptorSetLayout m_taskGroupCullingResourcesLayout; // push descriptors, one mesh at a time
+	VkPipelineLayout m_taskGroupCullingPipelineLayout;
+
+	VkPipeline m_meshDepthPass;      // draws the triangles the compute rasterizer exported with it
 	VkPipeline m_meshGbufferPass;
+	VkPipeline m_meshVisibilityPass;
 	VkPipeline m_combineAndLight;
+	VkPipeline m_buildDepthPyramidFirstLevel;
+	VkPipeline m_buildDepthPyramid;
+	VkPipeline m_buildDepthPyramidFirstLevelVisibility;
+	VkPipeline m_resolveVisibility;
+	VkPipeline m_cullTaskGroups;
+	VkPipeline m_writeTaskGroupDraws;
+	VkPipeline m_computeRasterTasks;
+	VkPipeline m_computeRasterDepthPass;
+	VkPipeline m_computeRasterGbufferPass;
+	VkPipeline m_clearTiledDepth;
 
-	std::vector<ParameterizedMesh const*> m_meshInstances;
+	std::vector<ParameterizedMesh*> m_meshes;
+	std::vector<MeshInstance> m_instances;         // in the order they were added
+	std::vector<MeshInstance> m_sortedInstances;   // grouped by mesh, as in the instance buffer
+	std::vector<uint32_t> m_meshFirstInstances;    // per mesh, its first instance in the instance buffer (and the instance count at the end)
+	std::vector<uint32_t> m_meshFirstVisibleTaskGroups; // per mesh, its region of the visible task group buffer (room for all of its task groups)
+	std::vector<uint32_t> m_meshFirstDraws;        // per mesh, its first indirect draw (and the draw count at the end)
+	uint32_t m_taskGroupCount = 0;                 // of every instance
+	bool m_instancesChanged = false;
 };
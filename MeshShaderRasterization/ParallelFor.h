@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// calls function(index) for every index in [0, count) using all hardware threads (or threadCount if non zero)
+// indices are handed out one at a time, so work items of uneven cost balance themselves
+template<typename Function>
+auto ParallelFor(uint32_t count, Function const& function, uint32_t threadCount = 0) -> void
+{
+	if (count == 0)
+		return;
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, count);
+
+	std::atomic<uint32_t> nextIndex = 0;
+	auto worker = [&]()
+	{
+		for (uint32_t index = nextIndex++; index < count; index = nextIndex++)
+			function(index);
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (uint32_t i = 1; i < threadCount; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
@@ -1,16 +1,205 @@
 
 #include "ParameterizedMesh.h"
-#include <cmath>
+#include "BlockCompression.h"
+#include "GeometryImageEncoding.h"
+#include "GeometryImageFile.h"
+#include "GeometryImageGenerator.h"
+#include "GeometryImageMipChain.h"
+#include "StagingRing.h"
+
 #include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <vector>
 
-auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
+namespace
+{
+	auto GetVkFormat(GeometryImageFormat format) -> VkFormat
+	{
+		switch (format)
+		{
+		case GeometryImageFormat_A2B10G10R10: return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+		case GeometryImageFormat_RGBA8: return VK_FORMAT_R8G8B8A8_UNORM;
+		case GeometryImageFormat_RGBA16: return VK_FORMAT_R16G16B16A16_UNORM;
+		case GeometryImageFormat_RG8Snorm: return VK_FORMAT_R8G8_SNORM;
+		case GeometryImageFormat_RG16Snorm: return VK_FORMAT_R16G16_SNORM;
+		case GeometryImageFormat_BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		case GeometryImageFormat_BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+		case GeometryImageFormat_BC5Snorm: return VK_FORMAT_BC5_SNORM_BLOCK;
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+}
+
+ParameterizedMesh::ParameterizedMesh()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(VK_NULL_HANDLE)
+	, m_size(0)
+	, m_mipCount(0)
+	, m_parameterization(GeometryImageParameterization_Octahedral)
+	, m_borderVertexCount(0)
+	, m_streaming(false)
+	, m_sourceMegatiles(nullptr)
+	, m_sourcePayload(nullptr)
+	, m_positionTexture(VK_NULL_HANDLE)
+	, m_positionTextureAllocation(VK_NULL_HANDLE)
+	, m_albedoTexture(VK_NULL_HANDLE)
+	, m_albedoTextureAllocation(VK_NULL_HANDLE)
+	, m_normalTexture(VK_NULL_HANDLE)
+	, m_normalTextureAllocation(VK_NULL_HANDLE)
+	, m_imageViews{ VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE }
+	, m_megatileBuffer(VK_NULL_HANDLE)
+	, m_megatileBufferAllocation(VK_NULL_HANDLE)
+	, m_taskGroupBuffer(VK_NULL_HANDLE)
+	, m_taskGroupBufferAllocation(VK_NULL_HANDLE)
+	, m_pageTableBuffer(VK_NULL_HANDLE)
+	, m_pageTableBufferAllocation(VK_NULL_HANDLE)
+	, m_requestBuffer(VK_NULL_HANDLE)
+	, m_requestBufferAllocation(VK_NULL_HANDLE)
+	, m_borderBuffer(VK_NULL_HANDLE)
+	, m_borderBufferAllocation(VK_NULL_HANDLE)
+	, m_requests(nullptr)
+	, m_meshResources(VK_NULL_HANDLE)
+{
+}
+
+ParameterizedMesh::~ParameterizedMesh()
+{
+	Uninitialize();
+}
+
+auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device, std::string const& geometryImageFilepath, uint64_t residencyBudget) -> bool
 {
 	VkResult result;
 
 	VkDevice vkDevice = device.GetDevice();
 	VmaAllocator allocator = device.GetAllocator();
+	m_device = vkDevice;
+	m_allocator = allocator;
+
+	const VkDeviceSize stagingSlotSize = 4 << 20;
+	const uint32_t stagingSlotCount = 4;
+
+	auto uploadStart = std::chrono::steady_clock::now();
+
+	// the albedo encoding of files is free, the sphere uses the build time one
+	GeometryImageAlbedoEncoding albedoEncoding = geometryImageAlbedoEncoding;
+
+	if (!geometryImageFilepath.empty())
+	{
+		if (!m_file.Open(geometryImageFilepath))
+			return false;
+
+		// the mesh shader only decodes the encodings it was built with
+		GeometryImageFileHeader const& header = m_file.GetHeader();
+		if (header.positionEncoding != geometryImagePositionEncoding || header.normalEncoding != geometryImageNormalEncoding)
+		{
+			std::cerr << "geometry image file " << geometryImageFilepath << " uses " << GetGeometryImagePositionEncodingName(header.positionEncoding) << " positions and "
+			          << GetGeometryImageNormalEncodingName(header.normalEncoding) << " normals, this build decodes " << GetGeometryImagePositionEncodingName(geometryImagePositionEncoding)
+			          << " positions and " << GetGeometryImageNormalEncodingName(geometryImageNormalEncoding) << " normals" << std::endl;
+			return false;
+		}
+
+		if (header.mipCount > maxGeometryImageMipCount)
+		{
+			std::cerr << "geometry image file " << geometryImageFilepath << " has more than " << maxGeometryImageMipCount << " mips" << std::endl;
+			return false;
+		}
+
+		// the task shader dispatches groups of 8x8 megatiles
+		if (header.size % (geometryImageMegatileSize * 8) != 0)
+		{
+			std::cerr << "geometry image file " << geometryImageFilepath << " is " << header.size << " texels wide, which is not a multiple of " << geometryImageMegatileSize * 8 << std::endl;
+			return false;
+		}
+
+		albedoEncoding = header.albedoEncoding;
+		m_size = header.size;
+		m_mipCount = header.mipCount;
+		m_parameterization = header.parameterization;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			m_positionBoundsMin[k] = header.positionBoundsMin[k];
+			m_positionBoundsMax[k] = header.positionBoundsMax[k];
+		}
+	}
+	else
+	{
+		// the sphere is generated in [0, 1]
+		m_size = 8192;
+		m_mipCount = GetGeometryImageMipCount(m_size);
+		m_parameterization = GeometryImageParameterization_Periodic;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			m_positionBoundsMin[k] = 0;
+			m_positionBoundsMax[k] = 1;
+		}
+	}
+
+	m_formats[0] = GetGeometryImagePositionFormat(geometryImagePositionEncoding);
+	m_formats[1] = GetGeometryImageAlbedoFormat(albedoEncoding);
+	m_formats[2] = GetGeometryImageNormalFormat(geometryImageNormalEncoding);
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		if (GetGeometryImageFormatBlockSize(m_formats[k]) > 0 && !device.SupportsTextureCompressionBc())
+		{
+			std::cerr << "the device does not support BC textures, needed by " << GetGeometryImageAlbedoEncodingName(albedoEncoding) << " albedo or "
+			          << GetGeometryImageNormalEncodingName(geometryImageNormalEncoding) << " normals" << std::endl;
+			return false;
+		}
+	}
+
+	uint32_t megatileCount = 0;
+	m_borderVertexCount = 0;
+	for (uint32_t mip = 0; mip < maxGeometryImageMipCount; ++mip)
+	{
+		m_megatileMipOffsets[mip] = megatileCount;
+		m_borderMipOffsets[mip] = m_borderVertexCount;
+		if (mip < m_mipCount)
+		{
+			uint32_t megatilesPerRow = (GetGeometryImageMipSize(m_size, mip) + geometryImageMegatileSize - 1) / geometryImageMegatileSize;
+			megatileCount += megatilesPerRow * megatilesPerRow;
+			m_borderVertexCount += 4 * GetGeometryImageMipSize(m_size, mip);
+		}
+	}
+	m_megatileInfos.assign(megatileCount, {});
+
+	// mips of a single megatile are always resident, the task shader falls back on them when finer megatiles are missing
+	uint32_t pinnedMipCount = 0;
+	for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+	{
+		if (GetGeometryImageMipSize(m_size, mip) <= geometryImageMegatileSize)
+			++pinnedMipCount;
+	}
 
-	const uint32_t size = 8192;
+	VkDeviceSize pageSize = 0;
+	for (uint32_t k = 0; k < 3; ++k)
+		pageSize += GetGeometryImagePlaneSize(m_formats[k], geometryImageMegatileSize, geometryImageMegatileSize);
+
+	uint32_t pageCount = megatileCount;
+	if (residencyBudget > 0)
+		pageCount = uint32_t(std::min<uint64_t>(pageCount, std::max<uint64_t>(residencyBudget / pageSize, pinnedMipCount + maxResidencyLoadsPerFrame)));
+	if (pageCount > maxGeometryImagePoolPageCount)
+	{
+		std::cout << "the " << megatileCount << " megatiles do not fit in a pool of " << maxGeometryImagePoolPageCount << " pages, they are streamed" << std::endl;
+		pageCount = maxGeometryImagePoolPageCount;
+	}
+	m_streaming = pageCount < megatileCount;
+
+	m_residency.Initialize(megatileCount, pageCount);
+	for (uint32_t mip = m_mipCount - pinnedMipCount; mip < m_mipCount; ++mip)
+		m_residency.Allocate(m_megatileMipOffsets[mip], true);
+	// the rest of the pool is filled coarse to fine, requests then trade megatiles nobody looks at for the ones on screen
+	for (uint32_t megatile = megatileCount; megatile-- > 0;)
+	{
+		if (m_residency.Allocate(megatile, !m_streaming) == invalidMegatilePage)
+			break;
+	}
+
+	uint32_t poolWidth = std::min(pageCount, geometryImagePoolPagesPerRow) * geometryImageMegatileSize;
+	uint32_t poolHeight = (pageCount + geometryImagePoolPagesPerRow - 1) / geometryImagePoolPagesPerRow * geometryImageMegatileSize;
 
 	{
 		VmaAllocationCreateInfo allocationCreateInfo;
@@ -25,9 +214,9 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 		VkImageCreateInfo imageCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
 		imageCreateInfo.flags = 0;
 		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageCreateInfo.format = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
-		imageCreateInfo.extent.width = size;
-		imageCreateInfo.extent.height = size;
+		imageCreateInfo.format = GetVkFormat(m_formats[0]);
+		imageCreateInfo.extent.width = poolWidth;
+		imageCreateInfo.extent.height = poolHeight;
 		imageCreateInfo.extent.depth = 1;
 		imageCreateInfo.mipLevels = 1;
 		imageCreateInfo.arrayLayers = 1;
@@ -40,17 +229,38 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		result = vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &m_positionTexture, &m_positionTextureAllocation, nullptr);
 
-		imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageCreateInfo.format = GetVkFormat(m_formats[1]);
 		result = vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &m_albedoTexture, &m_albedoTextureAllocation, nullptr);
+
+		imageCreateInfo.format = GetVkFormat(m_formats[2]);
 		result = vmaCreateImage(allocator, &imageCreateInfo, &allocationCreateInfo, &m_normalTexture, &m_normalTextureAllocation, nullptr);
+
+		VkBufferCreateInfo bufferCreateInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+		bufferCreateInfo.flags = 0;
+		bufferCreateInfo.size = sizeof(m_megatileMipOffsets) + m_megatileInfos.size() * sizeof(MegatileInfo);
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_megatileBuffer, &m_megatileBufferAllocation, nullptr);
+
+		uint32_t taskGroupsPerRow = m_size / (geometryImageMegatileSize * 8);
+		bufferCreateInfo.size = taskGroupsPerRow * taskGroupsPerRow * sizeof(TaskGroupBounds);
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_taskGroupBuffer, &m_taskGroupBufferAllocation, nullptr);
+
+		bufferCreateInfo.size = megatileCount * sizeof(uint32_t);
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_pageTableBuffer, &m_pageTableBufferAllocation, nullptr);
+
+		bufferCreateInfo.size = sizeof(m_borderMipOffsets) + m_borderVertexCount * sizeof(GeometryImageBorderVertex);
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_borderBuffer, &m_borderBufferAllocation, nullptr);
 	}
 
 	{
-		VkBuffer stagingBuffer; VmaAllocation stagingBufferAllocation; VmaAllocationInfo allocationInfo;
-
+		// the task shader stamps the megatiles it wants in the region of the frame execution context,
+		// which is read back once the context comes around again (its fence has signaled by then)
 		VmaAllocationCreateInfo allocationCreateInfo;
-		allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
-		allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+		allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
 		allocationCreateInfo.requiredFlags = 0;
 		allocationCreateInfo.preferredFlags = 0;
 		allocationCreateInfo.memoryTypeBits = 0;
@@ -59,57 +269,29 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 
 		VkBufferCreateInfo bufferCreateInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
 		bufferCreateInfo.flags = 0;
-		bufferCreateInfo.size = size * size * sizeof(uint32_t) * 3;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferCreateInfo.size = VkDeviceSize(device.GetFrameExecutionContextCount()) * megatileCount * sizeof(uint32_t);
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		bufferCreateInfo.queueFamilyIndexCount = 0;
 		bufferCreateInfo.pQueueFamilyIndices = nullptr;
-		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &stagingBuffer, &stagingBufferAllocation, &allocationInfo);
-
-		void* data;
-		vkMapMemory(vkDevice, allocationInfo.deviceMemory, allocationInfo.offset, allocationInfo.size, 0, &data);
 
-		VkMappedMemoryRange memoryRange{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr };
-		memoryRange.memory = allocationInfo.deviceMemory;
-		memoryRange.offset = allocationInfo.offset;
-		memoryRange.size = allocationInfo.size;
-		vkFlushMappedMemoryRanges(vkDevice, 1, &memoryRange);
-		vkUnmapMemory(vkDevice, allocationInfo.deviceMemory);
+		VmaAllocationInfo allocationInfo;
+		result = vmaCreateBuffer(allocator, &bufferCreateInfo, &allocationCreateInfo, &m_requestBuffer, &m_requestBufferAllocation, &allocationInfo);
+		CHECK_ERROR_AND_RETURN("could not create residency request buffer");
 
-		const float pi = 3.14159265359f;
-
-		uint32_t* position = (uint32_t*)(data);
-		uint32_t* albedo = position + size * size;
-		uint32_t* normal = albedo + size * size;
-
-		for (uint32_t i = 0; i < size; ++i)
-		{
-			float y = std::sin(i / float(size - 1) * 2 * pi) / 2.0f + 0.5f;
-			float r = std::cos(i / float(size - 1) * 2 * pi);
-			for (uint32_t j = 0; j < size; ++j)
-			{
-				float z = r * std::sin(j / float(size - 1) * 2 * pi) / 2.0f + 0.5f;
-				float x = r * std::cos(j / float(size - 1) * 2 * pi) / 2.0f + 0.5f;
-				*(position++) = (uint32_t(std::clamp(x, 0.0f, 1.0f) * 1023.0f) << 0)
-					          | (uint32_t(std::clamp(y, 0.0f, 1.0f) * 1023.0f) << 10)
-					          | (uint32_t(std::clamp(z, 0.0f, 1.0f) * 1023.0f) << 20)
-					          ;
-
-				*(albedo++) = 0xff000000
-						    | ((i & 0xff) << 0)
-						    | ((j & 0xff) << 8)
-							| ((0xff - (i & 0xff)/2 - (j & 0xff)/2) << 16)
-						    ;
-
-				*(normal++) = (uint32_t(std::clamp(x, 0.0f, 1.0f) * 255.0f) << 0)
-					        | (uint32_t(std::clamp(y, 0.0f, 1.0f) * 255.0f) << 8)
-					        | (uint32_t(std::clamp(z, 0.0f, 1.0f) * 255.0f) << 16)
-					        ;
-			}
-		}
+		// frames are numbered from 1, 0 is never requested
+		std::memset(allocationInfo.pMappedData, 0, bufferCreateInfo.size);
+		vmaFlushAllocation(allocator, m_requestBufferAllocation, 0, VK_WHOLE_SIZE);
+		m_requests = (uint32_t const*)allocationInfo.pMappedData;
+		m_requestFrames.assign(device.GetFrameExecutionContextCount(), 0);
+	}
 
-		device.BeginFrame();
-		VkCommandBuffer commandBuffer = device.GetCommandBuffer();
+	{
+		// the geometry image is streamed through a small staging ring:
+		// while the GPU copies one slot the CPU fills the next, and staging memory does not depend on size
+		StagingRing stagingRing;
+		if (!stagingRing.Initialize(device, stagingSlotSize, stagingSlotCount))
+			return false;
 
 		VkImageMemoryBarrier imageMemoryBarrier[3];
 		for (uint32_t i = 0; i < std::size(imageMemoryBarrier); ++i)
@@ -118,7 +300,7 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 			imageMemoryBarrier[i].srcAccessMask = 0;
 			imageMemoryBarrier[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 			imageMemoryBarrier[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageMemoryBarrier[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier[i].newLayout = VK_IMAGE_LAYOUT_GENERAL; // pages are copied to while the pools are read, they never change layout
 			imageMemoryBarrier[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			imageMemoryBarrier[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			imageMemoryBarrier[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -130,51 +312,85 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 		imageMemoryBarrier[0].image = m_positionTexture;
 		imageMemoryBarrier[1].image = m_albedoTexture;
 		imageMemoryBarrier[2].image = m_normalTexture;
+		VkCommandBuffer commandBuffer = stagingRing.GetCommandBuffer();
+		if (commandBuffer == VK_NULL_HANDLE)
+			return false;
 		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
 
-		VkBufferImageCopy region;
-		region.bufferOffset = allocationInfo.offset;
-		region.bufferRowLength = 0;
-		region.bufferImageHeight = 0;
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-		region.imageSubresource.layerCount = 1;
-		region.imageOffset.x = 0;
-		region.imageOffset.y = 0;
-		region.imageOffset.z = 0;
-		region.imageExtent.width = size;
-		region.imageExtent.height = size;
-		region.imageExtent.depth = 1;
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, m_positionTexture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-		region.bufferOffset += size * size * sizeof(uint32_t);
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, m_albedoTexture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-		region.bufferOffset += size * size * sizeof(uint32_t);
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, m_normalTexture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		bool uploaded = geometryImageFilepath.empty() ? UploadSphere(stagingRing) : UploadFile(stagingRing);
+		std::vector<uint32_t> const& pageTable = m_residency.GetPageTable();
+		if (!uploaded || !UploadMegatileBuffer(stagingRing) || !UploadTaskGroupBuffer(stagingRing) || !UploadBuffer(stagingRing, m_pageTableBuffer, pageTable.data(), pageTable.size() * sizeof(uint32_t)))
+			return false;
+
+		VkBufferMemoryBarrier bufferMemoryBarrier[4];
+		for (uint32_t i = 0; i < std::size(bufferMemoryBarrier); ++i)
+		{
+			bufferMemoryBarrier[i] = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr };
+			bufferMemoryBarrier[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			bufferMemoryBarrier[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			bufferMemoryBarrier[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferMemoryBarrier[i].offset = 0;
+			bufferMemoryBarrier[i].size = VK_WHOLE_SIZE;
+		}
+		bufferMemoryBarrier[0].buffer = m_megatileBuffer;
+		bufferMemoryBarrier[1].buffer = m_pageTableBuffer;
+		bufferMemoryBarrier[2].buffer = m_taskGroupBuffer;
+		bufferMemoryBarrier[3].buffer = m_borderBuffer;
 
 		for (uint32_t i = 0; i < std::size(imageMemoryBarrier); ++i)
 		{
 			imageMemoryBarrier[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 			imageMemoryBarrier[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			imageMemoryBarrier[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageMemoryBarrier[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier[i].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageMemoryBarrier[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+		commandBuffer = stagingRing.GetCommandBuffer();
+		if (commandBuffer == VK_NULL_HANDLE)
+			return false;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | device.GetMeshShadingPipelineStages(), 0, 0, nullptr,
+			uint32_t(std::size(bufferMemoryBarrier)), bufferMemoryBarrier, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
+
+		if (!stagingRing.Flush())
+			return false;
+
+		auto uploadEnd = std::chrono::steady_clock::now();
+		double bytesPerVertex = 0;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			uint32_t blockSize = GetGeometryImageFormatBlockSize(m_formats[k]);
+			bytesPerVertex += blockSize > 0 ? blockSize / 16.0 : GetGeometryImageFormatTexelSize(m_formats[k]);
 		}
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_MESH_SHADER_BIT_NV, 0, 0, nullptr, 0, nullptr, uint32_t(std::size(imageMemoryBarrier)), imageMemoryBarrier);
 
-		device.EndFrame();
-		device.WaitIdle();
+		std::cout << (geometryImageFilepath.empty() ? "generated" : "loaded") << " and uploaded " << m_size << "x" << m_size << " geometry image (" << m_mipCount << " mips, "
+		          << GetGeometryImageAlbedoEncodingName(albedoEncoding) << " albedo, " << bytesPerVertex << " bytes per vertex) in "
+		          << std::chrono::duration<double, std::milli>(uploadEnd - uploadStart).count() << " ms (" << (stagingRing.GetSize() >> 20) << " MB of staging memory), "
+		          << m_residency.GetResidentCount() << " of " << megatileCount << " megatiles resident in a " << ((pageCount * pageSize) >> 20) << " MB pool" << std::endl;
+	}
+
+	if (m_streaming)
+	{
+		// the file stays mapped (or the encoded sphere in memory) for megatiles to be streamed in
+		uint32_t sourceCount = geometryImageFilepath.empty() ? uint32_t(m_retainedMegatiles.size()) : m_file.GetHeader().megatileCount;
+		m_sourceMegatiles = geometryImageFilepath.empty() ? m_retainedMegatiles.data() : m_file.GetMegatiles();
+		m_sourcePayload = geometryImageFilepath.empty() ? m_retainedPayload.data() : m_file.GetPayload();
+
+		m_sourceEntries.assign(megatileCount, 0);
+		for (uint32_t i = 0; i < sourceCount; ++i)
+			m_sourceEntries[GetMegatileIndex(m_sourceMegatiles[i].mip, m_sourceMegatiles[i].x, m_sourceMegatiles[i].y)] = i;
 
-		vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAllocation);
+		if (!m_streamingRing.Initialize(device, stagingSlotSize, device.GetFrameExecutionContextCount()))
+			return false;
 	}
+	else
+		m_file.Close();
 
 	{
 		VkImageViewCreateInfo imageViewCreateInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, nullptr };
 		imageViewCreateInfo.flags = 0;
 		imageViewCreateInfo.image = m_positionTexture;
 		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewCreateInfo.format = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+		imageViewCreateInfo.format = GetVkFormat(m_formats[0]);
 		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -187,10 +403,11 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 		vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_imageViews[0]);
 
 		imageViewCreateInfo.image = m_albedoTexture;
-		imageViewCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageViewCreateInfo.format = GetVkFormat(m_formats[1]);
 		vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_imageViews[1]);
 
 		imageViewCreateInfo.image = m_normalTexture;
+		imageViewCreateInfo.format = GetVkFormat(m_formats[2]);
 		vkCreateImageView(vkDevice, &imageViewCreateInfo, nullptr, &m_imageViews[2]);
 	}
 
@@ -202,12 +419,13 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 		vkAllocateDescriptorSets(vkDevice, &descriptorSetAllocateInfo, &m_meshResources);
 
 		VkDescriptorImageInfo imageInfos[3];
-		VkWriteDescriptorSet writeDescriptorSets[3];
-		for (uint32_t i = 0; i < std::size(writeDescriptorSets); ++i)
+		VkDescriptorBufferInfo bufferInfos[4];
+		VkWriteDescriptorSet writeDescriptorSets[7];
+		for (uint32_t i = 0; i < std::size(imageInfos); ++i)
 		{
 			imageInfos[i].sampler = VK_NULL_HANDLE;
 			imageInfos[i].imageView = m_imageViews[i];
-			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
 			writeDescriptorSets[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
 			writeDescriptorSets[i].dstSet = m_meshResources;
@@ -219,13 +437,418 @@ auto ParameterizedMesh::Initialize(InstanceDeviceAndSwapchain& device) -> bool
 			writeDescriptorSets[i].pBufferInfo = nullptr;
 			writeDescriptorSets[i].pTexelBufferView = nullptr;
 		}
+
+		bufferInfos[0].buffer = m_megatileBuffer;
+		bufferInfos[1].buffer = m_pageTableBuffer;
+		bufferInfos[2].buffer = m_requestBuffer;
+		bufferInfos[3].buffer = m_borderBuffer;
+		for (uint32_t i = 0; i < std::size(bufferInfos); ++i)
+		{
+			bufferInfos[i].offset = 0;
+			bufferInfos[i].range = VK_WHOLE_SIZE;
+
+			writeDescriptorSets[3 + i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+			writeDescriptorSets[3 + i].dstSet = m_meshResources;
+			writeDescriptorSets[3 + i].dstBinding = 3 + i;
+			writeDescriptorSets[3 + i].dstArrayElement = 0;
+			writeDescriptorSets[3 + i].descriptorCount = 1;
+			writeDescriptorSets[3 + i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[3 + i].pImageInfo = nullptr;
+			writeDescriptorSets[3 + i].pBufferInfo = &bufferInfos[i];
+			writeDescriptorSets[3 + i].pTexelBufferView = nullptr;
+		}
+
 		vkUpdateDescriptorSets(vkDevice, uint32_t(std::size(writeDescriptorSets)), writeDescriptorSets, 0, nullptr);
 	}
 
 	return true;
 }
 
+auto ParameterizedMesh::UpdateResidency(InstanceDeviceAndSwapchain const& device) -> bool
+{
+	if (!m_streaming)
+		return true;
+
+	uint32_t frameExecutionContext = device.GetFrameExecutionContextIndex();
+	uint32_t requestOffset = GetRequestOffset(frameExecutionContext);
+
+	// BeginFrame waited for the last frame that used this context, its requests are complete
+	m_loads.clear();
+	if (m_requestFrames[frameExecutionContext] != 0)
+	{
+		vmaInvalidateAllocation(device.GetAllocator(), m_requestBufferAllocation, requestOffset * sizeof(uint32_t), m_megatileInfos.size() * sizeof(uint32_t));
+		m_residency.Update(m_requests + requestOffset, m_requestFrames[frameExecutionContext], maxResidencyLoadsPerFrame, m_loads);
+	}
+	m_requestFrames[frameExecutionContext] = device.GetFrameNumber();
+
+	if (m_loads.empty())
+		return true;
+
+	// evicted pages may still be read by the frames in flight (and written by the previous update)
+	VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkCommandBuffer commandBuffer = m_streamingRing.GetCommandBuffer();
+	if (commandBuffer == VK_NULL_HANDLE)
+		return false;
+	vkCmdPipelineBarrier(commandBuffer, device.GetMeshShadingPipelineStages() | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	for (MegatileResidency::Load const& load : m_loads)
+	{
+		if (!UploadMegatiles(m_streamingRing, &m_sourceMegatiles[m_sourceEntries[load.m_megatile]], 1, m_sourcePayload))
+			return false;
+	}
+
+	std::vector<uint32_t> const& pageTable = m_residency.GetPageTable();
+	if (!UploadBuffer(m_streamingRing, m_pageTableBuffer, pageTable.data(), pageTable.size() * sizeof(uint32_t)))
+		return false;
+
+	// submitted ahead of the frame, which waits for the copies before its task shaders
+	return m_streamingRing.Submit();
+}
+
+auto ParameterizedMesh::UploadSphere(StagingRing& stagingRing) -> bool
+{
+	const uint32_t size = m_size;
+
+	// bands of one row of megatiles: the encoder hands each band over as soon as it is generated
+	const uint32_t bandRows = geometryImageMegatileSize;
+
+	bool uploadFailed = false;
+	GeometryImageEncoder encoder(size, m_mipCount, geometryImagePositionEncoding, geometryImageAlbedoEncoding, geometryImageNormalEncoding, m_positionBoundsMin, m_positionBoundsMax,
+		[&](GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload, uint64_t payloadSize)
+	{
+		uploadFailed = !UploadMegatiles(stagingRing, megatiles, megatileCount, payload) || uploadFailed;
+
+		// megatiles that are not resident are streamed in later from memory (a file keeps them on disk instead)
+		if (m_streaming)
+		{
+			for (uint32_t i = 0; i < megatileCount; ++i)
+			{
+				GeometryImageFileMegatile megatile = megatiles[i];
+				megatile.payloadOffset += m_retainedPayload.size();
+				m_retainedMegatiles.push_back(megatile);
+			}
+			m_retainedPayload.insert(m_retainedPayload.end(), payload, payload + payloadSize);
+		}
+	}
+	);
+
+	// coarser mips are built from the bands of mip 0 and encoded as their rows complete
+	GeometryImageMipChainBuilder mipChainBuilder(size, m_mipCount,
+		[&](uint32_t mip, uint32_t, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal)
+	{
+		encoder.PushRows(mip, rowCount, position, albedo, normal);
+	}
+	);
+
+	std::vector<float> position(size_t(bandRows) * (size + 1) * 3);
+	std::vector<uint32_t> albedo(size_t(bandRows) * (size + 1));
+	std::vector<float> normal(size_t(bandRows) * (size + 1) * 3);
+
+	for (uint32_t firstRow = 0; firstRow <= size; firstRow += bandRows)
+	{
+		uint32_t rowCount = std::min(bandRows, size + 1 - firstRow);
+		GenerateSphereGeometryImage(size, firstRow, rowCount, position.data(), albedo.data(), normal.data());
+		encoder.PushRows(0, rowCount, position.data(), albedo.data(), normal.data());
+		mipChainBuilder.PushRows(firstRow, rowCount, position.data(), albedo.data(), normal.data());
+		if (uploadFailed)
+			return false;
+	}
+
+	std::vector<MegatileBounds> bounds = encoder.GetBounds();
+	ExtendCoarseMegatileBoxes(bounds.data(), size, m_mipCount);
+	for (uint32_t i = 0; i < bounds.size(); ++i)
+		m_megatileInfos[i].bounds = bounds[i];
+
+	return UploadBorderBuffer(stagingRing, encoder.GetBorderVertices().data());
+}
+
+auto ParameterizedMesh::UploadFile(StagingRing& stagingRing) -> bool
+{
+	if (m_file.GetHeader().megatileCount != m_megatileInfos.size())
+	{
+		std::cerr << "geometry image file has " << m_file.GetHeader().megatileCount << " megatiles instead of " << m_megatileInfos.size() << std::endl;
+		return false;
+	}
+
+	std::vector<MegatileBounds> bounds(m_file.GetBounds(), m_file.GetBounds() + m_megatileInfos.size());
+	ExtendCoarseMegatileBoxes(bounds.data(), m_size, m_mipCount);
+	for (uint32_t i = 0; i < m_megatileInfos.size(); ++i)
+		m_megatileInfos[i].bounds = bounds[i];
+
+	return UploadBorderBuffer(stagingRing, m_file.GetBorderVertices())
+		&& UploadMegatiles(stagingRing, m_file.GetMegatiles(), m_file.GetHeader().megatileCount, m_file.GetPayload());
+}
+
+auto ParameterizedMesh::UploadMegatiles(StagingRing& stagingRing, GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload) -> bool
+{
+	VkImage images[3] = { m_positionTexture, m_albedoTexture, m_normalTexture };
+	std::vector<VkBufferImageCopy> regions[3];
+
+	for (uint32_t i = 0; i < megatileCount; ++i)
+	{
+		GeometryImageFileMegatile const& megatile = megatiles[i];
+		MegatileInfo& info = m_megatileInfos[GetMegatileIndex(megatile.mip, megatile.x, megatile.y)];
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			info.positionBoundsMin[k] = megatile.positionBoundsMin[k];
+			info.positionBoundsExtent[k] = megatile.positionBoundsMax[k] - megatile.positionBoundsMin[k];
+		}
+	}
+
+	auto getPage = [&](uint32_t i) { return m_residency.GetPage(GetMegatileIndex(megatiles[i].mip, megatiles[i].x, megatiles[i].y)); };
+
+	// megatiles are stored in upload order: runs of consecutive resident megatiles that fit in a slot are copied to staging at once
+	uint32_t firstMegatile = 0;
+	while (firstMegatile < megatileCount)
+	{
+		if (getPage(firstMegatile) == invalidMegatilePage)
+		{
+			++firstMegatile;
+			continue;
+		}
+
+		uint64_t runOffset = megatiles[firstMegatile].payloadOffset;
+		uint64_t runSize = 0;
+		uint32_t endMegatile = firstMegatile;
+		while (endMegatile < megatileCount
+			&& megatiles[endMegatile].payloadOffset == runOffset + runSize
+			&& getPage(endMegatile) != invalidMegatilePage
+			&& (runSize + megatiles[endMegatile].payloadSize <= stagingRing.GetSlotSize() || endMegatile == firstMegatile))
+		{
+			runSize += megatiles[endMegatile].payloadSize;
+			++endMegatile;
+		}
+
+		VkDeviceSize bufferOffset;
+		void* data = stagingRing.Allocate(runSize, bufferOffset);
+		if (!data)
+			return false;
+		std::memcpy(data, payload + runOffset, runSize);
+
+		for (uint32_t k = 0; k < 3; ++k)
+			regions[k].clear();
+
+		for (uint32_t i = firstMegatile; i < endMegatile; ++i)
+		{
+			GeometryImageFileMegatile const& megatile = megatiles[i];
+			VkDeviceSize imageOffset = bufferOffset + (megatile.payloadOffset - runOffset);
+			uint32_t page = getPage(i);
+
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				// megatiles narrower than a block (the last mips) still copy whole blocks, the rest of the page is unused
+				uint32_t alignment = GetGeometryImageFormatBlockSize(m_formats[k]) > 0 ? bcBlockSize : 1;
+
+				VkBufferImageCopy region;
+				region.bufferOffset = imageOffset;
+				region.bufferRowLength = 0;
+				region.bufferImageHeight = 0;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = 0;
+				region.imageSubresource.baseArrayLayer = 0;
+				region.imageSubresource.layerCount = 1;
+				region.imageOffset.x = int32_t(page % geometryImagePoolPagesPerRow * geometryImageMegatileSize);
+				region.imageOffset.y = int32_t(page / geometryImagePoolPagesPerRow * geometryImageMegatileSize);
+				region.imageOffset.z = 0;
+				region.imageExtent.width = (megatile.width + alignment - 1) / alignment * alignment;
+				region.imageExtent.height = (megatile.height + alignment - 1) / alignment * alignment;
+				region.imageExtent.depth = 1;
+				regions[k].push_back(region);
+
+				imageOffset += GetGeometryImagePlaneSize(m_formats[k], megatile.width, megatile.height);
+			}
+		}
+
+		VkCommandBuffer commandBuffer = stagingRing.GetCommandBuffer();
+		if (commandBuffer == VK_NULL_HANDLE)
+			return false;
+		for (uint32_t k = 0; k < 3; ++k)
+			vkCmdCopyBufferToImage(commandBuffer, stagingRing.GetBuffer(), images[k], VK_IMAGE_LAYOUT_GENERAL, uint32_t(regions[k].size()), regions[k].data());
+
+		firstMegatile = endMegatile;
+	}
+
+	return true;
+}
+
+auto ParameterizedMesh::UploadMegatileBuffer(StagingRing& stagingRing) -> bool
+{
+	std::vector<uint8_t> contents(sizeof(m_megatileMipOffsets) + m_megatileInfos.size() * sizeof(MegatileInfo));
+	std::memcpy(contents.data(), m_megatileMipOffsets, sizeof(m_megatileMipOffsets));
+	std::memcpy(contents.data() + sizeof(m_megatileMipOffsets), m_megatileInfos.data(), m_megatileInfos.size() * sizeof(MegatileInfo));
+
+	return UploadBuffer(stagingRing, m_megatileBuffer, contents.data(), contents.size());
+}
+
+auto ParameterizedMesh::UploadTaskGroupBuffer(StagingRing& stagingRing) -> bool
+{
+	// mips keep vertices of mip 0, so a task group draws within the bounds of its mip 0 megatiles (they cover the row and column past
+	// them) as long as its quads do not cover more than the task group
+	uint32_t taskGroupsPerRow = m_size / (geometryImageMegatileSize * 8);
+	std::vector<TaskGroupBounds> taskGroupBounds(taskGroupsPerRow * taskGroupsPerRow);
+	for (uint32_t y = 0; y < taskGroupsPerRow; ++y)
+	{
+		for (uint32_t x = 0; x < taskGroupsPerRow; ++x)
+		{
+			TaskGroupBounds& bounds = taskGroupBounds[y * taskGroupsPerRow + x];
+			std::fill_n(bounds.boundsMin, 4, FLT_MAX);
+			std::fill_n(bounds.boundsMax, 4, -FLT_MAX);
+			for (uint32_t megatile = 0; megatile < 64; ++megatile)
+			{
+				MegatileBounds const& megatileBounds = m_megatileInfos[GetMegatileIndex(0, x * 8 + megatile % 8, y * 8 + megatile / 8)].bounds;
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					bounds.boundsMin[k] = std::min(bounds.boundsMin[k], megatileBounds.boundsMin[k]);
+					bounds.boundsMax[k] = std::max(bounds.boundsMax[k], megatileBounds.boundsMax[k]);
+				}
+			}
+			bounds.boundsMin[3] = bounds.boundsMax[3] = 0;
+		}
+	}
+
+	// a quad of mip m > 9 covers 2^(m - 9) task groups per side, the first of them takes the bounds of all
+	// (regions on the last row and column are cut short when the task groups per row are not a power of two)
+	std::vector<TaskGroupBounds> regionBounds = taskGroupBounds;
+	uint32_t finerPerRow = taskGroupsPerRow;
+	for (uint32_t regionSize = 2, mip = 10; mip < m_mipCount; regionSize *= 2, ++mip)
+	{
+		uint32_t regionsPerRow = (finerPerRow + 1) / 2;
+		std::vector<TaskGroupBounds> coarserBounds(regionsPerRow * regionsPerRow);
+		for (uint32_t y = 0; y < regionsPerRow; ++y)
+		{
+			for (uint32_t x = 0; x < regionsPerRow; ++x)
+			{
+				TaskGroupBounds& bounds = coarserBounds[y * regionsPerRow + x];
+				bounds = regionBounds[(y * 2) * finerPerRow + x * 2];
+				for (uint32_t i = 1; i < 4; ++i)
+				{
+					uint32_t finerX = x * 2 + i % 2;
+					uint32_t finerY = y * 2 + i / 2;
+					if (finerX >= finerPerRow || finerY >= finerPerRow)
+						continue;
+
+					TaskGroupBounds const& finerBounds = regionBounds[finerY * finerPerRow + finerX];
+					for (uint32_t k = 0; k < 3; ++k)
+					{
+						bounds.boundsMin[k] = std::min(bounds.boundsMin[k], finerBounds.boundsMin[k]);
+						bounds.boundsMax[k] = std::max(bounds.boundsMax[k], finerBounds.boundsMax[k]);
+					}
+				}
+
+				TaskGroupBounds& firstBounds = taskGroupBounds[(y * regionSize) * taskGroupsPerRow + x * regionSize];
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					firstBounds.boundsMin[k] = std::min(firstBounds.boundsMin[k], bounds.boundsMin[k]);
+					firstBounds.boundsMax[k] = std::max(firstBounds.boundsMax[k], bounds.boundsMax[k]);
+				}
+			}
+		}
+		regionBounds.swap(coarserBounds);
+		finerPerRow = regionsPerRow;
+	}
+
+	return UploadBuffer(stagingRing, m_taskGroupBuffer, taskGroupBounds.data(), taskGroupBounds.size() * sizeof(TaskGroupBounds));
+}
+
+auto ParameterizedMesh::UploadBorderBuffer(StagingRing& stagingRing, GeometryImageBorderVertex const* borderVertices) -> bool
+{
+	std::vector<uint8_t> contents(sizeof(m_borderMipOffsets) + m_borderVertexCount * sizeof(GeometryImageBorderVertex));
+	std::memcpy(contents.data(), m_borderMipOffsets, sizeof(m_borderMipOffsets));
+	std::memcpy(contents.data() + sizeof(m_borderMipOffsets), borderVertices, m_borderVertexCount * sizeof(GeometryImageBorderVertex));
+
+	return UploadBuffer(stagingRing, m_borderBuffer, contents.data(), contents.size());
+}
+
+auto ParameterizedMesh::UploadBuffer(StagingRing& stagingRing, VkBuffer buffer, void const* contents, VkDeviceSize size) -> bool
+{
+	for (VkDeviceSize offset = 0; offset < size; offset += stagingRing.GetSlotSize())
+	{
+		VkBufferCopy region;
+		region.srcOffset = 0;
+		region.dstOffset = offset;
+		region.size = std::min(stagingRing.GetSlotSize(), size - offset);
+
+		void* data = stagingRing.Allocate(region.size, region.srcOffset);
+		if (!data)
+			return false;
+		std::memcpy(data, (uint8_t const*)contents + offset, region.size);
+
+		VkCommandBuffer commandBuffer = stagingRing.GetCommandBuffer();
+		if (commandBuffer == VK_NULL_HANDLE)
+			return false;
+		vkCmdCopyBuffer(commandBuffer, stagingRing.GetBuffer(), buffer, 1, &region);
+	}
+
+	return true;
+}
+
+auto ParameterizedMesh::GetMegatileIndex(uint32_t mip, uint32_t x, uint32_t y) const -> uint32_t
+{
+	uint32_t megatilesPerRow = (GetGeometryImageMipSize(m_size, mip) + geometryImageMegatileSize - 1) / geometryImageMegatileSize;
+	return m_megatileMipOffsets[mip] + y * megatilesPerRow + x;
+}
+
 auto ParameterizedMesh::Uninitialize() -> bool
 {
+	if (m_device == VK_NULL_HANDLE)
+		return true;
+
+	// the frames in flight may still read the geometry image
+	vkDeviceWaitIdle(m_device);
+
+	m_streamingRing.Uninitialize();
+
+	for (VkImageView& imageView : m_imageViews)
+	{
+		vkDestroyImageView(m_device, imageView, nullptr);
+		imageView = VK_NULL_HANDLE;
+	}
+	vmaDestroyImage(m_allocator, m_positionTexture, m_positionTextureAllocation);
+	vmaDestroyImage(m_allocator, m_albedoTexture, m_albedoTextureAllocation);
+	vmaDestroyImage(m_allocator, m_normalTexture, m_normalTextureAllocation);
+
+	vmaDestroyBuffer(m_allocator, m_megatileBuffer, m_megatileBufferAllocation);
+	vmaDestroyBuffer(m_allocator, m_taskGroupBuffer, m_taskGroupBufferAllocation);
+	vmaDestroyBuffer(m_allocator, m_pageTableBuffer, m_pageTableBufferAllocation);
+	vmaDestroyBuffer(m_allocator, m_requestBuffer, m_requestBufferAllocation);
+	vmaDestroyBuffer(m_allocator, m_borderBuffer, m_borderBufferAllocation);
+
+	m_positionTexture = VK_NULL_HANDLE;
+	m_positionTextureAllocation = VK_NULL_HANDLE;
+	m_albedoTexture = VK_NULL_HANDLE;
+	m_albedoTextureAllocation = VK_NULL_HANDLE;
+	m_normalTexture = VK_NULL_HANDLE;
+	m_normalTextureAllocation = VK_NULL_HANDLE;
+	m_megatileBuffer = VK_NULL_HANDLE;
+	m_megatileBufferAllocation = VK_NULL_HANDLE;
+	m_taskGroupBuffer = VK_NULL_HANDLE;
+	m_taskGroupBufferAllocation = VK_NULL_HANDLE;
+	m_pageTableBuffer = VK_NULL_HANDLE;
+	m_pageTableBufferAllocation = VK_NULL_HANDLE;
+	m_requestBuffer = VK_NULL_HANDLE;
+	m_requestBufferAllocation = VK_NULL_HANDLE;
+	m_borderBuffer = VK_NULL_HANDLE;
+	m_borderBufferAllocation = VK_NULL_HANDLE;
+	m_requests = nullptr;
+
+	// the descriptor pool does not free sets one by one, the set goes back with the pool
+	m_meshResources = VK_NULL_HANDLE;
+
+	m_file.Close();
+	m_retainedMegatiles.clear();
+	m_retainedPayload.clear();
+	m_sourceMegatiles = nullptr;
+	m_sourcePayload = nullptr;
+	m_sourceEntries.clear();
+	m_megatileInfos.clear();
+	m_requestFrames.clear();
+	m_loads.clear();
+	m_streaming = false;
+
+	m_device = VK_NULL_HANDLE;
+	m_allocator = VK_NULL_HANDLE;
 	return true;
 }
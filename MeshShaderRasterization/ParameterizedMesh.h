@@ -1,21 +1,123 @@
 #pragma once
 
+#include "GeometryImageFile.h"
 #include "InstanceDeviceAndSwapchain.h"
+#include "MegatileBounds.h"
+#include "MegatileResidency.h"
+#include "StagingRing.h"
+
+#include <string>
+#include <vector>
+
+const uint32_t maxGeometryImageMipCount = 16;
+
+// megatiles live in the 64x64 texel pages of one pool image per plane, pages are laid out row by row
+// (the shaders find a page from the page table, poolPagesPerRow in the shaders must match)
+const uint32_t geometryImagePoolPagesPerRow = 128;
+const uint32_t maxGeometryImagePoolPageCount = geometryImagePoolPagesPerRow * 256; // 8192x16384 texels
+// pages streamed in per frame at most, when the pool cannot hold every megatile
+const uint32_t maxResidencyLoadsPerFrame = 64;
+
+// per megatile data read by the task and mesh shaders (megatileBuffer, std430)
+// the buffer starts with the index of the first megatile of each mip, megatiles of a mip are stored row by row
+struct MegatileInfo
+{
+	float positionBoundsMin[4];    // relative position texels are dequantized as min + texel * extent
+	float positionBoundsExtent[4];
+	MegatileBounds bounds;         // for coarse culling, computed when the geometry image is encoded
+};
+
+// the border vertices of every mip (borderBuffer, std430) are the GeometryImageBorderVertex of geometry image files, always resident
+// the buffer starts with the index of the first border vertex of each mip
+
+// box of everything the task groups starting at one group of 8x8 mip 0 megatiles may draw, whatever the mips (taskGroupBuffer, std430)
+// past mip 9 a quad covers several task groups, the first of them draws it
+struct TaskGroupBounds
+{
+	float boundsMin[4]; // object space, w unused
+	float boundsMax[4];
+};
 
 class ParameterizedMesh
 {
 public:
-	auto Initialize(InstanceDeviceAndSwapchain& device) -> bool;
+	ParameterizedMesh();
+	~ParameterizedMesh();
+
+	// loads the geometry image from a file written by GeometryImageFileWriter, or generates a sphere if geometryImageFilepath is empty
+	// residencyBudget caps the pool in bytes (0 keeps every megatile resident), the rest is streamed on request of the task shader
+	auto Initialize(InstanceDeviceAndSwapchain& device, std::string const& geometryImageFilepath = {}, uint64_t residencyBudget = 0) -> bool;
+	// waits for the GPU to be done with the geometry image, then destroys it
 	auto Uninitialize() -> bool;
 
+	// reads back the requests of the last frame that used the current frame execution context and streams the missing megatiles
+	// must be called before recording the draws of the frame, the copies are submitted right away
+	auto UpdateResidency(InstanceDeviceAndSwapchain const& device) -> bool;
+
 	auto GetDescriptorSet() const -> VkDescriptorSet const& { return m_meshResources; }
+	// TaskGroupBounds of each task group, row by row
+	auto GetTaskGroupBuffer() const -> VkBuffer { return m_taskGroupBuffer; }
+	auto GetSize() const -> uint32_t { return m_size; }
+	auto GetMipCount() const -> uint32_t { return m_mipCount; }
+	auto GetParameterization() const -> GeometryImageParameterization { return m_parameterization; }
+	// first entry of the requests written with the given frame execution context
+	auto GetRequestOffset(uint32_t frameExecutionContext) const -> uint32_t { return frameExecutionContext * uint32_t(m_megatileInfos.size()); }
+	auto GetPositionBoundsMin() const -> float const* { return m_positionBoundsMin; }
+	auto GetPositionBoundsMax() const -> float const* { return m_positionBoundsMax; }
 
 private:
+	auto UploadSphere(StagingRing& stagingRing) -> bool;
+	auto UploadFile(StagingRing& stagingRing) -> bool;
+	// copies the encoded megatiles that have a page to the pool images and records the info of all, payload offsets are relative to payload
+	auto UploadMegatiles(StagingRing& stagingRing, GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload) -> bool;
+	auto UploadMegatileBuffer(StagingRing& stagingRing) -> bool;
+	auto UploadTaskGroupBuffer(StagingRing& stagingRing) -> bool;
+	auto UploadBorderBuffer(StagingRing& stagingRing, GeometryImageBorderVertex const* borderVertices) -> bool;
+	auto UploadBuffer(StagingRing& stagingRing, VkBuffer buffer, void const* contents, VkDeviceSize size) -> bool;
+	auto GetMegatileIndex(uint32_t mip, uint32_t x, uint32_t y) const -> uint32_t;
+
+	VkDevice m_device;
+	VmaAllocator m_allocator;
+
+	uint32_t m_size;
+	uint32_t m_mipCount;
+	GeometryImageParameterization m_parameterization;
+	float m_positionBoundsMin[3];
+	float m_positionBoundsMax[3];
+	GeometryImageFormat m_formats[3];
+
+	uint32_t m_megatileMipOffsets[maxGeometryImageMipCount];
+	std::vector<MegatileInfo> m_megatileInfos;
+	uint32_t m_borderMipOffsets[maxGeometryImageMipCount];
+	uint32_t m_borderVertexCount;
+
+	MegatileResidency m_residency;
+	bool m_streaming;
+
+	// where streamed megatiles are copied from: the mapped file, or the encoded sphere kept in memory
+	GeometryImageFile m_file;
+	std::vector<GeometryImageFileMegatile> m_retainedMegatiles;
+	std::vector<uint8_t> m_retainedPayload;
+	GeometryImageFileMegatile const* m_sourceMegatiles;
+	uint8_t const* m_sourcePayload;
+	std::vector<uint32_t> m_sourceEntries; // per megatile, its entry in m_sourceMegatiles
+
+	StagingRing m_streamingRing;
+	std::vector<uint32_t> m_requestFrames; // per frame execution context, the frame whose requests it holds (0: none)
+	std::vector<MegatileResidency::Load> m_loads;
+
 	VkImage m_positionTexture;	VmaAllocation m_positionTextureAllocation;
 	VkImage m_albedoTexture;	VmaAllocation m_albedoTextureAllocation;
 	VkImage m_normalTexture;	VmaAllocation m_normalTextureAllocation;
 
 	VkImageView m_imageViews[3];
 
+	VkBuffer m_megatileBuffer;	VmaAllocation m_megatileBufferAllocation;
+	VkBuffer m_taskGroupBuffer;	VmaAllocation m_taskGroupBufferAllocation;
+	VkBuffer m_pageTableBuffer;	VmaAllocation m_pageTableBufferAllocation;
+	VkBuffer m_requestBuffer;	VmaAllocation m_requestBufferAllocation;
+	VkBuffer m_borderBuffer;	VmaAllocation m_borderBufferAllocation;
+	uint32_t const* m_requests; // persistently mapped, one frame stamp per megatile and per frame execution context
+
 	VkDescriptorSet m_meshResources;
 };
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "ReadbackRing.h"
+
+ReadbackRing::ReadbackRing()
+	: m_allocator(VK_NULL_HANDLE)
+	, m_buffer(VK_NULL_HANDLE)
+	, m_allocation(VK_NULL_HANDLE)
+	, m_mappedData(nullptr)
+	, m_extent{ 0, 0 }
+	, m_format(VK_FORMAT_UNDEFINED)
+	, m_slotSize(0)
+{
+}
+
+ReadbackRing::~ReadbackRing()
+{
+	Uninitialize();
+}
+
+auto ReadbackRing::Initialize(InstanceDeviceAndSwapchain const& device) -> bool
+{
+	VkResult result;
+
+	m_allocator = device.GetAllocator();
+	m_extent = device.GetSwapchainExtent();
+	m_format = device.GetSwapchainFormat();
+	m_slotSize = GetRowPitch() * m_extent.height;
+	m_slotFrameNumbers.assign(device.GetFrameExecutionContextCount(), 0);
+
+	{
+		VmaAllocationCreateInfo allocationCreateInfo;
+		allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+		allocationCreateInfo.requiredFlags = 0;
+		allocationCreateInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT; // read by the CPU only
+		allocationCreateInfo.memoryTypeBits = 0;
+		allocationCreateInfo.pool = VK_NULL_HANDLE;
+		allocationCreateInfo.pUserData = nullptr;
+
+		VkBufferCreateInfo bufferCreateInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+		bufferCreateInfo.flags = 0;
+		bufferCreateInfo.size = m_slotSize * m_slotFrameNumbers.size();
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+		VmaAllocationInfo allocationInfo;
+		result = vmaCreateBuffer(m_allocator, &bufferCreateInfo, &allocationCreateInfo, &m_buffer, &m_allocation, &allocationInfo);
+		CHECK_ERROR_AND_RETURN("could not create readback ring buffer");
+
+		m_mappedData = (uint8_t*)allocationInfo.pMappedData;
+	}
+
+	return true;
+}
+
+auto ReadbackRing::Uninitialize() -> void
+{
+	if (m_buffer == VK_NULL_HANDLE)
+		return;
+
+	vmaDestroyBuffer(m_allocator, m_buffer, m_allocation);
+
+	m_buffer = VK_NULL_HANDLE;
+	m_allocation = VK_NULL_HANDLE;
+	m_mappedData = nullptr;
+	m_slotFrameNumbers.clear();
+}
+
+auto ReadbackRing::CopyAcquiredImage(InstanceDeviceAndSwapchain const& device) -> void
+{
+	VkCommandBuffer commandBuffer = device.GetCommandBuffer();
+	uint32_t slot = device.GetFrameExecutionContextIndex();
+
+	VkBufferImageCopy region;
+	region.bufferOffset = slot * m_slotSize;
+	region.bufferRowLength = 0; // tightly packed
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { m_extent.width, m_extent.height, 1 };
+	vkCmdCopyImageToBuffer(commandBuffer, device.GetAcquiredImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_buffer, 1, &region);
+
+	// make the copy visible to the host once the fence of the frame execution context has signaled
+	VkBufferMemoryBarrier bufferMemoryBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, nullptr };
+	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.buffer = m_buffer;
+	bufferMemoryBarrier.offset = region.bufferOffset;
+	bufferMemoryBarrier.size = m_slotSize;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+	m_slotFrameNumbers[slot] = device.GetFrameNumber();
+}
+
+auto ReadbackRing::GetCompletedImage(uint32_t frameExecutionContext, uint32_t& frameNumber) -> uint8_t const*
+{
+	frameNumber = m_slotFrameNumbers[frameExecutionContext];
+	if (frameNumber == 0)
+		return nullptr;
+
+	m_slotFrameNumbers[frameExecutionContext] = 0;
+	vmaInvalidateAllocation(m_allocator, m_allocation, frameExecutionContext * m_slotSize, m_slotSize);
+	return m_mappedData + frameExecutionContext * m_slotSize;
+}
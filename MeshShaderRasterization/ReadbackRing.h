@@ -0,0 +1,40 @@
+#pragma once
+
+#include "InstanceDeviceAndSwapchain.h"
+
+// persistently mapped host memory the frames are copied to, for headless rendering
+// the ring has one slot of the image size per frame execution context: a frame copies the acquired image to the slot of its context,
+// and the copy is complete once the context comes back (its fence waited for by BeginFrame), so reading it back never stalls the GPU
+class ReadbackRing
+{
+public:
+	ReadbackRing();
+	~ReadbackRing();
+
+	// slots of the extent and format of the acquired images
+	auto Initialize(InstanceDeviceAndSwapchain const& device) -> bool;
+	auto Uninitialize() -> void;
+
+	// records the copy of the acquired image, in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, to the slot of the current frame execution context
+	auto CopyAcquiredImage(InstanceDeviceAndSwapchain const& device) -> void;
+
+	// the image the last frame of a frame execution context copied (frameNumber is that frame), nullptr if there is none or it was returned already
+	// only once the GPU is done with the context: after BeginFrame for the current one, after WaitIdle for all
+	// rows are GetRowPitch() bytes apart, the memory stays valid until the next copy to the slot
+	auto GetCompletedImage(uint32_t frameExecutionContext, uint32_t& frameNumber) -> uint8_t const*;
+
+	auto GetExtent() const -> VkExtent2D const& { return m_extent; }
+	auto GetFormat() const -> VkFormat { return m_format; }
+	auto GetRowPitch() const -> VkDeviceSize { return VkDeviceSize(m_extent.width) * 4; }
+
+private:
+	VmaAllocator m_allocator;
+
+	VkBuffer m_buffer; VmaAllocation m_allocation;
+	uint8_t* m_mappedData;
+
+	VkExtent2D m_extent;
+	VkFormat m_format;
+	VkDeviceSize m_slotSize;
+	std::vector<uint32_t> m_slotFrameNumbers; // of the copy in each slot, 0 when there is none to return
+};
@@ -1,6 +1,8 @@
 #include "ShaderModule.h"
 
 #include "shaderc/shaderc.h"
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <fstream>
 
@@ -16,6 +18,7 @@ auto ShaderModule::Initialize(VkDevice device, std::string const& filepath, VkSh
 	shaderc_shader_kind kind;
 	switch (stage)
 	{
+	case VK_SHADER_STAGE_VERTEX_BIT: kind = shaderc_vertex_shader;  break;
 	case VK_SHADER_STAGE_FRAGMENT_BIT: kind = shaderc_fragment_shader;  break;
 	case VK_SHADER_STAGE_COMPUTE_BIT: kind = shaderc_compute_shader;  break;
 	case VK_SHADER_STAGE_TASK_BIT_NV: kind = shaderc_task_shader;  break;
@@ -0,0 +1,110 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : require
+#extension GL_ARB_compute_shader : require
+#if defined(VISIBILITY_BUFFER)
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_image_int64 : require
+#endif
+
+// one level of the depth pyramid: each texel keeps the farthest depth of the 2x2 texels below it, so a box nearer than a texel
+// covering it is in front of everything drawn there (farthest is the largest depth, the smallest with REVERSED_Z)
+// a level is ceil(source / 2) texels: the last row and column of an odd source are read twice
+// FIRST_LEVEL reads the depth pass (hardware and software rasterized depth, the nearest of both), other levels the previous level
+// with VISIBILITY_BUFFER as well, the first level reads the depth of the visibility buffer, which already holds the nearest of both
+
+#ifndef TILED_DEPTH
+#define TILED_DEPTH 0
+#endif
+// REVERSED_Z 1: the farthest depth is the smallest
+#ifndef REVERSED_Z
+#define REVERSED_Z 0
+#endif
+
+#if defined(FIRST_LEVEL) && defined(VISIBILITY_BUFFER)
+layout(set=0, binding=3, r64ui) uniform readonly u64image2D visibilityBuffer;
+#elif defined(FIRST_LEVEL) && TILED_DEPTH
+layout(set=0, binding=0) uniform sampler2D framebufferDepthTexture;
+
+// as in test_ms.glsl, the tile flags are not read here
+const uint tiledDepthBlocksPerRow = TILED_DEPTH_BLOCKS_PER_ROW;
+const uint tiledDepthTileCount = TILED_DEPTH_TILE_COUNT;
+
+layout(set=0, binding=4, std430) readonly buffer tiledDepthBuffer
+{
+    uint tiledDepthTilesWritten[tiledDepthTileCount];
+    uint tiledDepth[];
+};
+
+uint tiledDepthAddress(ivec2 pixel)
+{
+    uvec2 block = uvec2(pixel) >> 6;
+    uvec2 morton = uvec2(pixel) & 63;
+    morton = (morton | (morton << 4)) & 0x0f0f;
+    morton = (morton | (morton << 2)) & 0x3333;
+    morton = (morton | (morton << 1)) & 0x5555;
+    return (block.y * tiledDepthBlocksPerRow + block.x) * 4096 + (morton.x | (morton.y << 1));
+}
+#elif defined(FIRST_LEVEL)
+layout(set=0, binding=0) uniform sampler2D framebufferDepthTexture;
+layout(set=0, binding=1) uniform usampler2D meshShaderDepthTexture;
+#else
+layout(set=0, binding=0) uniform sampler2D sourceLevel;
+#endif
+layout(set=0, binding=2, r32f) uniform writeonly image2D destinationLevel;
+
+layout(push_constant) uniform levelConstants
+{
+    ivec2 sourceSize;
+    ivec2 destinationSize;
+    uint depthEpoch;
+};
+
+#if REVERSED_Z
+#define nearestOf max
+#define farthestOf min
+#else
+#define nearestOf min
+#define farthestOf max
+#endif
+
+// encodeDepth in test_ms.glsl: the pixels of earlier epochs are at the far plane
+float decodeDepth(uint bits)
+{
+#if REVERSED_Z
+    return (bits >> 24) == depthEpoch ? uintBitsToFloat((bits & 0xffffff) << 6) : 0;
+#else
+    return uintBitsToFloat(bits);
+#endif
+}
+
+float sourceDepth(ivec2 texel)
+{
+    texel = min(texel, sourceSize - 1);
+#if defined(FIRST_LEVEL) && defined(VISIBILITY_BUFFER)
+    return uintBitsToFloat(uint(imageLoad(visibilityBuffer, texel).x >> 32));
+#elif defined(FIRST_LEVEL)
+    float framebufferDepth = texelFetch(framebufferDepthTexture, texel, 0).x;
+#if TILED_DEPTH
+    float meshShaderDepth = decodeDepth(tiledDepth[tiledDepthAddress(texel)]);
+#else
+    float meshShaderDepth = decodeDepth(texelFetch(meshShaderDepthTexture, texel, 0).x);
+#endif
+    return nearestOf(framebufferDepth, meshShaderDepth);
+#else
+    return texelFetch(sourceLevel, texel, 0).x;
+#endif
+}
+
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+
+    if (all(lessThan(texel, destinationSize)))
+    {
+        ivec2 source = texel * 2;
+        float depth = farthestOf(farthestOf(sourceDepth(source), sourceDepth(source + ivec2(1, 0))),
+                                 farthestOf(sourceDepth(source + ivec2(0, 1)), sourceDepth(source + ivec2(1, 1))));
+        imageStore(destinationLevel, texel, vec4(depth));
+    }
+}
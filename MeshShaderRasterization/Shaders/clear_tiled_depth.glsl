@@ -0,0 +1,42 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : require
+#extension GL_ARB_compute_shader : require
+
+// clears the software rasterized depth of the tiled layout (MeshShadingRenderLoop::SetTiledDepth) to the farthest depth
+// a workgroup per 8x8 tile, dispatched as 64 x blocks: only the tiles flagged since the last clear are written, the others cost a
+// read of their flag
+
+// as in test_ms.glsl
+const uint tiledDepthBlocksPerRow = TILED_DEPTH_BLOCKS_PER_ROW;
+const uint tiledDepthTileCount = TILED_DEPTH_TILE_COUNT;
+
+layout(set=0, binding=14, std430) buffer tiledDepthBuffer
+{
+    uint tiledDepthTilesWritten[tiledDepthTileCount];
+    uint tiledDepth[];
+};
+
+shared bool s_written;
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+void main()
+{
+    uint tile = gl_WorkGroupID.y * 64 + gl_WorkGroupID.x;
+
+    if (gl_LocalInvocationID.x == 0)
+    {
+        s_written = tiledDepthTilesWritten[tile] != 0;
+        if (s_written)
+        {
+            tiledDepthTilesWritten[tile] = 0;
+        }
+    }
+
+    memoryBarrierShared();
+    barrier();
+
+    if (s_written)
+    {
+        tiledDepth[tile * 64 + gl_LocalInvocationID.x] = floatBitsToUint(1.0);
+    }
+}
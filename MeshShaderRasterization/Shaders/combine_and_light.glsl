@@ -2,14 +2,59 @@
 #extension GL_ARB_separate_shader_objects : require
 #extension GL_ARB_compute_shader : require
 
+// TILED_DEPTH 1 reads the software rasterized depth from the tiled buffer (MeshShadingRenderLoop::SetTiledDepth)
+#ifndef TILED_DEPTH
+#define TILED_DEPTH 0
+#endif
+// REVERSED_Z 1: the nearest depth is the largest, and the software rasterized one carries the epoch of the frame (test_ms.glsl)
+#ifndef REVERSED_Z
+#define REVERSED_Z 0
+#endif
 
 layout(set=0, binding=0) uniform sampler2D framebufferDepthTexture;
+#if TILED_DEPTH
+// as in test_ms.glsl
+const uint tiledDepthBlocksPerRow = TILED_DEPTH_BLOCKS_PER_ROW;
+const uint tiledDepthTileCount = TILED_DEPTH_TILE_COUNT;
+
+layout(set=0, binding=4, std430) readonly buffer tiledDepthBuffer
+{
+    uint tiledDepthTilesWritten[tiledDepthTileCount];
+    uint tiledDepth[];
+};
+
+uint tiledDepthAddress(ivec2 pixel)
+{
+    uvec2 block = uvec2(pixel) >> 6;
+    uvec2 morton = uvec2(pixel) & 63;
+    morton = (morton | (morton << 4)) & 0x0f0f;
+    morton = (morton | (morton << 2)) & 0x3333;
+    morton = (morton | (morton << 1)) & 0x5555;
+    return (block.y * tiledDepthBlocksPerRow + block.x) * 4096 + (morton.x | (morton.y << 1));
+}
+#else
 layout(set=0, binding=1) uniform usampler2D meshShaderDepthTexture;
+#endif
 layout(set=0, binding=2) uniform sampler2DArray albedoTextureArray;
 layout(set=0, binding=3) uniform sampler2DArray normalTextureArray;
 
 layout(set=1, binding=0, rgba8) uniform writeonly image2D swapchainImage;
 
+layout(push_constant) uniform combineConstants
+{
+    uint depthEpoch;
+};
+
+// encodeDepth in test_ms.glsl: the pixels of earlier epochs are at the far plane
+float decodeDepth(uint bits)
+{
+#if REVERSED_Z
+    return (bits >> 24) == depthEpoch ? uintBitsToFloat((bits & 0xffffff) << 6) : 0;
+#else
+    return uintBitsToFloat(bits);
+#endif
+}
+
 layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
 void main()
 {
@@ -22,9 +67,18 @@ void main()
         vec3 pos = vec3((vec2(gl_GlobalInvocationID.xy)+0.5)/vec2(buffersSize), 0);
 
         float framebufferDepth = textureLod(framebufferDepthTexture, pos.xy, 0).x;
-        float meshShaderDepth = uintBitsToFloat(textureLod(meshShaderDepthTexture, pos.xy, 0).x);
+#if TILED_DEPTH
+        float meshShaderDepth = decodeDepth(tiledDepth[tiledDepthAddress(vpos)]);
+#else
+        float meshShaderDepth = decodeDepth(textureLod(meshShaderDepthTexture, pos.xy, 0).x);
+#endif
 
+        // the layer of the nearest depth, the mesh shader one on ties
+#if REVERSED_Z
+        pos.z = step(framebufferDepth, meshShaderDepth);
+#else
         pos.z = step(meshShaderDepth, framebufferDepth);
+#endif
 
         vec3 albedo = textureLod(albedoTextureArray, pos, 0).xyz;
         vec3 normal = textureLod(normalTextureArray, pos, 0).xyz * 2 - 1;
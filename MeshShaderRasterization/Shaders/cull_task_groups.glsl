@@ -0,0 +1,193 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+
+// builds the task groups the passes draw, before the early depth pass: one invocation per task group of each instance of a mesh,
+// task groups whose bounds are out of the frustum are dropped and the others appended to the visible task groups of the mesh
+// WRITE_DRAWS then turns the count of a mesh into the indirect draws of the passes, at most 0xffff task groups each, and into the
+// dispatch of the compute rasterizer's task shader (test_ts.glsl), in rows of 0xffff task groups
+
+layout(push_constant) uniform taskGroupCullingConstants
+{
+    uint meshId;
+    uint firstInstance;          // instances of the mesh are consecutive in the instance buffer
+    uint instanceCount;
+    uint taskGroupsPerRow;
+    uint firstVisibleTaskGroup;  // where the visible task groups of the mesh start
+    uint firstDraw;              // where the indirect draws of the mesh start
+    uint maxDrawCount;
+    uint reserved;
+};
+
+layout(set=0, binding=0, std140) uniform sceneBuffer
+{
+    mat4 projectionMatrix;
+    vec4 viewportSize;
+    uint statisticsSlot;
+};
+
+struct MeshInstance
+{
+    mat3x4 modelToWorldMatrix;
+    uint   meshId;
+    uint   reserved0;
+    uint   reserved1;
+    uint   reserved2;
+};
+
+layout(set=0, binding=1, std430) readonly buffer instanceBuffer
+{
+    MeshInstance instances[];
+};
+
+// TaskGroupBounds in ParameterizedMesh.h
+struct TaskGroupBounds
+{
+    vec4 boundsMin;
+    vec4 boundsMax;
+};
+
+layout(set=0, binding=2, std430) readonly buffer taskGroupBuffer
+{
+    TaskGroupBounds taskGroupBounds[];
+};
+
+// VkDrawMeshTasksIndirectCommandNV
+struct DrawMeshTasksIndirectCommand
+{
+    uint taskCount;
+    uint firstTask;
+};
+
+// VkDispatchIndirectCommand
+struct DispatchIndirectCommand
+{
+    uint x;
+    uint y;
+    uint z;
+};
+
+const uint maxMeshCount = 256; // MeshShadingRenderLoop.h
+
+layout(set=0, binding=3, std430) buffer drawBuffer
+{
+    uint                         visibleTaskGroupCounts[maxMeshCount];
+    uint                         drawCounts[maxMeshCount];
+    DispatchIndirectCommand      taskDispatches[maxMeshCount];
+    DrawMeshTasksIndirectCommand draws[];
+};
+
+// instance << 16 | task group
+layout(set=0, binding=4, std430) writeonly buffer visibleTaskGroupBuffer
+{
+    uint visibleTaskGroups[];
+};
+
+// CullingStatistics in MeshShadingRenderLoop.h, the task groups are counted with the early depth pass
+struct CullingStatistics
+{
+    uint megatilesTested;
+    uint megatilesFrustumCulled;
+    uint megatilesBackfaceCulled;
+    uint megatilesOcclusionCulled;
+    uint tilesLaunched;
+    uint tilesCulled;
+    uint taskGroupsCulled;
+    uint pixelsRasterized;
+    uint depthAtomics;
+    uint reserved0;
+    uint reserved1;
+    uint reserved2;
+};
+
+layout(set=0, binding=5, std430) buffer statisticsBuffer
+{
+    CullingStatistics statistics[];
+};
+
+const uint maxTaskGroupsPerDraw = 0xffff;
+const uint CullingPass_Count = 3;
+
+// true when the box is entirely out of one of the clip planes (as the task shader tests megatiles)
+bool isOutsideFrustum(TaskGroupBounds bounds, mat4 objectToClip)
+{
+    uint outsidePlanes = 0x3f;
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        vec3 objectPosition = mix(bounds.boundsMin.xyz, bounds.boundsMax.xyz, vec3(corner & 1, (corner >> 1) & 1, corner >> 2));
+        vec4 clipPosition = vec4(objectPosition, 1) * objectToClip;
+        outsidePlanes &= (clipPosition.x < -clipPosition.w ? 0x01 : 0) | (clipPosition.x > clipPosition.w ? 0x02 : 0)
+                       | (clipPosition.y < -clipPosition.w ? 0x04 : 0) | (clipPosition.y > clipPosition.w ? 0x08 : 0)
+                       | (clipPosition.z < 0 ? 0x10 : 0) | (clipPosition.z > clipPosition.w ? 0x20 : 0);
+    }
+    return outsidePlanes != 0;
+}
+
+#if defined(WRITE_DRAWS)
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+void main()
+{
+    uint draw = gl_GlobalInvocationID.x;
+    uint count = visibleTaskGroupCounts[meshId];
+
+    if (draw < maxDrawCount)
+    {
+        // the task shader finds its entry from its workgroup index, which firstTask offsets
+        uint firstTask = draw * maxTaskGroupsPerDraw;
+        draws[firstDraw + draw].taskCount = firstTask < count ? min(count - firstTask, maxTaskGroupsPerDraw) : 0;
+        draws[firstDraw + draw].firstTask = firstTask;
+    }
+    if (draw == 0)
+    {
+        drawCounts[meshId] = (count + maxTaskGroupsPerDraw - 1) / maxTaskGroupsPerDraw;
+        taskDispatches[meshId].x = min(count, maxTaskGroupsPerDraw);
+        taskDispatches[meshId].y = (count + maxTaskGroupsPerDraw - 1) / maxTaskGroupsPerDraw;
+        taskDispatches[meshId].z = 1;
+    }
+}
+#else
+layout(local_size_x=256, local_size_y=1, local_size_z=1) in;
+void main()
+{
+    uint taskGroupsPerInstance = taskGroupsPerRow * taskGroupsPerRow;
+    uint index = gl_GlobalInvocationID.x;
+    bool valid = index < instanceCount * taskGroupsPerInstance;
+
+    uint instance = firstInstance + index / taskGroupsPerInstance;
+    uint group = index % taskGroupsPerInstance;
+
+    bool visible = false;
+    if (valid)
+    {
+        mat3x4 modelToWorldMatrix = instances[instance].modelToWorldMatrix;
+        mat4 objectToClip;
+        for (uint row = 0; row < 4; ++row)
+        {
+            objectToClip[row] = projectionMatrix[row].x * modelToWorldMatrix[0] + projectionMatrix[row].y * modelToWorldMatrix[1]
+                              + projectionMatrix[row].z * modelToWorldMatrix[2] + vec4(0, 0, 0, projectionMatrix[row].w);
+        }
+        visible = !isOutsideFrustum(taskGroupBounds[group], objectToClip);
+    }
+
+    // one atomic per subgroup
+    uvec4 vote = subgroupBallot(visible);
+    uint  visibleCount = subgroupBallotBitCount(vote);
+    uint  first = 0;
+    if (subgroupElect() && visibleCount > 0)
+    {
+        first = atomicAdd(visibleTaskGroupCounts[meshId], visibleCount);
+    }
+    first = subgroupBroadcastFirst(first);
+    if (visible)
+    {
+        visibleTaskGroups[firstVisibleTaskGroup + first + subgroupBallotExclusiveBitCount(vote)] = (instance << 16) | group;
+    }
+
+    uint culledCount = subgroupAdd(valid && !visible ? 1 : 0);
+    if (subgroupElect() && culledCount > 0)
+    {
+        atomicAdd(statistics[statisticsSlot * CullingPass_Count].taskGroupsCulled, culledCount);
+    }
+}
+#endif
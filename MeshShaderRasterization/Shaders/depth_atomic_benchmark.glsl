@@ -0,0 +1,77 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : require
+#extension GL_ARB_compute_shader : require
+
+// DepthAtomicBenchmark: each workgroup does atomicsPerInvocation depth atomics per invocation at random pixels of a footprint of
+// footprintSize pixels across, placed at random on the screen
+// TILED_DEPTH 1 to the tiled buffer (with its tile flags, as test_ms.glsl does), 0 to the image
+
+#ifndef TILED_DEPTH
+#define TILED_DEPTH 0
+#endif
+
+const uint atomicsPerInvocation = 16; // DepthAtomicBenchmark.cpp
+const ivec2 screenSize = ivec2(SCREEN_WIDTH, SCREEN_HEIGHT); // DepthAtomicBenchmark::width and height
+
+#if TILED_DEPTH
+// as in test_ms.glsl
+const uint tiledDepthBlocksPerRow = TILED_DEPTH_BLOCKS_PER_ROW;
+const uint tiledDepthTileCount = TILED_DEPTH_TILE_COUNT;
+
+layout(set=0, binding=1, std430) buffer tiledDepthBuffer
+{
+    uint tiledDepthTilesWritten[tiledDepthTileCount];
+    uint tiledDepth[];
+};
+
+uint tiledDepthAddress(ivec2 pixel)
+{
+    uvec2 block = uvec2(pixel) >> 6;
+    uvec2 morton = uvec2(pixel) & 63;
+    morton = (morton | (morton << 4)) & 0x0f0f;
+    morton = (morton | (morton << 2)) & 0x3333;
+    morton = (morton | (morton << 1)) & 0x5555;
+    return (block.y * tiledDepthBlocksPerRow + block.x) * 4096 + (morton.x | (morton.y << 1));
+}
+#else
+layout(set=0, binding=0, r32ui) uniform coherent uimage2D depthBuffer;
+#endif
+
+layout(push_constant) uniform benchmarkConstants
+{
+    uint footprintSize;
+    uint seed;
+};
+
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+void main()
+{
+    uint workgroup = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint origin = hash(workgroup ^ seed);
+    ivec2 footprintPos = ivec2(origin & 0xffff, origin >> 16) % (screenSize - int(footprintSize));
+
+    uint random = hash(workgroup * 64 + gl_LocalInvocationID.x + seed);
+    for (uint i = 0; i < atomicsPerInvocation; ++i)
+    {
+        random = hash(random);
+        ivec2 pixelpos = footprintPos + ivec2(random & 0xff, (random >> 8) & 0xff) % int(footprintSize);
+        uint depth = floatBitsToUint(float(random >> 16) / 65536.0);
+#if TILED_DEPTH
+        uint address = tiledDepthAddress(pixelpos);
+        atomicMin(tiledDepth[address], depth);
+        tiledDepthTilesWritten[address >> 6] = 1;
+#else
+        imageAtomicMin(depthBuffer, pixelpos, depth);
+#endif
+    }
+}
@@ -0,0 +1,400 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : require
+#extension GL_ARB_compute_shader : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_image_int64 : require
+
+// material pass of the visibility buffer: each pixel rebuilds the triangle the visibility pass kept there from its cluster (the tile
+// of a mesh shader workgroup) and writes the depth, albedo and normal the G-buffer pass would have
+// dispatched once per mesh with its geometry image bound, pixels of the other meshes are skipped
+// the vertices are found as in test_ms.glsl (processVertex and stitchedPosition), which must stay in sync and be compiled with the
+// same TILE_SIZE
+
+#ifndef TILE_SIZE
+#define TILE_SIZE 8
+#endif
+#ifndef TILED_DEPTH
+#define TILED_DEPTH 0
+#endif
+#ifndef REVERSED_Z
+#define REVERSED_Z 0
+#endif
+
+layout(set=0, binding=0, std140) uniform sceneBuffer
+{
+    mat4 projectionMatrix;
+    vec4 viewportSize;
+    uint statisticsSlot;
+    uint occlusionCulling;
+    float lodPixelError;
+    uint depthEpoch;
+};
+
+// as in test_ms.glsl
+#if REVERSED_Z
+uint encodeDepth(float depth)
+{
+    return (depthEpoch << 24) | (floatBitsToUint(depth) >> 6);
+}
+#else
+uint encodeDepth(float depth)
+{
+    return floatBitsToUint(depth);
+}
+#endif
+
+// read by combine_and_light.glsl as the mesh shader buffers
+#if TILED_DEPTH
+// as in test_ms.glsl
+const uint tiledDepthBlocksPerRow = TILED_DEPTH_BLOCKS_PER_ROW;
+const uint tiledDepthTileCount = TILED_DEPTH_TILE_COUNT;
+
+layout(set=0, binding=14, std430) writeonly buffer tiledDepthBuffer
+{
+    uint tiledDepthTilesWritten[tiledDepthTileCount];
+    uint tiledDepth[];
+};
+
+uint tiledDepthAddress(ivec2 pixel)
+{
+    uvec2 block = uvec2(pixel) >> 6;
+    uvec2 morton = uvec2(pixel) & 63;
+    morton = (morton | (morton << 4)) & 0x0f0f;
+    morton = (morton | (morton << 2)) & 0x3333;
+    morton = (morton | (morton << 1)) & 0x5555;
+    return (block.y * tiledDepthBlocksPerRow + block.x) * 4096 + (morton.x | (morton.y << 1));
+}
+#else
+layout(set=0, binding=1, r32ui) uniform writeonly uimage2D depthBuffer;
+#endif
+layout(set=0, binding=2, rgba8) uniform writeonly image2D albedoBuffer;
+layout(set=0, binding=3, rgba8) uniform writeonly image2D normalBuffer;
+
+struct MeshInstance
+{
+    mat3x4 modelToWorldMatrix;
+    uint   meshId;
+    uint   reserved0;
+    uint   reserved1;
+    uint   reserved2;
+};
+
+layout(set=0, binding=4, std430) readonly buffer instanceBuffer
+{
+    MeshInstance instances[];
+};
+
+// depth in the high 32 bits, cluster << 7 | triangle in the low ones
+layout(set=0, binding=9, r64ui) uniform readonly u64image2D visibilityBuffer;
+
+// VisibilityCluster in MeshShadingRenderLoop.h
+struct VisibilityCluster
+{
+    uint instance;
+    uint megatile;
+    uint tile;
+    uint aroundMips[13];
+};
+
+layout(set=0, binding=10, std430) readonly buffer visibilityClusterBuffer
+{
+    uint              clusterCount;
+    uint              reserved[3];
+    VisibilityCluster clusters[];
+};
+
+// MeshConstants in MeshShadingRenderLoop.cpp
+layout(push_constant) uniform meshConstants
+{
+    vec4 positionScale;
+    vec4 positionBias;
+    uint taskGroupsPerRow;
+    uint mipCount;
+    uint requestOffset;
+    uint requestFrame;
+    uint firstVisibleTaskGroup;
+    uint cullingPass;
+    uint meshId;
+};
+
+layout(set=1, binding=0) uniform sampler2D positionTexture;
+layout(set=1, binding=1) uniform sampler2D albedoTexture;
+layout(set=1, binding=2) uniform sampler2D normalTexture;
+
+#ifndef POSITION_ENCODING
+#define POSITION_ENCODING 0
+#endif
+#ifndef NORMAL_ENCODING
+#define NORMAL_ENCODING 0
+#endif
+
+struct MegatileInfo
+{
+    vec4 positionBoundsMin;
+    vec4 positionBoundsExtent;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    vec4 boundingSphere;
+    vec4 normalCone;
+};
+
+layout(set=1, binding=3, std430) readonly buffer megatileBuffer
+{
+    uint         megatileMipOffsets[16];
+    MegatileInfo megatileInfos[];
+};
+
+layout(set=1, binding=4, std430) readonly buffer pageTableBuffer
+{
+    uint pageTable[];
+};
+
+// the vertices on the border of each mip, at full precision (GeometryImageBorderVertex in GeometryImageFile.h): the last row and
+// column of a mip are not in its megatiles, and the vertices the parameterization maps to the same point must match bit for bit
+struct BorderVertex
+{
+    vec3  position;
+    uint  albedo;
+    vec3  normal;
+    float reserved;
+};
+
+layout(set=1, binding=6, std430) readonly buffer borderBuffer
+{
+    uint         borderMipOffsets[16];
+    BorderVertex borderVertices[];
+};
+
+const uint poolPagesPerRow = 128; // geometryImagePoolPagesPerRow
+const uint noVisibility = 0xffffffff;
+
+ivec4 unpackMegatile(uint megatile)
+{
+    return ivec4(megatile >> 20, (megatile >> 8) & 0xfff, megatile & 0xf, (megatile >> 4) & 0xf);
+}
+
+uint ownerMegatileIndex(ivec2 texel, int mipLevel, int mipSize)
+{
+    ivec2 owner = texel >> 6;
+    return megatileMipOffsets[mipLevel] + owner.y * ((mipSize + 63) >> 6) + owner.x;
+}
+
+ivec2 poolTexel(ivec2 texel, int mipLevel, int mipSize)
+{
+    uint page = pageTable[ownerMegatileIndex(texel, mipLevel, mipSize)];
+    return ivec2(page % poolPagesPerRow, page / poolPagesPerRow) * 64 + (texel & 63);
+}
+
+vec3 decodePosition(vec4 encoded, ivec2 texel, int mipLevel, int mipSize)
+{
+#if POSITION_ENCODING == 0
+    return encoded.xyz * positionScale.xyz + positionBias.xyz;
+#else
+    uint index = ownerMegatileIndex(texel, mipLevel, mipSize);
+    return encoded.xyz * megatileInfos[index].positionBoundsExtent.xyz + megatileInfos[index].positionBoundsMin.xyz;
+#endif
+}
+
+vec3 decodeNormal(vec4 encoded)
+{
+#if NORMAL_ENCODING == 0
+    return encoded.xyz * 2 - 1;
+#else
+    vec3 n = vec3(encoded.xy, 1 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0)));
+    return n;
+#endif
+}
+
+bool isBorderVertex(ivec2 texel, int mipSize)
+{
+    return any(equal(texel, ivec2(0))) || any(equal(texel, ivec2(mipSize)));
+}
+
+// GetGeometryImageBorderVertexIndex in GeometryImageFile.h
+uint borderVertexIndex(ivec2 texel, int mipLevel, int mipSize)
+{
+    uint index = texel.y == 0 || texel.y == mipSize ? uint(texel.y == 0 ? 0 : mipSize + 1) + uint(texel.x)
+                                                     : uint(2 * (mipSize + 1) + 2 * (texel.y - 1)) + uint(texel.x == 0 ? 0 : 1);
+    return borderMipOffsets[mipLevel] + index;
+}
+
+// vertex (x, y) of a mip of size s, 0 <= x, y <= s
+vec3 fetchPosition(ivec2 texel, int mipLevel, int mipSize)
+{
+    if (isBorderVertex(texel, mipSize))
+    {
+        return borderVertices[borderVertexIndex(texel, mipLevel, mipSize)].position;
+    }
+    return decodePosition(texelFetch(positionTexture, poolTexel(texel, mipLevel, mipSize), 0), texel, mipLevel, mipSize);
+}
+
+void fetchAttributes(ivec2 texel, int mipLevel, int mipSize, out vec3 albedo, out vec3 normal)
+{
+    if (isBorderVertex(texel, mipSize))
+    {
+        BorderVertex vertex = borderVertices[borderVertexIndex(texel, mipLevel, mipSize)];
+        albedo = unpackUnorm4x8(vertex.albedo).xyz;
+        normal = vertex.normal;
+        return;
+    }
+    ivec2 pool = poolTexel(texel, mipLevel, mipSize);
+    albedo = texelFetch(albedoTexture, pool, 0).xyz;
+    normal = decodeNormal(texelFetch(normalTexture, pool, 0));
+}
+
+// the task payload mips the cluster kept
+int aroundMip(uint cluster, ivec2 megatile, ivec2 taskGroupBase)
+{
+    ivec2 around = megatile - taskGroupBase;
+    if (any(lessThan(around, ivec2(-1))) || any(greaterThan(around, ivec2(8))))
+    {
+        return 0;
+    }
+    uint index = (around.y + 1) * 10 + around.x + 1;
+    return int((clusters[cluster].aroundMips[index >> 3] >> ((index & 7) * 4)) & 0xf);
+}
+
+int touchingMip(uint cluster, ivec2 mip0Texel, int mipLevel, ivec2 taskGroupBase)
+{
+    ivec2 first = (mip0Texel - 1) >> 6;
+    ivec2 last = mip0Texel >> 6;
+
+    int coarseMip = mipLevel;
+    for (int y = first.y; y <= last.y; ++y)
+    {
+        for (int x = first.x; x <= last.x; ++x)
+        {
+            coarseMip = max(coarseMip, aroundMip(cluster, ivec2(x, y), taskGroupBase));
+        }
+    }
+    return coarseMip;
+}
+
+bool coarseEdge(ivec2 mip0Texel, int coarseMip, out ivec2 coarseTexel, out ivec2 nextTexel, out float weight)
+{
+    int   spacing = 1 << coarseMip;
+    ivec2 offset = mip0Texel & (spacing - 1);
+    coarseTexel = (mip0Texel - offset) >> coarseMip;
+    nextTexel = coarseTexel + (offset.x == 0 ? ivec2(0, 1) : ivec2(1, 0));
+    weight = float(offset.x + offset.y) / float(spacing);
+    return (offset.x == 0) != (offset.y == 0);
+}
+
+vec3 coarseEdgeEndPosition(uint cluster, ivec2 texel, int mipLevel, int mipSize, ivec2 taskGroupBase)
+{
+    ivec2 mip0Texel = texel << mipLevel;
+    int   coarseMip = touchingMip(cluster, mip0Texel, mipLevel, taskGroupBase);
+    if (coarseMip == mipLevel)
+    {
+        return fetchPosition(texel, mipLevel, mipSize);
+    }
+
+    int   coarseSize = max(int(taskGroupsPerRow * 512) >> coarseMip, 1);
+    ivec2 coarseTexel;
+    ivec2 nextTexel;
+    float weight;
+    if (!coarseEdge(mip0Texel, coarseMip, coarseTexel, nextTexel, weight))
+    {
+        return weight == 0 ? fetchPosition(coarseTexel, coarseMip, coarseSize) : fetchPosition(texel, mipLevel, mipSize);
+    }
+    return mix(fetchPosition(coarseTexel, coarseMip, coarseSize), fetchPosition(nextTexel, coarseMip, coarseSize), weight);
+}
+
+vec3 stitchedPosition(uint cluster, vec3 objectPosition, ivec2 texel, int mipLevel, ivec2 taskGroupBase)
+{
+    ivec2 mip0Texel = texel << mipLevel;
+    int   coarseMip = touchingMip(cluster, mip0Texel, mipLevel, taskGroupBase);
+    if (coarseMip == mipLevel)
+    {
+        return objectPosition;
+    }
+
+    int   coarseSize = max(int(taskGroupsPerRow * 512) >> coarseMip, 1);
+    ivec2 coarseTexel;
+    ivec2 nextTexel;
+    float weight;
+    if (!coarseEdge(mip0Texel, coarseMip, coarseTexel, nextTexel, weight))
+    {
+        return weight == 0 ? fetchPosition(coarseTexel, coarseMip, coarseSize) : objectPosition;
+    }
+
+    vec3 coarsePosition = coarseEdgeEndPosition(cluster, coarseTexel, coarseMip, coarseSize, taskGroupBase);
+    vec3 nextPosition = coarseEdgeEndPosition(cluster, nextTexel, coarseMip, coarseSize, taskGroupBase);
+    return mix(coarsePosition, nextPosition, weight);
+}
+
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, ivec2(viewportSize.xy))))
+    {
+        return;
+    }
+
+    uint64_t visibility = imageLoad(visibilityBuffer, pixel).x;
+    uint     visibilityId = uint(visibility);
+    if (visibilityId == noVisibility)
+    {
+        return;
+    }
+
+    uint   cluster = visibilityId >> 7;
+    uint   instance = clusters[cluster].instance;
+    if (instances[instance].meshId != meshId)
+    {
+        return;
+    }
+    mat3x4 modelToWorldMatrix = instances[instance].modelToWorldMatrix;
+
+    // the tile of the cluster, as the mesh shader workgroup found it
+    ivec4 megatile = unpackMegatile(clusters[cluster].megatile);
+    uint  tile = clusters[cluster].tile;
+    uint  regionSize = (64u << megatile.w) >> megatile.z;
+    uint  tilesPerRow = max(regionSize / TILE_SIZE, 1);
+    ivec2 tilePos = ((megatile.xy << 6) >> megatile.z) + ivec2(tile % tilesPerRow, tile / tilesPerRow) * TILE_SIZE;
+    int   mipSize = max(int(taskGroupsPerRow * 512) >> megatile.z, 1);
+
+    // the triangle: (pos, pos + 1, pos + 9) or (pos + 1, pos + 10, pos + 9) of its quad with 8x8 quad tiles
+    uint  triangle = visibilityId & 127;
+    ivec2 quad = ivec2((triangle >> 1) % TILE_SIZE, (triangle >> 1) / TILE_SIZE);
+    ivec2 corners[3] = (triangle & 1) == 0 ? ivec2[3](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1)) : ivec2[3](ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+    mat3 clipPositions; // xyw
+    vec3 albedos[3];
+    vec3 normals[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        ivec2 texel = min(tilePos + quad + corners[k], ivec2(mipSize));
+
+        vec3 objectPosition = fetchPosition(texel, megatile.z, mipSize);
+        objectPosition = stitchedPosition(cluster, objectPosition, texel, megatile.z, megatile.xy & ~7);
+        vec4 clipPosition = vec4(vec4(objectPosition, 1) * modelToWorldMatrix, 1) * projectionMatrix;
+
+        vec3 normal;
+        fetchAttributes(texel, megatile.z, mipSize, albedos[k], normal);
+        clipPositions[k] = clipPosition.xyw;
+        normals[k] = normalize(normal * mat3(modelToWorldMatrix));
+    }
+
+    // perspective-correct barycentrics straight from clip space (no divide by w, so triangles crossing the near plane work too)
+    vec2 p = (vec2(pixel) + 0.5) * viewportSize.zw * 2 - 1;
+    vec3 bary = inverse(clipPositions) * vec3(p, 1);
+    bary /= bary.x + bary.y + bary.z;
+
+    vec3 albedo = bary.x * albedos[0] + bary.y * albedos[1] + bary.z * albedos[2];
+    vec3 normal = bary.x * normals[0] + bary.y * normals[1] + bary.z * normals[2];
+
+    uint depth = encodeDepth(uintBitsToFloat(uint(visibility >> 32)));
+#if TILED_DEPTH
+    uint address = tiledDepthAddress(pixel);
+    tiledDepth[address] = depth;
+    tiledDepthTilesWritten[address >> 6] = 1;
+#else
+    imageStore(depthBuffer, pixel, uvec4(depth));
+#endif
+    imageStore(albedoBuffer, pixel, vec4(albedo, 0));
+    imageStore(normalBuffer, pixel, (vec4(normalize(normal), 0) + 1) / 2);
+}
@@ -1,6 +1,32 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : require
+#if defined(VISIBILITY_PASS)
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_image_int64 : require
+#extension GL_NV_mesh_shader : require
+#endif
 
+#if defined(VISIBILITY_PASS)
+// hardware rasterized pixels of the visibility pass, merged with the software rasterized ones by the same atomic (see test_ms.glsl)
+layout(early_fragment_tests) in;
+
+layout(location=0) perprimitiveNV flat in uint visibilityId;
+
+layout(set=0, binding=9, r64ui) uniform u64image2D visibilityBuffer;
+
+#ifndef REVERSED_Z
+#define REVERSED_Z 0
+#endif
+
+void main()
+{
+#if REVERSED_Z
+    imageAtomicMax(visibilityBuffer, ivec2(gl_FragCoord.xy), (uint64_t(floatBitsToUint(gl_FragCoord.z)) << 32) | visibilityId);
+#else
+    imageAtomicMin(visibilityBuffer, ivec2(gl_FragCoord.xy), (uint64_t(floatBitsToUint(gl_FragCoord.z)) << 32) | visibilityId);
+#endif
+}
+#else
 layout(location=0) in Interpolant
 {
     vec3 albedo;
@@ -15,3 +41,4 @@ void main()
     rt0 = vec4(IN.albedo, 0);
     rt1 = vec4(IN.normal, 1);
 }
+#endif
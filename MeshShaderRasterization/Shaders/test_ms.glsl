@@ -2,36 +2,105 @@
 #extension GL_ARB_separate_shader_objects : require
 #extension GL_EXT_shader_explicit_arithmetic_types_int8 : require
 #extension GL_EXT_shader_explicit_arithmetic_types_int16 : require
+#if !defined(COMPUTE_RASTERIZER)
+#extension GL_KHR_shader_subgroup_arithmetic : require
 #extension GL_KHR_shader_subgroup_ballot : require
 #extension GL_NV_mesh_shader : require
+#endif
+#if defined(VISIBILITY_PASS)
+#if defined(COMPUTE_RASTERIZER)
+#error the compute rasterizer has no visibility pass
+#endif
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_image_int64 : require
+#endif
 
-// we use a tile of 8x8 quads, hence 9x9=81 vertices and 8x8x2=128 triangles
-// we dispatch megatiles of 8x8 tiles (or 64x64 quads)
-// one task shader may dispatch 
+// we use a tile of TILE_SIZE x TILE_SIZE quads, 8x8 by default, hence 9x9=81 vertices and 8x8x2=128 triangles
+// we dispatch megatiles of 64x64 quads (8x8 tiles of 8x8 quads)
+// the task shader picks the mip of each mip 0 megatile: at mip m it is ((64>>m)/TILE_SIZE)^2 tiles, or a single tile of 64>>m quads
+// per side once fewer than TILE_SIZE
+// past mip 3, 2^u x 2^u megatiles at the same mip (u = min(m - 3, 3)) are drawn together as a unit of (64<<u)>>m quads per side
+// vertices on the border of a coarser megatile are moved onto its edges, the vertex and triangle counts stay the same
+// triangles whose pixel footprint is at most softwareRasterMaxSize pixels wide and high are rasterized here rather than exported:
+// their pixels are spread over the invocations, tested against the edge functions and written with the depth atomics
+// (DEPTH_PASS first merges them per pixel in shared memory, see s_depthCachePixels)
+// VISIBILITY_PASS replaces both the depth and G-buffer passes: the workgroup records its tile as a cluster, and hardware and software
+// rasterized pixels keep the nearest depth with the cluster and triangle in one 64-bit atomic (resolve_visibility.glsl shades them)
+// COMPUTE_RASTERIZER runs this as a compute shader over the tiles test_ts.glsl listed: the vertices stay in shared memory, and the
+// exported triangles are appended to the geometry buffer with the vertices of the tile, which test_vs.glsl then draws
+// TILE_SIZE and WORKGROUP_SIZE come from the MeshShaderPermutation (MeshShaderProfile.h) the render loop compiles this with
+
+#ifndef TILE_SIZE
+#define TILE_SIZE 8
+#endif
+#ifndef WORKGROUP_SIZE
+#define WORKGROUP_SIZE 32
+#endif
+#if !defined(COMPUTE_RASTERIZER) && WORKGROUP_SIZE != 32
+#error the mesh shader workgroup is one subgroup of 32 invocations
+#endif
+#define TILE_VERTEX_COUNT ((TILE_SIZE + 1) * (TILE_SIZE + 1))
+#define TILE_PRIMITIVE_COUNT (TILE_SIZE * TILE_SIZE * 2)
 
-layout(local_size_x=32) in;
+layout(local_size_x=WORKGROUP_SIZE) in;
+#if !defined(COMPUTE_RASTERIZER)
 layout(triangles) out;
-layout(max_vertices=81, max_primitives=128) out;
+layout(max_vertices=TILE_VERTEX_COUNT, max_primitives=TILE_PRIMITIVE_COUNT) out;
+#endif
 
+// side of the largest pixel footprint rasterized in the shader, 0 exports every triangle (MeshShadingRenderLoop::SetSoftwareRasterMaxSize)
+layout(constant_id=0) const uint softwareRasterMaxSize = 1;
+
+#if defined(COMPUTE_RASTERIZER)
+// ComputeRasterPayload in MeshShadingRenderLoop.h
+struct Task
+{
+    mat3x4 modelToWorldMatrix;
+    uint   megatileCount;
+    uint   instance;
+    uint   megatile[64];
+    uint   firstTask[64];
+    uint   aroundMips[13];
+};
+
+uint g_payload; // of the tile, in the payload buffer
+#define IN payloads[g_payload]
+#else
 taskNV in Task
 {
     mat3x4 modelToWorldMatrix;
+    uint   megatileCount;
+    uint   instance;
     uint   megatile[64];
+    uint   firstTask[64];
+    uint   aroundMips[13];
 } IN;
+#endif
 
-ivec3 unpackMegatile(uint megatile)
+ivec4 unpackMegatile(uint megatile)
 {
     // assuming a max texture size of 64k, we would need:
     // * 4 bits for mip
     // * 10 bits per axis (1024 megatiles of 64 quads)
-    // for hex reading convenience, let's pack 12-12-8
-    return ivec3(megatile >> 20, (megatile >> 8) & 0xfff, megatile & 0xf);
+    // for hex reading convenience, let's pack 12-12-8 (the unit shift in the high 4 bits of the 8)
+    return ivec4(megatile >> 20, (megatile >> 8) & 0xfff, megatile & 0xf, (megatile >> 4) & 0xf);
 }
 
+#if defined(COMPUTE_RASTERIZER)
+shared vec4 s_positions[TILE_VERTEX_COUNT];
+#define vertexPosition(i) s_positions[i]
+#if defined(GBUFFER_PASS)
+shared vec3 s_albedos[TILE_VERTEX_COUNT];
+shared vec3 s_normals[TILE_VERTEX_COUNT];
+#define vertexAlbedo(i) s_albedos[i]
+#define vertexNormal(i) s_normals[i]
+#endif
+#else
 out gl_MeshPerVertexNV
 {
     precise vec4 gl_Position;
 } gl_MeshVerticesNV[];
+#define vertexPosition(i) gl_MeshVerticesNV[i].gl_Position
 
 #if defined(GBUFFER_PASS)
 layout(location=0) out Interpolant
@@ -39,111 +108,516 @@ layout(location=0) out Interpolant
     vec3 albedo;
     vec3 normal;
 } OUT[];
+#define vertexAlbedo(i) OUT[i].albedo
+#define vertexNormal(i) OUT[i].normal
+#elif defined(VISIBILITY_PASS)
+layout(location=0) perprimitiveNV out uint visibilityIds[];
+#endif
 #endif
 
 shared uint    s_primsToExport;
+#if defined(COMPUTE_RASTERIZER)
+shared uint    s_rasterCounts;             // triangles | pixels << 8, one atomic orders the triangles and their first pixels alike
+#define s_trisToRaster (s_rasterCounts & 0xff)
+#define s_pixelsToRaster (s_rasterCounts >> 8)
+shared uint8_t s_exportIndices[3 * TILE_PRIMITIVE_COUNT]; // of the exported primitives, packed 3x8
+shared uint    s_firstVertex;              // of the tile in the geometry buffer
+shared uint    s_firstIndex;
+#else
+shared uint    s_trisToRaster;
 shared uint    s_pixelsToRaster;
-shared u16vec2 s_pixelPos[128];         // packed 2x16
-shared u8vec4  s_pixelTriIndices[128];  // packed 3x8
-shared uint    s_pixelBary[128];        // packed 2x16f
+#endif
+shared u16vec2 s_rasterTriPos[TILE_PRIMITIVE_COUNT];       // first pixel of the footprint, packed 2x16
+shared u8vec4  s_rasterTriIndices[TILE_PRIMITIVE_COUNT];   // packed 3x8, then the footprint width | height << 4
+shared uint    s_rasterTriFirstPixel[TILE_PRIMITIVE_COUNT]; // pixels of the footprints before this one
+#if defined(VISIBILITY_PASS)
+shared uint8_t s_exportTriangles[TILE_PRIMITIVE_COUNT]; // triangle of the tile (2 per quad) of each exported primitive
+shared uint8_t s_rasterTriangles[TILE_PRIMITIVE_COUNT]; // and of each triangle marked for internal rasterization
+shared uint    s_cluster;
+#endif
+#if defined(DEPTH_PASS)
+// the nearest depth of each pixel the software rasterized triangles of the workgroup cover: the small triangles of a tile land on
+// few pixels, many of them shared by neighbours, so the depth buffer takes one atomic per pixel once they are all in rather than one
+// per triangle; open addressing on x | y << 16, pixels finding no free slot within depthCacheProbes go to the depth buffer directly
+const uint depthCacheBits = 8;
+const uint depthCacheSize = 1 << depthCacheBits;
+const uint depthCacheProbes = 8;
+const uint noPixel = 0xffffffff;
+shared uint    s_depthCachePixels[depthCacheSize];
+shared uint    s_depthCacheDepths[depthCacheSize]; // encodeDepth, ordered as uints
+shared uint    s_pixelsRasterized;
+shared uint    s_depthAtomics;
+
+uint g_pixelsRasterized; // by this invocation
+uint g_depthAtomics;
+#endif
 
 layout(set=0, binding=0, std140) uniform sceneBuffer
 {
     mat4 projectionMatrix;
     vec4 viewportSize;
+    uint statisticsSlot;
+    uint occlusionCulling;
+    float lodPixelError;
+    uint depthEpoch;
+};
+
+// REVERSED_Z 1 has the near plane at depth 1 and the far plane at 0, the nearest depth is the largest
+#ifndef REVERSED_Z
+#define REVERSED_Z 0
+#endif
+
+// the software rasterized depth as stored, ordered as uints the way the depth is
+// with reversed-Z it is tagged with the epoch of the frame writing it in the top 8 bits, above the float bits less the 6 low
+// mantissa ones (the depth is at most 1, under 1 << 30): the atomics keep the largest, so the pixels of the earlier epochs lose
+// against those of this frame and read as the far plane, no clear needed until the epochs start over (depthEpochCount in
+// MeshShadingRenderLoop.h)
+#if REVERSED_Z
+const uint farthestDepthBits = 0;
+
+uint encodeDepth(float depth)
+{
+    return (depthEpoch << 24) | (floatBitsToUint(depth) >> 6);
+}
+#else
+const uint farthestDepthBits = 0xffffffff;
+
+uint encodeDepth(float depth)
+{
+    return floatBitsToUint(depth);
+}
+#endif
+
+// TILED_DEPTH 1 keeps the software rasterized depth in the tiled buffer of binding 14 instead of the image of binding 1
+#ifndef TILED_DEPTH
+#define TILED_DEPTH 0
+#endif
+
+#if TILED_DEPTH && !defined(VISIBILITY_PASS)
+// MeshShadingRenderLoop.h: 64x64 pixel blocks in rows, the pixels of a block in Morton order so that an 8x8 tile is 64 consecutive
+// uints, after a flag per 8x8 tile for clear_tiled_depth.glsl (the sizes are defined by MeshShadingRenderLoop from its constants)
+const uint tiledDepthBlocksPerRow = TILED_DEPTH_BLOCKS_PER_ROW;
+const uint tiledDepthTileCount = TILED_DEPTH_TILE_COUNT;
+
+layout(set=0, binding=14, std430) buffer tiledDepthBuffer
+{
+    uint tiledDepthTilesWritten[tiledDepthTileCount]; // non-zero for the 8x8 tiles written since the last clear
+    uint tiledDepth[];
 };
 
+uint tiledDepthAddress(ivec2 pixel)
+{
+    uvec2 block = uvec2(pixel) >> 6;
+    uvec2 morton = uvec2(pixel) & 63;
+    morton = (morton | (morton << 4)) & 0x0f0f;
+    morton = (morton | (morton << 2)) & 0x3333;
+    morton = (morton | (morton << 1)) & 0x5555;
+    return (block.y * tiledDepthBlocksPerRow + block.x) * 4096 + (morton.x | (morton.y << 1));
+}
+#endif
+
 #if defined(DEPTH_PASS)
+#if !TILED_DEPTH
 layout(set=0, binding=1, r32ui) uniform coherent uimage2D depthBuffer;
+#endif
+
+// CullingStatistics in MeshShadingRenderLoop.h, the mesh shader counts the software rasterized pixels
+struct CullingStatistics
+{
+    uint megatilesTested;
+    uint megatilesFrustumCulled;
+    uint megatilesBackfaceCulled;
+    uint megatilesOcclusionCulled;
+    uint tilesLaunched;
+    uint tilesCulled;
+    uint taskGroupsCulled;
+    uint pixelsRasterized;
+    uint depthAtomics;
+    uint reserved0;
+    uint reserved1;
+    uint reserved2;
+};
+
+layout(set=0, binding=5, std430) buffer statisticsBuffer
+{
+    CullingStatistics statistics[];
+};
+
+const uint CullingPass_Count = 3; // MeshShadingRenderLoop.h
 #elif defined(GBUFFER_PASS)
+#if !TILED_DEPTH
 layout(set=0, binding=1, r32ui) uniform readonly uimage2D depthBuffer;
+#endif
 layout(set=0, binding=2, rgba8) uniform writeonly image2D albedoBuffer;
 layout(set=0, binding=3, rgba8) uniform writeonly image2D normalBuffer;
+#elif defined(VISIBILITY_PASS)
+// depth in the high 32 bits, cluster << 7 | triangle in the low ones
+layout(set=0, binding=9, r64ui) uniform u64image2D visibilityBuffer;
+
+// VisibilityCluster in MeshShadingRenderLoop.h
+struct VisibilityCluster
+{
+    uint instance;
+    uint megatile;      // as in the task payload
+    uint tile;          // workgroup of the megatile
+    uint aroundMips[13];
+};
+
+const uint maxVisibilityClusterCount = 1 << 20; // MeshShadingRenderLoop.h
+const uint noCluster = 0xffffffff;
+
+layout(set=0, binding=10, std430) buffer visibilityClusterBuffer
+{
+    uint              clusterCount;
+    uint              reserved[3];
+    VisibilityCluster clusters[];
+};
+#endif
+
+layout(push_constant) uniform meshConstants
+{
+    vec4 positionScale;     // dequantizes position texels to object space
+    vec4 positionBias;
+    uint taskGroupsPerRow;
+    uint mipCount;
+    uint requestOffset;
+    uint requestFrame;
+    uint firstVisibleTaskGroup;
+    uint cullingPass;
+    uint meshId;
+};
+
+#if defined(COMPUTE_RASTERIZER)
+const uint maxMeshCount = 256;                       // MeshShadingRenderLoop.h
+const uint maxComputeRasterPayloadCount = 1 << 15;   // MeshShadingRenderLoop.h
+const uint maxComputeRasterExportTileCount = 1 << 14;
+const uint maxComputeRasterVertexCount = 81 * maxComputeRasterExportTileCount; // sized for 8x8 quad tiles, smaller ones fit more
+const uint maxComputeRasterIndexCount = 384 * maxComputeRasterExportTileCount;
+const uint tilesPerDispatchRow = 256;                // test_ts.glsl
+const uint noVertex = 0xffffffff;
+
+// as in test_ts.glsl
+struct ComputeRasterCounters
+{
+    uint payloadCount;
+    uint tileAllocation;
+    uint tileCount;
+    uint tileDispatchX;
+    uint tileDispatchY;
+    uint tileDispatchZ;
+    uint reserved0;
+    uint reserved1;
+};
+
+layout(set=0, binding=12, std430) readonly buffer computeRasterWorkBuffer
+{
+    ComputeRasterCounters counters[maxMeshCount];
+    Task                  payloads[maxComputeRasterPayloadCount];
+    uint                  tiles[]; // payload << 14 | mesh shader workgroup of the task group
+};
+
+// ComputeRasterVertex in MeshShadingRenderLoop.h
+struct ComputeRasterVertex
+{
+    vec4 position;  // clip space
+    uint albedo;    // packUnorm4x8
+    uint normal;    // packSnorm4x8
+    uint reserved0;
+    uint reserved1;
+};
+
+// the header is the VkDrawIndexedIndirectCommand of test_vs.glsl, reset before each pass
+layout(set=0, binding=13, std430) buffer computeRasterGeometryBuffer
+{
+    uint                indexCount;
+    uint                instanceCount;
+    uint                firstIndex;
+    int                 vertexOffset;
+    uint                firstInstance;
+    uint                vertexAllocation;
+    uint                indexAllocation;
+    uint                reserved;
+    ComputeRasterVertex vertices[maxComputeRasterVertexCount];
+    uint                indices[];
+};
 #endif
 
+// pools of 64x64 texel pages, one megatile per page (see ParameterizedMesh.h)
 layout(set=1, binding=0) uniform sampler2D positionTexture;
 #if defined(GBUFFER_PASS)
+// RGBA8, BC1 or BC7 depending on the geometry image file, block compressed views sample the same
 layout(set=1, binding=1 )uniform sampler2D albedoTexture;
 layout(set=1, binding=2 )uniform sampler2D normalTexture;
 #endif
 
-// BaryTri3D courtesy of Tom Forsyth https://www.shadertoy.com/view/wdjfz1
-// (adapted to use vec4 instead of Vertex struct)
-// -------------------------------------------------------------------
-// Test a position against a triangle and return
-// the perspective-correct barycentric coordinates in the triangle
-// Note the z value in the vertex is ignored, it's the w that matters.
-vec2 BaryTri3D ( vec2 pos, vec4 v1, vec4 v2, vec4 v3 )
-{
-    vec2 posv1 = pos - v1.xy;
-
-    vec2 v21 = v2.xy - v1.xy;
-    vec2 v31 = v3.xy - v1.xy;
-
-    float scale = v21.x * v31.y - v21.y * v31.x;
-    float rscale = 1.0 / scale;
-    float baryi = ( posv1.x * v31.y - posv1.y * v31.x ) * rscale;
-    float baryj = ( posv1.x * v21.y - posv1.y * v21.x ) * -rscale;
-
-    // Now interpolate the canonical coordinates (0,0,1,v1.w), (1,0,1,v2.w) and (0,1,1,v3.w)
-    // with perspective correction
-    // So we project all three by their respective w:
-    // (0,0,v1.w) -> (0,     0,     1/v1.w)
-    // (1,0,v2.w) -> (1/v2.w,0,     1/v2.w)
-    // (0,1,v3.w) -> (0,     1/v3.w,1/v3.w)
-    // Then interpolate those values linearly to produce (nx,ny,nw),
-    // then divide by nw again.
-    vec3 recipw = vec3 ( 1.0/v1.w, 1.0/v2.w, 1.0/v3.w );
-
-    float baryk = 1.0 - baryi - baryj;
-    float newi = recipw.y * baryi;
-    float newj = recipw.z * baryj;
-    //float neww = recipw.x * baryk + recipw.y * baryi + recipw.z * baryj;
-    float neww = recipw.x * baryk + newi + newj;
-
-    // ...and project back.
-    float rneww = 1.0/neww;
-    float perspi = newi * rneww;
-    float perspj = newj * rneww;
-
-    return vec2 ( perspi, perspj );
+// geometry image encodings, chosen at build time (see GeometryImageEncoding.h)
+// POSITION_ENCODING 0: absolute in the mesh bounds, 1 and 2: relative to the bounds of the megatile owning the texel
+// NORMAL_ENCODING   0: xyz * 0.5 + 0.5, 1, 2 and 3: octahedral snorm (RG8, RG16, BC5)
+#ifndef POSITION_ENCODING
+#define POSITION_ENCODING 0
+#endif
+#ifndef NORMAL_ENCODING
+#define NORMAL_ENCODING 0
+#endif
+
+struct MegatileInfo
+{
+    vec4 positionBoundsMin;
+    vec4 positionBoundsExtent;
+    vec4 boundsMin;      // MegatileBounds: box, sphere and normal cone of everything the megatile draws
+    vec4 boundsMax;
+    vec4 boundingSphere;
+    vec4 normalCone;
+};
+
+layout(set=1, binding=3, std430) readonly buffer megatileBuffer
+{
+    uint         megatileMipOffsets[16];
+    MegatileInfo megatileInfos[];
+};
+
+// the task shader only draws megatiles whose page (and neighbours' pages) are resident
+layout(set=1, binding=4, std430) readonly buffer pageTableBuffer
+{
+    uint pageTable[];
+};
+
+const uint poolPagesPerRow = 128; // geometryImagePoolPagesPerRow
+
+// the vertices on the border of each mip, at full precision (GeometryImageBorderVertex in GeometryImageFile.h): the last row and
+// column of a mip are not in its megatiles, and the vertices the parameterization maps to the same point must match bit for bit
+struct BorderVertex
+{
+    vec3  position;
+    uint  albedo;
+    vec3  normal;
+    float reserved;
+};
+
+layout(set=1, binding=6, std430) readonly buffer borderBuffer
+{
+    uint         borderMipOffsets[16];
+    BorderVertex borderVertices[];
+};
+
+// vertices past the right or bottom edge of a megatile belong to the next one (texels are clamped to the mip first),
+// so neighbours agree on them
+uint ownerMegatileIndex(ivec2 texel, int mipLevel, int mipSize)
+{
+    ivec2 owner = texel >> 6;
+    return megatileMipOffsets[mipLevel] + owner.y * ((mipSize + 63) >> 6) + owner.x;
+}
+
+ivec2 poolTexel(ivec2 texel, int mipLevel, int mipSize)
+{
+    uint page = pageTable[ownerMegatileIndex(texel, mipLevel, mipSize)];
+    return ivec2(page % poolPagesPerRow, page / poolPagesPerRow) * 64 + (texel & 63);
+}
+
+vec3 decodePosition(vec4 encoded, ivec2 texel, int mipLevel, int mipSize)
+{
+#if POSITION_ENCODING == 0
+    return encoded.xyz * positionScale.xyz + positionBias.xyz;
+#else
+    uint index = ownerMegatileIndex(texel, mipLevel, mipSize);
+    return encoded.xyz * megatileInfos[index].positionBoundsExtent.xyz + megatileInfos[index].positionBoundsMin.xyz;
+#endif
+}
+
+vec3 decodeNormal(vec4 encoded)
+{
+#if NORMAL_ENCODING == 0
+    return encoded.xyz * 2 - 1;
+#else
+    vec3 n = vec3(encoded.xy, 1 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0)));
+    return n;
+#endif
+}
+
+bool isBorderVertex(ivec2 texel, int mipSize)
+{
+    return any(equal(texel, ivec2(0))) || any(equal(texel, ivec2(mipSize)));
+}
+
+// GetGeometryImageBorderVertexIndex in GeometryImageFile.h
+uint borderVertexIndex(ivec2 texel, int mipLevel, int mipSize)
+{
+    uint index = texel.y == 0 || texel.y == mipSize ? uint(texel.y == 0 ? 0 : mipSize + 1) + uint(texel.x)
+                                                     : uint(2 * (mipSize + 1) + 2 * (texel.y - 1)) + uint(texel.x == 0 ? 0 : 1);
+    return borderMipOffsets[mipLevel] + index;
+}
+
+// vertex (x, y) of a mip of size s, 0 <= x, y <= s
+vec3 fetchPosition(ivec2 texel, int mipLevel, int mipSize)
+{
+    if (isBorderVertex(texel, mipSize))
+    {
+        return borderVertices[borderVertexIndex(texel, mipLevel, mipSize)].position;
+    }
+    return decodePosition(texelFetch(positionTexture, poolTexel(texel, mipLevel, mipSize), 0), texel, mipLevel, mipSize);
+}
+
+#if defined(GBUFFER_PASS)
+void fetchAttributes(ivec2 texel, int mipLevel, int mipSize, out vec3 albedo, out vec3 normal)
+{
+    if (isBorderVertex(texel, mipSize))
+    {
+        BorderVertex vertex = borderVertices[borderVertexIndex(texel, mipLevel, mipSize)];
+        albedo = unpackUnorm4x8(vertex.albedo).xyz;
+        normal = vertex.normal;
+        return;
+    }
+    ivec2 pool = poolTexel(texel, mipLevel, mipSize);
+    albedo = texelFetch(albedoTexture, pool, 0).xyz;
+    normal = decodeNormal(texelFetch(normalTexture, pool, 0));
+}
+#endif
+
+// mip a mip 0 megatile of the task group or of the ring around it is drawn at (out of the image, the megatile across the fold of the
+// parameterization, see foldedMegatile in test_ts.glsl), 0 for the others (past the ring, or past a corner or a pole row of the image)
+int aroundMip(ivec2 megatile, ivec2 taskGroupBase)
+{
+    ivec2 around = megatile - taskGroupBase;
+    if (any(lessThan(around, ivec2(-1))) || any(greaterThan(around, ivec2(8))))
+    {
+        return 0;
+    }
+    uint index = (around.y + 1) * 10 + around.x + 1;
+    return int((IN.aroundMips[index >> 3] >> ((index & 7) * 4)) & 0xf);
+}
+
+// coarsest mip of a vertex of the mip and of the megatiles touching it: one, the two of a border or the four of a corner
+int touchingMip(ivec2 mip0Texel, int mipLevel, ivec2 taskGroupBase)
+{
+    ivec2 first = (mip0Texel - 1) >> 6;
+    ivec2 last = mip0Texel >> 6;
+
+    int coarseMip = mipLevel;
+    for (int y = first.y; y <= last.y; ++y)
+    {
+        for (int x = first.x; x <= last.x; ++x)
+        {
+            coarseMip = max(coarseMip, aroundMip(ivec2(x, y), taskGroupBase));
+        }
+    }
+    return coarseMip;
 }
 
-void processVertex(uint vertexId, vec2 tileOffset, int mipLevel)
+// true when the vertex is on the grid of the coarse mip along one axis only: between two of its vertices along the other, weight
+// of the second (0 when it is on the grid along both, coarseTexel then being the vertex)
+bool coarseEdge(ivec2 mip0Texel, int coarseMip, out ivec2 coarseTexel, out ivec2 nextTexel, out float weight)
 {
-    if (vertexId < 81)
+    int   spacing = 1 << coarseMip;
+    ivec2 offset = mip0Texel & (spacing - 1);
+    coarseTexel = (mip0Texel - offset) >> coarseMip;
+    nextTexel = coarseTexel + (offset.x == 0 ? ivec2(0, 1) : ivec2(1, 0));
+    weight = float(offset.x + offset.y) / float(spacing);
+    return (offset.x == 0) != (offset.y == 0);
+}
+
+// an end vertex of a coarse edge where the coarse side draws it, as stitchedPosition places it from the coarser megatiles touching it
+vec3 coarseEdgeEndPosition(ivec2 texel, int mipLevel, int mipSize, ivec2 taskGroupBase)
+{
+    ivec2 mip0Texel = texel << mipLevel;
+    int   coarseMip = touchingMip(mip0Texel, mipLevel, taskGroupBase);
+    if (coarseMip == mipLevel)
+    {
+        return fetchPosition(texel, mipLevel, mipSize);
+    }
+
+    int   coarseSize = max(int(taskGroupsPerRow * 512) >> coarseMip, 1);
+    ivec2 coarseTexel;
+    ivec2 nextTexel;
+    float weight;
+    if (!coarseEdge(mip0Texel, coarseMip, coarseTexel, nextTexel, weight))
+    {
+        return weight == 0 ? fetchPosition(coarseTexel, coarseMip, coarseSize) : fetchPosition(texel, mipLevel, mipSize);
+    }
+    return mix(fetchPosition(coarseTexel, coarseMip, coarseSize), fetchPosition(nextTexel, coarseMip, coarseSize), weight);
+}
+
+// a vertex on the border of megatiles drawn at different mips takes the coarsest of them: on its grid, the vertex of that mip (each
+// mip is quantized apart, so the same vertex decodes differently in each), between two of its vertices, the edge joining them, whose
+// ends move too where a third, coarser mip touches them; megatiles out of the image are those across the folds of the
+// parameterization. not handled: a fourth mip moving those ends, and megatiles past the ring, where edges of mips past 9 may end
+vec3 stitchedPosition(vec3 objectPosition, ivec2 texel, int mipLevel, ivec2 taskGroupBase)
+{
+    ivec2 mip0Texel = texel << mipLevel;
+    int   coarseMip = touchingMip(mip0Texel, mipLevel, taskGroupBase);
+    if (coarseMip == mipLevel)
+    {
+        return objectPosition;
+    }
+
+    int   coarseSize = max(int(taskGroupsPerRow * 512) >> coarseMip, 1);
+    ivec2 coarseTexel;
+    ivec2 nextTexel;
+    float weight;
+    if (!coarseEdge(mip0Texel, coarseMip, coarseTexel, nextTexel, weight))
+    {
+        return weight == 0 ? fetchPosition(coarseTexel, coarseMip, coarseSize) : objectPosition;
+    }
+
+    vec3 coarsePosition = coarseEdgeEndPosition(coarseTexel, coarseMip, coarseSize, taskGroupBase);
+    vec3 nextPosition = coarseEdgeEndPosition(nextTexel, coarseMip, coarseSize, taskGroupBase);
+    return mix(coarsePosition, nextPosition, weight);
+}
+
+void processVertex(uint vertexId, ivec2 tileOffset, int mipLevel, ivec2 taskGroupBase)
+{
+    if (vertexId < TILE_VERTEX_COUNT)
     {
         uvec2 pos;
-        pos.y = vertexId / 9;
-        pos.x = vertexId - (pos.y * 9);
+        pos.y = vertexId / (TILE_SIZE + 1);
+        pos.x = vertexId - (pos.y * (TILE_SIZE + 1));
 
-        vec2 uv = (tileOffset + vec2(pos)) / vec2(textureSize(positionTexture, mipLevel));
+        // vertices past the last one of the mip (mips smaller than a tile) repeat it, their triangles are degenerate
+        int   mipSize = max(int(taskGroupsPerRow * 512) >> mipLevel, 1);
+        ivec2 texel = min(tileOffset + ivec2(pos), ivec2(mipSize));
 
-        gl_MeshVerticesNV[vertexId].gl_Position = vec4(vec4(textureLod(positionTexture, uv, mipLevel).xyz, 1) * IN.modelToWorldMatrix, 1) * projectionMatrix;
+        vec3 objectPosition = fetchPosition(texel, mipLevel, mipSize);
+        objectPosition = stitchedPosition(objectPosition, texel, mipLevel, taskGroupBase);
+        precise vec4 position = vec4(vec4(objectPosition, 1) * IN.modelToWorldMatrix, 1) * projectionMatrix;
+        vertexPosition(vertexId) = position;
 #if defined(GBUFFER_PASS)
-        OUT[vertexId].albedo = textureLod(albedoTexture, uv, mipLevel).xyz;
-        OUT[vertexId].normal = normalize(textureLod(normalTexture, uv, mipLevel).xyz * mat3(IN.modelToWorldMatrix) * 2 - 1);
+        vec3 albedo;
+        vec3 normal;
+        fetchAttributes(texel, mipLevel, mipSize, albedo, normal);
+        vertexAlbedo(vertexId) = albedo;
+        vertexNormal(vertexId) = normalize(normal * mat3(IN.modelToWorldMatrix));
 #endif
     }
 }
 
-void exportTriangleForRaterization(uint ia, uint ib, uint ic)
+void exportTriangleForRaterization(uint ia, uint ib, uint ic, uint triangle)
 {
+#if defined(COMPUTE_RASTERIZER)
+    uint index = atomicAdd(s_primsToExport, 1);
+    s_exportIndices[3*index + 0] = uint8_t(ia);
+    s_exportIndices[3*index + 1] = uint8_t(ib);
+    s_exportIndices[3*index + 2] = uint8_t(ic);
+#else
     uvec4 vote = subgroupBallot(true);
     uint  index = s_primsToExport + subgroupBallotExclusiveBitCount(vote);
 
     gl_PrimitiveIndicesNV[3*index + 0] = ia;
     gl_PrimitiveIndicesNV[3*index + 1] = ib;
     gl_PrimitiveIndicesNV[3*index + 2] = ic;
+#if defined(VISIBILITY_PASS)
+    s_exportTriangles[index] = uint8_t(triangle);
+#endif
 
     s_primsToExport += subgroupBallotBitCount(vote);
+#endif
 }
 
-void processTriangle(uint ia, uint ib, uint ic)
+void processTriangle(uint ia, uint ib, uint ic, uint triangle)
 {
-    vec4 pa = gl_MeshVerticesNV[ia].gl_Position;
-    vec4 pb = gl_MeshVerticesNV[ib].gl_Position;
-    vec4 pc = gl_MeshVerticesNV[ic].gl_Position;
+    vec4 pa = vertexPosition(ia);
+    vec4 pb = vertexPosition(ib);
+    vec4 pc = vertexPosition(ic);
 
     pa.xyz /= pa.w;
     pb.xyz /= pb.w;
@@ -164,7 +638,7 @@ void processTriangle(uint ia, uint ib, uint ic)
     if (any(lessThan(vec3(pa.z, pb.z, pc.z), vec3(0))) || any(greaterThan(vec3(pa.z, pb.z, pc.z), vec3(1))))
     {
         // triangles that crosses near or far clip plane are exported for rasterization
-        exportTriangleForRaterization(ia, ib, ic);
+        exportTriangleForRaterization(ia, ib, ic, triangle);
         return;
     }
 
@@ -202,126 +676,424 @@ void processTriangle(uint ia, uint ib, uint ic)
     pixelquad *= viewportSize.xyxy;
     pixelquad = ceil(pixelquad - 0.5 + vec4(-0.005, -0.005, 0.005, 0.005)); // todo: fixme
 
+    // pixel centers covered by the bounding box: pixelquad.xy to pixelquad.zw - 1
     vec2 pixelsize = pixelquad.zw - pixelquad.xy;
     if (min(pixelsize.x, pixelsize.y) <= 0)
     {
         // cull triangles so small they do not even cover one pixel
         return;
     }
-    else if (max(pixelsize.x, pixelsize.y) > 1)
+    else if (max(pixelsize.x, pixelsize.y) > float(softwareRasterMaxSize))
     {
         // output the triangle for normal rasterization
-        exportTriangleForRaterization(ia, ib, ic);
+        exportTriangleForRaterization(ia, ib, ic, triangle);
     }
-    else 
+    else if (any(lessThan(pixelquad.xy, vec2(0))) || any(greaterThan(pixelquad.zw, viewportSize.xy)))
     {
-        // this pixel will be shader rasterized
-        vec2 pixelpos = (pixelquad.xy + pixelquad.zw)/2;
+        // footprints crossing the viewport edge are left to the rasterizer
+        exportTriangleForRaterization(ia, ib, ic, triangle);
+    }
+    else
+    {
+        // mark the triangle for internal rasterization, its pixels follow those of the triangles marked before
+        uvec2 footprint = uvec2(pixelsize);
+        uint  pixelCount = footprint.x * footprint.y;
 
-        // discard single pixel outside of clipspace
-        if (any(lessThan(pixelpos, vec2(0))) || any(greaterThanEqual(pixelpos, viewportSize.xy)))
-        {
-            exportTriangleForRaterization(ia, ib, ic);
-            return;
-        }
+#if defined(COMPUTE_RASTERIZER)
+        uint counts = atomicAdd(s_rasterCounts, 1 | (pixelCount << 8));
+        uint index = counts & 0xff;
 
-        precise vec2 bary = BaryTri3D((pixelpos * viewportSize.zw)*2 - 1, pa, pb, pc);
+        s_rasterTriPos[index] = u16vec2(pixelquad.xy);
+        s_rasterTriIndices[index] = u8vec4(ia, ib, ic, footprint.x | (footprint.y << 4));
+        s_rasterTriFirstPixel[index] = counts >> 8;
+#else
+        uvec4 vote = subgroupBallot(true);
+        uint  index = s_trisToRaster + subgroupBallotExclusiveBitCount(vote);
 
-        // the pixel is actually inside of the triangle
-        if (all(greaterThanEqual(bary, vec2(0))) && all(lessThanEqual(bary, vec2(1))))
+        s_rasterTriPos[index] = u16vec2(pixelquad.xy);
+        s_rasterTriIndices[index] = u8vec4(ia, ib, ic, footprint.x | (footprint.y << 4));
+        s_rasterTriFirstPixel[index] = s_pixelsToRaster + subgroupExclusiveAdd(pixelCount);
+#if defined(VISIBILITY_PASS)
+        s_rasterTriangles[index] = uint8_t(triangle);
+#endif
+
+        s_trisToRaster += subgroupBallotBitCount(vote);
+        s_pixelsToRaster += subgroupAdd(pixelCount);
+#endif
+    }
+}
+
+void processQuad(uint quadId, uint quadsPerRow)
+{
+    if ((quadId % TILE_SIZE) >= quadsPerRow || (quadId / TILE_SIZE) >= quadsPerRow)
+    {
+        // tiles of megatiles drawn past mip 3 have fewer quads (and the invocations past the last quad have none)
+        return;
+    }
+
+    uint pos = (quadId / TILE_SIZE)*(TILE_SIZE + 1) + (quadId % TILE_SIZE);
+    processTriangle(pos, pos + 1, pos + TILE_SIZE + 1, quadId * 2);
+    processTriangle(pos + 1, pos + TILE_SIZE + 2, pos + TILE_SIZE + 1, quadId * 2 + 1);
+}
+
+// the triangle marked for internal rasterization whose footprint holds this pixel (the last one starting at or before it)
+uint findRasterTriangle(uint pixel)
+{
+    uint first = 0;
+    uint count = s_trisToRaster;
+    while (count > 1)
+    {
+        uint halfCount = count / 2;
+        if (s_rasterTriFirstPixel[first + halfCount] <= pixel)
         {
-            // mark the triangle for internal rasterization
-            uvec4 vote = subgroupBallot(true);
-            uint  index = s_pixelsToRaster + subgroupBallotExclusiveBitCount(vote);
+            first += halfCount;
+            count -= halfCount;
+        }
+        else
+        {
+            count = halfCount;
+        }
+    }
+    return first;
+}
 
-            uvec2 ipixelpos = uvec2(pixelpos);
-            s_pixelPos[index] = u16vec2(ipixelpos);
-            s_pixelTriIndices[index] = u8vec4(ia, ib, ic, 0);
-            s_pixelBary[index] = packHalf2x16(bary);
+float edgeFunction(vec2 a, vec2 b, vec2 p)
+{
+    return determinant(mat2(b - a, p - a));
+}
 
-            s_pixelsToRaster += subgroupBallotBitCount(vote);
+#if defined(DEPTH_PASS)
+// keeps the nearest depth of the pixel in the workgroup, false when the probed slots all hold other pixels
+bool cacheDepth(ivec2 pixelpos, uint depth)
+{
+    uint pixel = uint(pixelpos.x) | (uint(pixelpos.y) << 16);
+    uint slot = (pixel * 2654435761u) >> (32 - depthCacheBits);
+    for (uint probe = 0; probe < depthCacheProbes; ++probe)
+    {
+        uint previous = atomicCompSwap(s_depthCachePixels[slot], noPixel, pixel);
+        if (previous == noPixel || previous == pixel)
+        {
+#if REVERSED_Z
+            atomicMax(s_depthCacheDepths[slot], depth);
+#else
+            atomicMin(s_depthCacheDepths[slot], depth);
+#endif
+            return true;
         }
+        slot = (slot + 1) & (depthCacheSize - 1);
     }
+    return false;
 }
 
-void processQuad(uint quadId)
+// keeps the nearest of depth and what the depth buffer holds, depth as encodeDepth
+void depthAtomicNearest(ivec2 pixelpos, uint depth)
 {
-    uint pos = (quadId >> 3)*9 + (quadId & 0x7);
-    processTriangle(pos, pos + 1, pos + 9);
-    processTriangle(pos + 1, pos + 10, pos + 9);
+#if TILED_DEPTH && REVERSED_Z
+    atomicMax(tiledDepth[tiledDepthAddress(pixelpos)], depth);
+#elif TILED_DEPTH
+    uint address = tiledDepthAddress(pixelpos);
+    atomicMin(tiledDepth[address], depth);
+    tiledDepthTilesWritten[address >> 6] = 1;
+#elif REVERSED_Z
+    imageAtomicMax(depthBuffer, pixelpos, depth);
+#else
+    imageAtomicMin(depthBuffer, pixelpos, depth);
+#endif
+    ++g_depthAtomics;
 }
+#elif defined(GBUFFER_PASS)
+uint loadDepth(ivec2 pixelpos)
+{
+#if TILED_DEPTH
+    return tiledDepth[tiledDepthAddress(pixelpos)];
+#else
+    return imageLoad(depthBuffer, pixelpos).x;
+#endif
+}
+#endif
 
-void rasterPixel(uint index)
+void rasterPixel(uint pixel)
 {
-    ivec2 pixelpos = s_pixelPos[index];
+    uint  index = findRasterTriangle(pixel);
+    uint  footprint = s_rasterTriIndices[index].w;
+    uint  local = pixel - s_rasterTriFirstPixel[index];
+    ivec2 pixelpos = ivec2(s_rasterTriPos[index]) + ivec2(local % (footprint & 0xf), local / (footprint & 0xf));
 
-    uint ia = s_pixelTriIndices[index].x;
-    uint ib = s_pixelTriIndices[index].y;
-    uint ic = s_pixelTriIndices[index].z;
+    uint ia = s_rasterTriIndices[index].x;
+    uint ib = s_rasterTriIndices[index].y;
+    uint ic = s_rasterTriIndices[index].z;
 
-    vec2 bary = unpackHalf2x16(s_pixelBary[index]);
+    vec4 pa = vertexPosition(ia);
+    vec4 pb = vertexPosition(ib);
+    vec4 pc = vertexPosition(ic);
 
-    vec4 pa = gl_MeshVerticesNV[ia].gl_Position;
-    vec4 pb = gl_MeshVerticesNV[ib].gl_Position;
-    vec4 pc = gl_MeshVerticesNV[ic].gl_Position;
+    pa.xyz /= pa.w;
+    pb.xyz /= pb.w;
+    pc.xyz /= pc.w;
 
-    vec2 zw = mix(pa.zw, mix(pb.zw, pc.zw, bary.y), bary.x);
-    float d = zw.x/zw.y;
+    // the triangle is counter-clockwise (processTriangle culled the others): the pixel center is covered when no edge function is negative
+    precise vec2 p = (vec2(pixelpos) + 0.5) * viewportSize.zw * 2 - 1;
+    precise vec3 edges = vec3(edgeFunction(pb.xy, pc.xy, p), edgeFunction(pc.xy, pa.xy, p), edgeFunction(pa.xy, pb.xy, p));
+    if (any(lessThan(edges, vec3(0))))
+    {
+        return;
+    }
+
+    // depth is linear in screen space, attributes are interpolated perspective-correct
+    vec3  bary = edges / (edges.x + edges.y + edges.z);
+    float d = dot(bary, vec3(pa.z, pb.z, pc.z));
 
 #if defined(DEPTH_PASS)
-    imageAtomicMin(depthBuffer, pixelpos, floatBitsToUint(d));
+    ++g_pixelsRasterized;
+    if (!cacheDepth(pixelpos, encodeDepth(d)))
+    {
+        depthAtomicNearest(pixelpos, encodeDepth(d));
+    }
 #elif defined(GBUFFER_PASS)
-    float olddepth = uintBitsToFloat(imageLoad(depthBuffer, pixelpos).x);
-    if (d == olddepth)
+    // the same triangle encodes the same depth (which rounds the depth to as many bits with reversed-Z)
+    if (encodeDepth(d) == loadDepth(pixelpos))
     {
-        imageStore(albedoBuffer, pixelpos, vec4(mix(OUT[ia].albedo, mix(OUT[ib].albedo, OUT[ib].albedo, bary.y), bary.x), 0));
-        imageStore(normalBuffer, pixelpos, (normalize(vec4(mix(OUT[ia].normal, mix(OUT[ib].normal, OUT[ib].normal, bary.y), bary.x), 0)) + 1) / 2);
+        vec3 perspectiveBary = bary / vec3(pa.w, pb.w, pc.w);
+        perspectiveBary /= perspectiveBary.x + perspectiveBary.y + perspectiveBary.z;
+
+        vec3 albedo = perspectiveBary.x * vertexAlbedo(ia) + perspectiveBary.y * vertexAlbedo(ib) + perspectiveBary.z * vertexAlbedo(ic);
+        vec3 normal = perspectiveBary.x * vertexNormal(ia) + perspectiveBary.y * vertexNormal(ib) + perspectiveBary.z * vertexNormal(ic);
+        imageStore(albedoBuffer, pixelpos, vec4(albedo, 0));
+        imageStore(normalBuffer, pixelpos, (vec4(normalize(normal), 0) + 1) / 2);
     }
+#elif defined(VISIBILITY_PASS)
+    uint visibilityId = (s_cluster << 7) | uint(s_rasterTriangles[index]);
+#if REVERSED_Z
+    imageAtomicMax(visibilityBuffer, pixelpos, (uint64_t(floatBitsToUint(d)) << 32) | visibilityId);
+#else
+    imageAtomicMin(visibilityBuffer, pixelpos, (uint64_t(floatBitsToUint(d)) << 32) | visibilityId);
 #endif
+#endif
+}
+
+// the megatile of the task payload drawing this workgroup (the last one starting at or before it)
+uint findMegatile(uint task)
+{
+    uint first = 0;
+    uint count = IN.megatileCount;
+    while (count > 1)
+    {
+        uint halfCount = count / 2;
+        if (IN.firstTask[first + halfCount] <= task)
+        {
+            first += halfCount;
+            count -= halfCount;
+        }
+        else
+        {
+            count = halfCount;
+        }
+    }
+    return first;
 }
 
 void main()
 {
+#if defined(COMPUTE_RASTERIZER)
+    // dispatched in rows of tilesPerDispatchRow, the last one partly used
+    uint tileIndex = gl_WorkGroupID.y * tilesPerDispatchRow + gl_WorkGroupID.x;
+    if (tileIndex >= counters[meshId].tileCount)
+    {
+        return;
+    }
+    g_payload = tiles[tileIndex] >> 14;
+    uint task = tiles[tileIndex] & 0x3fff;
+#else
+    uint task = gl_WorkGroupID.x;
+#endif
+
     if (gl_LocalInvocationID.x == 0)
     {
         s_primsToExport = 0;
+#if defined(COMPUTE_RASTERIZER)
+        s_rasterCounts = 0;
+#else
+        s_trisToRaster = 0;
         s_pixelsToRaster = 0;
+#endif
+#if defined(DEPTH_PASS)
+        s_pixelsRasterized = 0;
+        s_depthAtomics = 0;
+#endif
     }
+#if defined(DEPTH_PASS)
+    g_pixelsRasterized = 0;
+    g_depthAtomics = 0;
+#endif
 
     memoryBarrierShared();
     barrier();
 
-    ivec3 megatile = unpackMegatile(IN.megatile[gl_WorkGroupID.x/64]);
-    vec2 tilePos = vec2(uvec2(megatile.x << 6, megatile.y << 6) + uvec2((gl_WorkGroupID.x & 0x7) << 3, gl_WorkGroupID.x & 0x38));
+    uint  entry = findMegatile(task);
+    ivec4 megatile = unpackMegatile(IN.megatile[entry]);
+    uint  tile = task - IN.firstTask[entry];
+
+    // texels of the mip covered by the unit of mip 0 megatiles (0 when it shares one texel with its neighbours)
+    uint  regionSize = (64u << megatile.w) >> megatile.z;
+    uint  tilesPerRow = max(regionSize / TILE_SIZE, 1);
+    uint  quadsPerRow = clamp(regionSize, 1, TILE_SIZE);
+    ivec2 tilePos = ((megatile.xy << 6) >> megatile.z) + ivec2(tile % tilesPerRow, tile / tilesPerRow) * TILE_SIZE;
 
-    for (int i = 0; i < 3; ++i)
+    for (int i = 0; i < (TILE_VERTEX_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE; ++i)
     {
-        processVertex(i*32 + gl_LocalInvocationID.x, tilePos, megatile.z);
+        processVertex(i*WORKGROUP_SIZE + gl_LocalInvocationID.x, tilePos, megatile.z, megatile.xy & ~7);
     }
 
     memoryBarrierShared();
     barrier();
 
-    for (int i = 0; i < 2; ++i)
+    for (int i = 0; i < (TILE_SIZE * TILE_SIZE + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE; ++i)
     {
-        processQuad(i*32 + gl_LocalInvocationID.x);
+        processQuad(i*WORKGROUP_SIZE + gl_LocalInvocationID.x, quadsPerRow);
     }
 
     memoryBarrierShared();
     barrier();
 
-    uint loops = (s_pixelsToRaster + 31) / 32;
+#if defined(VISIBILITY_PASS)
+    // workgroups that keep any triangle record their tile, past the capacity of the cluster buffer they draw nothing
+    if (gl_LocalInvocationID.x == 0)
+    {
+        s_cluster = noCluster;
+        if (s_primsToExport + s_trisToRaster > 0)
+        {
+            uint cluster = atomicAdd(clusterCount, 1);
+            s_cluster = cluster < maxVisibilityClusterCount ? cluster : noCluster;
+        }
+    }
+
+    memoryBarrierShared();
+    barrier();
+
+    if (s_cluster == noCluster)
+    {
+        if (gl_LocalInvocationID.x == 0)
+        {
+            gl_PrimitiveCountNV = 0;
+        }
+        return;
+    }
+
+    if (gl_LocalInvocationID.x == 0)
+    {
+        clusters[s_cluster].instance = IN.instance;
+        clusters[s_cluster].megatile = IN.megatile[entry];
+        clusters[s_cluster].tile = tile;
+    }
+    if (gl_LocalInvocationID.x < 13)
+    {
+        clusters[s_cluster].aroundMips[gl_LocalInvocationID.x] = IN.aroundMips[gl_LocalInvocationID.x];
+    }
+    for (uint i = gl_LocalInvocationID.x; i < s_primsToExport; i += WORKGROUP_SIZE)
+    {
+        visibilityIds[i] = (s_cluster << 7) | uint(s_exportTriangles[i]);
+    }
+#endif
+
+#if defined(COMPUTE_RASTERIZER)
+    // the exported triangles and the vertices of the tile are appended as long as they fit (once they do not, no later tile's do,
+    // so the index count stays that of the ones written)
+    if (gl_LocalInvocationID.x == 0)
+    {
+        s_firstVertex = noVertex;
+        if (s_primsToExport > 0)
+        {
+            uint firstVertex = atomicAdd(vertexAllocation, TILE_VERTEX_COUNT);
+            uint firstIndex = firstVertex + TILE_VERTEX_COUNT <= maxComputeRasterVertexCount ? atomicAdd(indexAllocation, 3 * s_primsToExport) : maxComputeRasterIndexCount;
+            if (firstIndex + 3 * s_primsToExport <= maxComputeRasterIndexCount)
+            {
+                atomicMax(indexCount, firstIndex + 3 * s_primsToExport);
+                s_firstVertex = firstVertex;
+                s_firstIndex = firstIndex;
+            }
+        }
+    }
+
+    memoryBarrierShared();
+    barrier();
+
+    if (s_firstVertex != noVertex)
+    {
+        for (uint i = gl_LocalInvocationID.x; i < TILE_VERTEX_COUNT; i += WORKGROUP_SIZE)
+        {
+            vertices[s_firstVertex + i].position = s_positions[i];
+#if defined(GBUFFER_PASS)
+            vertices[s_firstVertex + i].albedo = packUnorm4x8(vec4(s_albedos[i], 0));
+            vertices[s_firstVertex + i].normal = packSnorm4x8(vec4(s_normals[i], 0));
+#endif
+        }
+        for (uint i = gl_LocalInvocationID.x; i < 3 * s_primsToExport; i += WORKGROUP_SIZE)
+        {
+            indices[s_firstIndex + i] = s_firstVertex + uint(s_exportIndices[i]);
+        }
+    }
+#endif
+
+#if defined(DEPTH_PASS)
+    // only workgroups with pixels to rasterize pay for the cache (the condition is the same for the whole workgroup)
+    if (s_pixelsToRaster > 0)
+    {
+        for (uint i = gl_LocalInvocationID.x; i < depthCacheSize; i += WORKGROUP_SIZE)
+        {
+            s_depthCachePixels[i] = noPixel;
+            s_depthCacheDepths[i] = farthestDepthBits;
+        }
+
+        memoryBarrierShared();
+        barrier();
+    }
+#endif
+
+    uint loops = (s_pixelsToRaster + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
     for (uint i = 0; i < loops; ++i)
     {
-        uint index = i*32 + gl_LocalInvocationID.x;
+        uint index = i*WORKGROUP_SIZE + gl_LocalInvocationID.x;
         if (index < s_pixelsToRaster)
         {
             rasterPixel(index);
         }
     }
 
+#if defined(DEPTH_PASS)
+    if (s_pixelsToRaster > 0)
+    {
+        memoryBarrierShared();
+        barrier();
+
+        // one depth atomic per pixel covered
+        for (uint i = gl_LocalInvocationID.x; i < depthCacheSize; i += WORKGROUP_SIZE)
+        {
+            uint pixel = s_depthCachePixels[i];
+            if (pixel != noPixel)
+            {
+                depthAtomicNearest(ivec2(pixel & 0xffff, pixel >> 16), s_depthCacheDepths[i]);
+            }
+        }
+
+        atomicAdd(s_pixelsRasterized, g_pixelsRasterized);
+        atomicAdd(s_depthAtomics, g_depthAtomics);
+
+        memoryBarrierShared();
+        barrier();
+
+        if (gl_LocalInvocationID.x == 0 && s_pixelsRasterized > 0)
+        {
+            uint slot = statisticsSlot * CullingPass_Count + cullingPass;
+            atomicAdd(statistics[slot].pixelsRasterized, s_pixelsRasterized);
+            atomicAdd(statistics[slot].depthAtomics, s_depthAtomics);
+        }
+    }
+#endif
+
+#if !defined(COMPUTE_RASTERIZER)
     if (gl_LocalInvocationID.x == 0)
     {
         gl_PrimitiveCountNV = s_primsToExport;
     }
+#endif
 }
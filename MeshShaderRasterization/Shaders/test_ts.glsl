@@ -1,42 +1,694 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : require
+#if !defined(COMPUTE_RASTERIZER)
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#extension GL_KHR_shader_subgroup_ballot : require
 #extension GL_NV_mesh_shader : require
+#endif
 
 layout(local_size_x=32) in;
 
-taskNV out Task
+// quads per side of a mesh shader tile, as test_ms.glsl is compiled with
+#ifndef TILE_SIZE
+#define TILE_SIZE 8
+#endif
+
+// each task group looks at 8x8 megatiles of mip 0 of one instance and draws each at the mip its screen-space error calls for, or the
+// next resident one
+// the instances of a mesh are drawn at once, from the task groups of all of them that cull_task_groups.glsl found in the frustum
+// a megatile drawn at mip m covers 64>>m texels of it: ((64>>m)/TILE_SIZE)^2 tiles of TILE_SIZE^2 quads, or one tile of fewer quads
+// past mip 3 that wastes most of the mesh shader workgroup, so the megatiles of the task group drawn at the same mip are merged in
+// units of 2^u x 2^u (u = min(m - 3, 3)), drawn by their first megatile: (64<<u)>>m texels, whole tiles up to mip 6
+// the mesh shader stitches the borders of megatiles to coarser neighbours, so the mips of the megatiles around the task group go
+// along: 10x10 mip 0 megatiles, the 8x8 of the task group and the ring around them
+// COMPUTE_RASTERIZER runs this as a compute shader over the visible task groups: the payload goes to a buffer and each mesh shader
+// workgroup it would launch to the tile list of the mesh, which test_ms.glsl then runs over as a compute shader (shared atomics
+// replace the subgroup operations, subgroups may be smaller than the workgroup there)
+shared uint s_mips[100];
+
+#if defined(COMPUTE_RASTERIZER)
+// ComputeRasterPayload in MeshShadingRenderLoop.h, built in shared memory and copied to the payload buffer
+struct Task
 {
     mat3x4 modelToWorldMatrix;
+    uint   megatileCount;
+    uint   instance;
     uint   megatile[64];
+    uint   firstTask[64];
+    uint   aroundMips[13];
+};
+
+shared Task s_task;
+shared uint s_counts;         // megatiles | tasks << 8, one atomic orders both
+shared uint s_cullingCounts;  // tested | frustum culled << 8 | backface culled << 16 | occlusion culled << 24
+shared uint s_culledTaskCount;
+shared uint s_payload;
+shared uint s_firstTile;
+#define OUT s_task
+#else
+taskNV out Task
+{
+    mat3x4 modelToWorldMatrix;
+    uint   megatileCount;
+    uint   instance;       // in the instance buffer, for the clusters of the visibility pass
+    uint   megatile[64];   // packed first mip 0 megatile of the unit, the mip it is drawn at and the unit shift u
+    uint   firstTask[64];  // first mesh shader workgroup of each unit
+    uint   aroundMips[13]; // 4 bit mips of the megatiles around the task group, row by row (see aroundIndex), across the folds out of the image (foldedMegatile)
 } OUT;
+#endif
+
+layout(push_constant) uniform meshConstants
+{
+    vec4 positionScale;
+    vec4 positionBias;
+    uint taskGroupsPerRow;
+    uint mipCount;
+    uint requestOffset;
+    uint requestFrame;
+    uint firstVisibleTaskGroup;
+    uint cullingPass;
+    uint meshId;
+    uint parameterization;
+};
+
+// REVERSED_Z 1 has the near plane at depth 1 and the far plane at 0, the nearest depth is the largest
+#ifndef REVERSED_Z
+#define REVERSED_Z 0
+#endif
+
+layout(set=0, binding=0, std140) uniform sceneBuffer
+{
+    mat4 projectionMatrix;
+    vec4 viewportSize;
+    uint statisticsSlot;
+    uint occlusionCulling;
+    float lodPixelError;   // quads are drawn at most that long on screen, as far as the resident mips allow
+};
+
+struct MegatileInfo
+{
+    vec4 positionBoundsMin;
+    vec4 positionBoundsExtent;
+    vec4 boundsMin;      // MegatileBounds: box, sphere and normal cone of everything the megatile draws
+    vec4 boundsMax;
+    vec4 boundingSphere;
+    vec4 normalCone;
+};
+
+struct MeshInstance
+{
+    mat3x4 modelToWorldMatrix;
+    uint   meshId;
+    uint   reserved0;
+    uint   reserved1;
+    uint   reserved2;
+};
+
+layout(set=0, binding=4, std430) readonly buffer instanceBuffer
+{
+    MeshInstance instances[];
+};
+
+// megatile culling counters, one slot of each pass per frame execution context (CullingStatistics in MeshShadingRenderLoop.h)
+struct CullingStatistics
+{
+    uint megatilesTested;
+    uint megatilesFrustumCulled;
+    uint megatilesBackfaceCulled;
+    uint megatilesOcclusionCulled;
+    uint tilesLaunched;
+    uint tilesCulled;
+    uint taskGroupsCulled;
+    uint pixelsRasterized;
+    uint depthAtomics;
+    uint reserved0;
+    uint reserved1;
+    uint reserved2;
+};
+
+layout(set=0, binding=5, std430) buffer statisticsBuffer
+{
+    CullingStatistics statistics[];
+};
+
+// farthest depth of the texels below, mip 0 has one texel per 2x2 pixels and each mip halves it (rounding up)
+// depthPyramid holds the last complete depth: the previous frame's in the depth passes, this frame's in the G-buffer pass
+layout(set=0, binding=6) uniform sampler2D depthPyramid;
+layout(set=0, binding=7) uniform sampler2D earlyDepthPyramid;
+
+// task groups of the instances of every mesh, instance << 16 | task group
+layout(set=0, binding=8, std430) readonly buffer visibleTaskGroupBuffer
+{
+    uint visibleTaskGroups[];
+};
+
+#if defined(COMPUTE_RASTERIZER)
+const uint maxMeshCount = 256;                      // MeshShadingRenderLoop.h
+const uint maxComputeRasterPayloadCount = 1 << 15;  // MeshShadingRenderLoop.h
+const uint maxComputeRasterTileCount = 1 << 20;
+const uint maxTaskGroupsPerDispatch = 0xffff;       // rows of the task group dispatch (cull_task_groups.glsl)
+const uint tilesPerDispatchRow = 256;               // rows of the tile dispatch
+const uint noPayload = 0xffffffff;
+
+// the visible task group count of each mesh (cull_task_groups.glsl)
+layout(set=0, binding=11, std430) readonly buffer drawBuffer
+{
+    uint visibleTaskGroupCounts[maxMeshCount];
+};
+
+// ComputeRasterCounters in MeshShadingRenderLoop.h, one per mesh, zeroed before each pass
+struct ComputeRasterCounters
+{
+    uint payloadCount;
+    uint tileAllocation;
+    uint tileCount;       // the tiles written, always the first ones allocated
+    uint tileDispatchX;   // VkDispatchIndirectCommand of test_ms.glsl
+    uint tileDispatchY;
+    uint tileDispatchZ;
+    uint reserved0;
+    uint reserved1;
+};
+
+layout(set=0, binding=12, std430) buffer computeRasterWorkBuffer
+{
+    ComputeRasterCounters counters[maxMeshCount];
+    Task                  payloads[maxComputeRasterPayloadCount];
+    uint                  tiles[]; // payload << 14 | mesh shader workgroup of the task group (up to 64x16x16 with 4x4 quad tiles)
+};
+#endif
+
+const uint depthPyramidLevelCount = 12;
+
+// CullingPass in MeshShadingRenderLoop.h
+const uint CullingPass_EarlyDepth = 0;
+const uint CullingPass_LateDepth = 1;
+const uint CullingPass_Gbuffer = 2;
+const uint CullingPass_Count = 3;
+
+layout(set=1, binding=3, std430) readonly buffer megatileBuffer
+{
+    uint         megatileMipOffsets[16];
+    MegatileInfo megatileInfos[];
+};
+
+// pool page of every megatile, 0xffffffff when it is not resident
+layout(set=1, binding=4, std430) readonly buffer pageTableBuffer
+{
+    uint pageTable[];
+};
 
-uint packMegatile(ivec3 megatile)
+// the megatiles this frame would like resident are stamped with the frame number, the CPU reads them back a few frames later
+layout(set=1, binding=5, std430) writeonly buffer requestBuffer
+{
+    uint requests[];
+};
+
+const uint invalidPage = 0xffffffff;
+
+uint packMegatile(uvec4 megatile)
 {
     // assuming a max texture size of 64k, we would need:
     // * 4 bits for mip
     // * 10 bits per axis (1024 megatiles of 64 quads)
-    // for hex reading convenience, let's pack 12-12-8
-    return (megatile.x << 20) | (megatile.y << 8) | megatile.z;
+    // for hex reading convenience, let's pack 12-12-8 (the unit shift in the high 4 bits of the 8)
+    return (megatile.x << 20) | (megatile.y << 8) | (megatile.w << 4) | megatile.z;
+}
+
+// where a mip 0 megatile of the task group (-1 to 8 on each axis, relative to its first) is in s_mips and aroundMips
+uint aroundIndex(ivec2 around)
+{
+    return (around.y + 1) * 10 + around.x + 1;
+}
+
+uint megatilesPerRow(uint mip)
+{
+    uint mipSize = max((taskGroupsPerRow * 512) >> mip, 1);
+    return (mipSize + 63) >> 6;
+}
+
+uint megatileIndex(uvec2 megatile, uint mip)
+{
+    return megatileMipOffsets[mip] + megatile.y * megatilesPerRow(mip) + megatile.x;
 }
 
-void exportMegatile(uint index, ivec2 base, uint mip)
+// GeometryImageParameterization in GeometryImageFile.h
+const uint Parameterization_Octahedral = 0;
+const uint Parameterization_Spherical = 1;
+const uint Parameterization_Periodic = 2;
+
+// a mip 0 megatile at most one megatile out of the image on one axis stands for the megatile of the image the parameterization folds
+// its edge onto, so that megatiles stitch across the folds as they do inside (GetGeometryImageFoldedMegatile in GeometryImageFile.h):
+// itself in the image, false past a corner or a pole row (single vertices, nothing to stitch)
+bool foldedMegatile(ivec2 megatile, out uvec2 folded)
 {
-    OUT.megatile[index] = packMegatile(ivec3(ivec2(index >> 3, index & 0x7) + base, mip));
+    int   last = int(megatilesPerRow(0)) - 1;
+    bvec2 outside = bvec2(megatile.x < 0 || megatile.x > last, megatile.y < 0 || megatile.y > last);
+    folded = uvec2(max(megatile, ivec2(0)));
+    if (outside.x == outside.y)
+    {
+        return !outside.x;
+    }
+    if (parameterization == Parameterization_Spherical)
+    {
+        // the last column is the first one
+        folded.x = megatile.x < 0 ? last : 0;
+        return outside.x;
+    }
+    if (parameterization == Parameterization_Periodic)
+    {
+        // the last column is the first one, the last row too
+        folded = uvec2(megatile.x < 0 ? last : megatile.x > last ? 0 : megatile.x, megatile.y < 0 ? last : megatile.y > last ? 0 : megatile.y);
+        return true;
+    }
+
+    // octahedral: (x, 0) is (size - x, 0) and (0, y) is (0, size - y), same for the last row and column
+    folded = outside.y ? uvec2(last - megatile.x, megatile.y < 0 ? 0 : last) : uvec2(megatile.x < 0 ? 0 : last, last - megatile.y);
+    return true;
+}
+
+// the vertices on the right and bottom edges of a megatile are read from its neighbours, which must be resident too
+void requestMegatile(uvec2 megatile, uint mip)
+{
+    uvec2 last = min(megatile + 1, uvec2(megatilesPerRow(mip) - 1));
+    requests[requestOffset + megatileIndex(megatile, mip)] = requestFrame;
+    requests[requestOffset + megatileIndex(uvec2(last.x, megatile.y), mip)] = requestFrame;
+    requests[requestOffset + megatileIndex(uvec2(megatile.x, last.y), mip)] = requestFrame;
+    requests[requestOffset + megatileIndex(last, mip)] = requestFrame;
+}
+
+bool isResident(uvec2 megatile, uint mip)
+{
+    uvec2 last = min(megatile + 1, uvec2(megatilesPerRow(mip) - 1));
+    return pageTable[megatileIndex(megatile, mip)] != invalidPage
+        && pageTable[megatileIndex(uvec2(last.x, megatile.y), mip)] != invalidPage
+        && pageTable[megatileIndex(uvec2(megatile.x, last.y), mip)] != invalidPage
+        && pageTable[megatileIndex(last, mip)] != invalidPage;
+}
+
+// object space homogeneous point where the x, y and w rows of the projection vanish: the camera, or the direction it looks from
+// a triangle (a, b, c) is rasterized by the mesh shader when dot(cross(b - a, c - a), camera.xyz - camera.w * a) > 0, whatever the
+// transforms (the sign of the screen space determinant of its vertices)
+vec4 cameraPosition(mat4 objectToClip)
+{
+    vec4 x = objectToClip[0];
+    vec4 y = objectToClip[1];
+    vec4 w = objectToClip[3];
+    return vec4( determinant(mat3(x.yzw, y.yzw, w.yzw)),
+                -determinant(mat3(x.xzw, y.xzw, w.xzw)),
+                 determinant(mat3(x.xyw, y.xyw, w.xyw)),
+                -determinant(mat3(x.xyz, y.xyz, w.xyz)));
+}
+
+// true when the box is entirely out of one of the clip planes
+// crossesNearPlane tells part of it is in front of the near plane, where the mesh shader hands triangles over to the rasterizer
+bool isOutsideFrustum(MegatileInfo info, mat4 objectToClip, out bool crossesNearPlane)
+{
+    uint outsidePlanes = 0x3f;
+    crossesNearPlane = false;
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        vec3 objectPosition = mix(info.boundsMin.xyz, info.boundsMax.xyz, vec3(corner & 1, (corner >> 1) & 1, corner >> 2));
+        vec4 clipPosition = vec4(objectPosition, 1) * objectToClip;
+        outsidePlanes &= (clipPosition.x < -clipPosition.w ? 0x01 : 0) | (clipPosition.x > clipPosition.w ? 0x02 : 0)
+                       | (clipPosition.y < -clipPosition.w ? 0x04 : 0) | (clipPosition.y > clipPosition.w ? 0x08 : 0)
+                       | (clipPosition.z < 0 ? 0x10 : 0) | (clipPosition.z > clipPosition.w ? 0x20 : 0);
+#if REVERSED_Z
+        crossesNearPlane = crossesNearPlane || clipPosition.z > clipPosition.w || clipPosition.w <= 0;
+#else
+        crossesNearPlane = crossesNearPlane || clipPosition.z < 0 || clipPosition.w <= 0;
+#endif
+    }
+    return outsidePlanes != 0;
+}
+
+// true when every triangle of the megatile faces away from the camera, from anywhere in its bounding sphere
+bool isBackfacing(MegatileInfo info, vec4 camera)
+{
+    float cutoff = info.normalCone.w;
+    if (cutoff <= 0)
+    {
+        // the normals span a hemisphere
+        return false;
+    }
+
+    // the triangle normals are within acos(cutoff) of the axis: all face away when the camera is more than 90 degrees
+    // plus that angle off the axis, seen from any point of the sphere
+    vec3  toCamera = camera.xyz - camera.w * info.boundingSphere.xyz;
+    float spread = abs(camera.w) * info.boundingSphere.w;
+    float sine = sqrt(1 - cutoff * cutoff);
+    return dot(info.normalCone.xyz, toCamera) + spread <= -sine * (length(toCamera) + spread);
+}
+
+// pixels (min and max, inclusive) and nearest depth of a box that is entirely past the near plane
+void projectBox(MegatileInfo info, mat4 objectToClip, out uvec4 pixels, out float nearestDepth)
+{
+    vec2 boundsMin = vec2(1e30);
+    vec2 boundsMax = vec2(-1e30);
+    nearestDepth = REVERSED_Z != 0 ? -1e30 : 1e30;
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        vec3 objectPosition = mix(info.boundsMin.xyz, info.boundsMax.xyz, vec3(corner & 1, (corner >> 1) & 1, corner >> 2));
+        vec4 clipPosition = vec4(objectPosition, 1) * objectToClip;
+        boundsMin = min(boundsMin, clipPosition.xy / clipPosition.w);
+        boundsMax = max(boundsMax, clipPosition.xy / clipPosition.w);
+#if REVERSED_Z
+        nearestDepth = max(nearestDepth, clipPosition.z / clipPosition.w);
+#else
+        nearestDepth = min(nearestDepth, clipPosition.z / clipPosition.w);
+#endif
+    }
+
+    // x / w, y / w and z / w are extreme at the corners of the box, clamped to the viewport
+    vec2 pixelsMin = (max(boundsMin, vec2(-1)) * 0.5 + 0.5) * viewportSize.xy;
+    vec2 pixelsMax = (min(boundsMax, vec2(1)) * 0.5 + 0.5) * viewportSize.xy;
+    pixels = uvec4(min(uvec4(pixelsMin, pixelsMax), uvec4(viewportSize.xyxy) - 1));
+}
+
+// true when the box is behind the farthest depth of every pixel it covers
+bool isOccluded(uvec4 pixels, float nearestDepth, sampler2D pyramid)
+{
+    // the finest level where the pixels span at most 2x2 texels (of 2 << level pixels)
+    uint extent = max(pixels.z - pixels.x, pixels.w - pixels.y);
+    int  level = min(extent > 1 ? findMSB(extent - 1) : 0, int(depthPyramidLevelCount) - 1);
+
+    uvec4 texels = pixels >> (level + 1);
+#if REVERSED_Z
+    float farthestDepth = min(min(texelFetch(pyramid, ivec2(texels.xy), level).x, texelFetch(pyramid, ivec2(texels.zy), level).x),
+                              min(texelFetch(pyramid, ivec2(texels.xw), level).x, texelFetch(pyramid, ivec2(texels.zw), level).x));
+    return nearestDepth < farthestDepth;
+#else
+    float farthestDepth = max(max(texelFetch(pyramid, ivec2(texels.xy), level).x, texelFetch(pyramid, ivec2(texels.zy), level).x),
+                              max(texelFetch(pyramid, ivec2(texels.xw), level).x, texelFetch(pyramid, ivec2(texels.zw), level).x));
+    return nearestDepth > farthestDepth;
+#endif
+}
+
+// largest side of the box on screen, in pixels (unclamped: quads off screen do not get bigger for it)
+float projectedPixels(MegatileInfo info, mat4 objectToClip)
+{
+    vec2 boundsMin = vec2(1e30);
+    vec2 boundsMax = vec2(-1e30);
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        vec3 objectPosition = mix(info.boundsMin.xyz, info.boundsMax.xyz, vec3(corner & 1, (corner >> 1) & 1, corner >> 2));
+        vec4 clipPosition = vec4(objectPosition, 1) * objectToClip;
+        if (clipPosition.w <= 0)
+        {
+            // crosses the camera plane, as close as it gets
+            return 1e30;
+        }
+        boundsMin = min(boundsMin, clipPosition.xy / clipPosition.w);
+        boundsMax = max(boundsMax, clipPosition.xy / clipPosition.w);
+    }
+
+    vec2 pixels = (boundsMax - boundsMin) * 0.5 * viewportSize.xy;
+    return max(pixels.x, pixels.y);
+}
+
+// coarsest mip whose quads are at most lodPixelError pixels on screen around a mip 0 megatile, going down the megatiles of each mip
+// containing it: the mip 0 megatiles of a megatile of the chosen mip share every megatile looked at, so they all make the same choice
+uint lodMip(uvec2 megatile, mat4 objectToClip)
+{
+    for (uint mip = mipCount - 1; mip > 0; --mip)
+    {
+        MegatileInfo info = megatileInfos[megatileIndex(megatile >> mip, mip)];
+        uint quadsPerRow = min(max((taskGroupsPerRow * 512) >> mip, 1), 64);
+        if (projectedPixels(info, objectToClip) <= lodPixelError * quadsPerRow)
+        {
+            return mip;
+        }
+    }
+    return 0;
+}
+
+// mip a mip 0 megatile is drawn at: what its screen-space error calls for, or the next resident one (the mips of a single megatile
+// always are)
+uint drawnMip(uvec2 megatile, uint lod)
+{
+    uint mip = lod;
+    while (mip + 1 < mipCount && !isResident(megatile >> mip, mip))
+    {
+        ++mip;
+    }
+    return mip;
 }
 
 void main()
 {
-    ivec2 base = ivec2(gl_WorkGroupID.x & 0xf, gl_WorkGroupID.x >> 4) * 8;
+#if defined(COMPUTE_RASTERIZER)
+    // dispatched in rows of maxTaskGroupsPerDispatch, the last one partly used
+    uint taskGroup = gl_WorkGroupID.y * maxTaskGroupsPerDispatch + gl_WorkGroupID.x;
+    if (taskGroup >= visibleTaskGroupCounts[meshId])
+    {
+        return;
+    }
+#else
+    uint taskGroup = gl_WorkGroupID.x;
+#endif
+
+    uint  visibleTaskGroup = visibleTaskGroups[firstVisibleTaskGroup + taskGroup];
+    uint  group = visibleTaskGroup & 0xffff;
+    uvec2 base = uvec2(group % taskGroupsPerRow, group / taskGroupsPerRow) * 8;
+    mat3x4 modelToWorldMatrix = instances[visibleTaskGroup >> 16].modelToWorldMatrix;
+
+    // culling happens in object space: clip = vec4(objectPosition, 1) * objectToClip
+    mat4 objectToClip;
+    for (uint row = 0; row < 4; ++row)
+    {
+        objectToClip[row] = projectionMatrix[row].x * modelToWorldMatrix[0] + projectionMatrix[row].y * modelToWorldMatrix[1]
+                          + projectionMatrix[row].z * modelToWorldMatrix[2] + vec4(0, 0, 0, projectionMatrix[row].w);
+    }
+    vec4 camera = cameraPosition(objectToClip);
+
+    uint lods[2];
+    uint mips[2];
+    for (uint i = 0; i < 2; ++i)
+    {
+        uint  local = i * 32 + gl_LocalInvocationID.x;
+        uvec2 megatile = base + uvec2(local >> 3, local & 0x7);
+
+        lods[i] = lodMip(megatile, objectToClip);
+        mips[i] = drawnMip(megatile, lods[i]);
+        s_mips[aroundIndex(ivec2(local >> 3, local & 0x7))] = mips[i];
+    }
+
+    // the ring of neighbours makes the same choices as the task groups drawing them, out of the image those of the megatiles across
+    // the folds
     for (uint i = 0; i < 2; ++i)
     {
-        exportMegatile(i * 32 + gl_LocalInvocationID.x, base, 0);
+        uint ring = i * 32 + gl_LocalInvocationID.x;
+        if (ring < 36)
+        {
+            ivec2 around = ring < 10 ? ivec2(ring - 1, -1) : ring < 20 ? ivec2(ring - 11, 8)
+                         : ring < 28 ? ivec2(-1, ring - 20) : ivec2(8, ring - 28);
+            uvec2 megatile;
+            bool  folded = foldedMegatile(ivec2(base) + around, megatile);
+            s_mips[aroundIndex(around)] = folded ? drawnMip(megatile, lodMip(megatile, objectToClip)) : 0;
+        }
     }
 
+#if defined(COMPUTE_RASTERIZER)
     if (gl_LocalInvocationID.x == 0)
     {
-        OUT.modelToWorldMatrix = mat3x4(1, 0, 0, -0.5,
-                                        0, 1, 0, -0.5,
-                                        0, 0, 1, 0);
-        gl_TaskCountNV = 64 * 64;
+        s_counts = 0;
+        s_cullingCounts = 0;
+        s_culledTaskCount = 0;
+    }
+#endif
+
+    memoryBarrierShared();
+    barrier();
+
+    if (gl_LocalInvocationID.x < 13)
+    {
+        uint packedMips = 0;
+        for (uint j = 0; j < 8 && gl_LocalInvocationID.x * 8 + j < 100; ++j)
+        {
+            packedMips |= s_mips[gl_LocalInvocationID.x * 8 + j] << (j * 4);
+        }
+        OUT.aroundMips[gl_LocalInvocationID.x] = packedMips;
+    }
+
+    uint megatileCount = 0;
+    uint taskCount = 0;
+    uint testedCount = 0;
+    uint frustumCulledCount = 0;
+    uint backfaceCulledCount = 0;
+    uint occlusionCulledCount = 0;
+    uint culledTaskCount = 0;
+    for (uint i = 0; i < 2; ++i)
+    {
+        uint  local = i * 32 + gl_LocalInvocationID.x;
+        uvec2 megatile = base + uvec2(local >> 3, local & 0x7);
+        uint  mip = mips[i];
+
+        // units only merge megatiles that all draw at the mip (they may not when some are waiting for their mip to stream in)
+        uint  unitShift = uint(clamp(int(mip) - 3, 0, 3));
+        uint  unitSize = 1u << unitShift;
+        uvec2 unitFirst = uvec2(local >> 3, local & 0x7) & ~(unitSize - 1);
+        bool  uniformUnit = true;
+        for (uint x = 0; x < unitSize; ++x)
+        {
+            for (uint y = 0; y < unitSize; ++y)
+            {
+                uniformUnit = uniformUnit && s_mips[aroundIndex(ivec2(unitFirst + uvec2(x, y)))] == mip;
+            }
+        }
+        unitShift = uniformUnit ? unitShift : 0;
+
+        // the first megatile of a unit draws it, past mip 6 + u a unit is less than a texel: the first of the units sharing that
+        // texel draws its quad
+        uint regionSize = (64u << unitShift) >> mip;
+        uint firstMask = (1u << max(unitShift, uint(max(int(mip) - 6, 0)))) - 1;
+        bool tested = all(equal(megatile & firstMask, uvec2(0)));
+        uint tilesPerRow = max(regionSize / TILE_SIZE, 1);
+
+        // the bounds of the megatile of the drawn mip cover every vertex its units read
+        MegatileInfo info = megatileInfos[megatileIndex(megatile >> mip, mip)];
+        bool crossesNearPlane;
+        bool frustumCulled = isOutsideFrustum(info, objectToClip, crossesNearPlane);
+        bool backfaceCulled = !frustumCulled && !crossesNearPlane && isBackfacing(info, camera);
+        bool visible = !frustumCulled && !backfaceCulled;
+
+        // the pyramids are built from the pixels drawn in the viewport, boxes crossing the near plane are never occluded
+        // the late depth pass only considers what the early one found occluded, the early and late decisions agree as both test the
+        // same bounds against the same pyramid
+        bool occluded = false;
+        bool occlusionCulled = false;
+        if (occlusionCulling != 0 && visible && !crossesNearPlane)
+        {
+            uvec4 pixels;
+            float nearestDepth;
+            projectBox(info, objectToClip, pixels, nearestDepth);
+            occluded = isOccluded(pixels, nearestDepth, depthPyramid);
+            occlusionCulled = occluded && (cullingPass != CullingPass_LateDepth || isOccluded(pixels, nearestDepth, earlyDepthPyramid));
+        }
+        bool passVisible = visible && !occlusionCulled && (cullingPass != CullingPass_LateDepth || occluded);
+        bool considered = tested && (cullingPass != CullingPass_LateDepth || (visible && occluded));
+        bool draws = tested && passVisible;
+        uint tasks = draws ? tilesPerRow * tilesPerRow : 0;
+
+        // the depth passes request the mip the megatiles they draw would like, occluded ones wait until they show up
+        if (cullingPass != CullingPass_Gbuffer && passVisible)
+        {
+            requestMegatile(megatile >> lods[i], lods[i]);
+        }
+
+#if defined(COMPUTE_RASTERIZER)
+        if (considered)
+        {
+            atomicAdd(s_cullingCounts, 1 | (frustumCulled ? 1 << 8 : 0) | (backfaceCulled ? 1 << 16 : 0) | (occlusionCulled ? 1 << 24 : 0));
+            if (!draws)
+            {
+                atomicAdd(s_culledTaskCount, tilesPerRow * tilesPerRow);
+            }
+        }
+        if (draws)
+        {
+            // the units come in any order, their first tasks still increase with their index
+            uint counts = atomicAdd(s_counts, 1 | (tasks << 8));
+            OUT.megatile[counts & 0xff] = packMegatile(uvec4(megatile, mip, unitShift));
+            OUT.firstTask[counts & 0xff] = counts >> 8;
+        }
+#else
+        testedCount += subgroupBallotBitCount(subgroupBallot(considered));
+        frustumCulledCount += subgroupBallotBitCount(subgroupBallot(considered && frustumCulled));
+        backfaceCulledCount += subgroupBallotBitCount(subgroupBallot(considered && backfaceCulled));
+        occlusionCulledCount += subgroupBallotBitCount(subgroupBallot(considered && occlusionCulled));
+        culledTaskCount += subgroupAdd(considered && !draws ? tilesPerRow * tilesPerRow : 0);
+
+        uvec4 vote = subgroupBallot(draws);
+        uint  index = megatileCount + subgroupBallotExclusiveBitCount(vote);
+        uint  firstTask = taskCount + subgroupExclusiveAdd(tasks);
+        if (draws)
+        {
+            OUT.megatile[index] = packMegatile(uvec4(megatile, mip, unitShift));
+            OUT.firstTask[index] = firstTask;
+        }
+
+        megatileCount += subgroupBallotBitCount(vote);
+        taskCount += subgroupAdd(tasks);
+#endif
+    }
+
+#if defined(COMPUTE_RASTERIZER)
+    memoryBarrierShared();
+    barrier();
+
+    megatileCount = s_counts & 0xff;
+    taskCount = s_counts >> 8;
+    testedCount = s_cullingCounts & 0xff;
+    frustumCulledCount = (s_cullingCounts >> 8) & 0xff;
+    backfaceCulledCount = (s_cullingCounts >> 16) & 0xff;
+    occlusionCulledCount = s_cullingCounts >> 24;
+    culledTaskCount = s_culledTaskCount;
+#endif
+
+    if (gl_LocalInvocationID.x == 0)
+    {
+        OUT.modelToWorldMatrix = modelToWorldMatrix;
+        OUT.megatileCount = megatileCount;
+        OUT.instance = visibleTaskGroup >> 16;
+
+        uint slot = statisticsSlot * CullingPass_Count + cullingPass;
+        atomicAdd(statistics[slot].megatilesTested, testedCount);
+        atomicAdd(statistics[slot].megatilesFrustumCulled, frustumCulledCount);
+        atomicAdd(statistics[slot].megatilesBackfaceCulled, backfaceCulledCount);
+        atomicAdd(statistics[slot].megatilesOcclusionCulled, occlusionCulledCount);
+        atomicAdd(statistics[slot].tilesLaunched, taskCount);
+        atomicAdd(statistics[slot].tilesCulled, culledTaskCount);
+#if defined(COMPUTE_RASTERIZER)
+        // the tiles written are always the first ones allocated (once one does not fit, none of the later ones do), so the tile
+        // count and dispatch stay exact when the buffer overflows
+        s_payload = noPayload;
+        if (taskCount > 0)
+        {
+            uint payload = atomicAdd(counters[meshId].payloadCount, 1);
+            uint firstTile = payload < maxComputeRasterPayloadCount ? atomicAdd(counters[meshId].tileAllocation, taskCount) : maxComputeRasterTileCount;
+            uint tileCount = firstTile + taskCount;
+            if (tileCount <= maxComputeRasterTileCount)
+            {
+                atomicMax(counters[meshId].tileCount, tileCount);
+                atomicMax(counters[meshId].tileDispatchX, min(tileCount, tilesPerDispatchRow));
+                atomicMax(counters[meshId].tileDispatchY, (tileCount + tilesPerDispatchRow - 1) / tilesPerDispatchRow);
+                atomicMax(counters[meshId].tileDispatchZ, 1);
+                s_payload = payload;
+                s_firstTile = firstTile;
+            }
+        }
+#else
+        gl_TaskCountNV = taskCount;
+#endif
+    }
+
+#if defined(COMPUTE_RASTERIZER)
+    memoryBarrierShared();
+    barrier();
+
+    if (s_payload == noPayload)
+    {
+        return;
+    }
+
+    for (uint i = gl_LocalInvocationID.x; i < 64; i += 32)
+    {
+        payloads[s_payload].megatile[i] = s_task.megatile[i];
+        payloads[s_payload].firstTask[i] = s_task.firstTask[i];
+    }
+    if (gl_LocalInvocationID.x < 13)
+    {
+        payloads[s_payload].aroundMips[gl_LocalInvocationID.x] = s_task.aroundMips[gl_LocalInvocationID.x];
+    }
+    if (gl_LocalInvocationID.x == 0)
+    {
+        payloads[s_payload].modelToWorldMatrix = s_task.modelToWorldMatrix;
+        payloads[s_payload].megatileCount = s_task.megatileCount;
+        payloads[s_payload].instance = s_task.instance;
+    }
+
+    for (uint task = gl_LocalInvocationID.x; task < taskCount; task += 32)
+    {
+        tiles[s_firstTile + task] = (s_payload << 14) | task;
     }
+#endif
 }
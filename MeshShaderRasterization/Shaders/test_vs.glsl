@@ -0,0 +1,48 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : require
+
+// draws the triangles the compute rasterizer exported (test_ms.glsl with COMPUTE_RASTERIZER): the vertices are pulled from the
+// geometry buffer, already in clip space, by the index the indexed draw gives
+
+// ComputeRasterVertex in MeshShadingRenderLoop.h
+struct ComputeRasterVertex
+{
+    vec4 position;
+    uint albedo;    // packUnorm4x8
+    uint normal;    // packSnorm4x8
+    uint reserved0;
+    uint reserved1;
+};
+
+const uint maxComputeRasterVertexCount = 81 * (1 << 14); // maxComputeRasterExportTileCount in MeshShadingRenderLoop.h
+
+layout(set=0, binding=13, std430) readonly buffer computeRasterGeometryBuffer
+{
+    uint                drawIndexedIndirectCommand[5];
+    uint                vertexAllocation;
+    uint                indexAllocation;
+    uint                reserved;
+    ComputeRasterVertex vertices[maxComputeRasterVertexCount];
+};
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+#if defined(GBUFFER_PASS)
+layout(location=0) out Interpolant
+{
+    vec3 albedo;
+    vec3 normal;
+} OUT;
+#endif
+
+void main()
+{
+    gl_Position = vertices[gl_VertexIndex].position;
+#if defined(GBUFFER_PASS)
+    OUT.albedo = unpackUnorm4x8(vertices[gl_VertexIndex].albedo).xyz;
+    OUT.normal = unpackSnorm4x8(vertices[gl_VertexIndex].normal).xyz;
+#endif
+}
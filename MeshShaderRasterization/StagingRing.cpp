@@ -0,0 +1,225 @@
+#include "StagingRing.h"
+
+StagingRing::StagingRing()
+	: m_device(VK_NULL_HANDLE)
+	, m_queue(VK_NULL_HANDLE)
+	, m_allocator(VK_NULL_HANDLE)
+	, m_buffer(VK_NULL_HANDLE)
+	, m_allocation(VK_NULL_HANDLE)
+	, m_mappedData(nullptr)
+	, m_commandPool(VK_NULL_HANDLE)
+	, m_slotSize(0)
+	, m_slotUsed(0)
+	, m_currentSlot(0)
+	, m_recording(false)
+{
+}
+
+StagingRing::~StagingRing()
+{
+	Uninitialize();
+}
+
+auto StagingRing::Initialize(InstanceDeviceAndSwapchain const& device, VkDeviceSize slotSize, uint32_t slotCount) -> bool
+{
+	VkResult result;
+
+	m_device = device.GetDevice();
+	m_queue = device.GetQueue();
+	m_allocator = device.GetAllocator();
+	m_slotSize = slotSize;
+
+	{
+		VmaAllocationCreateInfo allocationCreateInfo;
+		allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		allocationCreateInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+		allocationCreateInfo.requiredFlags = 0;
+		allocationCreateInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT; // callers may read back what they wrote (e.g. to build mips)
+		allocationCreateInfo.memoryTypeBits = 0;
+		allocationCreateInfo.pool = VK_NULL_HANDLE;
+		allocationCreateInfo.pUserData = nullptr;
+
+		VkBufferCreateInfo bufferCreateInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+		bufferCreateInfo.flags = 0;
+		bufferCreateInfo.size = slotSize * slotCount;
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = 0;
+		bufferCreateInfo.pQueueFamilyIndices = nullptr;
+
+		VmaAllocationInfo allocationInfo;
+		result = vmaCreateBuffer(m_allocator, &bufferCreateInfo, &allocationCreateInfo, &m_buffer, &m_allocation, &allocationInfo);
+		CHECK_ERROR_AND_RETURN("could not create staging ring buffer");
+
+		m_mappedData = (uint8_t*)allocationInfo.pMappedData;
+	}
+
+	{
+		VkCommandPoolCreateInfo commandPoolCreateInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		commandPoolCreateInfo.queueFamilyIndex = device.GetQueueFamily();
+		result = vkCreateCommandPool(m_device, &commandPoolCreateInfo, nullptr, &m_commandPool);
+		CHECK_ERROR_AND_RETURN("could not create staging ring command pool");
+
+		m_slots.resize(slotCount);
+		for (Slot& slot : m_slots)
+		{
+			VkCommandBufferAllocateInfo commandBufferAllocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+			commandBufferAllocateInfo.commandPool = m_commandPool;
+			commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			commandBufferAllocateInfo.commandBufferCount = 1;
+			result = vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, &slot.m_commandBuffer);
+			CHECK_ERROR_AND_RETURN("could not allocate staging ring command buffer");
+
+			VkFenceCreateInfo fenceCreateInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+			fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+			result = vkCreateFence(m_device, &fenceCreateInfo, nullptr, &slot.m_copiesCompleted);
+			CHECK_ERROR_AND_RETURN("could not create staging ring fence");
+		}
+	}
+
+	m_currentSlot = 0;
+	m_slotUsed = 0;
+	m_recording = false;
+
+	return true;
+}
+
+auto StagingRing::Uninitialize() -> void
+{
+	if (m_device == VK_NULL_HANDLE)
+		return;
+
+	Flush();
+
+	for (Slot& slot : m_slots)
+		vkDestroyFence(m_device, slot.m_copiesCompleted, nullptr);
+	m_slots.clear();
+
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+	vmaDestroyBuffer(m_allocator, m_buffer, m_allocation);
+
+	m_commandPool = VK_NULL_HANDLE;
+	m_buffer = VK_NULL_HANDLE;
+	m_allocation = VK_NULL_HANDLE;
+	m_mappedData = nullptr;
+	m_device = VK_NULL_HANDLE;
+}
+
+auto StagingRing::Allocate(VkDeviceSize size, VkDeviceSize& bufferOffset) -> void*
+{
+	// keep every allocation aligned for buffer to image copies of any texel size
+	const VkDeviceSize alignment = 16;
+
+	if (size > m_slotSize)
+	{
+		std::cerr << "staging ring allocation of " << size << " bytes does not fit in a " << m_slotSize << " bytes slot" << std::endl;
+		return nullptr;
+	}
+
+	VkDeviceSize offset = (m_slotUsed + alignment - 1) & ~(alignment - 1);
+	if (offset + size > m_slotSize)
+	{
+		if (!SubmitSlot())
+			return nullptr;
+		offset = 0;
+	}
+
+	if (!m_recording && !BeginSlot())
+		return nullptr;
+
+	m_slotUsed = offset + size;
+	bufferOffset = m_currentSlot * m_slotSize + offset;
+	return m_mappedData + bufferOffset;
+}
+
+auto StagingRing::Submit() -> bool
+{
+	return SubmitSlot();
+}
+
+auto StagingRing::Flush() -> bool
+{
+	VkResult result;
+
+	if (m_recording && !SubmitSlot())
+		return false;
+
+	for (Slot& slot : m_slots)
+	{
+		result = vkWaitForFences(m_device, 1, &slot.m_copiesCompleted, VK_TRUE, UINT64_MAX);
+		CHECK_ERROR_AND_RETURN("could not wait for staging ring fence");
+	}
+
+	return true;
+}
+
+auto StagingRing::GetCommandBuffer() -> VkCommandBuffer
+{
+	if (!m_recording && !BeginSlot())
+		return VK_NULL_HANDLE;
+
+	return m_slots[m_currentSlot].m_commandBuffer;
+}
+
+auto StagingRing::BeginSlot() -> bool
+{
+	VkResult result;
+
+	Slot& slot = m_slots[m_currentSlot];
+
+	// the GPU may still be copying out of this slot from its previous use
+	result = vkWaitForFences(m_device, 1, &slot.m_copiesCompleted, VK_TRUE, UINT64_MAX);
+	CHECK_ERROR_AND_RETURN("could not wait for staging ring fence");
+	result = vkResetFences(m_device, 1, &slot.m_copiesCompleted);
+	CHECK_ERROR_AND_RETURN("could not reset staging ring fence");
+
+	result = vkResetCommandBuffer(slot.m_commandBuffer, 0);
+	CHECK_ERROR_AND_RETURN("could not reset staging ring command buffer");
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = nullptr;
+	result = vkBeginCommandBuffer(slot.m_commandBuffer, &commandBufferBeginInfo);
+	CHECK_ERROR_AND_RETURN("could not begin staging ring command buffer");
+
+	m_slotUsed = 0;
+	m_recording = true;
+
+	return true;
+}
+
+auto StagingRing::SubmitSlot() -> bool
+{
+	VkResult result;
+
+	if (!m_recording)
+		return true;
+
+	Slot& slot = m_slots[m_currentSlot];
+
+	// no-op on host coherent memory
+	vmaFlushAllocation(m_allocator, m_allocation, m_currentSlot * m_slotSize, m_slotUsed);
+
+	result = vkEndCommandBuffer(slot.m_commandBuffer);
+	CHECK_ERROR_AND_RETURN("could not end staging ring command buffer");
+
+	VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+	submitInfo.waitSemaphoreCount = 0;
+	submitInfo.pWaitSemaphores = nullptr;
+	submitInfo.pWaitDstStageMask = nullptr;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &slot.m_commandBuffer;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.pSignalSemaphores = nullptr;
+	result = vkQueueSubmit(m_queue, 1, &submitInfo, slot.m_copiesCompleted);
+	CHECK_ERROR_AND_RETURN("could not submit staging ring slot");
+
+	m_recording = false;
+	m_slotUsed = 0;
+	++m_currentSlot;
+	if (m_currentSlot >= m_slots.size())
+		m_currentSlot = 0;
+
+	return true;
+}
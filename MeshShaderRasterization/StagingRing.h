@@ -0,0 +1,57 @@
+#pragma once
+
+#include "InstanceDeviceAndSwapchain.h"
+
+// fixed size, persistently mapped staging memory used to stream data to the GPU
+// the ring is split in slots, each with its own command buffer and fence: while the GPU copies out of the
+// submitted slots the CPU fills the next one, and a slot is only reused once its fence has signaled
+class StagingRing
+{
+public:
+	StagingRing();
+	~StagingRing();
+
+	auto Initialize(InstanceDeviceAndSwapchain const& device, VkDeviceSize slotSize, uint32_t slotCount) -> bool;
+	auto Uninitialize() -> void;
+
+	// returns size bytes of mapped memory in the current slot (bufferOffset is its offset in GetBuffer())
+	// if the slot is full it is submitted and the next one is waited for
+	// copies reading the returned memory must be recorded in GetCommandBuffer() before the next call
+	auto Allocate(VkDeviceSize size, VkDeviceSize& bufferOffset) -> void*;
+
+	// submits the current slot if anything was recorded, without waiting (uploads recorded while rendering frames)
+	auto Submit() -> bool;
+	// submits the current slot if anything was recorded and waits until the GPU is done with every slot
+	auto Flush() -> bool;
+
+	auto GetBuffer() const -> VkBuffer const& { return m_buffer; }
+	// the recording command buffer of the current slot, beginning it if needed (VK_NULL_HANDLE if that failed)
+	auto GetCommandBuffer() -> VkCommandBuffer;
+	auto GetSlotSize() const -> VkDeviceSize { return m_slotSize; }
+	auto GetSize() const -> VkDeviceSize { return m_slotSize * m_slots.size(); }
+
+private:
+	auto BeginSlot() -> bool;
+	auto SubmitSlot() -> bool;
+
+	struct Slot
+	{
+		VkCommandBuffer m_commandBuffer;
+		VkFence m_copiesCompleted;
+	};
+
+	VkDevice m_device;
+	VkQueue m_queue;
+	VmaAllocator m_allocator;
+
+	VkBuffer m_buffer; VmaAllocation m_allocation;
+	uint8_t* m_mappedData;
+
+	VkCommandPool m_commandPool;
+	std::vector<Slot> m_slots;
+
+	VkDeviceSize m_slotSize;
+	VkDeviceSize m_slotUsed;
+	uint32_t m_currentSlot;
+	bool m_recording;
+};
@@ -1,8 +1,25 @@
 #include "InstanceDeviceAndSwapchain.h"
 #include "MeshShadingRenderLoop.h"
 #include "ParameterizedMesh.h"
+#include "GeometryImageEncoding.h"
+#include "BlockCompression.h"
+#include "GeometryImageFile.h"
+#include "GeometryImageGenerator.h"
+#include "GeometryImageMipChain.h"
+#include "MeshShaderProfile.h"
+#include "DepthAtomicBenchmark.h"
+#include "ReadbackRing.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 std::atomic<bool> g_exitRequested = false;
 
@@ -22,61 +39,511 @@ LRESULT CALLBACK WindowProc(_In_ HWND hwnd, _In_ UINT uMsg, _In_ WPARAM wParam,
 }
 #endif
 
-int main(char* argv[])
+// times the geometry image generator against its scalar reference and checks both outputs are identical (no GPU needed)
+auto BenchmarkGeometryImageGenerator(uint32_t size) -> int
+{
+	size_t imageTexels = size_t(size + 1) * (size + 1);
+	std::vector<float> generatedPosition(imageTexels * 3), referencePosition(imageTexels * 3);
+	std::vector<uint32_t> generatedAlbedo(imageTexels), referenceAlbedo(imageTexels);
+	std::vector<float> generatedNormal(imageTexels * 3), referenceNormal(imageTexels * 3);
+
+	auto start = std::chrono::steady_clock::now();
+	GenerateSphereGeometryImage(size, 0, size + 1, generatedPosition.data(), generatedAlbedo.data(), generatedNormal.data());
+	auto middle = std::chrono::steady_clock::now();
+	GenerateSphereGeometryImageReference(size, 0, size + 1, referencePosition.data(), referenceAlbedo.data(), referenceNormal.data());
+	auto end = std::chrono::steady_clock::now();
+
+	bool identical = std::memcmp(generatedPosition.data(), referencePosition.data(), imageTexels * 3 * sizeof(float)) == 0
+		&& std::memcmp(generatedAlbedo.data(), referenceAlbedo.data(), imageTexels * sizeof(uint32_t)) == 0
+		&& std::memcmp(generatedNormal.data(), referenceNormal.data(), imageTexels * 3 * sizeof(float)) == 0;
+
+	std::cout << "geometry image " << size << "x" << size << std::endl;
+	std::cout << "  parallel:  " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms" << std::endl;
+	std::cout << "  reference: " << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+	std::cout << "  outputs " << (identical ? "are bit identical" : "DIFFER") << std::endl;
+
+	return identical ? 0 : -3;
+}
+
+// writes the procedural sphere and its mips to a geometry image file, in the build time encodings (no GPU needed)
+auto WriteSphereGeometryImageFile(std::string const& filepath, uint32_t size) -> int
+{
+	const uint32_t mipCount = GetGeometryImageMipCount(size);
+	const uint32_t bandRows = 64;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// the sphere is generated in [0, 1]
+	const float positionBoundsMin[3] = { 0, 0, 0 };
+	const float positionBoundsMax[3] = { 1, 1, 1 };
+
+	GeometryImageFileWriter writer;
+	if (!writer.Open(filepath, size, mipCount, geometryImagePositionEncoding, geometryImageAlbedoEncoding, geometryImageNormalEncoding, GeometryImageParameterization_Periodic,
+		positionBoundsMin, positionBoundsMax))
+		return -4;
+
+	bool written = true;
+	GeometryImageEncoder encoder(size, mipCount, geometryImagePositionEncoding, geometryImageAlbedoEncoding, geometryImageNormalEncoding, positionBoundsMin, positionBoundsMax,
+		[&](GeometryImageFileMegatile const* megatiles, uint32_t megatileCount, uint8_t const* payload, uint64_t payloadSize)
+	{
+		written = writer.WriteMegatiles(megatiles, megatileCount, payload, payloadSize) && written;
+	}
+	);
+
+	GeometryImageMipChainBuilder mipChainBuilder(size, mipCount,
+		[&](uint32_t mip, uint32_t, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal)
+	{
+		encoder.PushRows(mip, rowCount, position, albedo, normal);
+	}
+	);
+
+	std::vector<float> position(size_t(bandRows) * (size + 1) * 3);
+	std::vector<uint32_t> albedo(size_t(bandRows) * (size + 1));
+	std::vector<float> normal(size_t(bandRows) * (size + 1) * 3);
+	for (uint32_t firstRow = 0; firstRow <= size && written; firstRow += bandRows)
+	{
+		uint32_t rowCount = std::min(bandRows, size + 1 - firstRow);
+		GenerateSphereGeometryImage(size, firstRow, rowCount, position.data(), albedo.data(), normal.data());
+		encoder.PushRows(0, rowCount, position.data(), albedo.data(), normal.data());
+		mipChainBuilder.PushRows(firstRow, rowCount, position.data(), albedo.data(), normal.data());
+	}
+
+	written = writer.Close(encoder.GetBounds(), encoder.GetBorderVertices()) && written;
+
+	auto end = std::chrono::steady_clock::now();
+	std::cout << "wrote " << size << "x" << size << " geometry image (" << mipCount << " mips, " << GetGeometryImagePositionEncodingName(geometryImagePositionEncoding)
+	          << " positions, " << GetGeometryImageAlbedoEncodingName(geometryImageAlbedoEncoding) << " albedo, " << GetGeometryImageNormalEncodingName(geometryImageNormalEncoding)
+	          << " normals) to " << filepath
+	          << " in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+	return written ? 0 : -4;
+}
+
+// encodes the procedural sphere in every encoding and prints their size, error and encoding throughput (no GPU needed)
+auto ReportGeometryImageEncodings(uint32_t size) -> int
+{
+	const uint32_t bandRows = 64;
+	const uint32_t encoderCount = std::max({ uint32_t(GeometryImagePositionEncoding_Count), uint32_t(GeometryImageAlbedoEncoding_Count), uint32_t(GeometryImageNormalEncoding_Count) });
+
+	// the sphere is generated in [0, 1]
+	const float positionBoundsMin[3] = { 0, 0, 0 };
+	const float positionBoundsMax[3] = { 1, 1, 1 };
+
+	std::vector<float> position(size_t(bandRows) * (size + 1) * 3);
+	std::vector<uint32_t> albedo(size_t(bandRows) * (size + 1));
+	std::vector<float> normal(size_t(bandRows) * (size + 1) * 3);
+
+	// returns the encoding time of mip 0 in seconds, generation excluded
+	auto encode = [&](GeometryImageEncoder& encoder) -> double
+	{
+		std::chrono::steady_clock::duration duration = {};
+		for (uint32_t firstRow = 0; firstRow <= size; firstRow += bandRows)
+		{
+			uint32_t rowCount = std::min(bandRows, size + 1 - firstRow);
+			GenerateSphereGeometryImage(size, firstRow, rowCount, position.data(), albedo.data(), normal.data());
+			auto start = std::chrono::steady_clock::now();
+			encoder.PushRows(0, rowCount, position.data(), albedo.data(), normal.data());
+			duration += std::chrono::steady_clock::now() - start;
+		}
+		return std::chrono::duration<double>(duration).count();
+	};
+
+	// the errors of the three images do not depend on each other, so encoder i pairs position, albedo and normal encodings i
+	std::vector<GeometryImageEncodingError> errors(encoderCount);
+	for (uint32_t i = 0; i < encoderCount; ++i)
+	{
+		GeometryImageEncoder encoder(size, 1, GeometryImagePositionEncoding(i % GeometryImagePositionEncoding_Count), GeometryImageAlbedoEncoding(i % GeometryImageAlbedoEncoding_Count),
+			GeometryImageNormalEncoding(i % GeometryImageNormalEncoding_Count), positionBoundsMin, positionBoundsMax,
+			[](GeometryImageFileMegatile const*, uint32_t, uint8_t const*, uint64_t) {}
+		);
+		encoder.EnableErrorMeasurement();
+		encode(encoder);
+		errors[i] = encoder.GetError();
+	}
+
+	// throughput of the whole encoder without error measurement, the other images in their cheapest encodings
+	const double megatexels = double(size) * size / 1e6;
+	double albedoThroughputs[GeometryImageAlbedoEncoding_Count];
+	for (uint32_t i = 0; i < GeometryImageAlbedoEncoding_Count; ++i)
+	{
+		GeometryImageEncoder encoder(size, 1, GeometryImagePositionEncoding_Absolute10, GeometryImageAlbedoEncoding(i), GeometryImageNormalEncoding_Xyz8, positionBoundsMin, positionBoundsMax,
+			[](GeometryImageFileMegatile const*, uint32_t, uint8_t const*, uint64_t) {}
+		);
+		albedoThroughputs[i] = megatexels / encode(encoder);
+	}
+	double normalThroughputs[GeometryImageNormalEncoding_Count];
+	for (uint32_t i = 0; i < GeometryImageNormalEncoding_Count; ++i)
+	{
+		GeometryImageEncoder encoder(size, 1, GeometryImagePositionEncoding_Absolute10, GeometryImageAlbedoEncoding_Rgba8, GeometryImageNormalEncoding(i), positionBoundsMin, positionBoundsMax,
+			[](GeometryImageFileMegatile const*, uint32_t, uint8_t const*, uint64_t) {}
+		);
+		normalThroughputs[i] = megatexels / encode(encoder);
+	}
+
+	auto bitsPerTexel = [](GeometryImageFormat format) -> uint32_t
+	{
+		uint32_t blockSize = GetGeometryImageFormatBlockSize(format);
+		return blockSize > 0 ? blockSize * 8 / (bcBlockSize * bcBlockSize) : GetGeometryImageFormatTexelSize(format) * 8;
+	};
+
+	// errors are relative to the size of the unit sphere: a mesh 1 m across rendered so that it covers 1000 pixels has 1e-3 per pixel
+	std::cout << "geometry image encodings, " << size << "x" << size << " sphere of diameter 1" << std::endl;
+	std::cout << "  position                    bits  max error  rms error" << std::endl;
+	for (uint32_t i = 0; i < GeometryImagePositionEncoding_Count; ++i)
+	{
+		GeometryImagePositionEncoding encoding = GeometryImagePositionEncoding(i);
+		std::cout << "  " << (encoding == geometryImagePositionEncoding ? "*" : " ") << std::left << std::setw(27) << GetGeometryImagePositionEncodingName(encoding) << std::right
+		          << std::setw(5) << bitsPerTexel(GetGeometryImagePositionFormat(encoding))
+		          << std::setw(11) << std::setprecision(3) << errors[i].m_positionMaxError << std::setw(11) << errors[i].GetPositionRmsError() << std::endl;
+	}
+	std::cout << "  albedo                      bits  max error  PSNR (dB)  Mtexels/s" << std::endl;
+	for (uint32_t i = 0; i < GeometryImageAlbedoEncoding_Count; ++i)
+	{
+		GeometryImageAlbedoEncoding encoding = GeometryImageAlbedoEncoding(i);
+		std::cout << "  " << (encoding == geometryImageAlbedoEncoding ? "*" : " ") << std::left << std::setw(27) << GetGeometryImageAlbedoEncodingName(encoding) << std::right
+		          << std::setw(5) << bitsPerTexel(GetGeometryImageAlbedoFormat(encoding))
+		          << std::setw(11) << std::setprecision(3) << errors[i].m_albedoMaxError << std::setw(11) << errors[i].GetAlbedoPsnr()
+		          << std::setw(11) << albedoThroughputs[i] << std::endl;
+	}
+	std::cout << "  normal                      bits  max angle  mean angle Mtexels/s (angles in degrees)" << std::endl;
+	for (uint32_t i = 0; i < GeometryImageNormalEncoding_Count; ++i)
+	{
+		GeometryImageNormalEncoding encoding = GeometryImageNormalEncoding(i);
+		std::cout << "  " << (encoding == geometryImageNormalEncoding ? "*" : " ") << std::left << std::setw(27) << GetGeometryImageNormalEncodingName(encoding) << std::right
+		          << std::setw(5) << bitsPerTexel(GetGeometryImageNormalFormat(encoding))
+		          << std::setw(11) << std::setprecision(3) << errors[i].m_normalMaxAngle << std::setw(11) << errors[i].GetNormalMeanAngle()
+		          << std::setw(11) << normalThroughputs[i] << std::endl;
+	}
+
+	// a full mip chain is 4/3 of mip 0
+	uint32_t bitsPerVertex = bitsPerTexel(GetGeometryImagePositionFormat(geometryImagePositionEncoding))
+		+ bitsPerTexel(GetGeometryImageAlbedoFormat(geometryImageAlbedoEncoding))
+		+ bitsPerTexel(GetGeometryImageNormalFormat(geometryImageNormalEncoding));
+	std::cout << "  * built encodings: " << bitsPerVertex / 8.0 << " bytes per vertex with albedo, "
+	          << (double(size) * size * bitsPerVertex / 8 * 4 / 3 / (1 << 20)) << " MB with mips (12 bytes per vertex before)" << std::endl;
+
+	return 0;
+}
+
+// writes the color of a frame read back headless as a binary PPM
+auto WriteFrameImage(std::string const& filepath, uint8_t const* image, VkExtent2D extent, VkDeviceSize rowPitch, VkFormat format) -> bool
+{
+	// offscreen images are RGBA, swapchain images BGRA
+	bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM;
+	std::vector<uint8_t> rgb(size_t(extent.width) * extent.height * 3);
+	for (uint32_t y = 0; y < extent.height; ++y)
+	{
+		uint8_t const* row = image + y * rowPitch;
+		for (uint32_t x = 0; x < extent.width; ++x)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+				rgb[3 * (size_t(y) * extent.width + x) + k] = row[4 * x + (bgra ? 2 - k : k)];
+		}
+	}
+
+	std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+	file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+	file.write(reinterpret_cast<char const*>(rgb.data()), rgb.size());
+	if (!file.good())
+	{
+		std::cerr << "could not write " << filepath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// GPU time of every pass of a frame, what -autotune minimizes
+auto TotalPassTime(PassTimings const& timings) -> double
+{
+	return timings.earlyDepthPass + timings.earlyDepthPyramid + timings.lateDepthPass + timings.depthPyramid + timings.gbufferPass +
+	       timings.materialResolve;
+}
+
+// mean GPU time of the passes with occlusion culling ([1]) and without ([0]), from timings summed over frameCounts frames
+auto ReportOcclusionCullingTimings(PassTimings const timingSums[2], uint32_t const frameCounts[2]) -> void
+{
+	auto report = [&](char const* pass, auto const& time)
+	{
+		double culled = time(timingSums[1]) / frameCounts[1];
+		double notCulled = time(timingSums[0]) / frameCounts[0];
+		std::cout << "  " << std::left << std::setw(16) << pass << std::right << std::fixed << std::setprecision(3)
+		          << std::setw(10) << culled << std::setw(12) << notCulled << std::setw(10) << notCulled - culled << std::endl;
+	};
+
+	std::cout << "pass times (ms)     culled  not culled     saved" << std::endl;
+	report("depth", [](PassTimings const& timings) { return timings.earlyDepthPass + timings.lateDepthPass; });
+	report("depth pyramids", [](PassTimings const& timings) { return timings.earlyDepthPyramid + timings.depthPyramid; });
+	report("G-buffer", [](PassTimings const& timings) { return timings.gbufferPass; });
+	report("material resolve", [](PassTimings const& timings) { return timings.materialResolve; });
+	report("total", [](PassTimings const& timings) { return TotalPassTime(timings); });
+	std::cout.unsetf(std::ios::fixed);
+}
+
+int main(int argc, char* argv[])
 {
 	int result = 0;
 
+	std::string geometryImageFilepath;
+	uint64_t residencyBudget = 0; // every megatile stays resident
+	uint32_t instanceGridSize = 1;
+	bool reportCullingStatistics = false;
+	bool occlusionCulling = true;
+	bool compareOcclusionCulling = false; // alternates with and without every 120 frames
+	float lodPixelError = 2.0f;
+	int32_t softwareRasterMaxSize = -1; // pixels across, the mesh shader packs footprints of up to 8; -1: from the profile
+	uint32_t tileSize = 0;              // quads per side of a mesh shader tile, 4 or 8; 0: from the profile
+	uint32_t meshWorkgroupSize = 0;     // 32 with mesh shaders, up to 128 with the compute rasterizer; 0: from the profile
+	bool visibilityBuffer = false;
+	bool computeRasterizer = false; // forced on devices without mesh shaders
+	bool tiledDepth = false;
+	bool reversedZ = false;
+	bool benchmarkDepthAtomics = false;
+
+	// headless, frames go to offscreen images instead of a window (always on platforms without one) and may be read back to files
+#ifdef _WIN32
+	bool headless = false;
+#else
+	bool headless = true;
+#endif
+	VkExtent2D headlessExtent = { 1280, 720 };
+	uint32_t frameCount = 0;  // 0: until the window is closed
+	std::string outputPrefix; // every frame is written to <outputPrefix><frame number>.ppm when set (headless)
+
+	// the mesh shader permutation of the device comes from its profile, -autotune times every candidate and writes the fastest to it
+	std::string meshShaderProfileFilepath = "mesh_shader_profile.txt";
+	std::string meshShaderProfileKey;
+	MeshShaderPermutation meshShaderPermutation = defaultMeshShaderPermutation;
+	bool autotune = false;
+	uint32_t autotuneFrames = 120; // timed per permutation, after as many to settle
+	std::vector<MeshShaderPermutation> autotuneCandidates;
+	std::vector<double> autotuneTimes;
+	uint32_t autotuneIndex = 0;
+	uint32_t autotuneFrame = 0;
+
+	// -compareOcclusionCulling sums the pass timings of the frames without (0) and with (1) occlusion culling
+	// (declared before the gotos to end, which may not jump over initializations)
+	PassTimings timingSums[2] = {};
+	uint32_t timingFrameCounts[2] = {};
+
+	for (int i = 1; i < argc; ++i)
+	{
+		int option = i;
+		try
+		{
+			if (strcmp(argv[i], "-benchmarkGeometryImage") == 0)
+				return BenchmarkGeometryImageGenerator(i + 1 < argc ? uint32_t(std::stoul(argv[i + 1])) : 8192);
+			if (strcmp(argv[i], "-reportGeometryImageEncodings") == 0)
+				return ReportGeometryImageEncodings(i + 1 < argc ? uint32_t(std::stoul(argv[i + 1])) : 2048);
+			if (strcmp(argv[i], "-writeGeometryImage") == 0 && i + 1 < argc)
+				return WriteSphereGeometryImageFile(argv[i + 1], i + 2 < argc ? uint32_t(std::stoul(argv[i + 2])) : 8192);
+			if (strcmp(argv[i], "-geometryImage") == 0 && i + 1 < argc)
+				geometryImageFilepath = argv[++i];
+			if (strcmp(argv[i], "-residencyBudget") == 0 && i + 1 < argc)
+				residencyBudget = uint64_t(std::stoul(argv[++i])) << 20; // in MB
+			if (strcmp(argv[i], "-instanceGrid") == 0 && i + 1 < argc)
+				instanceGridSize = std::max(1u, uint32_t(std::stoul(argv[++i])));
+			if (strcmp(argv[i], "-cullingStatistics") == 0)
+				reportCullingStatistics = true;
+			if (strcmp(argv[i], "-noOcclusionCulling") == 0)
+				occlusionCulling = false;
+			if (strcmp(argv[i], "-compareOcclusionCulling") == 0)
+				compareOcclusionCulling = true;
+			if (strcmp(argv[i], "-lodPixelError") == 0 && i + 1 < argc)
+				lodPixelError = std::max(0.0f, std::stof(argv[++i]));
+			if (strcmp(argv[i], "-softwareRasterSize") == 0 && i + 1 < argc)
+				softwareRasterMaxSize = int32_t(std::min(8u, uint32_t(std::stoul(argv[++i]))));
+			if (strcmp(argv[i], "-tileSize") == 0 && i + 1 < argc)
+				tileSize = uint32_t(std::stoul(argv[++i]));
+			if (strcmp(argv[i], "-meshWorkgroupSize") == 0 && i + 1 < argc)
+				meshWorkgroupSize = uint32_t(std::stoul(argv[++i]));
+			if (strcmp(argv[i], "-meshShaderProfile") == 0 && i + 1 < argc)
+				meshShaderProfileFilepath = argv[++i];
+			if (strcmp(argv[i], "-autotune") == 0)
+			{
+				autotune = true;
+				if (i + 1 < argc && isdigit(argv[i + 1][0]))
+					autotuneFrames = std::max(1u, uint32_t(std::stoul(argv[++i])));
+			}
+			if (strcmp(argv[i], "-visibilityBuffer") == 0)
+				visibilityBuffer = true;
+			if (strcmp(argv[i], "-computeRasterizer") == 0)
+				computeRasterizer = true;
+			if (strcmp(argv[i], "-tiledDepth") == 0)
+				tiledDepth = true;
+			if (strcmp(argv[i], "-reversedZ") == 0)
+				reversedZ = true;
+			if (strcmp(argv[i], "-benchmarkDepthAtomics") == 0)
+				benchmarkDepthAtomics = true;
+			if (strcmp(argv[i], "-headless") == 0)
+				headless = true;
+			if (strcmp(argv[i], "-resolution") == 0 && i + 2 < argc)
+			{
+				headlessExtent.width = std::max(1u, uint32_t(std::stoul(argv[++i])));
+				headlessExtent.height = std::max(1u, uint32_t(std::stoul(argv[++i])));
+			}
+			if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+				frameCount = uint32_t(std::stoul(argv[++i]));
+			if (strcmp(argv[i], "-output") == 0 && i + 1 < argc)
+				outputPrefix = argv[++i];
+		}
+		catch (std::logic_error const&) // std::invalid_argument or std::out_of_range of std::stoul and std::stof
+		{
+			std::cerr << argv[option] << ": invalid number" << std::endl;
+			return -1;
+		}
+	}
+
+	// the offscreen images and the software rasterized depth cover at most maxWidth x maxHeight
+	if (headlessExtent.width > MeshShadingRenderLoop::maxWidth || headlessExtent.height > MeshShadingRenderLoop::maxHeight)
+	{
+		std::cerr << "-resolution is at most " << MeshShadingRenderLoop::maxWidth << "x" << MeshShadingRenderLoop::maxHeight << std::endl;
+		return -1;
+	}
+
+	// nothing else ends a headless run (-autotune and -benchmarkDepthAtomics end on their own)
+	if (headless && frameCount == 0 && !autotune && !benchmarkDepthAtomics)
+	{
+		std::cerr << "headless rendering needs -frames <n>" << std::endl;
+		return -1;
+	}
+	if (!outputPrefix.empty() && !headless)
+	{
+		std::cerr << "-output needs -headless" << std::endl;
+		return -1;
+	}
+
 	InstanceDeviceAndSwapchain instanceDeviceAndSwapchain;
 	MeshShadingRenderLoop renderLoop;
 	ParameterizedMesh parameterizedMesh;
+	ReadbackRing readbackRing;
+
+	// once the GPU is done with a frame execution context, the frame it read back last
+	auto writeCompletedImage = [&](uint32_t frameExecutionContext) -> bool
+	{
+		uint32_t frameNumber;
+		uint8_t const* image = readbackRing.GetCompletedImage(frameExecutionContext, frameNumber);
+		if (!image)
+			return true;
+		std::string number = std::to_string(frameNumber);
+		std::string filepath = outputPrefix + std::string(number.size() < 5 ? 5 - number.size() : 0, '0') + number + ".ppm";
+		return WriteFrameImage(filepath, image, readbackRing.GetExtent(), readbackRing.GetRowPitch(), readbackRing.GetFormat());
+	};
 
 	void* platformWindowHandle = nullptr;
 #ifdef _WIN32
 	HWND hWnd = nullptr;
 
 	WNDCLASSEX wndclass;
-	wndclass.cbSize = sizeof(WNDCLASSEX);
-	wndclass.style = 0;
-	wndclass.lpfnWndProc = &WindowProc;
-	wndclass.cbClsExtra = 0;
-	wndclass.cbWndExtra = 0;
-	wndclass.hInstance = HINSTANCE(GetModuleHandle(nullptr));
-	wndclass.hIcon = nullptr;
-	wndclass.hCursor = nullptr;
-	wndclass.hbrBackground = HBRUSH(1 + COLOR_WINDOW);
-	wndclass.lpszMenuName = nullptr;
-	wndclass.lpszClassName = "YoloWindowClass";
-	wndclass.hIconSm = nullptr;
-	if (!RegisterClassEx(&wndclass))
-	{
-		std::cerr << "failed to register window class" << std::endl;
-		result = -2;
-		goto end;
+	if (!headless)
+	{
+		wndclass.cbSize = sizeof(WNDCLASSEX);
+		wndclass.style = 0;
+		wndclass.lpfnWndProc = &WindowProc;
+		wndclass.cbClsExtra = 0;
+		wndclass.cbWndExtra = 0;
+		wndclass.hInstance = HINSTANCE(GetModuleHandle(nullptr));
+		wndclass.hIcon = nullptr;
+		wndclass.hCursor = nullptr;
+		wndclass.hbrBackground = HBRUSH(1 + COLOR_WINDOW);
+		wndclass.lpszMenuName = nullptr;
+		wndclass.lpszClassName = "YoloWindowClass";
+		wndclass.hIconSm = nullptr;
+		if (!RegisterClassEx(&wndclass))
+		{
+			std::cerr << "failed to register window class" << std::endl;
+			result = -2;
+			goto end;
+		}
+
+		hWnd = CreateWindow(wndclass.lpszClassName, "MeshShaderRasterization", WS_OVERLAPPEDWINDOW | WS_VISIBLE, CW_USEDEFAULT, CW_USEDEFAULT, 1280, 720, nullptr, nullptr, HINSTANCE(GetModuleHandle(nullptr)), 0);
+		if (!hWnd)
+		{
+			std::cerr << "failed to create window" << std::endl;
+			result = -2;
+			goto end;
+		}
+		platformWindowHandle = hWnd;
 	}
+#endif
 
-	hWnd = CreateWindow(wndclass.lpszClassName, "MeshShaderRasterization", WS_OVERLAPPEDWINDOW | WS_VISIBLE, CW_USEDEFAULT, CW_USEDEFAULT, 1280, 720, nullptr, nullptr, HINSTANCE(GetModuleHandle(nullptr)), 0);
-	if (!hWnd)
+	if (!instanceDeviceAndSwapchain.Initialize(0, platformWindowHandle, headlessExtent))
 	{
-		std::cerr << "failed to create window" << std::endl;
-		result = -2;
+		result = -1;
 		goto end;
 	}
-	platformWindowHandle = hWnd;
-#else
-#error "platform not supported. please implement me"
-#endif
 
-	if (!instanceDeviceAndSwapchain.Initialize(0, platformWindowHandle))
+	if (!outputPrefix.empty() && !readbackRing.Initialize(instanceDeviceAndSwapchain))
 	{
 		result = -1;
 		goto end;
 	}
 
+	if (benchmarkDepthAtomics)
+	{
+		DepthAtomicBenchmark benchmark;
+		result = benchmark.Initialize(instanceDeviceAndSwapchain) && benchmark.Run() ? 0 : -1;
+		goto end;
+	}
+
+	{
+		// the command line overrides the profile, tuning starts from the first candidate
+		bool meshComputeRasterizer = computeRasterizer || !instanceDeviceAndSwapchain.SupportsNvMeshShader();
+		VkPhysicalDeviceProperties const& properties = instanceDeviceAndSwapchain.GetPhysicalDeviceProperties();
+		meshShaderProfileKey = GetMeshShaderProfileKey(properties.vendorID, properties.deviceID, properties.driverVersion, meshComputeRasterizer);
+		if (autotune)
+		{
+			autotuneCandidates = GetMeshShaderPermutationCandidates(meshComputeRasterizer);
+			autotuneTimes.assign(autotuneCandidates.size(), 0.0);
+			meshShaderPermutation = autotuneCandidates[0];
+			compareOcclusionCulling = false;
+			std::cout << "tuning " << autotuneCandidates.size() << " mesh shader permutations of " << properties.deviceName << std::endl;
+		}
+		else
+		{
+			if (LoadMeshShaderProfile(meshShaderProfileFilepath, meshShaderProfileKey, meshComputeRasterizer, meshShaderPermutation))
+				std::cout << "mesh shader permutation of " << meshShaderProfileKey << " from " << meshShaderProfileFilepath << std::endl;
+			if (tileSize != 0)
+				meshShaderPermutation.tileSize = tileSize;
+			if (meshWorkgroupSize != 0)
+				meshShaderPermutation.workgroupSize = meshWorkgroupSize;
+			if (softwareRasterMaxSize >= 0)
+				meshShaderPermutation.softwareRasterMaxSize = uint32_t(softwareRasterMaxSize);
+		}
+	}
+
+	renderLoop.SetMeshShaderPermutation(meshShaderPermutation);
+	renderLoop.SetVisibilityBuffer(visibilityBuffer);
+	renderLoop.SetComputeRasterizer(computeRasterizer);
+	renderLoop.SetTiledDepth(tiledDepth);
+	renderLoop.SetReversedZ(reversedZ);
 	renderLoop.Initialize(instanceDeviceAndSwapchain);
-	parameterizedMesh.Initialize(instanceDeviceAndSwapchain);
-	renderLoop.AddMeshInstance(&parameterizedMesh);
+	if (!parameterizedMesh.Initialize(instanceDeviceAndSwapchain, geometryImageFilepath, residencyBudget))
+	{
+		result = -1;
+		goto end;
+	}
 
-	while (!g_exitRequested.load())
+	// copies of the mesh on a grid, each scaled down to its cell (a single one spans [-0.5, 0.5])
+	for (uint32_t i = 0; i < instanceGridSize * instanceGridSize; ++i)
+	{
+		float scale = 1.0f / float(instanceGridSize);
+		float modelToWorldMatrix[3][4] =
+		{
+			{ scale, 0, 0, float(i % instanceGridSize) * scale - 0.5f },
+			{ 0, scale, 0, float(i / instanceGridSize) * scale - 0.5f },
+			{ 0, 0, scale, 0 },
+		};
+		if (!renderLoop.AddMeshInstance(&parameterizedMesh, modelToWorldMatrix))
+		{
+			result = -1;
+			goto end;
+		}
+	}
+
+	renderLoop.SetOcclusionCulling(occlusionCulling);
+	renderLoop.SetLodPixelError(lodPixelError);
+
+	while (!g_exitRequested.load() && (frameCount == 0 || instanceDeviceAndSwapchain.GetFrameNumber() <= frameCount))
 	{
 #if _WIN32
 		MSG msg;
@@ -91,15 +558,112 @@ int main(char* argv[])
 #endif
 
 		instanceDeviceAndSwapchain.BeginFrame();
-		renderLoop.RenderLoop(instanceDeviceAndSwapchain);
+		if (!outputPrefix.empty() && !writeCompletedImage(instanceDeviceAndSwapchain.GetFrameExecutionContextIndex()))
+		{
+			result = -1;
+			break;
+		}
+		if (renderLoop.RenderLoop(instanceDeviceAndSwapchain) && !outputPrefix.empty())
+			readbackRing.CopyAcquiredImage(instanceDeviceAndSwapchain);
 		instanceDeviceAndSwapchain.EndFrame();
+
+		if (reportCullingStatistics && instanceDeviceAndSwapchain.GetFrameNumber() % 120 == 0)
+		{
+			char const* passNames[CullingPass_Count] = { "early depth", "late depth", "G-buffer" };
+			std::cout << "culled " << renderLoop.GetCullingStatistics(CullingPass_EarlyDepth).taskGroupsCulled << " task groups (frustum) before the passes" << std::endl;
+			for (uint32_t pass = 0; pass < CullingPass_Count; ++pass)
+			{
+				CullingStatistics const& statistics = renderLoop.GetCullingStatistics(CullingPass(pass));
+				std::cout << passNames[pass] << ": culled " << statistics.megatilesFrustumCulled << " (frustum), " << statistics.megatilesBackfaceCulled << " (backface) and "
+				          << statistics.megatilesOcclusionCulled << " (occlusion) of " << statistics.megatilesTested << " megatiles tested, "
+				          << statistics.tilesLaunched << " tiles launched and " << statistics.tilesCulled << " culled" << std::endl;
+				if (statistics.pixelsRasterized > 0)
+				{
+					std::cout << passNames[pass] << ": " << statistics.pixelsRasterized << " pixels rasterized in the mesh shader with " << statistics.depthAtomics << " depth atomics ("
+					          << 100.0 * statistics.depthAtomics / statistics.pixelsRasterized << "%)" << std::endl;
+				}
+			}
+		}
+
+		if (autotune)
+		{
+			// the first permutation also waits for the megatiles to stream in
+			uint32_t settleFrames = autotuneIndex == 0 ? 4 * autotuneFrames : autotuneFrames;
+			if (++autotuneFrame > settleFrames)
+				autotuneTimes[autotuneIndex] += TotalPassTime(renderLoop.GetPassTimings());
+
+			if (autotuneFrame == settleFrames + autotuneFrames)
+			{
+				MeshShaderPermutation const& permutation = autotuneCandidates[autotuneIndex];
+				autotuneTimes[autotuneIndex] /= autotuneFrames;
+				std::cout << "  tile " << permutation.tileSize << "x" << permutation.tileSize << ", workgroup " << permutation.workgroupSize
+				          << ", software raster " << permutation.softwareRasterMaxSize << ": " << autotuneTimes[autotuneIndex] << " ms" << std::endl;
+
+				autotuneFrame = 0;
+				if (++autotuneIndex == autotuneCandidates.size())
+				{
+					size_t fastest = std::min_element(autotuneTimes.begin(), autotuneTimes.end()) - autotuneTimes.begin();
+					std::string deviceName = instanceDeviceAndSwapchain.GetPhysicalDeviceProperties().deviceName;
+					if (!SaveMeshShaderProfile(meshShaderProfileFilepath, meshShaderProfileKey, autotuneCandidates[fastest], deviceName))
+						result = -1;
+					else
+						std::cout << "fastest: " << autotuneTimes[fastest] << " ms, written to " << meshShaderProfileFilepath << std::endl;
+					break;
+				}
+
+				renderLoop.SetMeshShaderPermutation(autotuneCandidates[autotuneIndex]);
+				if (!renderLoop.RecreateMeshShaders(instanceDeviceAndSwapchain))
+				{
+					result = -1;
+					break;
+				}
+			}
+		}
+
+		if (compareOcclusionCulling)
+		{
+			PassTimings const& timings = renderLoop.GetPassTimings();
+			PassTimings& timingSum = timingSums[timings.occlusionCulling ? 1 : 0];
+			timingSum.earlyDepthPass += timings.earlyDepthPass;
+			timingSum.earlyDepthPyramid += timings.earlyDepthPyramid;
+			timingSum.lateDepthPass += timings.lateDepthPass;
+			timingSum.depthPyramid += timings.depthPyramid;
+			timingSum.gbufferPass += timings.gbufferPass;
+			timingSum.materialResolve += timings.materialResolve;
+			++timingFrameCounts[timings.occlusionCulling ? 1 : 0];
+
+			if (instanceDeviceAndSwapchain.GetFrameNumber() % 120 == 0)
+			{
+				occlusionCulling = !occlusionCulling;
+				renderLoop.SetOcclusionCulling(occlusionCulling);
+
+				if (timingFrameCounts[0] > 0 && timingFrameCounts[1] > 0)
+				{
+					ReportOcclusionCullingTimings(timingSums, timingFrameCounts);
+					std::fill(std::begin(timingSums), std::end(timingSums), PassTimings{});
+					std::fill(std::begin(timingFrameCounts), std::end(timingFrameCounts), 0);
+				}
+			}
+		}
+	}
+
+	// the frames still in flight, oldest first
+	if (!outputPrefix.empty() && instanceDeviceAndSwapchain.WaitIdle())
+	{
+		for (uint32_t i = 0; i < instanceDeviceAndSwapchain.GetFrameExecutionContextCount(); ++i)
+		{
+			uint32_t frameExecutionContext = (instanceDeviceAndSwapchain.GetFrameExecutionContextIndex() + i) % instanceDeviceAndSwapchain.GetFrameExecutionContextCount();
+			if (!writeCompletedImage(frameExecutionContext))
+				result = -1;
+		}
 	}
 
 end:
 #ifdef _WIN32
 	if (hWnd)
 		DestroyWindow(hWnd);
-	UnregisterClass(wndclass.lpszClassName, HINSTANCE(GetModuleHandle(nullptr)));
+	if (!headless)
+		UnregisterClass(wndclass.lpszClassName, HINSTANCE(GetModuleHandle(nullptr)));
 #endif
 
 	return result;
@@ -0,0 +1,261 @@
+#include "ReferenceGeometryImage.h"
+#include "../MeshShaderRasterization/BlockCompression.h"
+#include "../MeshShaderRasterization/GeometryImageEncoding.h"
+#include "../MeshShaderRasterization/GeometryImageFile.h"
+#include "../MeshShaderRasterization/GeometryImageGenerator.h"
+#include "../MeshShaderRasterization/GeometryImageMipChain.h"
+#include "../MeshShaderRasterization/ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// the task shader dispatches groups of 8x8 megatiles
+	const uint32_t sizeGranularity = geometryImageMegatileSize * 8;
+
+	// octahedral snorm to unit vector, as decodeNormal in test_ms.glsl (BC5 blocks decode to the same snorm pairs)
+	auto DecodeOctahedralNormal(float const e[2], float normal[3]) -> void
+	{
+		normal[0] = e[0];
+		normal[1] = e[1];
+		normal[2] = 1 - std::abs(e[0]) - std::abs(e[1]);
+		float t = std::max(-normal[2], 0.0f);
+		normal[0] += normal[0] >= 0 ? -t : t;
+		normal[1] += normal[1] >= 0 ? -t : t;
+
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float scale = length > 0 ? 1 / length : 0;
+		for (uint32_t k = 0; k < 3; ++k)
+			normal[k] *= scale;
+	}
+}
+
+auto ReferenceGeometryImage::Initialize(std::string const& geometryImageFilepath, uint32_t size, uint32_t threadCount) -> bool
+{
+	if (!geometryImageFilepath.empty())
+		return Load(geometryImageFilepath, threadCount);
+
+	if (size < sizeGranularity || size % sizeGranularity != 0)
+	{
+		std::cerr << "the geometry image size must be a multiple of " << sizeGranularity << std::endl;
+		return false;
+	}
+
+	m_size = size;
+	m_mipCount = GetGeometryImageMipCount(size);
+	m_parameterization = GeometryImageParameterization_Periodic;
+	Generate(threadCount);
+	ComputeBounds(threadCount);
+	return true;
+}
+
+auto ReferenceGeometryImage::AllocateMips() -> void
+{
+	m_mips.assign(m_mipCount, {});
+	for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+	{
+		size_t vertexCount = size_t(GetMipSize(mip) + 1) * (GetMipSize(mip) + 1);
+		m_mips[mip].m_position.resize(3 * vertexCount);
+		m_mips[mip].m_albedo.resize(vertexCount);
+		m_mips[mip].m_normal.resize(3 * vertexCount);
+	}
+}
+
+auto ReferenceGeometryImage::Generate(uint32_t threadCount) -> void
+{
+	AllocateMips();
+
+	Mip& mip0 = m_mips[0];
+	GenerateSphereGeometryImage(m_size, 0, m_size + 1, mip0.m_position.data(), mip0.m_albedo.data(), mip0.m_normal.data(), threadCount);
+
+	// the renderer builds its mips the same way, before encoding them
+	GeometryImageMipChainBuilder mipChainBuilder(m_size, m_mipCount,
+		[&](uint32_t mip, uint32_t firstRow, uint32_t rowCount, float const* position, uint32_t const* albedo, float const* normal)
+	{
+		size_t offset = size_t(firstRow) * (GetMipSize(mip) + 1);
+		size_t texelCount = size_t(rowCount) * (GetMipSize(mip) + 1);
+		std::memcpy(&m_mips[mip].m_position[3 * offset], position, 3 * texelCount * sizeof(float));
+		std::memcpy(&m_mips[mip].m_albedo[offset], albedo, texelCount * sizeof(uint32_t));
+		std::memcpy(&m_mips[mip].m_normal[3 * offset], normal, 3 * texelCount * sizeof(float));
+	}
+	);
+
+	const uint32_t bandRows = 64;
+	for (uint32_t firstRow = 0; firstRow <= m_size; firstRow += bandRows)
+	{
+		size_t offset = size_t(firstRow) * (m_size + 1);
+		mipChainBuilder.PushRows(firstRow, std::min(bandRows, m_size + 1 - firstRow), &mip0.m_position[3 * offset], &mip0.m_albedo[offset], &mip0.m_normal[3 * offset]);
+	}
+}
+
+auto ReferenceGeometryImage::Load(std::string const& geometryImageFilepath, uint32_t threadCount) -> bool
+{
+	GeometryImageFile file;
+	if (!file.Open(geometryImageFilepath))
+		return false;
+
+	GeometryImageFileHeader const& header = file.GetHeader();
+	if (header.size % sizeGranularity != 0)
+	{
+		std::cerr << "geometry image file " << geometryImageFilepath << " is " << header.size << " texels wide, which is not a multiple of " << sizeGranularity << std::endl;
+		return false;
+	}
+
+	m_size = header.size;
+	m_mipCount = header.mipCount;
+	m_parameterization = header.parameterization;
+	AllocateMips();
+
+	// megatiles own disjoint texels, they decode on their own
+	GeometryImageFileMegatile const* megatiles = file.GetMegatiles();
+	uint8_t const* payload = file.GetPayload();
+	ParallelFor(header.megatileCount, [&](uint32_t index)
+	{
+		GeometryImageFileMegatile const& megatile = megatiles[index];
+		Mip& mip = m_mips[megatile.mip];
+		uint32_t width = GetMipSize(megatile.mip) + 1;
+		uint32_t firstX = megatile.x * geometryImageMegatileSize;
+		uint32_t firstY = megatile.y * geometryImageMegatileSize;
+
+		uint8_t const* positionTexels = payload + megatile.payloadOffset;
+		uint8_t const* albedoTexels = positionTexels + GetGeometryImagePlaneSize(header.formats[0], megatile.width, megatile.height);
+		uint8_t const* normalTexels = albedoTexels + GetGeometryImagePlaneSize(header.formats[1], megatile.width, megatile.height);
+
+		// absolute positions are in the bounds of the mesh, relative ones in those of the megatile
+		float const* boundsMin = header.positionEncoding == GeometryImagePositionEncoding_Absolute10 ? header.positionBoundsMin : megatile.positionBoundsMin;
+		float const* boundsMax = header.positionEncoding == GeometryImagePositionEncoding_Absolute10 ? header.positionBoundsMax : megatile.positionBoundsMax;
+		uint32_t positionTexelSize = GetGeometryImageFormatTexelSize(header.formats[0]);
+		for (uint32_t y = 0; y < megatile.height; ++y)
+		{
+			for (uint32_t x = 0; x < megatile.width; ++x)
+			{
+				size_t texel = size_t(firstY + y) * width + firstX + x;
+				DecodeGeometryImagePosition(header.positionEncoding, positionTexels + (y * megatile.width + x) * positionTexelSize, boundsMin, boundsMax, &mip.m_position[3 * texel]);
+			}
+		}
+
+		uint32_t albedoBlockSize = GetGeometryImageFormatBlockSize(header.formats[1]);
+		if (albedoBlockSize == 0)
+		{
+			for (uint32_t y = 0; y < megatile.height; ++y)
+				std::memcpy(&mip.m_albedo[size_t(firstY + y) * width + firstX], albedoTexels + y * megatile.width * sizeof(uint32_t), megatile.width * sizeof(uint32_t));
+		}
+
+		uint32_t normalBlockSize = GetGeometryImageFormatBlockSize(header.formats[2]);
+		uint32_t normalTexelSize = GetGeometryImageFormatTexelSize(header.formats[2]);
+		if (normalBlockSize == 0)
+		{
+			for (uint32_t y = 0; y < megatile.height; ++y)
+			{
+				for (uint32_t x = 0; x < megatile.width; ++x)
+				{
+					size_t texel = size_t(firstY + y) * width + firstX + x;
+					DecodeGeometryImageNormal(header.normalEncoding, normalTexels + (y * megatile.width + x) * normalTexelSize, &mip.m_normal[3 * texel]);
+				}
+			}
+		}
+
+		// block compressed images are rows of 4x4 blocks, the texels past the edge of the megatile are dropped
+		uint32_t blocksPerRow = (megatile.width + bcBlockSize - 1) / bcBlockSize;
+		uint32_t blockRows = (megatile.height + bcBlockSize - 1) / bcBlockSize;
+		for (uint32_t blockY = 0; blockY < blockRows && (albedoBlockSize > 0 || normalBlockSize > 0); ++blockY)
+		{
+			for (uint32_t blockX = 0; blockX < blocksPerRow; ++blockX)
+			{
+				uint32_t block = blockY * blocksPerRow + blockX;
+				uint32_t albedoPixels[16];
+				if (header.formats[1] == GeometryImageFormat_BC1)
+					DecodeBc1Block(albedoTexels + block * albedoBlockSize, albedoPixels);
+				else if (header.formats[1] == GeometryImageFormat_BC7)
+					DecodeBc7Block(albedoTexels + block * albedoBlockSize, albedoPixels);
+				float normalPixels[16][2];
+				if (normalBlockSize > 0)
+					DecodeBc5SnormBlock(normalTexels + block * normalBlockSize, normalPixels);
+
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					uint32_t x = blockX * bcBlockSize + pixel % bcBlockSize;
+					uint32_t y = blockY * bcBlockSize + pixel / bcBlockSize;
+					if (x >= megatile.width || y >= megatile.height)
+						continue;
+
+					size_t texel = size_t(firstY + y) * width + firstX + x;
+					if (albedoBlockSize > 0)
+						mip.m_albedo[texel] = albedoPixels[pixel];
+					if (normalBlockSize > 0)
+						DecodeOctahedralNormal(normalPixels[pixel], &mip.m_normal[3 * texel]);
+				}
+			}
+		}
+	}, threadCount);
+
+	// the last row and column of every mip, and the border vertices the megatiles also hold, come from the border table
+	GeometryImageBorderVertex const* borderVertices = file.GetBorderVertices();
+	for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+	{
+		uint32_t mipSize = GetMipSize(mip);
+		for (uint32_t y = 0; y <= mipSize; ++y)
+		{
+			for (uint32_t x = 0; x <= mipSize; x += (y == 0 || y == mipSize) ? 1 : mipSize)
+			{
+				GeometryImageBorderVertex const& vertex = borderVertices[GetGeometryImageBorderVertexIndex(mipSize, x, y)];
+				size_t index = size_t(y) * (mipSize + 1) + x;
+				std::memcpy(&m_mips[mip].m_position[3 * index], vertex.position, sizeof(vertex.position));
+				m_mips[mip].m_albedo[index] = vertex.albedo;
+				std::memcpy(&m_mips[mip].m_normal[3 * index], vertex.normal, sizeof(vertex.normal));
+			}
+		}
+		borderVertices += GetGeometryImageBorderVertexCount(mipSize, 1);
+	}
+
+	// the bounds the task shader culls and selects mips with, as ParameterizedMesh::UploadFile extends them
+	m_boundsMipOffsets.resize(m_mipCount);
+	uint32_t megatileCount = 0;
+	for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+	{
+		m_boundsMipOffsets[mip] = megatileCount;
+		megatileCount += GetMegatilesPerRow(mip) * GetMegatilesPerRow(mip);
+	}
+	m_bounds.assign(file.GetBounds(), file.GetBounds() + megatileCount);
+	ExtendCoarseMegatileBoxes(m_bounds.data(), m_size, m_mipCount);
+
+	std::cout << "loaded " << m_size << "x" << m_size << " geometry image (" << m_mipCount << " mips, " << GetGeometryImagePositionEncodingName(header.positionEncoding)
+	          << " positions, " << GetGeometryImageAlbedoEncodingName(header.albedoEncoding) << " albedo, " << GetGeometryImageNormalEncodingName(header.normalEncoding)
+	          << " normals) from " << geometryImageFilepath << std::endl;
+	return true;
+}
+
+auto ReferenceGeometryImage::ComputeBounds(uint32_t threadCount) -> void
+{
+	m_boundsMipOffsets.resize(m_mipCount);
+	uint32_t megatileCount = 0;
+	for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+	{
+		m_boundsMipOffsets[mip] = megatileCount;
+		megatileCount += GetMegatilesPerRow(mip) * GetMegatilesPerRow(mip);
+	}
+	m_bounds.resize(megatileCount);
+
+	// positions are exact, no quantization to pad for
+	const float padding[3] = { 0, 0, 0 };
+	for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+	{
+		uint32_t mipSize = GetMipSize(mip);
+		uint32_t megatilesPerRow = GetMegatilesPerRow(mip);
+		ParallelFor(megatilesPerRow * megatilesPerRow, [&](uint32_t index)
+		{
+			// the megatile and the column and row it reads from its right and bottom neighbours (see MegatileBounds.h)
+			uint32_t firstX = (index % megatilesPerRow) * geometryImageMegatileSize;
+			uint32_t firstY = (index / megatilesPerRow) * geometryImageMegatileSize;
+			uint32_t width = std::min(geometryImageMegatileSize, mipSize - firstX) + 1;
+			uint32_t height = std::min(geometryImageMegatileSize, mipSize - firstY) + 1;
+			ComputeMegatileBounds(GetPosition(mip, firstX, firstY), width, height, mipSize + 1, padding, m_bounds[m_boundsMipOffsets[mip] + index]);
+		}, threadCount);
+	}
+
+	// as ParameterizedMesh does
+	ExtendCoarseMegatileBoxes(m_bounds.data(), m_size, m_mipCount);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../MeshShaderRasterization/GeometryImageFile.h"
+#include "../MeshShaderRasterization/MegatileBounds.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// every mip of a geometry image at full precision, all of it resident, as the reference rasterizer reads it
+// position is xyz floats in object space, albedo is RGBA8, normal is unit xyz floats (the layout of GeometryImageGenerator.h)
+// a file is decoded texel by texel the way the mesh shader decodes it, so the reference sees the vertices the GPU does; the procedural
+// sphere skips the encodings and gives the exact surface
+class ReferenceGeometryImage
+{
+public:
+	// the procedural sphere of size x size quads when geometryImageFilepath is empty (as ParameterizedMesh::Initialize)
+	auto Initialize(std::string const& geometryImageFilepath = {}, uint32_t size = 2048, uint32_t threadCount = 0) -> bool;
+
+	auto GetSize() const -> uint32_t { return m_size; }
+	auto GetMipCount() const -> uint32_t { return m_mipCount; }
+	auto GetParameterization() const -> GeometryImageParameterization { return m_parameterization; }
+	auto GetMipSize(uint32_t mip) const -> uint32_t { return (m_size >> mip) > 0 ? (m_size >> mip) : 1; }
+	auto GetMegatilesPerRow(uint32_t mip) const -> uint32_t { return (GetMipSize(mip) + 63) / 64; }
+
+	// vertex (x, y) of a mip, 0 <= x, y <= mip size (mips are grids of (s + 1) x (s + 1) vertices, see GeometryImageMipChain.h)
+	auto GetPosition(uint32_t mip, uint32_t x, uint32_t y) const -> float const* { return &m_mips[mip].m_position[3 * (size_t(y) * (GetMipSize(mip) + 1) + x)]; }
+	auto GetAlbedo(uint32_t mip, uint32_t x, uint32_t y) const -> uint32_t { return m_mips[mip].m_albedo[size_t(y) * (GetMipSize(mip) + 1) + x]; }
+	auto GetNormal(uint32_t mip, uint32_t x, uint32_t y) const -> float const* { return &m_mips[mip].m_normal[3 * (size_t(y) * (GetMipSize(mip) + 1) + x)]; }
+
+	// culling bounds of megatile (x, y) of a mip, as in megatileBuffer
+	auto GetBounds(uint32_t mip, uint32_t x, uint32_t y) const -> MegatileBounds const& { return m_bounds[m_boundsMipOffsets[mip] + y * GetMegatilesPerRow(mip) + x]; }
+
+private:
+	auto AllocateMips() -> void;
+	auto Generate(uint32_t threadCount) -> void;
+	auto Load(std::string const& geometryImageFilepath, uint32_t threadCount) -> bool;
+	auto ComputeBounds(uint32_t threadCount) -> void;
+
+	struct Mip
+	{
+		std::vector<float> m_position;
+		std::vector<uint32_t> m_albedo;
+		std::vector<float> m_normal;
+	};
+
+	uint32_t m_size = 0;
+	uint32_t m_mipCount = 0;
+	GeometryImageParameterization m_parameterization = GeometryImageParameterization_Octahedral;
+	std::vector<Mip> m_mips;
+	std::vector<MegatileBounds> m_bounds;
+	std::vector<uint32_t> m_boundsMipOffsets;
+};
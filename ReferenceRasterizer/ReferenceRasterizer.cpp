@@ -0,0 +1,957 @@
+#include "ReferenceRasterizer.h"
+#include "../MeshShaderRasterization/ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define REFERENCE_RASTERIZER_SSE2 1
+#endif
+
+namespace
+{
+	// the largest tile is 8x8 quads, 9x9 vertices, padded to whole SSE2 lanes
+	const uint32_t maxTileSize = 8;
+	const uint32_t maxTileVertexCount = ((maxTileSize + 1) * (maxTileSize + 1) + 3) & ~3u;
+
+	// the software rasterized depth of this frame, see encodeDepth in test_ms.glsl (a single frame never needs another epoch)
+	const uint32_t depthEpoch = 1;
+
+	// clipped exported triangles: a triangle cut by the near, far and w planes has at most 6 vertices
+	const uint32_t maxClippedVertexCount = 6;
+
+	inline auto FloatBits(float value) -> uint32_t
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline auto BitsFloat(uint32_t bits) -> float
+	{
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// keeps the smallest or the largest of value and what the pixel holds, true when value is kept
+	inline auto AtomicNearest(std::atomic<uint32_t>& pixel, uint32_t value, bool largest) -> bool
+	{
+		uint32_t previous = pixel.load(std::memory_order_relaxed);
+		while (largest ? value > previous : value < previous)
+		{
+			if (pixel.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	// as an RGBA8 unorm attachment or storage image stores it
+	inline auto PackUnorm4x8(float r, float g, float b, float a) -> uint32_t
+	{
+		auto quantize = [](float value) { return uint32_t(std::round(std::clamp(value, 0.0f, 1.0f) * 255)); };
+		return quantize(r) | (quantize(g) << 8) | (quantize(b) << 16) | (quantize(a) << 24);
+	}
+
+	inline auto UnpackUnorm8(uint32_t value, uint32_t channel) -> float
+	{
+		return float((value >> (8 * channel)) & 0xff) / 255;
+	}
+
+	inline auto Determinant3(float const a[3], float const b[3], float const c[3]) -> float
+	{
+		return a[0] * (b[1] * c[2] - b[2] * c[1]) - b[0] * (a[1] * c[2] - a[2] * c[1]) + c[0] * (a[1] * b[2] - a[2] * b[1]);
+	}
+
+	// edgeFunction in test_ms.glsl
+	inline auto EdgeFunction(float ax, float ay, float bx, float by, float px, float py) -> float
+	{
+		return (bx - ax) * (py - ay) - (px - ax) * (by - ay);
+	}
+
+	// vertex of an exported triangle in clip space, attributes as the G-buffer pass interpolates them
+	struct ClipVertex
+	{
+		float m_position[4];
+		float m_albedo[3];
+		float m_normal[3];
+	};
+
+	auto LerpClipVertex(ClipVertex const& a, ClipVertex const& b, float t, ClipVertex& result) -> void
+	{
+		for (uint32_t k = 0; k < 4; ++k)
+			result.m_position[k] = a.m_position[k] + (b.m_position[k] - a.m_position[k]) * t;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			result.m_albedo[k] = a.m_albedo[k] + (b.m_albedo[k] - a.m_albedo[k]) * t;
+			result.m_normal[k] = a.m_normal[k] + (b.m_normal[k] - a.m_normal[k]) * t;
+		}
+	}
+
+	// Sutherland-Hodgman against the plane where dot(plane, position) >= 0, returns the vertex count left
+	auto ClipPolygon(ClipVertex const* vertices, uint32_t count, float const plane[4], ClipVertex* result) -> uint32_t
+	{
+		uint32_t resultCount = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			ClipVertex const& a = vertices[i];
+			ClipVertex const& b = vertices[(i + 1) % count];
+			float da = plane[0] * a.m_position[0] + plane[1] * a.m_position[1] + plane[2] * a.m_position[2] + plane[3] * a.m_position[3];
+			float db = plane[0] * b.m_position[0] + plane[1] * b.m_position[1] + plane[2] * b.m_position[2] + plane[3] * b.m_position[3];
+			if (da >= 0)
+				result[resultCount++] = a;
+			if ((da >= 0) != (db >= 0))
+				LerpClipVertex(a, b, da / (da - db), result[resultCount++]);
+		}
+		return resultCount;
+	}
+}
+
+// the vertices of a tile, in lanes: structure of arrays, as the invocations of the mesh shader workgroup hold them
+struct ReferenceRasterizer::TileVertices
+{
+	float m_object[3][maxTileVertexCount];
+	float m_clip[4][maxTileVertexCount];
+	float m_ndc[3][maxTileVertexCount]; // clip xyz / w, what processTriangle works on
+	float m_albedo[maxTileVertexCount][3];
+	float m_normal[maxTileVertexCount][3];
+};
+
+auto GetReferenceTriangleClassName(ReferenceTriangleClass triangleClass) -> char const*
+{
+	switch (triangleClass)
+	{
+	case ReferenceTriangleClass_Backfacing: return "backfacing";
+	case ReferenceTriangleClass_OutsideDepth: return "outside depth range";
+	case ReferenceTriangleClass_OutsideViewport: return "outside viewport";
+	case ReferenceTriangleClass_NoPixel: return "no pixel";
+	case ReferenceTriangleClass_ExportedClipped: return "exported, clipped";
+	case ReferenceTriangleClass_ExportedLarge: return "exported, large";
+	case ReferenceTriangleClass_ExportedEdge: return "exported, viewport edge";
+	case ReferenceTriangleClass_SoftwareRasterized: return "software rasterized";
+	default: return "unknown";
+	}
+}
+
+auto GetReferenceProjectionMatrix(uint32_t width, uint32_t height, bool reversedZ, float projectionMatrix[4][4]) -> void
+{
+	std::memset(projectionMatrix, 0, 16 * sizeof(float));
+	if (reversedZ)
+	{
+		// seen from z = -cameraDistance, depth is nearPlane / w (MeshShadingRenderLoop::RenderLoop)
+		const float cameraDistance = 2.0f;
+		const float nearPlane = 0.05f;
+		projectionMatrix[0][0] = cameraDistance;
+		projectionMatrix[1][1] = cameraDistance;
+		projectionMatrix[2][3] = nearPlane;
+		projectionMatrix[3][2] = 1;
+		projectionMatrix[3][3] = cameraDistance;
+	}
+	else
+	{
+		projectionMatrix[0][0] = 1;
+		projectionMatrix[1][1] = 1;
+		projectionMatrix[2][2] = 1;
+		projectionMatrix[2][3] = 0.5f;
+		projectionMatrix[3][3] = 1;
+	}
+	projectionMatrix[1][1] *= float(width) / float(height);
+}
+
+auto ReferenceRasterizer::Initialize(ReferenceRasterizerSettings const& settings) -> bool
+{
+	if (settings.m_width == 0 || settings.m_height == 0 || settings.m_width > 0xffff || settings.m_height > 0xffff)
+	{
+		std::cerr << "unsupported resolution " << settings.m_width << "x" << settings.m_height << std::endl;
+		return false;
+	}
+	if (!IsMeshShaderPermutationSupported(settings.m_permutation, true))
+	{
+		std::cerr << "unsupported mesh shader permutation: tile " << settings.m_permutation.tileSize << ", workgroup " << settings.m_permutation.workgroupSize
+		          << ", software raster " << settings.m_permutation.softwareRasterMaxSize << std::endl;
+		return false;
+	}
+
+	m_settings = settings;
+	GetReferenceProjectionMatrix(settings.m_width, settings.m_height, settings.m_reversedZ, m_projectionMatrix);
+
+	size_t pixelCount = size_t(settings.m_width) * settings.m_height;
+	m_softwareDepth.reset(new std::atomic<uint32_t>[pixelCount]);
+	m_hardwareDepth.reset(new std::atomic<uint32_t>[pixelCount]);
+	for (uint32_t layer = 0; layer < 2; ++layer)
+	{
+		m_albedo[layer].reset(new std::atomic<uint32_t>[pixelCount]);
+		m_normal[layer].reset(new std::atomic<uint32_t>[pixelCount]);
+	}
+	m_image.assign(pixelCount, 0);
+	return true;
+}
+
+auto ReferenceRasterizer::AddMeshInstance(float const modelToWorldMatrix[3][4]) -> void
+{
+	Instance instance;
+	std::memcpy(instance.m_modelToWorldMatrix, modelToWorldMatrix, sizeof(instance.m_modelToWorldMatrix));
+
+	// culling happens in object space, as in test_ts.glsl
+	for (uint32_t row = 0; row < 4; ++row)
+	{
+		for (uint32_t column = 0; column < 4; ++column)
+		{
+			instance.m_objectToClip[row][column] = m_projectionMatrix[row][0] * modelToWorldMatrix[0][column] + m_projectionMatrix[row][1] * modelToWorldMatrix[1][column]
+			                                     + m_projectionMatrix[row][2] * modelToWorldMatrix[2][column] + (column == 3 ? m_projectionMatrix[row][3] : 0);
+		}
+	}
+
+	// the object space point where the x, y and w rows of the projection vanish
+	float const* x = instance.m_objectToClip[0];
+	float const* y = instance.m_objectToClip[1];
+	float const* w = instance.m_objectToClip[3];
+	float yzw[3][3] = { { x[1], x[2], x[3] }, { y[1], y[2], y[3] }, { w[1], w[2], w[3] } };
+	float xzw[3][3] = { { x[0], x[2], x[3] }, { y[0], y[2], y[3] }, { w[0], w[2], w[3] } };
+	float xyw[3][3] = { { x[0], x[1], x[3] }, { y[0], y[1], y[3] }, { w[0], w[1], w[3] } };
+	float xyz[3][3] = { { x[0], x[1], x[2] }, { y[0], y[1], y[2] }, { w[0], w[1], w[2] } };
+	instance.m_camera[0] = Determinant3(yzw[0], yzw[1], yzw[2]);
+	instance.m_camera[1] = -Determinant3(xzw[0], xzw[1], xzw[2]);
+	instance.m_camera[2] = Determinant3(xyw[0], xyw[1], xyw[2]);
+	instance.m_camera[3] = -Determinant3(xyz[0], xyz[1], xyz[2]);
+
+	m_instances.push_back(instance);
+}
+
+auto ReferenceRasterizer::EncodeDepth(float depth) const -> uint32_t
+{
+	return m_settings.m_reversedZ ? (depthEpoch << 24) | (FloatBits(depth) >> 6) : FloatBits(depth);
+}
+
+auto ReferenceRasterizer::DecodeDepth(uint32_t bits) const -> float
+{
+	if (!m_settings.m_reversedZ)
+		return BitsFloat(bits);
+	return (bits >> 24) == depthEpoch ? BitsFloat((bits & 0xffffff) << 6) : 0;
+}
+
+auto ReferenceRasterizer::Render(ReferenceGeometryImage const& geometryImage) -> void
+{
+	const uint32_t width = m_settings.m_width;
+	const uint32_t height = m_settings.m_height;
+	const uint32_t threadCount = m_settings.m_threadCount;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// the clears of the frame: the farthest depth, and a black G-buffer where the GPU leaves its attachments undefined
+	uint32_t farthestSoftwareDepth = m_settings.m_reversedZ ? 0 : FloatBits(1.0f);
+	uint32_t farthestHardwareDepth = FloatBits(m_settings.m_reversedZ ? 0.0f : 1.0f);
+	ParallelFor(height, [&](uint32_t y)
+	{
+		for (size_t pixel = size_t(y) * width; pixel < size_t(y + 1) * width; ++pixel)
+		{
+			m_softwareDepth[pixel].store(farthestSoftwareDepth, std::memory_order_relaxed);
+			m_hardwareDepth[pixel].store(farthestHardwareDepth, std::memory_order_relaxed);
+			for (uint32_t layer = 0; layer < 2; ++layer)
+			{
+				m_albedo[layer][pixel].store(0, std::memory_order_relaxed);
+				m_normal[layer][pixel].store(0, std::memory_order_relaxed);
+			}
+		}
+	}, threadCount);
+
+	ComputeMips(geometryImage);
+
+	// one work item per mip 0 megatile of every instance, those that are not the first of their unit return at once
+	uint32_t megatilesPerRow = geometryImage.GetMegatilesPerRow(0);
+	uint32_t megatileCount = megatilesPerRow * megatilesPerRow;
+	uint32_t itemCount = uint32_t(m_instances.size()) * megatileCount;
+	std::vector<ReferenceRasterizerStatistics> itemStatistics(itemCount, ReferenceRasterizerStatistics{});
+	ParallelFor(itemCount, [&](uint32_t item)
+	{
+		uint32_t megatile = item % megatileCount;
+		DrawMegatile(Pass_Depth, geometryImage, item / megatileCount, megatile % megatilesPerRow, megatile / megatilesPerRow, itemStatistics[item]);
+	}, threadCount);
+
+	auto depthEnd = std::chrono::steady_clock::now();
+
+	ParallelFor(itemCount, [&](uint32_t item)
+	{
+		uint32_t megatile = item % megatileCount;
+		ReferenceRasterizerStatistics statistics = {};
+		DrawMegatile(Pass_Gbuffer, geometryImage, item / megatileCount, megatile % megatilesPerRow, megatile / megatilesPerRow, statistics);
+	}, threadCount);
+
+	auto gbufferEnd = std::chrono::steady_clock::now();
+
+	Combine();
+
+	auto end = std::chrono::steady_clock::now();
+
+	m_statistics = {};
+	for (ReferenceRasterizerStatistics const& statistics : itemStatistics)
+	{
+		m_statistics.megatilesTested += statistics.megatilesTested;
+		m_statistics.megatilesFrustumCulled += statistics.megatilesFrustumCulled;
+		m_statistics.megatilesBackfaceCulled += statistics.megatilesBackfaceCulled;
+		m_statistics.tilesLaunched += statistics.tilesLaunched;
+		for (uint32_t i = 0; i < ReferenceTriangleClass_Count; ++i)
+			m_statistics.triangles[i] += statistics.triangles[i];
+		m_statistics.pixelsSoftwareRasterized += statistics.pixelsSoftwareRasterized;
+		m_statistics.pixelsScanlineRasterized += statistics.pixelsScanlineRasterized;
+	}
+
+	// the clears and the mips of the megatiles count with the depth pass
+	m_timings.depthPass = std::chrono::duration<double, std::milli>(depthEnd - start).count();
+	m_timings.gbufferPass = std::chrono::duration<double, std::milli>(gbufferEnd - depthEnd).count();
+	m_timings.combine = std::chrono::duration<double, std::milli>(end - gbufferEnd).count();
+}
+
+auto ReferenceRasterizer::ComputeMips(ReferenceGeometryImage const& geometryImage) -> void
+{
+	// every mip is resident: the drawn mip is the one the screen-space error calls for (drawnMip in test_ts.glsl)
+	uint32_t megatilesPerRow = geometryImage.GetMegatilesPerRow(0);
+	m_mips.resize(m_instances.size() * megatilesPerRow * megatilesPerRow);
+	ParallelFor(uint32_t(m_instances.size()) * megatilesPerRow, [&](uint32_t row)
+	{
+		Instance const& instance = m_instances[row / megatilesPerRow];
+		uint32_t y = row % megatilesPerRow;
+		for (uint32_t x = 0; x < megatilesPerRow; ++x)
+			m_mips[size_t(row) * megatilesPerRow + x] = uint8_t(GetLodMip(geometryImage, instance, x, y));
+	}, m_settings.m_threadCount);
+}
+
+auto ReferenceRasterizer::GetLodMip(ReferenceGeometryImage const& geometryImage, Instance const& instance, uint32_t x, uint32_t y) const -> uint32_t
+{
+	// lodMip in test_ts.glsl: the coarsest mip whose quads are at most lodPixelError pixels on screen
+	for (uint32_t mip = geometryImage.GetMipCount() - 1; mip > 0; --mip)
+	{
+		MegatileBounds const& bounds = geometryImage.GetBounds(mip, x >> mip, y >> mip);
+
+		// largest side of the box on screen, unclamped, as close as it gets when it crosses the camera plane
+		float boundsMin[2] = { 1e30f, 1e30f };
+		float boundsMax[2] = { -1e30f, -1e30f };
+		bool crossesCameraPlane = false;
+		for (uint32_t corner = 0; corner < 8; ++corner)
+		{
+			float position[3];
+			for (uint32_t k = 0; k < 3; ++k)
+				position[k] = (corner >> k) & 1 ? bounds.boundsMax[k] : bounds.boundsMin[k];
+
+			float clip[4];
+			for (uint32_t row = 0; row < 4; ++row)
+				clip[row] = position[0] * instance.m_objectToClip[row][0] + position[1] * instance.m_objectToClip[row][1] + position[2] * instance.m_objectToClip[row][2] + instance.m_objectToClip[row][3];
+			if (clip[3] <= 0)
+			{
+				crossesCameraPlane = true;
+				break;
+			}
+			for (uint32_t k = 0; k < 2; ++k)
+			{
+				boundsMin[k] = std::min(boundsMin[k], clip[k] / clip[3]);
+				boundsMax[k] = std::max(boundsMax[k], clip[k] / clip[3]);
+			}
+		}
+		if (crossesCameraPlane)
+			continue;
+
+		float pixels = std::max((boundsMax[0] - boundsMin[0]) * 0.5f * float(m_settings.m_width), (boundsMax[1] - boundsMin[1]) * 0.5f * float(m_settings.m_height));
+		uint32_t quadsPerRow = std::min(geometryImage.GetMipSize(mip), 64u);
+		if (pixels <= m_settings.m_lodPixelError * float(quadsPerRow))
+			return mip;
+	}
+	return 0;
+}
+
+auto ReferenceRasterizer::DrawMegatile(Pass pass, ReferenceGeometryImage const& geometryImage, uint32_t instanceIndex, uint32_t x, uint32_t y, ReferenceRasterizerStatistics& statistics) -> void
+{
+	Instance const& instance = m_instances[instanceIndex];
+	const uint32_t tileSize = m_settings.m_permutation.tileSize;
+	uint32_t megatilesPerRow = geometryImage.GetMegatilesPerRow(0);
+	uint8_t const* mips = &m_mips[size_t(instanceIndex) * megatilesPerRow * megatilesPerRow];
+	uint32_t mip = mips[y * megatilesPerRow + x];
+
+	// units merge the 2^u x 2^u megatiles drawn at the same mip past mip 3, drawn by their first one (as in test_ts.glsl)
+	uint32_t unitShift = uint32_t(std::clamp(int32_t(mip) - 3, 0, 3));
+	uint32_t unitSize = 1u << unitShift;
+	uint32_t unitFirstX = x & ~(unitSize - 1);
+	uint32_t unitFirstY = y & ~(unitSize - 1);
+	bool uniformUnit = true;
+	for (uint32_t unitY = 0; unitY < unitSize; ++unitY)
+	{
+		for (uint32_t unitX = 0; unitX < unitSize; ++unitX)
+			uniformUnit = uniformUnit && mips[(unitFirstY + unitY) * megatilesPerRow + unitFirstX + unitX] == mip;
+	}
+	unitShift = uniformUnit ? unitShift : 0;
+
+	uint32_t regionSize = (64u << unitShift) >> mip;
+	uint32_t firstMask = (1u << std::max(unitShift, uint32_t(std::max(int32_t(mip) - 6, 0)))) - 1;
+	if ((x & firstMask) != 0 || (y & firstMask) != 0)
+		return;
+
+	// frustum and normal cone culling against the bounds of the megatile of the drawn mip
+	MegatileBounds const& bounds = geometryImage.GetBounds(mip, x >> mip, y >> mip);
+	uint32_t outsidePlanes = 0x3f;
+	bool crossesNearPlane = false;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		float position[3];
+		for (uint32_t k = 0; k < 3; ++k)
+			position[k] = (corner >> k) & 1 ? bounds.boundsMax[k] : bounds.boundsMin[k];
+
+		float clip[4];
+		for (uint32_t row = 0; row < 4; ++row)
+			clip[row] = position[0] * instance.m_objectToClip[row][0] + position[1] * instance.m_objectToClip[row][1] + position[2] * instance.m_objectToClip[row][2] + instance.m_objectToClip[row][3];
+
+		outsidePlanes &= (clip[0] < -clip[3] ? 0x01 : 0) | (clip[0] > clip[3] ? 0x02 : 0) | (clip[1] < -clip[3] ? 0x04 : 0) | (clip[1] > clip[3] ? 0x08 : 0)
+		               | (clip[2] < 0 ? 0x10 : 0) | (clip[2] > clip[3] ? 0x20 : 0);
+		crossesNearPlane = crossesNearPlane || (m_settings.m_reversedZ ? clip[2] > clip[3] : clip[2] < 0) || clip[3] <= 0;
+	}
+	bool frustumCulled = outsidePlanes != 0;
+
+	bool backfaceCulled = false;
+	if (!frustumCulled && !crossesNearPlane && bounds.normalCone[3] > 0)
+	{
+		float const* camera = instance.m_camera;
+		float toCamera[3];
+		for (uint32_t k = 0; k < 3; ++k)
+			toCamera[k] = camera[k] - camera[3] * bounds.boundingSphere[k];
+		float spread = std::abs(camera[3]) * bounds.boundingSphere[3];
+		float sine = std::sqrt(1 - bounds.normalCone[3] * bounds.normalCone[3]);
+		float length = std::sqrt(toCamera[0] * toCamera[0] + toCamera[1] * toCamera[1] + toCamera[2] * toCamera[2]);
+		float cosine = bounds.normalCone[0] * toCamera[0] + bounds.normalCone[1] * toCamera[1] + bounds.normalCone[2] * toCamera[2];
+		backfaceCulled = cosine + spread <= -sine * (length + spread);
+	}
+
+	++statistics.megatilesTested;
+	statistics.megatilesFrustumCulled += frustumCulled ? 1 : 0;
+	statistics.megatilesBackfaceCulled += backfaceCulled ? 1 : 0;
+	if (frustumCulled || backfaceCulled)
+		return;
+
+	// the tiles of the unit, each one mesh shader workgroup
+	uint32_t tilesPerRow = std::max(regionSize / tileSize, 1u);
+	uint32_t quadsPerRow = std::clamp(regionSize, 1u, tileSize);
+	statistics.tilesLaunched += tilesPerRow * tilesPerRow;
+
+	TileVertices vertices;
+	for (uint32_t tile = 0; tile < tilesPerRow * tilesPerRow; ++tile)
+	{
+		int32_t tileX = int32_t((x << 6) >> mip) + int32_t(tile % tilesPerRow * tileSize);
+		int32_t tileY = int32_t((y << 6) >> mip) + int32_t(tile / tilesPerRow * tileSize);
+		ProcessVertices(pass, geometryImage, instanceIndex, tileX, tileY, mip, int32_t(x & ~7u), int32_t(y & ~7u), vertices);
+
+		// processQuad: (a, b, c) and (b, d, c) with a the top left corner
+		for (uint32_t quadY = 0; quadY < quadsPerRow; ++quadY)
+		{
+			for (uint32_t quadX = 0; quadX < quadsPerRow; ++quadX)
+			{
+				uint32_t position = quadY * (tileSize + 1) + quadX;
+				ProcessTriangle(pass, vertices, position, position + 1, position + tileSize + 1, statistics);
+				ProcessTriangle(pass, vertices, position + 1, position + tileSize + 2, position + tileSize + 1, statistics);
+			}
+		}
+	}
+}
+
+auto ReferenceRasterizer::ProcessVertices(Pass pass, ReferenceGeometryImage const& geometryImage, uint32_t instanceIndex, int32_t tileX, int32_t tileY, uint32_t mip, int32_t taskGroupX, int32_t taskGroupY, TileVertices& vertices) const -> void
+{
+	Instance const& instance = m_instances[instanceIndex];
+	const uint32_t tileSize = m_settings.m_permutation.tileSize;
+	const uint32_t vertexCount = (tileSize + 1) * (tileSize + 1);
+	const uint32_t megatilesPerRow = geometryImage.GetMegatilesPerRow(0);
+	int32_t mipSize = int32_t(geometryImage.GetMipSize(mip));
+	uint8_t const* mips = &m_mips[size_t(instanceIndex) * megatilesPerRow * megatilesPerRow];
+
+	// mip of a mip 0 megatile of the task group or of the ring around it, out of the image the one of the megatile across the fold, 0
+	// for the others (aroundMip in test_ms.glsl)
+	auto aroundMip = [&](int32_t megatileX, int32_t megatileY) -> int32_t
+	{
+		int32_t aroundX = megatileX - taskGroupX;
+		int32_t aroundY = megatileY - taskGroupY;
+		if (aroundX < -1 || aroundY < -1 || aroundX > 8 || aroundY > 8)
+			return 0;
+		int32_t foldedX;
+		int32_t foldedY;
+		if (!GetGeometryImageFoldedMegatile(geometryImage.GetParameterization(), int32_t(megatilesPerRow), megatileX, megatileY, foldedX, foldedY))
+			return 0;
+		return mips[foldedY * megatilesPerRow + foldedX];
+	};
+
+	// touchingMip: the coarsest mip of a vertex of the mip and of the megatiles touching it
+	auto touchingMip = [&](int32_t mip0X, int32_t mip0Y, int32_t vertexMip) -> int32_t
+	{
+		int32_t coarseMip = vertexMip;
+		for (int32_t megatileY = (mip0Y - 1) >> 6; megatileY <= mip0Y >> 6; ++megatileY)
+		{
+			for (int32_t megatileX = (mip0X - 1) >> 6; megatileX <= mip0X >> 6; ++megatileX)
+				coarseMip = std::max(coarseMip, aroundMip(megatileX, megatileY));
+		}
+		return coarseMip;
+	};
+
+	// coarseEdge: whether the vertex is between two vertices of the coarse mip along one axis, the first, the second and its weight (0
+	// on the grid along both, the first then being the vertex)
+	auto coarseEdge = [](int32_t mip0X, int32_t mip0Y, int32_t coarseMip, int32_t (&coarse)[2], int32_t (&next)[2], float& weight) -> bool
+	{
+		int32_t spacing = 1 << coarseMip;
+		int32_t offsetX = mip0X & (spacing - 1);
+		int32_t offsetY = mip0Y & (spacing - 1);
+		coarse[0] = (mip0X - offsetX) >> coarseMip;
+		coarse[1] = (mip0Y - offsetY) >> coarseMip;
+		next[0] = coarse[0] + (offsetX == 0 ? 0 : 1);
+		next[1] = coarse[1] + (offsetX == 0 ? 1 : 0);
+		weight = float(offsetX + offsetY) / float(spacing);
+		return (offsetX == 0) != (offsetY == 0);
+	};
+
+	auto mixPositions = [](float const* a, float const* b, float weight, float (&position)[3])
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+			position[k] = a[k] * (1 - weight) + b[k] * weight;
+	};
+
+	// coarseEdgeEndPosition: an end vertex of a coarse edge where the coarse side draws it
+	auto coarseEdgeEndPosition = [&](int32_t x, int32_t y, int32_t vertexMip, float (&position)[3])
+	{
+		int32_t coarseMip = touchingMip(x << vertexMip, y << vertexMip, vertexMip);
+		int32_t coarse[2];
+		int32_t next[2];
+		float weight;
+		if (coarseMip == vertexMip || !coarseEdge(x << vertexMip, y << vertexMip, coarseMip, coarse, next, weight))
+		{
+			bool onCoarseGrid = coarseMip != vertexMip && weight == 0;
+			float const* vertexPosition = onCoarseGrid ? geometryImage.GetPosition(uint32_t(coarseMip), uint32_t(coarse[0]), uint32_t(coarse[1]))
+			                                           : geometryImage.GetPosition(uint32_t(vertexMip), uint32_t(x), uint32_t(y));
+			std::copy(vertexPosition, vertexPosition + 3, position);
+			return;
+		}
+		mixPositions(geometryImage.GetPosition(uint32_t(coarseMip), uint32_t(coarse[0]), uint32_t(coarse[1])),
+			geometryImage.GetPosition(uint32_t(coarseMip), uint32_t(next[0]), uint32_t(next[1])), weight, position);
+	};
+
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		// vertices past the last one of the mip (mips smaller than a tile) repeat it
+		uint32_t clampedX = uint32_t(std::min(tileX + int32_t(vertex % (tileSize + 1)), mipSize));
+		uint32_t clampedY = uint32_t(std::min(tileY + int32_t(vertex / (tileSize + 1)), mipSize));
+		float const* position = geometryImage.GetPosition(mip, clampedX, clampedY);
+		float objectPosition[3] = { position[0], position[1], position[2] };
+
+		// stitchedPosition: a vertex on the border of megatiles drawn at coarser mips is the vertex of the coarsest on its grid, else
+		// moves onto its edge, whose ends are where the coarse side draws them
+		int32_t mip0X = int32_t(clampedX) << mip;
+		int32_t mip0Y = int32_t(clampedY) << mip;
+		int32_t coarseMip = touchingMip(mip0X, mip0Y, int32_t(mip));
+		int32_t coarse[2];
+		int32_t next[2];
+		float weight;
+		if (coarseMip != int32_t(mip) && coarseEdge(mip0X, mip0Y, coarseMip, coarse, next, weight))
+		{
+			float coarsePosition[3];
+			float nextPosition[3];
+			coarseEdgeEndPosition(coarse[0], coarse[1], coarseMip, coarsePosition);
+			coarseEdgeEndPosition(next[0], next[1], coarseMip, nextPosition);
+			mixPositions(coarsePosition, nextPosition, weight, objectPosition);
+		}
+		else if (coarseMip != int32_t(mip) && weight == 0)
+		{
+			float const* coarsePosition = geometryImage.GetPosition(uint32_t(coarseMip), uint32_t(coarse[0]), uint32_t(coarse[1]));
+			std::copy(coarsePosition, coarsePosition + 3, objectPosition);
+		}
+
+		for (uint32_t k = 0; k < 3; ++k)
+			vertices.m_object[k][vertex] = objectPosition[k];
+
+		if (pass == Pass_Gbuffer)
+		{
+			uint32_t albedo = geometryImage.GetAlbedo(mip, clampedX, clampedY);
+			float const* normal = geometryImage.GetNormal(mip, clampedX, clampedY);
+			float worldNormal[3];
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				vertices.m_albedo[vertex][k] = UnpackUnorm8(albedo, k);
+				worldNormal[k] = normal[0] * instance.m_modelToWorldMatrix[k][0] + normal[1] * instance.m_modelToWorldMatrix[k][1] + normal[2] * instance.m_modelToWorldMatrix[k][2];
+			}
+			float length = std::sqrt(worldNormal[0] * worldNormal[0] + worldNormal[1] * worldNormal[1] + worldNormal[2] * worldNormal[2]);
+			for (uint32_t k = 0; k < 3; ++k)
+				vertices.m_normal[vertex][k] = length > 0 ? worldNormal[k] / length : 0;
+		}
+	}
+	for (uint32_t vertex = vertexCount; vertex < ((vertexCount + 3) & ~3u); ++vertex)
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+			vertices.m_object[k][vertex] = 0;
+	}
+
+	// object to world to clip space, then the divide of processTriangle, 4 vertices at a time (the same operations in the same order
+	// in both paths, so the depth and G-buffer passes always agree)
+	float const (*modelToWorld)[4] = instance.m_modelToWorldMatrix;
+	float const (*projection)[4] = m_projectionMatrix;
+	uint32_t vertex = 0;
+#if REFERENCE_RASTERIZER_SSE2
+	for (; vertex < vertexCount; vertex += 4)
+	{
+		__m128 objectX = _mm_loadu_ps(&vertices.m_object[0][vertex]);
+		__m128 objectY = _mm_loadu_ps(&vertices.m_object[1][vertex]);
+		__m128 objectZ = _mm_loadu_ps(&vertices.m_object[2][vertex]);
+
+		__m128 world[3];
+		for (uint32_t row = 0; row < 3; ++row)
+		{
+			world[row] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(objectX, _mm_set1_ps(modelToWorld[row][0])), _mm_mul_ps(objectY, _mm_set1_ps(modelToWorld[row][1]))),
+				_mm_mul_ps(objectZ, _mm_set1_ps(modelToWorld[row][2]))), _mm_set1_ps(modelToWorld[row][3]));
+		}
+
+		__m128 clip[4];
+		for (uint32_t row = 0; row < 4; ++row)
+		{
+			clip[row] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(world[0], _mm_set1_ps(projection[row][0])), _mm_mul_ps(world[1], _mm_set1_ps(projection[row][1]))),
+				_mm_mul_ps(world[2], _mm_set1_ps(projection[row][2]))), _mm_set1_ps(projection[row][3]));
+			_mm_storeu_ps(&vertices.m_clip[row][vertex], clip[row]);
+		}
+		for (uint32_t row = 0; row < 3; ++row)
+			_mm_storeu_ps(&vertices.m_ndc[row][vertex], _mm_div_ps(clip[row], clip[3]));
+	}
+#endif
+	for (; vertex < vertexCount; ++vertex)
+	{
+		float world[3];
+		for (uint32_t row = 0; row < 3; ++row)
+		{
+			world[row] = vertices.m_object[0][vertex] * modelToWorld[row][0] + vertices.m_object[1][vertex] * modelToWorld[row][1];
+			world[row] = world[row] + vertices.m_object[2][vertex] * modelToWorld[row][2];
+			world[row] = world[row] + modelToWorld[row][3];
+		}
+		for (uint32_t row = 0; row < 4; ++row)
+		{
+			float clip = world[0] * projection[row][0] + world[1] * projection[row][1];
+			clip = clip + world[2] * projection[row][2];
+			vertices.m_clip[row][vertex] = clip + projection[row][3];
+		}
+		for (uint32_t row = 0; row < 3; ++row)
+			vertices.m_ndc[row][vertex] = vertices.m_clip[row][vertex] / vertices.m_clip[3][vertex];
+	}
+}
+
+auto ReferenceRasterizer::ProcessTriangle(Pass pass, TileVertices const& vertices, uint32_t ia, uint32_t ib, uint32_t ic, ReferenceRasterizerStatistics& statistics) -> void
+{
+	float ax = vertices.m_ndc[0][ia], ay = vertices.m_ndc[1][ia], az = vertices.m_ndc[2][ia];
+	float bx = vertices.m_ndc[0][ib], by = vertices.m_ndc[1][ib], bz = vertices.m_ndc[2][ib];
+	float cx = vertices.m_ndc[0][ic], cy = vertices.m_ndc[1][ic], cz = vertices.m_ndc[2][ic];
+
+	ReferenceTriangleClass triangleClass;
+	float pixelquad[4]; // min xy, max xy of the pixel centers covered, as in processTriangle
+	if ((bx - ax) * (cy - ay) - (cx - ax) * (by - ay) <= 0)
+	{
+		triangleClass = ReferenceTriangleClass_Backfacing;
+	}
+	else if ((az < 0 && bz < 0 && cz < 0) || (az > 1 && bz > 1 && cz > 1))
+	{
+		triangleClass = ReferenceTriangleClass_OutsideDepth;
+	}
+	else if (az < 0 || bz < 0 || cz < 0 || az > 1 || bz > 1 || cz > 1)
+	{
+		triangleClass = ReferenceTriangleClass_ExportedClipped;
+	}
+	else
+	{
+		pixelquad[0] = std::min({ ax, bx, cx });
+		pixelquad[1] = std::min({ ay, by, cy });
+		pixelquad[2] = std::max({ ax, bx, cx });
+		pixelquad[3] = std::max({ ay, by, cy });
+
+		float viewportSize[2] = { float(m_settings.m_width), float(m_settings.m_height) };
+		float offsets[4] = { -0.005f, -0.005f, 0.005f, 0.005f };
+		bool outsideViewport = pixelquad[0] < -1 || pixelquad[1] < -1 || pixelquad[2] > 1 || pixelquad[3] > 1;
+		for (uint32_t k = 0; k < 4; ++k)
+			pixelquad[k] = std::ceil((pixelquad[k] + 1) / 2 * viewportSize[k & 1] - 0.5f + offsets[k]);
+
+		float pixelsizeX = pixelquad[2] - pixelquad[0];
+		float pixelsizeY = pixelquad[3] - pixelquad[1];
+		if (outsideViewport)
+			triangleClass = ReferenceTriangleClass_OutsideViewport;
+		else if (std::min(pixelsizeX, pixelsizeY) <= 0)
+			triangleClass = ReferenceTriangleClass_NoPixel;
+		else if (std::max(pixelsizeX, pixelsizeY) > float(m_settings.m_permutation.softwareRasterMaxSize))
+			triangleClass = ReferenceTriangleClass_ExportedLarge;
+		else if (pixelquad[0] < 0 || pixelquad[1] < 0 || pixelquad[2] > viewportSize[0] || pixelquad[3] > viewportSize[1])
+			triangleClass = ReferenceTriangleClass_ExportedEdge;
+		else
+			triangleClass = ReferenceTriangleClass_SoftwareRasterized;
+	}
+
+	++statistics.triangles[triangleClass];
+	if (triangleClass == ReferenceTriangleClass_SoftwareRasterized)
+	{
+		RasterizeSoftwareTriangle(pass, vertices, ia, ib, ic, int32_t(pixelquad[0]), int32_t(pixelquad[1]), uint32_t(pixelquad[2] - pixelquad[0]),
+			uint32_t(pixelquad[3] - pixelquad[1]), statistics);
+	}
+	else if (triangleClass >= ReferenceTriangleClass_ExportedClipped)
+	{
+		RasterizeExportedTriangle(pass, vertices, ia, ib, ic, statistics);
+	}
+}
+
+auto ReferenceRasterizer::RasterizeSoftwareTriangle(Pass pass, TileVertices const& vertices, uint32_t ia, uint32_t ib, uint32_t ic, int32_t firstX, int32_t firstY, uint32_t width, uint32_t height, ReferenceRasterizerStatistics& statistics) -> void
+{
+	float ax = vertices.m_ndc[0][ia], ay = vertices.m_ndc[1][ia];
+	float bx = vertices.m_ndc[0][ib], by = vertices.m_ndc[1][ib];
+	float cx = vertices.m_ndc[0][ic], cy = vertices.m_ndc[1][ic];
+	float inverseWidth = 1 / float(m_settings.m_width);
+	float inverseHeight = 1 / float(m_settings.m_height);
+
+	// rasterPixel in test_ms.glsl, for every pixel of the footprint
+	for (uint32_t pixel = 0; pixel < width * height; ++pixel)
+	{
+		int32_t pixelX = firstX + int32_t(pixel % width);
+		int32_t pixelY = firstY + int32_t(pixel / width);
+
+		// the triangle is counter-clockwise: the pixel center is covered when no edge function is negative
+		float px = (float(pixelX) + 0.5f) * inverseWidth * 2 - 1;
+		float py = (float(pixelY) + 0.5f) * inverseHeight * 2 - 1;
+		float edges[3] = { EdgeFunction(bx, by, cx, cy, px, py), EdgeFunction(cx, cy, ax, ay, px, py), EdgeFunction(ax, ay, bx, by, px, py) };
+		if (edges[0] < 0 || edges[1] < 0 || edges[2] < 0)
+			continue;
+
+		// depth is linear in screen space, attributes are interpolated perspective-correct
+		float sum = edges[0] + edges[1] + edges[2];
+		float bary[3] = { edges[0] / sum, edges[1] / sum, edges[2] / sum };
+		float d = bary[0] * vertices.m_ndc[2][ia] + bary[1] * vertices.m_ndc[2][ib] + bary[2] * vertices.m_ndc[2][ic];
+
+		size_t address = size_t(pixelY) * m_settings.m_width + size_t(pixelX);
+		if (pass == Pass_Depth)
+		{
+			++statistics.pixelsSoftwareRasterized;
+			AtomicNearest(m_softwareDepth[address], EncodeDepth(d), m_settings.m_reversedZ);
+		}
+		else if (EncodeDepth(d) == m_softwareDepth[address].load(std::memory_order_relaxed))
+		{
+			float perspectiveBary[3] = { bary[0] / vertices.m_clip[3][ia], bary[1] / vertices.m_clip[3][ib], bary[2] / vertices.m_clip[3][ic] };
+			float perspectiveSum = perspectiveBary[0] + perspectiveBary[1] + perspectiveBary[2];
+			float albedo[3];
+			float normal[3];
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				float weights[3] = { perspectiveBary[0] / perspectiveSum, perspectiveBary[1] / perspectiveSum, perspectiveBary[2] / perspectiveSum };
+				albedo[k] = weights[0] * vertices.m_albedo[ia][k] + weights[1] * vertices.m_albedo[ib][k] + weights[2] * vertices.m_albedo[ic][k];
+				normal[k] = weights[0] * vertices.m_normal[ia][k] + weights[1] * vertices.m_normal[ib][k] + weights[2] * vertices.m_normal[ic][k];
+			}
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			float scale = length > 0 ? 1 / length : 0;
+			m_albedo[1][address].store(PackUnorm4x8(albedo[0], albedo[1], albedo[2], 0), std::memory_order_relaxed);
+			m_normal[1][address].store(PackUnorm4x8((normal[0] * scale + 1) / 2, (normal[1] * scale + 1) / 2, (normal[2] * scale + 1) / 2, 0.5f), std::memory_order_relaxed);
+		}
+	}
+}
+
+auto ReferenceRasterizer::RasterizeExportedTriangle(Pass pass, TileVertices const& vertices, uint32_t ia, uint32_t ib, uint32_t ic, ReferenceRasterizerStatistics& statistics) -> void
+{
+	// the hardware path: no face culling (processTriangle already did it), clipped to 0 <= z <= w without depth clamp, x and y are
+	// left to the guard band and the viewport
+	ClipVertex polygons[2][maxClippedVertexCount];
+	uint32_t indices[3] = { ia, ib, ic };
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		ClipVertex& vertex = polygons[0][i];
+		for (uint32_t k = 0; k < 4; ++k)
+			vertex.m_position[k] = vertices.m_clip[k][indices[i]];
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			vertex.m_albedo[k] = pass == Pass_Gbuffer ? vertices.m_albedo[indices[i]][k] : 0;
+			vertex.m_normal[k] = pass == Pass_Gbuffer ? vertices.m_normal[indices[i]][k] : 0;
+		}
+	}
+
+	// z >= 0, w - z >= 0, and w > 0 so that the divide stays finite
+	const float planes[3][4] = { { 0, 0, 1, 0 }, { 0, 0, -1, 1 }, { 0, 0, 0, 1 } };
+	uint32_t count = 3;
+	uint32_t polygon = 0;
+	for (uint32_t plane = 0; plane < 3 && count >= 3; ++plane)
+	{
+		count = ClipPolygon(polygons[polygon], count, planes[plane], polygons[polygon ^ 1]);
+		polygon ^= 1;
+	}
+	if (count < 3)
+		return;
+
+	// window coordinates, attributes divided by w to interpolate them linearly in screen space
+	struct ScreenVertex
+	{
+		float x;
+		float y;
+		float z;
+		float inverseW;
+		float albedo[3];
+		float normal[3];
+	};
+	ScreenVertex screen[maxClippedVertexCount];
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		ClipVertex const& vertex = polygons[polygon][i];
+		float w = vertex.m_position[3];
+		if (w <= 0)
+			return;
+		screen[i].x = (vertex.m_position[0] / w + 1) / 2 * float(m_settings.m_width);
+		screen[i].y = (vertex.m_position[1] / w + 1) / 2 * float(m_settings.m_height);
+		screen[i].z = std::clamp(vertex.m_position[2] / w, 0.0f, 1.0f);
+		screen[i].inverseW = 1 / w;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			screen[i].albedo[k] = vertex.m_albedo[k] / w;
+			screen[i].normal[k] = vertex.m_normal[k] / w;
+		}
+	}
+
+	// the polygon is convex, as a fan
+	for (uint32_t fan = 1; fan + 1 < count; ++fan)
+	{
+		ScreenVertex const* v[3] = { &screen[0], &screen[fan], &screen[fan + 1] };
+		float area = EdgeFunction(v[0]->x, v[0]->y, v[1]->x, v[1]->y, v[2]->x, v[2]->y);
+		if (area == 0)
+			continue;
+		if (area < 0)
+		{
+			std::swap(v[1], v[2]);
+			area = -area;
+		}
+
+		// edge i goes from vertex i to i + 1 and is opposite vertex i + 2; the top-left rule keeps the pixel centers exactly on top edges
+		// and on left edges (down the screen, y grows)
+		bool ownsEdge[3];
+		for (uint32_t edge = 0; edge < 3; ++edge)
+		{
+			float dx = v[(edge + 1) % 3]->x - v[edge]->x;
+			float dy = v[(edge + 1) % 3]->y - v[edge]->y;
+			ownsEdge[edge] = dy < 0 || (dy == 0 && dx > 0);
+		}
+		auto inside = [&](float px, float py, float edges[3]) -> bool
+		{
+			for (uint32_t edge = 0; edge < 3; ++edge)
+			{
+				ScreenVertex const* a = v[edge];
+				ScreenVertex const* b = v[(edge + 1) % 3];
+				edges[edge] = EdgeFunction(a->x, a->y, b->x, b->y, px, py);
+				if (edges[edge] < 0 || (edges[edge] == 0 && !ownsEdge[edge]))
+					return false;
+			}
+			return true;
+		};
+
+		float minY = std::min({ v[0]->y, v[1]->y, v[2]->y });
+		float maxY = std::max({ v[0]->y, v[1]->y, v[2]->y });
+		int32_t firstRow = std::max(int32_t(std::ceil(minY - 0.5f)), 0);
+		int32_t lastRow = std::min(int32_t(std::floor(maxY - 0.5f)), int32_t(m_settings.m_height) - 1);
+		for (int32_t row = firstRow; row <= lastRow; ++row)
+		{
+			// the span of the row between the edges, from where each crosses the row; a pixel of margin on both sides absorbs the
+			// rounding of the crossings, the edge functions decide
+			float py = float(row) + 0.5f;
+			float spanMin = -1e30f;
+			float spanMax = 1e30f;
+			for (uint32_t edge = 0; edge < 3; ++edge)
+			{
+				ScreenVertex const* a = v[edge];
+				ScreenVertex const* b = v[(edge + 1) % 3];
+				float slope = -(b->y - a->y); // the edge function is slope * px + offset along the row
+				float offset = (b->x - a->x) * (py - a->y) + (b->y - a->y) * a->x;
+				if (slope > 0)
+					spanMin = std::max(spanMin, -offset / slope);
+				else if (slope < 0)
+					spanMax = std::min(spanMax, -offset / slope);
+				else if (offset < 0)
+					spanMax = spanMin - 1;
+			}
+			if (spanMax < spanMin)
+				continue;
+
+			int32_t firstColumn = std::max(int32_t(std::ceil(std::max(spanMin, -1.0f) - 0.5f)) - 1, 0);
+			int32_t lastColumn = std::min(int32_t(std::floor(std::min(spanMax, float(m_settings.m_width) + 1) - 0.5f)) + 1, int32_t(m_settings.m_width) - 1);
+			for (int32_t column = firstColumn; column <= lastColumn; ++column)
+			{
+				float edges[3];
+				if (!inside(float(column) + 0.5f, py, edges))
+					continue;
+
+				// the weight of a vertex is the edge function of the edge opposite it
+				float weights[3] = { edges[1] / area, edges[2] / area, edges[0] / area };
+				float depth = std::clamp(weights[0] * v[0]->z + weights[1] * v[1]->z + weights[2] * v[2]->z, 0.0f, 1.0f);
+
+				size_t address = size_t(row) * m_settings.m_width + size_t(column);
+				if (pass == Pass_Depth)
+				{
+					++statistics.pixelsScanlineRasterized;
+					AtomicNearest(m_hardwareDepth[address], FloatBits(depth), m_settings.m_reversedZ);
+				}
+				else if (FloatBits(depth) == m_hardwareDepth[address].load(std::memory_order_relaxed))
+				{
+					// test_fs.glsl writes the interpolated albedo and normal as they are, the RGBA8 attachments clamp them
+					float inverseW = weights[0] * v[0]->inverseW + weights[1] * v[1]->inverseW + weights[2] * v[2]->inverseW;
+					float albedo[3];
+					float normal[3];
+					for (uint32_t k = 0; k < 3; ++k)
+					{
+						albedo[k] = (weights[0] * v[0]->albedo[k] + weights[1] * v[1]->albedo[k] + weights[2] * v[2]->albedo[k]) / inverseW;
+						normal[k] = (weights[0] * v[0]->normal[k] + weights[1] * v[1]->normal[k] + weights[2] * v[2]->normal[k]) / inverseW;
+					}
+					m_albedo[0][address].store(PackUnorm4x8(albedo[0], albedo[1], albedo[2], 0), std::memory_order_relaxed);
+					m_normal[0][address].store(PackUnorm4x8(normal[0], normal[1], normal[2], 1), std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+}
+
+auto ReferenceRasterizer::Combine() -> void
+{
+	const uint32_t width = m_settings.m_width;
+	const float lightLength = std::sqrt(3.0f);
+
+	// combine_and_light.glsl
+	ParallelFor(m_settings.m_height, [&](uint32_t y)
+	{
+		for (size_t pixel = size_t(y) * width; pixel < size_t(y + 1) * width; ++pixel)
+		{
+			// the layer of the nearest depth, the mesh shader one on ties
+			float framebufferDepth = BitsFloat(m_hardwareDepth[pixel].load(std::memory_order_relaxed));
+			float meshShaderDepth = DecodeDepth(m_softwareDepth[pixel].load(std::memory_order_relaxed));
+			uint32_t layer = (m_settings.m_reversedZ ? meshShaderDepth >= framebufferDepth : framebufferDepth >= meshShaderDepth) ? 1 : 0;
+
+			uint32_t albedo = m_albedo[layer][pixel].load(std::memory_order_relaxed);
+			uint32_t normal = m_normal[layer][pixel].load(std::memory_order_relaxed);
+			float cosine = 0;
+			for (uint32_t k = 0; k < 3; ++k)
+				cosine += (UnpackUnorm8(normal, k) * 2 - 1) / lightLength;
+			float light = 0.4f + (1 - 0.4f) * std::clamp(-cosine, 0.0f, 1.0f);
+
+			float color[3];
+			for (uint32_t k = 0; k < 3; ++k)
+				color[k] = std::pow(UnpackUnorm8(albedo, k) * light, 2.2f);
+			m_image[pixel] = PackUnorm4x8(color[0], color[1], color[2], float(layer));
+		}
+	}, m_settings.m_threadCount);
+}
+
+auto ReferenceRasterizer::WriteImage(std::string const& filepath) const -> bool
+{
+	FILE* file = fopen(filepath.c_str(), "wb");
+	if (!file)
+	{
+		std::cerr << "could not open " << filepath << " for writing" << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> rgb(m_image.size() * 3);
+	for (size_t pixel = 0; pixel < m_image.size(); ++pixel)
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+			rgb[3 * pixel + k] = uint8_t(m_image[pixel] >> (8 * k));
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", m_settings.m_width, m_settings.m_height);
+	bool written = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	written = fclose(file) == 0 && written;
+	if (!written)
+		std::cerr << "could not write " << filepath << std::endl;
+	return written;
+}
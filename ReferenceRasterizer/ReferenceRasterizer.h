@@ -0,0 +1,137 @@
+#pragma once
+
+#include "ReferenceGeometryImage.h"
+#include "../MeshShaderRasterization/MeshShaderProfile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// CPU reference of the hybrid rasterizer, for machines without a mesh shader GPU: golden images, triangle statistics and a throughput
+// baseline
+// a frame runs the passes of MeshShadingRenderLoop without occlusion culling:
+// * megatile expansion (test_ts.glsl): the mip of every mip 0 megatile from its screen-space error, units of megatiles past mip 3,
+//   frustum and normal cone culling, then the tiles of TILE_SIZE x TILE_SIZE quads of each drawn megatile
+// * the depth pass (test_ms.glsl): stitched tile vertices, processTriangle classifying each triangle, the small ones rasterized one pixel
+//   at a time into the software depth with atomics, the exported ones scanline rasterized into the hardware depth
+// * the G-buffer pass: the same triangles again, writing albedo and normal where their depth is the one kept
+// * combine_and_light.glsl: the layer of the nearest depth, lit
+// megatiles spread over threads, the vertices of a tile are transformed 4 lanes at a time with SSE2
+// every mip is resident (no streaming) and the hardware path is one rasterizer among others: edges and coverage follow Vulkan's rules
+// but the GPU may round differently, so images match the GPU's up to a few pixels along edges
+struct ReferenceRasterizerSettings
+{
+	uint32_t m_width;
+	uint32_t m_height;
+	MeshShaderPermutation m_permutation; // the tile size and software raster size matter, the workgroup size only orders the GPU's work
+	float m_lodPixelError;
+	bool m_reversedZ;
+	uint32_t m_threadCount;              // 0 to use every core
+};
+
+// what processTriangle does with a triangle
+enum ReferenceTriangleClass
+{
+	ReferenceTriangleClass_Backfacing = 0,    // face culling
+	ReferenceTriangleClass_OutsideDepth,      // in front of the near plane or behind the far plane
+	ReferenceTriangleClass_OutsideViewport,   // its box leaves clip space (all of them, also those only partly outside)
+	ReferenceTriangleClass_NoPixel,           // covers no pixel center
+	ReferenceTriangleClass_ExportedClipped,   // crosses the near or far plane
+	ReferenceTriangleClass_ExportedLarge,     // footprint over softwareRasterMaxSize
+	ReferenceTriangleClass_ExportedEdge,      // footprint crossing the viewport edge
+	ReferenceTriangleClass_SoftwareRasterized,
+	ReferenceTriangleClass_Count
+};
+
+auto GetReferenceTriangleClassName(ReferenceTriangleClass triangleClass) -> char const*;
+
+// of the depth pass, the G-buffer pass draws the same
+struct ReferenceRasterizerStatistics
+{
+	uint64_t megatilesTested;
+	uint64_t megatilesFrustumCulled;
+	uint64_t megatilesBackfaceCulled;
+	uint64_t tilesLaunched;
+	uint64_t triangles[ReferenceTriangleClass_Count];
+	uint64_t pixelsSoftwareRasterized; // software rasterized triangles covering the pixel center
+	uint64_t pixelsScanlineRasterized; // exported triangles covering the pixel center, after clipping
+};
+
+struct ReferenceRasterizerTimings
+{
+	double depthPass; // ms
+	double gbufferPass;
+	double combine;
+};
+
+class ReferenceRasterizer
+{
+public:
+	auto Initialize(ReferenceRasterizerSettings const& settings) -> bool;
+
+	// rows of modelToWorldMatrix are the world x, y and z of an object position, as in MeshShadingRenderLoop::AddMeshInstance
+	auto AddMeshInstance(float const modelToWorldMatrix[3][4]) -> void;
+
+	// draws the instances of the geometry image
+	auto Render(ReferenceGeometryImage const& geometryImage) -> void;
+
+	// RGBA8 as combine_and_light.glsl writes the swapchain: the lit color, and the layer in alpha (255 where the mesh shader won)
+	auto GetImage() const -> std::vector<uint32_t> const& { return m_image; }
+	auto GetStatistics() const -> ReferenceRasterizerStatistics const& { return m_statistics; }
+	auto GetTimings() const -> ReferenceRasterizerTimings const& { return m_timings; }
+
+	// binary PPM of the color
+	auto WriteImage(std::string const& filepath) const -> bool;
+
+private:
+	enum Pass
+	{
+		Pass_Depth,
+		Pass_Gbuffer,
+	};
+
+	struct Instance
+	{
+		float m_modelToWorldMatrix[3][4];
+		float m_objectToClip[4][4]; // clip component i is the dot of row i with the object position
+		float m_camera[4];          // cameraPosition in test_ts.glsl
+	};
+
+	struct TileVertices;
+
+	auto ComputeMips(ReferenceGeometryImage const& geometryImage) -> void;
+	auto GetLodMip(ReferenceGeometryImage const& geometryImage, Instance const& instance, uint32_t x, uint32_t y) const -> uint32_t;
+	auto DrawMegatile(Pass pass, ReferenceGeometryImage const& geometryImage, uint32_t instanceIndex, uint32_t x, uint32_t y, ReferenceRasterizerStatistics& statistics) -> void;
+	auto ProcessVertices(Pass pass, ReferenceGeometryImage const& geometryImage, uint32_t instanceIndex, int32_t tileX, int32_t tileY, uint32_t mip, int32_t taskGroupX, int32_t taskGroupY, TileVertices& vertices) const -> void;
+	auto ProcessTriangle(Pass pass, TileVertices const& vertices, uint32_t ia, uint32_t ib, uint32_t ic, ReferenceRasterizerStatistics& statistics) -> void;
+	auto RasterizeSoftwareTriangle(Pass pass, TileVertices const& vertices, uint32_t ia, uint32_t ib, uint32_t ic, int32_t firstX, int32_t firstY, uint32_t width, uint32_t height, ReferenceRasterizerStatistics& statistics) -> void;
+	auto RasterizeExportedTriangle(Pass pass, TileVertices const& vertices, uint32_t ia, uint32_t ib, uint32_t ic, ReferenceRasterizerStatistics& statistics) -> void;
+	auto Combine() -> void;
+
+	auto EncodeDepth(float depth) const -> uint32_t;
+	auto DecodeDepth(uint32_t bits) const -> float;
+
+	ReferenceRasterizerSettings m_settings = {};
+	float m_projectionMatrix[4][4] = {};
+	std::vector<Instance> m_instances;
+
+	// drawn mip of every mip 0 megatile of each instance, s_mips in test_ts.glsl
+	std::vector<uint8_t> m_mips;
+
+	// software rasterized depth as encodeDepth stores it, and the float bits of the hardware depth (both ordered as uints)
+	std::unique_ptr<std::atomic<uint32_t>[]> m_softwareDepth;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_hardwareDepth;
+	// RGBA8 albedo and normal of the hardware layer (0) and of the software rasterized one (1), written by the triangles passing the
+	// depth test of the G-buffer pass
+	std::unique_ptr<std::atomic<uint32_t>[]> m_albedo[2];
+	std::unique_ptr<std::atomic<uint32_t>[]> m_normal[2];
+	std::vector<uint32_t> m_image;
+
+	ReferenceRasterizerStatistics m_statistics = {};
+	ReferenceRasterizerTimings m_timings = {};
+};
+
+// the projection MeshShadingRenderLoop draws with (ViewportConstants.projectionMatrix): row i gives clip component i
+auto GetReferenceProjectionMatrix(uint32_t width, uint32_t height, bool reversedZ, float projectionMatrix[4][4]) -> void;
@@ -0,0 +1,148 @@
+#include "ReferenceGeometryImage.h"
+#include "ReferenceRasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+auto PrintUsage() -> void
+{
+	std::cerr << "usage: ReferenceRasterizer [options]" << std::endl;
+	std::cerr << "  -geometryImage <file.gimg>  geometry image to draw (default: the procedural sphere)" << std::endl;
+	std::cerr << "  -size <n>                   size of the procedural sphere, a multiple of 512 (default 2048)" << std::endl;
+	std::cerr << "  -resolution <w> <h>         viewport (default 1280 720)" << std::endl;
+	std::cerr << "  -instanceGrid <n>           n x n copies of the mesh, as the renderer draws them (default 1)" << std::endl;
+	std::cerr << "  -lodPixelError <pixels>     (default 2)" << std::endl;
+	std::cerr << "  -tileSize 4|8               quads per side of a mesh shader tile (default 8)" << std::endl;
+	std::cerr << "  -softwareRasterSize <n>     pixels across of the footprints rasterized in software, up to 8 (default 1)" << std::endl;
+	std::cerr << "  -reversedZ                  draws with the reversed-Z projection" << std::endl;
+	std::cerr << "  -threads <n>                worker threads (default: every core)" << std::endl;
+	std::cerr << "  -frames <n>                 frames timed, the statistics are those of the last one (default 1)" << std::endl;
+	std::cerr << "  -output <file.ppm>          writes the image" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string geometryImageFilepath;
+	std::string outputFilepath;
+	uint32_t size = 2048;
+	uint32_t instanceGridSize = 1;
+	uint32_t frameCount = 1;
+
+	ReferenceRasterizerSettings settings;
+	settings.m_width = 1280;
+	settings.m_height = 720;
+	settings.m_permutation = defaultMeshShaderPermutation;
+	settings.m_lodPixelError = 2.0f;
+	settings.m_reversedZ = false;
+	settings.m_threadCount = 0;
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if (strcmp(argv[i], "-geometryImage") == 0 && i + 1 < argc)
+				geometryImageFilepath = argv[++i];
+			else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+				size = uint32_t(std::stoul(argv[++i]));
+			else if (strcmp(argv[i], "-resolution") == 0 && i + 2 < argc)
+			{
+				settings.m_width = uint32_t(std::stoul(argv[++i]));
+				settings.m_height = uint32_t(std::stoul(argv[++i]));
+			}
+			else if (strcmp(argv[i], "-instanceGrid") == 0 && i + 1 < argc)
+				instanceGridSize = std::max(1u, uint32_t(std::stoul(argv[++i])));
+			else if (strcmp(argv[i], "-lodPixelError") == 0 && i + 1 < argc)
+				settings.m_lodPixelError = std::max(0.0f, std::stof(argv[++i]));
+			else if (strcmp(argv[i], "-tileSize") == 0 && i + 1 < argc)
+				settings.m_permutation.tileSize = uint32_t(std::stoul(argv[++i]));
+			else if (strcmp(argv[i], "-softwareRasterSize") == 0 && i + 1 < argc)
+				settings.m_permutation.softwareRasterMaxSize = std::min(8u, uint32_t(std::stoul(argv[++i])));
+			else if (strcmp(argv[i], "-reversedZ") == 0)
+				settings.m_reversedZ = true;
+			else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+				settings.m_threadCount = uint32_t(std::stoul(argv[++i]));
+			else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+				frameCount = std::max(1u, uint32_t(std::stoul(argv[++i])));
+			else if (strcmp(argv[i], "-output") == 0 && i + 1 < argc)
+				outputFilepath = argv[++i];
+			else
+			{
+				PrintUsage();
+				return -1;
+			}
+		}
+	}
+	catch (std::logic_error const&) // a value std::stoul or std::stof cannot read
+	{
+		PrintUsage();
+		return -1;
+	}
+
+	ReferenceGeometryImage geometryImage;
+	if (!geometryImage.Initialize(geometryImageFilepath, size, settings.m_threadCount))
+		return -2;
+
+	ReferenceRasterizer rasterizer;
+	if (!rasterizer.Initialize(settings))
+		return -1;
+
+	// copies of the mesh on a grid, each scaled down to its cell (as in MeshShaderRasterization's main.cpp)
+	for (uint32_t i = 0; i < instanceGridSize * instanceGridSize; ++i)
+	{
+		float scale = 1.0f / float(instanceGridSize);
+		float modelToWorldMatrix[3][4] =
+		{
+			{ scale, 0, 0, float(i % instanceGridSize) * scale - 0.5f },
+			{ 0, scale, 0, float(i / instanceGridSize) * scale - 0.5f },
+			{ 0, 0, scale, 0 },
+		};
+		rasterizer.AddMeshInstance(modelToWorldMatrix);
+	}
+
+	ReferenceRasterizerTimings total = {};
+	for (uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		rasterizer.Render(geometryImage);
+		ReferenceRasterizerTimings const& timings = rasterizer.GetTimings();
+		total.depthPass += timings.depthPass;
+		total.gbufferPass += timings.gbufferPass;
+		total.combine += timings.combine;
+	}
+
+	ReferenceRasterizerStatistics const& statistics = rasterizer.GetStatistics();
+	uint64_t triangleCount = 0;
+	for (uint32_t i = 0; i < ReferenceTriangleClass_Count; ++i)
+		triangleCount += statistics.triangles[i];
+
+	std::cout << "megatiles: " << statistics.megatilesTested << " tested, " << statistics.megatilesFrustumCulled << " frustum culled, "
+	          << statistics.megatilesBackfaceCulled << " backface culled, " << statistics.tilesLaunched << " tiles" << std::endl;
+	std::cout << "triangles: " << triangleCount << std::endl;
+	std::cout << std::fixed << std::setprecision(2);
+	for (uint32_t i = 0; i < ReferenceTriangleClass_Count; ++i)
+	{
+		std::cout << "  " << std::left << std::setw(24) << GetReferenceTriangleClassName(ReferenceTriangleClass(i)) << std::right << std::setw(12) << statistics.triangles[i]
+		          << std::setw(8) << (triangleCount > 0 ? 100.0 * double(statistics.triangles[i]) / double(triangleCount) : 0.0) << " %" << std::endl;
+	}
+	std::cout << "pixels: " << statistics.pixelsSoftwareRasterized << " software rasterized, " << statistics.pixelsScanlineRasterized << " scanline rasterized" << std::endl;
+
+	double depthPass = total.depthPass / frameCount;
+	double gbufferPass = total.gbufferPass / frameCount;
+	double combine = total.combine / frameCount;
+	std::cout << "pass times (ms, mean of " << frameCount << " frames): depth " << depthPass << ", G-buffer " << gbufferPass << ", combine " << combine
+	          << ", total " << (depthPass + gbufferPass + combine) << std::endl;
+	std::cout << "depth pass throughput: " << (depthPass > 0 ? double(triangleCount) / (depthPass * 1000) : 0.0) << " Mtriangles/s" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+
+	if (!outputFilepath.empty())
+	{
+		if (!rasterizer.WriteImage(outputFilepath))
+			return -3;
+		std::cout << "wrote " << settings.m_width << "x" << settings.m_height << " image to " << outputFilepath << std::endl;
+	}
+	return 0;
+}